@@ -34,6 +34,8 @@ const std::vector<std::string> allowed_methods = {
 
 void handler(std::shared_ptr<hh_http::http_request> request, std::shared_ptr<hh_http::http_response> response)
 {
+    // Separate the time spent waiting in the pool from the handler time
+    request->mark_handler_start();
 
     if (std::find(allowed_methods.begin(), allowed_methods.end(), request->get_method()) == allowed_methods.end())
     {
@@ -0,0 +1,93 @@
+/**
+ * @file bench_server.cpp
+ * @brief Minimal http_server used as the target of load_generator.
+ *
+ * Answers every request with a fixed body, either in one send() or streamed
+ * in several chunks, so the effect of the socket options in socket_profile
+ * (Nagle, corking, quick ACKs) can be measured end to end on one machine.
+ *
+ * Usage:
+ *   ./bench_server --port 8080 --profile latency
+ *   ./bench_server --profile throughput --chunks 16 --body-size 65536
+ *   ./bench_server --backend uring --profile none
+ */
+
+#include "../http-lib.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <string>
+
+int main(int argc, char *argv[])
+{
+    int port = 8080;
+    std::size_t body_size = 128;
+    std::size_t chunks = 1;
+    std::string profile_name = "default";
+    hh_http::io_backend backend = hh_http::io_backend::EPOLL;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--port" && i + 1 < argc)
+            port = std::stoi(argv[++i]);
+        else if (arg == "--body-size" && i + 1 < argc)
+            body_size = std::stoull(argv[++i]);
+        else if (arg == "--chunks" && i + 1 < argc)
+            chunks = std::max<std::size_t>(1, std::stoull(argv[++i]));
+        else if (arg == "--profile" && i + 1 < argc)
+            profile_name = argv[++i];
+        else if (arg == "--backend" && i + 1 < argc)
+            backend = std::string(argv[++i]) == "uring" ? hh_http::io_backend::IO_URING : hh_http::io_backend::EPOLL;
+        else
+        {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--port N] [--body-size N] [--chunks N] [--profile none|default|latency|throughput]"
+                      << " [--backend epoll|uring]" << std::endl;
+            return 1;
+        }
+    }
+
+    hh_http::socket_profile profile;
+    if (profile_name == "none")
+        profile.no_delay = false; // plain sockets, Nagle enabled
+    else if (profile_name == "latency")
+        profile = hh_http::socket_profile::latency();
+    else if (profile_name == "throughput")
+        profile = hh_http::socket_profile::throughput();
+    else if (profile_name != "default")
+    {
+        std::cerr << "Unknown profile: " << profile_name << std::endl;
+        return 1;
+    }
+
+    hh_http::config::ENABLE_COMPRESSION = false;
+    hh_http::http_server server(port, "0.0.0.0", hh_http::epoll_config::TIMEOUT_MILLISECONDS, backend);
+    server.set_socket_profile(profile);
+
+    const std::string body(body_size, 'x');
+    const std::size_t piece = (body_size + chunks - 1) / chunks;
+    server.set_request_callback([&](hh_http::http_request &, hh_http::http_response &response)
+                                {
+        response.add_header("Content-Type", "text/plain");
+        if (chunks == 1)
+        {
+            response.add_header("Content-Length", std::to_string(body.size()));
+            response.set_body(body);
+            response.send();
+        }
+        else
+        {
+            for (std::size_t offset = 0; offset < body.size(); offset += piece)
+                response.send_chunk(body.substr(offset, piece));
+            response.send_last_chunk();
+        }
+        response.end(); });
+
+    server.set_listen_success_callback([&]()
+                                       { std::cerr << "bench_server listening on " << port << " (profile " << profile_name
+                                                   << ", " << chunks << " chunk(s) of " << body_size << " bytes)" << std::endl; });
+    server.listen();
+    return 0;
+}
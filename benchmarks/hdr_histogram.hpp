@@ -0,0 +1,135 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+namespace hh_http
+{
+    namespace bench
+    {
+        /**
+         * @brief Log-linear latency histogram in the style of HdrHistogram.
+         *
+         * Values are bucketed by power-of-two magnitude, and each magnitude is
+         * split into linear sub-buckets, so every recorded value keeps a fixed
+         * relative precision (1 / 2^(SUB_BUCKET_BITS - 1), under 1%) across the
+         * full uint64_t range. Recording is a handful of integer operations and
+         * never allocates.
+         *
+         * @note Not thread-safe; keep one histogram per thread and merge() them.
+         */
+        class hdr_histogram
+        {
+        public:
+            static constexpr int SUB_BUCKET_BITS = 8;
+            static constexpr std::uint64_t SUB_BUCKET_COUNT = 1ull << SUB_BUCKET_BITS;
+            static constexpr std::uint64_t SUB_BUCKET_HALF = SUB_BUCKET_COUNT / 2;
+            static constexpr int MAX_SHIFT = 64 - SUB_BUCKET_BITS;
+
+            hdr_histogram() : counts((MAX_SHIFT + 2) * SUB_BUCKET_HALF, 0) {}
+
+            /// Record a single value (e.g. a latency in nanoseconds)
+            void record(std::uint64_t value)
+            {
+                ++counts[index_of(value)];
+                ++total;
+                min_value = std::min(min_value, value);
+                max_value = std::max(max_value, value);
+                sum += static_cast<double>(value);
+            }
+
+            /// Add every sample of another histogram to this one
+            void merge(const hdr_histogram &other)
+            {
+                for (std::size_t i = 0; i < counts.size(); ++i)
+                    counts[i] += other.counts[i];
+                total += other.total;
+                min_value = std::min(min_value, other.min_value);
+                max_value = std::max(max_value, other.max_value);
+                sum += other.sum;
+            }
+
+            std::uint64_t count() const { return total; }
+            std::uint64_t min() const { return total ? min_value : 0; }
+            std::uint64_t max() const { return max_value; }
+            double mean() const { return total ? sum / static_cast<double>(total) : 0.0; }
+
+            /**
+             * @brief Value at the given percentile.
+             * @param percentile Percentile in [0, 100]
+             * @return Highest value equivalent to the bucket that holds the percentile
+             */
+            std::uint64_t value_at_percentile(double percentile) const
+            {
+                if (!total)
+                    return 0;
+                auto wanted = static_cast<std::uint64_t>(percentile / 100.0 * static_cast<double>(total) + 0.5);
+                wanted = std::max<std::uint64_t>(1, std::min(wanted, total));
+
+                std::uint64_t seen = 0;
+                for (std::size_t i = 0; i < counts.size(); ++i)
+                {
+                    seen += counts[i];
+                    if (seen >= wanted)
+                        return std::min(highest_equivalent(i), max_value);
+                }
+                return max_value;
+            }
+
+            /**
+             * @brief Print the percentile distribution in HdrHistogram's text format.
+             * @param out Destination stream
+             * @param unit_divisor Divides raw values on output (e.g. 1000.0 to print ns as us)
+             */
+            void print_percentiles(std::FILE *out, double unit_divisor) const
+            {
+                std::fprintf(out, "%12s %14s %10s %14s\n\n", "Value", "Percentile", "TotalCount", "1/(1-Percentile)");
+                std::uint64_t seen = 0;
+                for (std::size_t i = 0; i < counts.size(); ++i)
+                {
+                    if (!counts[i])
+                        continue;
+                    seen += counts[i];
+                    double fraction = static_cast<double>(seen) / static_cast<double>(total);
+                    if (fraction < 1.0)
+                        std::fprintf(out, "%12.3f %14.12f %10llu %14.2f\n",
+                                     static_cast<double>(highest_equivalent(i)) / unit_divisor, fraction,
+                                     static_cast<unsigned long long>(seen), 1.0 / (1.0 - fraction));
+                    else
+                        std::fprintf(out, "%12.3f %14.12f %10llu %14s\n",
+                                     static_cast<double>(max_value) / unit_divisor, fraction,
+                                     static_cast<unsigned long long>(seen), "inf");
+                }
+                std::fprintf(out, "#[Mean = %.3f, Max = %.3f, Total count = %llu]\n",
+                             mean() / unit_divisor, static_cast<double>(max_value) / unit_divisor,
+                             static_cast<unsigned long long>(total));
+            }
+
+        private:
+            std::vector<std::uint64_t> counts;
+            std::uint64_t total = 0;
+            std::uint64_t min_value = UINT64_MAX;
+            std::uint64_t max_value = 0;
+            double sum = 0;
+
+            static std::size_t index_of(std::uint64_t value)
+            {
+                if (value < SUB_BUCKET_COUNT)
+                    return static_cast<std::size_t>(value);
+                int shift = (63 - __builtin_clzll(value)) - (SUB_BUCKET_BITS - 1);
+                return static_cast<std::size_t>(shift * SUB_BUCKET_HALF + (value >> shift));
+            }
+
+            static std::uint64_t highest_equivalent(std::size_t index)
+            {
+                if (index < SUB_BUCKET_COUNT)
+                    return index;
+                std::uint64_t shift = index / SUB_BUCKET_HALF - 1;
+                std::uint64_t sub = index - shift * SUB_BUCKET_HALF;
+                return ((sub + 1) << shift) - 1;
+            }
+        };
+    }
+}
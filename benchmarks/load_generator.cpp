@@ -0,0 +1,650 @@
+/**
+ * @file load_generator.cpp
+ * @brief Multi-threaded, epoll-based HTTP/1.1 load generator.
+ *
+ * Each worker thread owns an epoll instance and a share of the connections.
+ * Two load models are supported:
+ *
+ * - Closed loop (default): every connection keeps `--pipeline` requests in
+ *   flight and sends the next one as soon as a response arrives.
+ * - Open loop (`--rate N`): requests are scheduled at a constant total rate
+ *   and latency is measured from the *intended* send time, so a stalled
+ *   server is charged for the requests it delayed (no coordinated omission).
+ *
+ * Latencies are recorded into an HDR-style histogram per thread and merged
+ * at the end.
+ *
+ * Usage:
+ *   ./load_generator --port 8080 --threads 4 --connections 64 --duration 10
+ *   ./load_generator --mode close --connections 32
+ *   ./load_generator --pipeline 8
+ *   ./load_generator --rate 50000 --histogram
+ *   ./load_generator --request GET:/:8 --request POST:/api/echo:2 --body-size 512
+ */
+
+#include "hdr_histogram.hpp"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using hh_http::bench::hdr_histogram;
+
+namespace
+{
+    enum class connection_mode
+    {
+        KEEP_ALIVE, ///< Reuse each connection for many requests
+        CLOSE       ///< One request per connection, "Connection: close"
+    };
+
+    struct request_template
+    {
+        std::string method;
+        std::string path;
+        unsigned weight = 1;
+        std::string raw; ///< Fully serialized request, built once
+    };
+
+    struct options
+    {
+        std::string host = "127.0.0.1";
+        int port = 8080;
+        int threads = 1;
+        int connections = 16;
+        int duration_seconds = 10;
+        int pipeline = 1;
+        double rate = 0; ///< Total requests/second; 0 selects the closed-loop model
+        connection_mode mode = connection_mode::KEEP_ALIVE;
+        std::size_t body_size = 0;
+        bool print_histogram = false;
+        std::vector<request_template> requests;
+    };
+
+    using steady = std::chrono::steady_clock;
+
+    inline std::uint64_t now_ns()
+    {
+        return static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(steady::now().time_since_epoch()).count());
+    }
+
+    struct client_connection
+    {
+        int fd = -1;
+        bool connected = false;
+        std::string out;
+        std::size_t out_offset = 0;
+        std::string in;
+        std::deque<std::uint64_t> in_flight; ///< Start timestamps of requests awaiting a response
+        std::size_t sent_on_connection = 0;
+    };
+
+    struct worker_stats
+    {
+        hdr_histogram latency;
+        std::uint64_t completed = 0;
+        std::uint64_t errors = 0;
+        std::uint64_t connects = 0;
+        std::uint64_t bytes_read = 0;
+        std::uint64_t bytes_written = 0;
+        std::uint64_t backlog_peak = 0; ///< Open loop: most requests ever waiting for a free connection
+    };
+
+    bool ieq_prefix(const char *data, std::size_t size, const char *prefix)
+    {
+        std::size_t n = std::strlen(prefix);
+        if (size < n)
+            return false;
+        for (std::size_t i = 0; i < n; ++i)
+            if (std::tolower(static_cast<unsigned char>(data[i])) != prefix[i])
+                return false;
+        return true;
+    }
+
+    /**
+     * @brief Find the end of one complete response at the front of the buffer.
+     * @param buffer Bytes read so far
+     * @param close_after Set when the server asked for the connection to be closed
+     * @param close_delimited Set when the response has no length and ends at EOF
+     * @return Bytes occupied by the response, or 0 if more data is needed
+     */
+    std::size_t parse_response(const std::string &buffer, bool &close_after, bool &close_delimited)
+    {
+        std::size_t header_end = buffer.find("\r\n\r\n");
+        if (header_end == std::string::npos)
+            return 0;
+
+        long long content_length = -1;
+        bool chunked = false;
+        close_after = false;
+        close_delimited = false;
+
+        std::size_t line_start = buffer.find("\r\n") + 2;
+        while (line_start < header_end)
+        {
+            std::size_t line_end = buffer.find("\r\n", line_start);
+            const char *line = buffer.data() + line_start;
+            std::size_t length = line_end - line_start;
+
+            if (ieq_prefix(line, length, "content-length:"))
+                content_length = std::atoll(line + 15);
+            else if (ieq_prefix(line, length, "transfer-encoding:") &&
+                     std::string(line, length).find("chunked") != std::string::npos)
+                chunked = true;
+            else if (ieq_prefix(line, length, "connection:") &&
+                     (std::string(line, length).find("close") != std::string::npos ||
+                      std::string(line, length).find("Close") != std::string::npos))
+                close_after = true;
+
+            line_start = line_end + 2;
+        }
+
+        std::size_t body_start = header_end + 4;
+        if (content_length >= 0)
+        {
+            std::size_t total = body_start + static_cast<std::size_t>(content_length);
+            return buffer.size() >= total ? total : 0;
+        }
+
+        if (chunked)
+        {
+            std::size_t pos = body_start;
+            while (true)
+            {
+                std::size_t size_end = buffer.find("\r\n", pos);
+                if (size_end == std::string::npos)
+                    return 0;
+                std::size_t chunk_size = std::strtoull(buffer.c_str() + pos, nullptr, 16);
+                pos = size_end + 2;
+                if (chunk_size == 0)
+                {
+                    std::size_t trailer_end = buffer.find("\r\n", pos);
+                    while (trailer_end != std::string::npos && trailer_end != pos)
+                    {
+                        pos = trailer_end + 2;
+                        trailer_end = buffer.find("\r\n", pos);
+                    }
+                    return trailer_end == std::string::npos ? 0 : trailer_end + 2;
+                }
+                if (buffer.size() < pos + chunk_size + 2)
+                    return 0;
+                pos += chunk_size + 2;
+            }
+        }
+
+        // No framing: the response runs until the server closes the connection
+        close_delimited = true;
+        close_after = true;
+        return 0;
+    }
+
+    class worker
+    {
+    public:
+        worker(const options &opts, const sockaddr_in &address, int connection_count, double rate, unsigned seed)
+            : opts(opts), address(address), connections(connection_count), rate(rate), rng(seed)
+        {
+            for (const auto &request : opts.requests)
+                cumulative_weights.push_back((cumulative_weights.empty() ? 0 : cumulative_weights.back()) + request.weight);
+        }
+
+        void run(std::uint64_t start_ns, std::uint64_t end_ns, const std::atomic<bool> &stop)
+        {
+            epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+            if (epoll_fd < 0)
+            {
+                std::perror("epoll_create1");
+                return;
+            }
+
+            for (auto &conn : connections)
+                open_connection(conn);
+
+            std::uint64_t issued = 0;
+            std::vector<epoll_event> events(256);
+
+            while (!stop.load(std::memory_order_relaxed))
+            {
+                std::uint64_t now = now_ns();
+                if (now >= end_ns)
+                    break;
+
+                if (rate > 0)
+                {
+                    // Queue every request whose intended send time has already passed
+                    auto due = static_cast<std::uint64_t>(static_cast<double>(now - start_ns) * rate / 1e9);
+                    for (; issued < due; ++issued)
+                        backlog.push_back(start_ns + static_cast<std::uint64_t>(static_cast<double>(issued) * 1e9 / rate));
+                    stats.backlog_peak = std::max<std::uint64_t>(stats.backlog_peak, backlog.size());
+                }
+
+                for (auto &conn : connections)
+                    dispatch(conn, now);
+
+                int timeout_ms = rate > 0 ? 1 : 10;
+                int ready = epoll_wait(epoll_fd, events.data(), static_cast<int>(events.size()), timeout_ms);
+                if (ready < 0 && errno != EINTR)
+                {
+                    std::perror("epoll_wait");
+                    break;
+                }
+
+                for (int i = 0; i < ready; ++i)
+                {
+                    auto *conn = static_cast<client_connection *>(events[i].data.ptr);
+                    if (events[i].events & (EPOLLERR | EPOLLHUP) && !(events[i].events & EPOLLIN))
+                    {
+                        fail_connection(*conn);
+                        continue;
+                    }
+                    if (events[i].events & EPOLLOUT)
+                        on_writable(*conn);
+                    if (conn->fd >= 0 && (events[i].events & EPOLLIN))
+                        on_readable(*conn);
+                }
+            }
+
+            for (auto &conn : connections)
+                if (conn.fd >= 0)
+                    ::close(conn.fd);
+            ::close(epoll_fd);
+        }
+
+        worker_stats stats;
+
+    private:
+        const options &opts;
+        sockaddr_in address;
+        std::vector<client_connection> connections;
+        double rate;
+        std::mt19937 rng;
+        std::vector<unsigned> cumulative_weights;
+        std::deque<std::uint64_t> backlog; ///< Intended start times not yet sent (open loop only)
+        int epoll_fd = -1;
+
+        void open_connection(client_connection &conn)
+        {
+            conn = client_connection();
+            conn.fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (conn.fd < 0)
+            {
+                ++stats.errors;
+                return;
+            }
+            int one = 1;
+            setsockopt(conn.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+            int rc = ::connect(conn.fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address));
+            if (rc < 0 && errno != EINPROGRESS)
+            {
+                ++stats.errors;
+                ::close(conn.fd);
+                conn.fd = -1;
+                return;
+            }
+            conn.connected = (rc == 0);
+            ++stats.connects;
+
+            epoll_event ev{};
+            ev.events = EPOLLIN | EPOLLOUT;
+            ev.data.ptr = &conn;
+            epoll_ctl(epoll_fd, EPOLL_CTL_ADD, conn.fd, &ev);
+        }
+
+        void close_connection(client_connection &conn)
+        {
+            if (conn.fd >= 0)
+            {
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn.fd, nullptr);
+                ::close(conn.fd);
+                conn.fd = -1;
+            }
+        }
+
+        /// Drop the connection, charging its in-flight requests as errors, and reconnect
+        void fail_connection(client_connection &conn)
+        {
+            stats.errors += conn.in_flight.size();
+            close_connection(conn);
+            open_connection(conn);
+        }
+
+        const request_template &pick_request()
+        {
+            if (opts.requests.size() == 1)
+                return opts.requests.front();
+            std::uniform_int_distribution<unsigned> pick(0, cumulative_weights.back() - 1);
+            unsigned value = pick(rng);
+            auto it = std::upper_bound(cumulative_weights.begin(), cumulative_weights.end(), value);
+            return opts.requests[static_cast<std::size_t>(it - cumulative_weights.begin())];
+        }
+
+        void dispatch(client_connection &conn, std::uint64_t now)
+        {
+            if (conn.fd < 0)
+            {
+                open_connection(conn);
+                return;
+            }
+            if (!conn.connected)
+                return;
+
+            std::size_t depth = opts.mode == connection_mode::CLOSE ? 1 : static_cast<std::size_t>(opts.pipeline);
+            bool queued = false;
+            while (conn.in_flight.size() < depth)
+            {
+                if (opts.mode == connection_mode::CLOSE && conn.sent_on_connection > 0)
+                    break;
+
+                std::uint64_t start = now;
+                if (rate > 0)
+                {
+                    if (backlog.empty())
+                        break;
+                    start = backlog.front();
+                    backlog.pop_front();
+                }
+
+                conn.out += pick_request().raw;
+                conn.in_flight.push_back(start);
+                ++conn.sent_on_connection;
+                queued = true;
+            }
+
+            if (queued)
+                on_writable(conn);
+        }
+
+        void on_writable(client_connection &conn)
+        {
+            if (!conn.connected)
+            {
+                int error = 0;
+                socklen_t length = sizeof(error);
+                getsockopt(conn.fd, SOL_SOCKET, SO_ERROR, &error, &length);
+                if (error)
+                {
+                    fail_connection(conn);
+                    return;
+                }
+                conn.connected = true;
+            }
+
+            while (conn.out_offset < conn.out.size())
+            {
+                ssize_t n = ::send(conn.fd, conn.out.data() + conn.out_offset, conn.out.size() - conn.out_offset, MSG_NOSIGNAL);
+                if (n < 0)
+                {
+                    if (errno == EAGAIN || errno == EWOULDBLOCK)
+                        return;
+                    fail_connection(conn);
+                    return;
+                }
+                conn.out_offset += static_cast<std::size_t>(n);
+                stats.bytes_written += static_cast<std::uint64_t>(n);
+            }
+            conn.out.clear();
+            conn.out_offset = 0;
+        }
+
+        void complete_request(client_connection &conn)
+        {
+            if (conn.in_flight.empty())
+            {
+                ++stats.errors; // Unsolicited response
+                return;
+            }
+            std::uint64_t now = now_ns();
+            std::uint64_t start = conn.in_flight.front();
+            conn.in_flight.pop_front();
+            stats.latency.record(now > start ? now - start : 0);
+            ++stats.completed;
+        }
+
+        void on_readable(client_connection &conn)
+        {
+            char buffer[16 * 1024];
+            bool peer_closed = false;
+            while (true)
+            {
+                ssize_t n = ::recv(conn.fd, buffer, sizeof(buffer), 0);
+                if (n > 0)
+                {
+                    conn.in.append(buffer, static_cast<std::size_t>(n));
+                    stats.bytes_read += static_cast<std::uint64_t>(n);
+                    continue;
+                }
+                if (n == 0)
+                    peer_closed = true;
+                else if (errno != EAGAIN && errno != EWOULDBLOCK)
+                    peer_closed = true;
+                break;
+            }
+
+            bool close_after = false, close_delimited = false;
+            while (!conn.in.empty())
+            {
+                std::size_t consumed = parse_response(conn.in, close_after, close_delimited);
+                if (!consumed)
+                    break;
+                conn.in.erase(0, consumed);
+                complete_request(conn);
+                if (close_after)
+                    break;
+            }
+
+            if (peer_closed && close_delimited && !conn.in.empty())
+            {
+                conn.in.clear();
+                complete_request(conn);
+            }
+
+            if (peer_closed || close_after || (opts.mode == connection_mode::CLOSE && conn.in_flight.empty()))
+            {
+                stats.errors += conn.in_flight.size();
+                close_connection(conn);
+                open_connection(conn);
+            }
+        }
+    };
+
+    void print_usage(const char *program)
+    {
+        std::cerr << "Usage: " << program << " [options]\n"
+                  << "  --host HOST            server address (default 127.0.0.1)\n"
+                  << "  --port PORT            server port (default 8080)\n"
+                  << "  --threads N            worker threads (default 1)\n"
+                  << "  --connections N        total connections (default 16)\n"
+                  << "  --duration SECONDS     test length (default 10)\n"
+                  << "  --mode keep-alive|close\n"
+                  << "  --pipeline N           requests in flight per connection (keep-alive only)\n"
+                  << "  --rate N               open-loop mode at N requests/second in total\n"
+                  << "  --request M:PATH[:W]   add a request to the mix with weight W (repeatable)\n"
+                  << "  --body-size N          body bytes for non-GET/HEAD requests\n"
+                  << "  --histogram            print the full percentile distribution\n";
+    }
+
+    bool parse_options(int argc, char *argv[], options &opts)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            bool has_value = i + 1 < argc;
+            if (arg == "--host" && has_value)
+                opts.host = argv[++i];
+            else if (arg == "--port" && has_value)
+                opts.port = std::stoi(argv[++i]);
+            else if (arg == "--threads" && has_value)
+                opts.threads = std::max(1, std::stoi(argv[++i]));
+            else if (arg == "--connections" && has_value)
+                opts.connections = std::max(1, std::stoi(argv[++i]));
+            else if (arg == "--duration" && has_value)
+                opts.duration_seconds = std::max(1, std::stoi(argv[++i]));
+            else if (arg == "--pipeline" && has_value)
+                opts.pipeline = std::max(1, std::stoi(argv[++i]));
+            else if (arg == "--rate" && has_value)
+                opts.rate = std::stod(argv[++i]);
+            else if (arg == "--body-size" && has_value)
+                opts.body_size = std::stoull(argv[++i]);
+            else if (arg == "--histogram")
+                opts.print_histogram = true;
+            else if (arg == "--mode" && has_value)
+            {
+                std::string mode = argv[++i];
+                if (mode == "keep-alive")
+                    opts.mode = connection_mode::KEEP_ALIVE;
+                else if (mode == "close")
+                    opts.mode = connection_mode::CLOSE;
+                else
+                    return false;
+            }
+            else if (arg == "--request" && has_value)
+            {
+                std::string spec = argv[++i];
+                std::size_t first = spec.find(':');
+                if (first == std::string::npos)
+                    return false;
+                request_template request;
+                request.method = spec.substr(0, first);
+                std::size_t second = spec.find(':', first + 1);
+                request.path = spec.substr(first + 1, second == std::string::npos ? std::string::npos : second - first - 1);
+                if (second != std::string::npos)
+                    request.weight = static_cast<unsigned>(std::max(1, std::stoi(spec.substr(second + 1))));
+                opts.requests.push_back(request);
+            }
+            else
+                return false;
+        }
+
+        if (opts.requests.empty())
+            opts.requests.push_back(request_template{"GET", "/", 1, ""});
+
+        // Serialize each request once so the hot loop only appends bytes
+        for (auto &request : opts.requests)
+        {
+            request.raw = request.method + " " + request.path + " HTTP/1.1\r\n";
+            request.raw += "Host: " + opts.host + ":" + std::to_string(opts.port) + "\r\n";
+            request.raw += "User-Agent: hh-load-generator\r\n";
+            request.raw += std::string("Connection: ") + (opts.mode == connection_mode::CLOSE ? "close" : "keep-alive") + "\r\n";
+            if (opts.body_size && request.method != "GET" && request.method != "HEAD")
+            {
+                request.raw += "Content-Type: application/octet-stream\r\n";
+                request.raw += "Content-Length: " + std::to_string(opts.body_size) + "\r\n\r\n";
+                request.raw += std::string(opts.body_size, 'x');
+            }
+            else
+                request.raw += "\r\n";
+        }
+        return true;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    options opts;
+    try
+    {
+        if (!parse_options(argc, argv, opts))
+        {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Invalid option value: " << e.what() << std::endl;
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    addrinfo hints{};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *resolved = nullptr;
+    if (getaddrinfo(opts.host.c_str(), std::to_string(opts.port).c_str(), &hints, &resolved) != 0 || !resolved)
+    {
+        std::cerr << "Failed to resolve " << opts.host << std::endl;
+        return 1;
+    }
+    sockaddr_in address = *reinterpret_cast<sockaddr_in *>(resolved->ai_addr);
+    freeaddrinfo(resolved);
+
+    int threads = std::min(opts.threads, opts.connections);
+    std::vector<std::unique_ptr<worker>> workers;
+    for (int t = 0; t < threads; ++t)
+    {
+        int share = opts.connections / threads + (t < opts.connections % threads ? 1 : 0);
+        workers.push_back(std::make_unique<worker>(opts, address, share, opts.rate / threads, 1234u + static_cast<unsigned>(t)));
+    }
+
+    std::printf("Running %ds test @ %s:%d\n", opts.duration_seconds, opts.host.c_str(), opts.port);
+    std::printf("  %d threads, %d connections, mode %s, pipeline %d, %s\n", threads, opts.connections,
+                opts.mode == connection_mode::CLOSE ? "close" : "keep-alive",
+                opts.mode == connection_mode::CLOSE ? 1 : opts.pipeline,
+                opts.rate > 0 ? ("open loop @ " + std::to_string(static_cast<long long>(opts.rate)) + " req/s").c_str() : "closed loop");
+
+    std::atomic<bool> stop{false};
+    std::uint64_t start_ns = now_ns();
+    std::uint64_t end_ns = start_ns + static_cast<std::uint64_t>(opts.duration_seconds) * 1000000000ull;
+
+    std::vector<std::thread> threads_running;
+    for (auto &w : workers)
+        threads_running.emplace_back([&w, start_ns, end_ns, &stop]()
+                                     { w->run(start_ns, end_ns, stop); });
+    for (auto &t : threads_running)
+        t.join();
+
+    double elapsed = static_cast<double>(now_ns() - start_ns) / 1e9;
+
+    worker_stats total;
+    for (auto &w : workers)
+    {
+        total.latency.merge(w->stats.latency);
+        total.completed += w->stats.completed;
+        total.errors += w->stats.errors;
+        total.connects += w->stats.connects;
+        total.bytes_read += w->stats.bytes_read;
+        total.bytes_written += w->stats.bytes_written;
+        total.backlog_peak = std::max(total.backlog_peak, w->stats.backlog_peak);
+    }
+
+    const auto &h = total.latency;
+    std::printf("\n  Latency (us)    p50 %.1f   p90 %.1f   p99 %.1f   p99.9 %.1f   p99.99 %.1f   max %.1f\n",
+                h.value_at_percentile(50) / 1e3, h.value_at_percentile(90) / 1e3, h.value_at_percentile(99) / 1e3,
+                h.value_at_percentile(99.9) / 1e3, h.value_at_percentile(99.99) / 1e3, h.max() / 1e3);
+    std::printf("  Requests        %llu completed, %llu errors, %llu connects\n",
+                static_cast<unsigned long long>(total.completed), static_cast<unsigned long long>(total.errors),
+                static_cast<unsigned long long>(total.connects));
+    std::printf("  Throughput      %.1f req/s, %.2f MB/s in, %.2f MB/s out\n", total.completed / elapsed,
+                total.bytes_read / elapsed / (1024.0 * 1024.0), total.bytes_written / elapsed / (1024.0 * 1024.0));
+    if (opts.rate > 0)
+        std::printf("  Backlog peak    %llu requests waiting for a connection\n",
+                    static_cast<unsigned long long>(total.backlog_peak));
+
+    if (opts.print_histogram)
+    {
+        std::printf("\n  Latency distribution (us)\n");
+        h.print_percentiles(stdout, 1e3);
+    }
+
+    return 0;
+}
@@ -0,0 +1,367 @@
+/**
+ * @file parser_benchmark.cpp
+ * @brief Socket-free microbenchmark for hh_http::http_message_handler.
+ *
+ * Feeds a fixed corpus of request shapes straight into the parser (no sockets,
+ * no epoll) and reports ns/request, bytes/s and heap allocations/request for
+ * each shape. Requests that arrive in several segments are replayed segment by
+ * segment, exactly as the server would hand them to the parser.
+ *
+ * Usage:
+ *   ./parser_benchmark                       # run every shape
+ *   ./parser_benchmark --iterations 50000    # requests per shape
+ *   ./parser_benchmark --shape json_post     # run a single shape
+ *   ./parser_benchmark --seed 7              # change the split/corpus seed
+ */
+
+#include "../includes/http_message_handler.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+// ------------------------------------------------------------
+// Allocation counting
+// ------------------------------------------------------------
+static std::atomic<std::size_t> allocation_count{0};
+
+// Every replaced operator new allocates with malloc/aligned_alloc and every
+// operator delete frees with free, so all forms pair up within one family
+static void *counted_allocate(std::size_t size, std::size_t alignment = 0)
+{
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    if (size == 0)
+        size = 1;
+    void *ptr = nullptr;
+    if (alignment > alignof(std::max_align_t))
+    {
+        // aligned_alloc requires a size that is a multiple of the alignment
+        ptr = std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+    }
+    else
+    {
+        ptr = std::malloc(size);
+    }
+    if (!ptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void *operator new(std::size_t size) { return counted_allocate(size); }
+void *operator new[](std::size_t size) { return counted_allocate(size); }
+void *operator new(std::size_t size, std::align_val_t alignment) { return counted_allocate(size, static_cast<std::size_t>(alignment)); }
+void *operator new[](std::size_t size, std::align_val_t alignment) { return counted_allocate(size, static_cast<std::size_t>(alignment)); }
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+    try
+    {
+        return counted_allocate(size);
+    }
+    catch (...)
+    {
+        return nullptr;
+    }
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+    try
+    {
+        return counted_allocate(size);
+    }
+    catch (...)
+    {
+        return nullptr;
+    }
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete[](void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::size_t, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, std::size_t, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete(void *ptr, const std::nothrow_t &) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept { std::free(ptr); }
+
+// ------------------------------------------------------------
+// Corpus
+// ------------------------------------------------------------
+
+/// A request shape: the raw segments handed to the parser, in arrival order.
+struct request_shape
+{
+    std::string name;
+    std::vector<std::string> segments;
+    std::size_t total_bytes = 0;
+};
+
+static std::string random_token(std::mt19937 &rng, std::size_t length)
+{
+    static const char alphabet[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+    std::uniform_int_distribution<std::size_t> pick(0, sizeof(alphabet) - 2);
+    std::string token;
+    token.reserve(length);
+    for (std::size_t i = 0; i < length; ++i)
+        token += alphabet[pick(rng)];
+    return token;
+}
+
+static request_shape make_shape(const std::string &name, const std::vector<std::string> &segments)
+{
+    request_shape shape;
+    shape.name = name;
+    for (const auto &segment : segments)
+    {
+        shape.segments.push_back(segment);
+        shape.total_bytes += segment.size();
+    }
+    return shape;
+}
+
+static request_shape tiny_get()
+{
+    return make_shape("tiny_get", {"GET / HTTP/1.1\r\n"
+                                   "Host: localhost\r\n"
+                                   "\r\n"});
+}
+
+static request_shape browser_get(std::mt19937 &rng)
+{
+    std::string cookie;
+    for (int i = 0; i < 24; ++i)
+        cookie += (i ? "; " : "") + random_token(rng, 8) + "=" + random_token(rng, 48);
+
+    return make_shape("browser_get", {"GET /dashboard/overview?tab=metrics&range=24h HTTP/1.1\r\n"
+                                      "Host: app.example.com\r\n"
+                                      "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/124.0 Safari/537.36\r\n"
+                                      "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\n"
+                                      "Accept-Language: en-US,en;q=0.9\r\n"
+                                      "Accept-Encoding: gzip, deflate, br\r\n"
+                                      "Referer: https://app.example.com/login\r\n"
+                                      "Connection: keep-alive\r\n"
+                                      "Cookie: " +
+                                      cookie + "\r\n"
+                                               "\r\n"});
+}
+
+static std::string json_body(std::mt19937 &rng, std::size_t items)
+{
+    std::string body = "{\"events\":[";
+    for (std::size_t i = 0; i < items; ++i)
+    {
+        if (i)
+            body += ",";
+        body += "{\"id\":" + std::to_string(i) + ",\"name\":\"" + random_token(rng, 16) +
+                "\",\"value\":" + std::to_string(rng() % 100000) + "}";
+    }
+    body += "]}";
+    return body;
+}
+
+static request_shape json_post(std::mt19937 &rng)
+{
+    std::string body = json_body(rng, 32);
+    return make_shape("json_post", {"POST /api/events HTTP/1.1\r\n"
+                                    "Host: api.example.com\r\n"
+                                    "Content-Type: application/json\r\n"
+                                    "Content-Length: " +
+                                    std::to_string(body.size()) + "\r\n"
+                                                                  "\r\n" +
+                                    body});
+}
+
+/// JSON POST whose body trickles in across several reads, split at random byte offsets.
+static request_shape json_post_split(std::mt19937 &rng)
+{
+    std::string body = json_body(rng, 256);
+    std::string head = "POST /api/events HTTP/1.1\r\n"
+                       "Host: api.example.com\r\n"
+                       "Content-Type: application/json\r\n"
+                       "Content-Length: " +
+                       std::to_string(body.size()) + "\r\n\r\n";
+
+    // The first segment must carry the whole header block; the body may be cut anywhere.
+    std::vector<std::string> segments;
+    std::uniform_int_distribution<std::size_t> cut(1, body.size() / 4);
+    std::size_t pos = cut(rng);
+    segments.push_back(head + body.substr(0, pos));
+    while (pos < body.size())
+    {
+        std::size_t len = std::min(cut(rng), body.size() - pos);
+        segments.push_back(body.substr(pos, len));
+        pos += len;
+    }
+    return make_shape("json_post_split", segments);
+}
+
+/// Chunked body as reads: the head, then the body cut into pieces of piece_size(rng) bytes.
+template <typename Distribution>
+static std::vector<std::string> chunked_segments(const std::string &head, const std::string &body, std::mt19937 &rng,
+                                                 Distribution piece_size)
+{
+    std::vector<std::string> segments{head};
+    for (std::size_t pos = 0; pos < body.size();)
+    {
+        std::size_t len = std::min(piece_size(rng), body.size() - pos);
+        segments.push_back(body.substr(pos, len));
+        pos += len;
+    }
+    return segments;
+}
+
+static std::string chunk(const std::string &data)
+{
+    char size_hex[32];
+    std::snprintf(size_hex, sizeof(size_hex), "%zx", data.size());
+    return std::string(size_hex) + "\r\n" + data + "\r\n";
+}
+
+/// Chunked upload split at random byte offsets: size lines, chunk data and CRLFs are cut anywhere.
+static request_shape chunked_upload(std::mt19937 &rng)
+{
+    std::string body;
+    std::uniform_int_distribution<std::size_t> chunk_size(64, 4096);
+    for (int i = 0; i < 48; ++i)
+        body += chunk(random_token(rng, chunk_size(rng)));
+    body += "0\r\n\r\n";
+
+    return make_shape("chunked_upload", chunked_segments("POST /upload HTTP/1.1\r\n"
+                                                         "Host: files.example.com\r\n"
+                                                         "Content-Type: application/octet-stream\r\n"
+                                                         "Transfer-Encoding: chunked\r\n"
+                                                         "\r\n",
+                                                         body, rng, std::uniform_int_distribution<std::size_t>(1, 8192)));
+}
+
+/// One large chunk arriving in MSS-sized reads: the parser must not re-copy the chunk on every read.
+static request_shape chunked_large(std::mt19937 &rng)
+{
+    std::string body = chunk(random_token(rng, 256 * 1024)) + "0\r\n\r\n";
+    return make_shape("chunked_large", chunked_segments("POST /upload HTTP/1.1\r\n"
+                                                        "Host: files.example.com\r\n"
+                                                        "Transfer-Encoding: chunked\r\n"
+                                                        "\r\n",
+                                                        body, rng, [](std::mt19937 &) { return std::size_t(1448); }));
+}
+
+// ------------------------------------------------------------
+// Runner
+// ------------------------------------------------------------
+
+struct shape_result
+{
+    double ns_per_request = 0;
+    double bytes_per_second = 0;
+    double allocations_per_request = 0;
+    std::size_t failures = 0;
+};
+
+static shape_result run_shape(const request_shape &shape, std::size_t iterations)
+{
+    hh_http::http_message_handler handler;
+    const std::string socket_key = "bench:" + shape.name;
+    shape_result result;
+
+    // Warm up so first-touch allocations of the handler are not attributed to the shape
+    for (const auto &segment : shape.segments)
+        handler.handle(socket_key, -1, segment.data(), segment.size());
+
+    std::size_t allocations_before = allocation_count.load(std::memory_order_relaxed);
+    auto start = std::chrono::steady_clock::now();
+
+    for (std::size_t i = 0; i < iterations; ++i)
+    {
+        for (std::size_t s = 0; s < shape.segments.size(); ++s)
+        {
+            // The in-place entry point the server uses, straight from the receive buffer
+            auto parsed = handler.handle(socket_key, -1, shape.segments[s].data(), shape.segments[s].size());
+            bool last = (s + 1 == shape.segments.size());
+            if (parsed.completed != last || parsed.method.rfind("BAD_", 0) == 0)
+            {
+                ++result.failures;
+                break;
+            }
+        }
+    }
+
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    std::size_t allocations = allocation_count.load(std::memory_order_relaxed) - allocations_before;
+
+    double ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    result.ns_per_request = ns / iterations;
+    result.bytes_per_second = ns > 0 ? (static_cast<double>(shape.total_bytes) * iterations) / (ns / 1e9) : 0;
+    result.allocations_per_request = static_cast<double>(allocations) / iterations;
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    std::size_t iterations = 20000;
+    unsigned seed = 42;
+    std::string only_shape;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--iterations" && i + 1 < argc)
+            iterations = std::stoull(argv[++i]);
+        else if (arg == "--seed" && i + 1 < argc)
+            seed = static_cast<unsigned>(std::stoul(argv[++i]));
+        else if (arg == "--shape" && i + 1 < argc)
+            only_shape = argv[++i];
+        else
+        {
+            std::cerr << "Usage: " << argv[0] << " [--iterations N] [--seed N] [--shape NAME]" << std::endl;
+            return 1;
+        }
+    }
+
+    // Keep the limits out of the way; the corpus is what is being measured
+    hh_http::config::MAX_HEADER_SIZE = 1024 * 64;
+    hh_http::config::MAX_BODY_SIZE = 1024 * 1024 * 16;
+
+    std::mt19937 rng(seed);
+    std::vector<request_shape> corpus = {
+        tiny_get(),
+        browser_get(rng),
+        json_post(rng),
+        json_post_split(rng),
+        chunked_upload(rng),
+        chunked_large(rng),
+    };
+
+    std::printf("%-18s %8s %10s %14s %12s %10s\n", "shape", "segments", "bytes", "ns/request", "MB/s", "allocs/req");
+
+    bool any_failure = false;
+    for (const auto &shape : corpus)
+    {
+        if (!only_shape.empty() && shape.name != only_shape)
+            continue;
+
+        auto result = run_shape(shape, iterations);
+        std::printf("%-18s %8zu %10zu %14.1f %12.1f %10.1f\n",
+                    shape.name.c_str(), shape.segments.size(), shape.total_bytes,
+                    result.ns_per_request, result.bytes_per_second / (1024.0 * 1024.0),
+                    result.allocations_per_request);
+
+        if (result.failures)
+        {
+            std::fprintf(stderr, "  %zu of %zu '%s' requests did not parse as expected\n",
+                         result.failures, iterations, shape.name.c_str());
+            any_failure = true;
+        }
+    }
+
+    return any_failure ? 1 : 0;
+}
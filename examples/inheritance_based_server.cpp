@@ -4,6 +4,7 @@
 #include <string>
 #include <map>
 #include <functional>
+#include <atomic>
 
 /**
  * @brief Example HTTP server using inheritance-based architecture
@@ -21,15 +22,22 @@ private:
     // Route storage: method -> path -> handler
     std::map<std::string, std::map<std::string, RouteHandler>> routes;
 
-    // Statistics
-    size_t request_count = 0;
-    size_t connection_count = 0;
+    // Statistics (updated from the event loop, read from route handlers)
+    std::atomic<size_t> request_count{0};
+    std::atomic<size_t> connection_count{0};
 
 public:
     CustomHttpServer(int port, const std::string &ip = "0.0.0.0")
         : hh_http::http_server(port, ip, 1000)
     {
         setup_routes();
+
+        // Built-in Prometheus metrics, answered by the library itself
+        set_metrics_endpoint("/metrics");
+
+        // Per-request logging goes through the asynchronous access log instead of std::cout,
+        // so request threads never contend on the stream lock
+        set_access_log(std::make_shared<hh_http::access_log>("-"));
     }
 
 private:
@@ -68,18 +76,16 @@ private:
      */
     void on_request_received(hh_http::http_request &request, hh_http::http_response &response) override
     {
-        request_count++;
+        size_t request_id = ++request_count;
 
         std::string method = request.get_method();
         std::string uri = request.get_uri();
 
-        std::cout << "🔄 [" << request_count << "] " << method << " " << uri << std::endl;
-
         // Set common headers
         response.set_version("HTTP/1.1");
         response.add_header("Server", "Custom-hh-HTTP-Server/1.0");
         response.add_header("Connection", "close");
-        response.add_header("X-Request-ID", std::to_string(request_count));
+        response.add_header("X-Request-ID", std::to_string(request_id));
 
         // Find and execute route handler
         if (routes.count(method) && routes[method].count(uri))
@@ -189,6 +195,7 @@ private:
         <div class="endpoint"><span class="method">GET /</span> - This home page</div>
         <div class="endpoint"><span class="method">GET /hello</span> - Simple greeting message</div>
         <div class="endpoint"><span class="method">GET /stats</span> - Server statistics and metrics</div>
+        <div class="endpoint"><span class="method">GET /metrics</span> - Built-in Prometheus metrics</div>
         <div class="endpoint"><span class="method">GET /api/info</span> - JSON server information</div>
         <div class="endpoint"><span class="method">POST /api/echo</span> - Echo back the request body</div>
         <div class="endpoint"><span class="method">POST /api/uppercase</span> - Convert request body to uppercase</div>
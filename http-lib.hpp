@@ -1,6 +1,26 @@
 #pragma once
 
 #include "includes/http_consts.hpp"
+#include "includes/http_request_timings.hpp"
 #include "includes/http_request.hpp"
 #include "includes/http_response.hpp"
-#include "includes/http_server.hpp"
\ No newline at end of file
+#include "includes/http_server.hpp"
+#include "includes/compression.hpp"
+#include "includes/metrics.hpp"
+#include "includes/access_log.hpp"
+#include "includes/uring_server.hpp"
+#include "includes/memory_budget.hpp"
+#include "includes/outbound_queue.hpp"
+#include "includes/listener_handoff.hpp"
+#include "includes/socket_profile.hpp"
+#include "includes/websocket.hpp"
+#include "includes/event_stream.hpp"
+#include "includes/hpack.hpp"
+#include "includes/http2.hpp"
+#include "includes/body_sink.hpp"
+#include "includes/multipart.hpp"
+#include "includes/url.hpp"
+#include "includes/header_values.hpp"
+#include "includes/middleware.hpp"
+#include "includes/rate_limiter.hpp"
+#include "includes/remote_address.hpp"
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "metrics.hpp"
+
+namespace hh_http
+{
+    /// Output format of the access log
+    enum class access_log_format
+    {
+        COMBINED, ///< Apache/NGINX Combined Log Format
+        JSON      ///< One JSON object per line
+    };
+
+    /**
+     * @brief Fixed-size access log entry.
+     *
+     * Plain data only, so it can be copied into a ring buffer slot without
+     * allocating. Strings longer than their field are truncated.
+     */
+    struct access_log_record
+    {
+        std::int64_t unix_time_ns = 0; ///< Wall-clock time the response was sent
+        std::uint64_t duration_ns = 0; ///< First byte received to response written
+        int status = 0;
+        std::uint64_t bytes_sent = 0; ///< Response body bytes
+        char method[16] = {};
+        char version[16] = {};
+        char remote[64] = {}; ///< Client IP, without the port (the CLF host field)
+        char uri[512] = {};
+        char referer[256] = {};
+        char user_agent[256] = {};
+
+        /// Copy value into a fixed field, truncating and NUL-terminating it
+        template <std::size_t N>
+        static void assign(char (&field)[N], std::string_view value)
+        {
+            std::size_t length = value.size() < N - 1 ? value.size() : N - 1;
+            value.copy(field, length);
+            field[length] = '\0';
+        }
+    };
+
+    /**
+     * @brief Asynchronous access log.
+     *
+     * Request threads copy a fixed-size record into their own single-producer
+     * single-consumer ring buffer; a background thread drains all rings,
+     * formats the records and writes them in batches. Logging never blocks
+     * and never takes a lock after a thread's first record: when a ring is
+     * full the record is dropped and counted instead. A ring outlives its
+     * thread only until the writer has drained it.
+     */
+    class access_log
+    {
+    public:
+        /**
+         * @brief Open the log and start the writer thread.
+         * @param path File to append to, or "-" for stdout
+         * @param format Output format
+         * @param ring_capacity Records buffered per producer thread (rounded up to a power of two, about 1.2 KB each)
+         * @throws std::runtime_error if the file cannot be opened
+         */
+        explicit access_log(const std::string &path, access_log_format format = access_log_format::COMBINED,
+                            std::size_t ring_capacity = 256);
+
+        /// Stops the writer thread after draining every ring
+        ~access_log();
+
+        access_log(const access_log &) = delete;
+        access_log &operator=(const access_log &) = delete;
+
+        /**
+         * @brief Queue a record from the calling thread.
+         * @return false if the record was dropped because the thread's ring was full
+         */
+        bool log(const access_log_record &record);
+
+        /// Records dropped because a ring was full
+        std::uint64_t dropped() const { return dropped_records.load(std::memory_order_relaxed); }
+
+        /// Records written to the output so far
+        std::uint64_t written() const { return written_records.load(std::memory_order_relaxed); }
+
+    private:
+        friend struct access_log_thread_rings;
+
+        /// Single-producer single-consumer ring of records
+        struct ring
+        {
+            explicit ring(std::size_t capacity) : slots(capacity), mask(capacity - 1) {}
+
+            std::vector<access_log_record> slots;
+            std::size_t mask;
+            std::atomic<bool> orphaned{false}; ///< Its thread exited: the writer drops it once drained
+            std::atomic<bool> closed{false};   ///< Its logger is gone: the thread drops it from its cache
+            alignas(64) std::atomic<std::size_t> head{0}; ///< Next slot to write (producer)
+            alignas(64) std::atomic<std::size_t> tail{0}; ///< Next slot to read (consumer)
+        };
+
+        std::FILE *output;
+        bool owns_output;
+        access_log_format format;
+        std::size_t ring_capacity;
+        std::uint64_t id; ///< Distinguishes loggers in the per-thread ring cache
+
+        std::mutex rings_mutex; ///< Guards rings; taken once per producer thread and by the writer
+        std::vector<std::shared_ptr<ring>> rings; ///< Shared with the producer thread's cache
+
+        std::atomic<bool> stopping{false};
+        std::mutex wake_mutex;
+        std::condition_variable wake;
+        std::thread writer;
+
+        std::atomic<std::uint64_t> dropped_records{0};
+        std::atomic<std::uint64_t> written_records{0};
+
+        ring *ring_for_this_thread();
+        void run_writer();
+        std::size_t drain(std::string &batch);
+        void format_record(const access_log_record &record, std::string &out) const;
+    };
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+
+namespace hh_http
+{
+    /**
+     * @brief Consumer of a request body as it arrives.
+     *
+     * When http_server::set_body_sink_callback() returns a sink for a
+     * request, the body is handed to it piece by piece (after any
+     * Content-Encoding was decoded) instead of being buffered in the
+     * request; http_request::get_body() is then empty and the handler
+     * reads the outcome from http_request::get_body_sink().
+     *
+     * Calls come from the event loop thread, in body order, while the
+     * connection's parse state is locked: keep them short.
+     */
+    class body_sink
+    {
+    public:
+        virtual ~body_sink() = default;
+
+        /**
+         * @brief Take the next body bytes.
+         * @param data Bytes of the body; only valid during the call
+         * @return false to reject the request (delivered as BAD_BODY_REJECTED)
+         */
+        virtual bool write(const char *data, std::size_t size) = 0;
+
+        /**
+         * @brief The whole body was received.
+         * @return false if the body is incomplete or malformed (delivered as BAD_BODY_REJECTED)
+         */
+        virtual bool finish() = 0;
+    };
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <istream>
+#include <streambuf>
+
+namespace hh_http
+{
+    /**
+     * @brief Input stream over bytes owned by someone else.
+     *
+     * Lets the line-oriented parser read a receive buffer in place instead of
+     * copying it into a std::istringstream first. The bytes must stay valid
+     * and unchanged for the lifetime of the stream.
+     */
+    class buffer_view_stream : public std::istream
+    {
+    public:
+        buffer_view_stream(const char *data, std::size_t size)
+            : std::istream(nullptr), view(data, size)
+        {
+            rdbuf(&view);
+        }
+
+        buffer_view_stream(const buffer_view_stream &) = delete;
+        buffer_view_stream &operator=(const buffer_view_stream &) = delete;
+
+        /**
+         * @brief Consume the next size bytes without copying them.
+         * @return Pointer to the bytes inside the viewed buffer, or nullptr
+         *         (and nothing consumed) if fewer than size bytes remain
+         */
+        const char *read_in_place(std::size_t size)
+        {
+            return view.take(size);
+        }
+
+        /// Bytes not consumed yet
+        std::size_t remaining() const
+        {
+            return view.remaining();
+        }
+
+        /// Next byte to be consumed
+        const char *position() const
+        {
+            return view.position();
+        }
+
+    private:
+        struct view_buffer : std::streambuf
+        {
+            view_buffer(const char *data, std::size_t size)
+            {
+                // streambuf wants char *, the stream never writes through it
+                char *begin = const_cast<char *>(data);
+                setg(begin, begin, begin + size);
+            }
+
+            const char *position() const
+            {
+                return gptr();
+            }
+
+            std::size_t remaining() const
+            {
+                return static_cast<std::size_t>(egptr() - gptr());
+            }
+
+            const char *take(std::size_t size)
+            {
+                if (remaining() < size)
+                    return nullptr;
+                const char *data = gptr();
+                setg(eback(), gptr() + size, egptr());
+                return data;
+            }
+        };
+
+        view_buffer view;
+    };
+}
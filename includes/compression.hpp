@@ -0,0 +1,156 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace hh_http
+{
+    namespace compression
+    {
+        /// Content codings the server can produce
+        enum class coding
+        {
+            IDENTITY,
+            GZIP,
+            DEFLATE
+        };
+
+        /// true if the library was built with zlib; without it every coding but IDENTITY is unavailable
+        bool available();
+
+        /// Token used in Content-Encoding for a coding ("gzip", "deflate", or "identity")
+        const char *coding_name(coding c);
+
+        /**
+         * @brief Pick a response coding from an Accept-Encoding header value.
+         * @param accept_encoding Raw header value (may be empty)
+         * @return GZIP or DEFLATE if the client accepts it with a non-zero q-value
+         *         (gzip wins ties), IDENTITY otherwise
+         */
+        coding negotiate(const std::string &accept_encoding);
+
+        /**
+         * @brief Returns true if the Content-Type is worth compressing.
+         *
+         * Matches the media type (parameters such as charset are ignored)
+         * against config::COMPRESSIBLE_CONTENT_TYPES; entries ending in '/'
+         * match a whole top-level type, e.g. "text/".
+         */
+        bool is_compressible_type(const std::string &content_type);
+
+        /**
+         * @brief Incremental gzip/deflate compressor.
+         *
+         * Borrows a z_stream from a small per-thread pool, so repeated
+         * responses reuse zlib's window and hash tables instead of paying
+         * deflateInit for every response. The stream goes back to the pool
+         * of the thread that calls finish() (or destroys the compressor).
+         */
+        class compressor
+        {
+        public:
+            /**
+             * @param c GZIP or DEFLATE
+             * @param level zlib level (1-9), defaults to config::COMPRESSION_LEVEL
+             * @throws std::runtime_error if c is IDENTITY or zlib is unavailable
+             */
+            explicit compressor(coding c, int level = -1);
+            ~compressor();
+
+            compressor(const compressor &) = delete;
+            compressor &operator=(const compressor &) = delete;
+
+            /// Compress data; returns whatever output zlib produced so far (may be empty)
+            std::string update(const std::string &data);
+
+            /// Flush everything compressed so far so the client can decode it now
+            std::string flush(const std::string &data = "");
+
+            /// Compress the remaining data and write the stream trailer; the compressor is done afterwards
+            std::string finish(const std::string &data = "");
+
+        private:
+            void *stream; ///< Pooled z_stream, nullptr once finished
+            coding stream_coding;
+            int stream_level;
+
+            std::string run(const std::string &data, int flush_mode);
+            void release();
+        };
+
+        /// Outcome of feeding data to a decompressor
+        enum class decompress_status
+        {
+            OK,       ///< Input consumed, output appended
+            CORRUPT,  ///< Input is not valid for the coding (or continues after the end of the stream)
+            TOO_LARGE ///< Output would exceed the size or ratio limit
+        };
+
+        /**
+         * @brief Incremental gzip/deflate decompressor with bomb protection.
+         *
+         * Input can be fed in pieces as it arrives from the socket, so the
+         * compressed body never has to be held in full. Output is produced in
+         * bounded steps and checked against the limits after every step, so a
+         * small, highly compressed input cannot allocate more than about
+         * max_output bytes before it is rejected.
+         */
+        class decompressor
+        {
+        public:
+            /// Ratio limits are only enforced once this much output has been produced
+            static constexpr std::size_t RATIO_CHECK_MIN_OUTPUT = 256 * 1024;
+
+            /**
+             * @param c GZIP or DEFLATE (zlib-wrapped deflate, as sent by HTTP clients)
+             * @param max_output Maximum total decompressed size in bytes
+             * @param max_ratio Maximum decompressed / compressed size ratio (0 disables the check)
+             * @throws std::runtime_error if c is IDENTITY or zlib is unavailable
+             */
+            decompressor(coding c, std::size_t max_output, std::size_t max_ratio);
+            ~decompressor();
+
+            decompressor(const decompressor &) = delete;
+            decompressor &operator=(const decompressor &) = delete;
+
+            /// Decompress size bytes and append the output to out
+            decompress_status update(const char *data, std::size_t size, std::string &out);
+
+            /// true once the end of the compressed stream was reached
+            bool finished() const { return stream_finished; }
+
+            /// Compressed bytes consumed so far
+            std::size_t total_in() const { return consumed; }
+
+            /// Decompressed bytes produced so far
+            std::size_t total_out() const { return produced; }
+
+        private:
+            void *stream;
+            std::size_t max_output;
+            std::size_t max_ratio;
+            std::size_t consumed = 0;
+            std::size_t produced = 0;
+            bool stream_finished = false;
+        };
+
+        /**
+         * @brief Coding named by a request's Content-Encoding header.
+         * @return GZIP for "gzip"/"x-gzip", DEFLATE for "deflate", IDENTITY for
+         *         anything else (including stacked codings such as "gzip, br")
+         */
+        coding parse_content_encoding(const std::string &content_encoding);
+
+        /// Compress a whole buffer in one call
+        std::string compress(const std::string &data, coding c, int level = -1);
+
+        /**
+         * @brief Find a precompressed sibling of a static file.
+         * @param path File the client asked for
+         * @param accept_encoding Raw Accept-Encoding header of the request
+         * @return path + ".gz" if the client accepts gzip and that file exists
+         *         and is not older than path, an empty string otherwise
+         */
+        std::string find_precompressed(const std::string &path, const std::string &accept_encoding);
+    }
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include "outbound_queue.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace hh_http
+{
+    /**
+     * @brief Open text/event-stream response (Server-Sent Events).
+     *
+     * Returned by http_response::start_event_stream() once the response
+     * head was sent. The stream outlives the http_response and the handler:
+     * keep it (or subscribe it to an event_channel) and push events from any
+     * thread until the client goes away or close() is called.
+     *
+     * Dropping the last reference closes the connection.
+     */
+    class event_stream
+    {
+    public:
+        /**
+         * @brief Serialize one event in the text/event-stream format.
+         * @param data Event data; every line becomes a "data:" field
+         * @param event Event type ("event:" field, omitted if empty)
+         * @param id Event id ("id:" field, omitted if empty), sent back by browsers in Last-Event-ID
+         * @note Line breaks in event and id are dropped, they would end the field
+         */
+        static std::string serialize(const std::string &data, const std::string &event = "", const std::string &id = "");
+
+        event_stream(const event_stream &) = delete;
+        event_stream &operator=(const event_stream &) = delete;
+
+        /// Closes the connection unless it is closed already
+        ~event_stream();
+
+        /// Send one event; false once the stream is closed
+        bool send(const std::string &data, const std::string &event = "", const std::string &id = "");
+
+        /// Send an event serialized with serialize(); the buffer is shared, not copied
+        bool send_serialized(std::shared_ptr<const std::string> event);
+
+        /// Send a comment line, which clients ignore; keeps proxies from closing an idle stream
+        bool send_comment(const std::string &text = "");
+
+        /// Close the connection once the queued events were written
+        void close();
+
+        /// false once close() was called or the client went away
+        bool is_open() const { return !closed.load(); }
+
+        /// Remote address of the client
+        const std::string &get_remote_address() const { return remote; }
+
+        /// Bytes sent that the client has not read yet (0 on the epoll backend)
+        std::size_t get_queued_bytes() const { return outbound ? outbound->size() : 0; }
+
+        /// false while more than config::OUTBOUND_HIGH_WATERMARK bytes wait for the client (always true on epoll)
+        bool is_writable() const { return !outbound || outbound->writable(); }
+
+        /// Run callback once the connection is writable, see http_response::on_writable()
+        void on_writable(std::function<void()> callback);
+
+    private:
+        friend class http_server;
+        friend class http2_connection;
+
+        /**
+         * @brief Private constructor, used by http_server for http_response::start_event_stream().
+         * @param write Queues a copy of bytes for the client
+         * @param write_shared Queues a shared buffer for the client
+         * @param close_transport Closes the connection once queued bytes were written
+         * @param outbound Outbound queue of the connection (null on epoll)
+         */
+        event_stream(std::string remote, std::function<void(const std::string &)> write,
+                     std::function<void(std::shared_ptr<const std::string>)> write_shared,
+                     std::function<void()> close_transport, std::shared_ptr<outbound_queue> outbound);
+
+        std::string remote;
+        std::function<void(const std::string &)> write;
+        std::function<void(std::shared_ptr<const std::string>)> write_shared;
+        std::function<void()> close_transport;
+        std::shared_ptr<outbound_queue> outbound;
+
+        std::atomic<bool> closed{false};
+        std::atomic<bool> detached{false}; ///< The server is gone, the transport must not be touched
+
+        /// The client went away (called by http_server)
+        void transport_closed() { closed.store(true); }
+
+        /// The server is being destroyed: later sends and close() are dropped
+        void detach();
+    };
+
+    /**
+     * @brief Broadcast channel fanning events out to many event_streams.
+     *
+     * publish() serializes an event once and queues the same reference-counted
+     * buffer to every subscriber, so the cost of an event does not grow with
+     * the size of the payload times the number of clients. Subscribers that
+     * have more than max_queued_bytes waiting (slow or stalled readers) are
+     * closed and removed instead of buffering without limit; closed streams
+     * are removed on the next publish().
+     *
+     * All members are safe to call from any thread.
+     */
+    class event_channel
+    {
+    public:
+        /**
+         * @param max_queued_bytes Queued bytes at which a subscriber is evicted (io_uring backend only;
+         *        the epoll socket layer reports no queue size)
+         */
+        explicit event_channel(std::size_t max_queued_bytes);
+
+        /// Evicts at config::OUTBOUND_HIGH_WATERMARK
+        event_channel();
+
+        /// Add a stream; it receives every event published from now on
+        void subscribe(std::shared_ptr<event_stream> stream);
+
+        /// Remove a stream (it stays open)
+        void unsubscribe(const std::shared_ptr<event_stream> &stream);
+
+        /**
+         * @brief Send one event to every subscriber.
+         * @return Number of subscribers the event was queued for
+         */
+        std::size_t publish(const std::string &data, const std::string &event = "", const std::string &id = "");
+
+        /// publish() for an event serialized with event_stream::serialize()
+        std::size_t publish_serialized(std::shared_ptr<const std::string> event);
+
+        /// Close every subscriber and empty the channel
+        void close_all();
+
+        /// Current number of subscribers
+        std::size_t size() const;
+
+    private:
+        std::size_t max_queued_bytes;
+        mutable std::mutex mutex;
+        std::vector<std::shared_ptr<event_stream>> subscribers;
+    };
+}
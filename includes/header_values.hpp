@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace hh_http
+{
+    /// One name=value pair of a Cookie header, as views into the header value
+    struct cookie
+    {
+        std::string_view name;
+        std::string_view value; ///< Surrounding double quotes removed
+    };
+
+    /// User and password of an "Authorization: Basic" header
+    struct basic_credentials
+    {
+        std::string user;
+        std::string password;
+    };
+
+    namespace header_values
+    {
+        /**
+         * @brief Append the cookies of a Cookie header value ("a=1; b=2") to out.
+         *
+         * Names and values are trimmed; pairs without '=' or with an empty
+         * name are skipped. The views refer to value, which must outlive them.
+         */
+        void parse_cookies(std::string_view value, std::vector<cookie> &out);
+
+        /**
+         * @brief Token of an "Authorization: Bearer <token>" value (scheme case-insensitive, RFC 6750).
+         * @return A view into value, or empty if the scheme is not Bearer or the token is missing
+         */
+        std::string_view bearer_token(std::string_view value);
+
+        /**
+         * @brief Decode an "Authorization: Basic <base64(user:password)>" value (RFC 7617).
+         * @return false if the scheme is not Basic, the base64 is malformed or there is no ':'
+         */
+        bool parse_basic(std::string_view value, basic_credentials &out);
+    }
+}
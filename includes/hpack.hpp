@@ -0,0 +1,142 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace hh_http
+{
+    /// HPACK header compression for HTTP/2 (RFC 7541)
+    namespace hpack
+    {
+        /// One header field; names are lower-case on the wire
+        struct header_field
+        {
+            std::string name;
+            std::string value;
+        };
+
+        /// Size of an entry as counted against the table limits (RFC 7541, section 4.1)
+        inline std::size_t entry_size(const std::string &name, const std::string &value)
+        {
+            return name.size() + value.size() + 32;
+        }
+
+        /**
+         * @brief Dynamic table of an encoder or decoder (RFC 7541, section 2.3.2).
+         *
+         * The newest entry has index 1; entries are evicted from the old end
+         * whenever an insert or a smaller limit would exceed max_size().
+         */
+        class dynamic_table
+        {
+        public:
+            explicit dynamic_table(std::size_t max_size);
+
+            /// Add an entry; one larger than the limit empties the table instead
+            void insert(const std::string &name, const std::string &value);
+
+            /// Change the limit, evicting entries that no longer fit
+            void resize(std::size_t max_size);
+
+            /// Entry by dynamic index (1 = newest), null if out of range
+            const header_field *get(std::size_t index) const;
+
+            std::size_t entries() const { return fields.size(); }
+            std::size_t size() const { return used; }
+            std::size_t max_size() const { return limit; }
+
+        private:
+            std::deque<header_field> fields;
+            std::size_t used = 0;
+            std::size_t limit;
+
+            void evict(std::size_t needed);
+        };
+
+        /// Outcome of decoding one header block
+        enum class decode_status
+        {
+            OK,
+            TOO_LARGE, ///< The fields exceed max_list_size; the block was still processed to keep the table in sync
+            ERROR      ///< Malformed block (COMPRESSION_ERROR); the connection must be closed
+        };
+
+        /**
+         * @brief Decoder for the header blocks of one connection.
+         *
+         * Blocks must be decoded in the order they arrive, including those of
+         * streams that are refused, since each may change the dynamic table.
+         */
+        class decoder
+        {
+        public:
+            /**
+             * @param max_table_size Table size we advertised in SETTINGS_HEADER_TABLE_SIZE
+             * @param max_list_size Decoded size (name + value + 32 per field) at which a block is TOO_LARGE
+             */
+            decoder(std::size_t max_table_size, std::size_t max_list_size);
+
+            /// Decode a complete header block (HEADERS plus CONTINUATION fragments), appending to fields
+            decode_status decode(const char *data, std::size_t size, std::vector<header_field> &fields);
+
+        private:
+            dynamic_table table;
+            std::size_t max_table_size;
+            std::size_t max_list_size;
+
+            /// Static or dynamic entry by combined index (1-based), null if out of range
+            const header_field *lookup(std::uint64_t index) const;
+        };
+
+        /**
+         * @brief Encoder for the header blocks we send on one connection.
+         *
+         * Exact matches are sent as indexes into the static or dynamic table;
+         * other fields are added to the dynamic table unless their value
+         * changes with every response (Content-Length, Date, ...) or is
+         * sensitive (Set-Cookie is sent never-indexed). Strings are sent
+         * without Huffman coding: the dynamic table does most of the saving
+         * on repeated responses, and the encoder stays a plain copy.
+         *
+         * Blocks must reach the peer in the order they were encoded.
+         */
+        class encoder
+        {
+        public:
+            explicit encoder(std::size_t max_table_size = 4096);
+
+            /// Apply the peer's SETTINGS_HEADER_TABLE_SIZE; announced at the start of the next block
+            void set_max_table_size(std::size_t max_size);
+
+            /// Append the encoding of one field (name must be lower-case)
+            void encode(const std::string &name, const std::string &value, std::string &out);
+
+            /// Start a block: emits a pending table size update
+            void begin_block(std::string &out);
+
+        private:
+            dynamic_table table;
+            std::size_t pending_size = 0;
+            std::size_t smallest_pending = 0;
+            bool size_update_pending = false;
+        };
+
+        /**
+         * @brief Append value as an HPACK integer with a prefix of prefix_bits.
+         * @param flags Bits above the prefix in the first byte (the representation type)
+         */
+        void encode_integer(std::uint64_t value, int prefix_bits, std::uint8_t flags, std::string &out);
+
+        /// Append a string literal without Huffman coding
+        void encode_string(const std::string &value, std::string &out);
+
+        /**
+         * @brief Decode a Huffman-coded string literal (RFC 7541, appendix B).
+         * @return false if it contains EOS or its padding is not a prefix of EOS of at most 7 bits
+         */
+        bool huffman_decode(const std::uint8_t *data, std::size_t size, std::string &out);
+    }
+}
@@ -0,0 +1,309 @@
+#pragma once
+
+#include "hpack.hpp"
+#include "http_consts.hpp"
+#include "http_request_timings.hpp"
+#include "outbound_queue.hpp"
+#include "event_stream.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace hh_http
+{
+    /// Frame types (RFC 9113, section 6)
+    enum class http2_frame_type : std::uint8_t
+    {
+        DATA = 0x0,
+        HEADERS = 0x1,
+        PRIORITY = 0x2,
+        RST_STREAM = 0x3,
+        SETTINGS = 0x4,
+        PUSH_PROMISE = 0x5,
+        PING = 0x6,
+        GOAWAY = 0x7,
+        WINDOW_UPDATE = 0x8,
+        CONTINUATION = 0x9
+    };
+
+    /// Frame flags; the meaning of a bit depends on the frame type
+    namespace http2_flag
+    {
+        constexpr std::uint8_t END_STREAM = 0x1;
+        constexpr std::uint8_t ACK = 0x1; ///< SETTINGS and PING
+        constexpr std::uint8_t END_HEADERS = 0x4;
+        constexpr std::uint8_t PADDED = 0x8;
+        constexpr std::uint8_t PRIORITY = 0x20;
+    }
+
+    /// Error codes of RST_STREAM and GOAWAY (RFC 9113, section 7)
+    namespace http2_error
+    {
+        constexpr std::uint32_t NO_ERROR = 0x0;
+        constexpr std::uint32_t PROTOCOL_ERROR = 0x1;
+        constexpr std::uint32_t INTERNAL_ERROR = 0x2;
+        constexpr std::uint32_t FLOW_CONTROL_ERROR = 0x3;
+        constexpr std::uint32_t STREAM_CLOSED = 0x5;
+        constexpr std::uint32_t FRAME_SIZE_ERROR = 0x6;
+        constexpr std::uint32_t REFUSED_STREAM = 0x7;
+        constexpr std::uint32_t CANCEL = 0x8;
+        constexpr std::uint32_t COMPRESSION_ERROR = 0x9;
+        constexpr std::uint32_t ENHANCE_YOUR_CALM = 0xb;
+    }
+
+    /// SETTINGS parameters (RFC 9113, section 6.5.2)
+    namespace http2_setting
+    {
+        constexpr std::uint16_t HEADER_TABLE_SIZE = 0x1;
+        constexpr std::uint16_t ENABLE_PUSH = 0x2;
+        constexpr std::uint16_t MAX_CONCURRENT_STREAMS = 0x3;
+        constexpr std::uint16_t INITIAL_WINDOW_SIZE = 0x4;
+        constexpr std::uint16_t MAX_FRAME_SIZE = 0x5;
+        constexpr std::uint16_t MAX_HEADER_LIST_SIZE = 0x6;
+    }
+
+    /**
+     * @brief Server side of one HTTP/2 connection over cleartext TCP (h2c).
+     *
+     * Created by http_server when a client opens with the HTTP/2 connection
+     * preface (prior knowledge) or upgrades an HTTP/1.1 request with
+     * "Upgrade: h2c". It parses frames, keeps the HPACK tables, enforces
+     * the flow-control windows in both directions and answers SETTINGS and
+     * PING. Each stream whose request is complete is handed to http_server,
+     * which runs it through the usual http_request / http_response handler;
+     * the response is framed back onto its stream by the send_* members.
+     *
+     * Frames are parsed straight from the receive buffer; only a frame cut
+     * off by the end of a read is staged. Frames produced while handling
+     * one read (SETTINGS ACK, WINDOW_UPDATE, responses sent from the
+     * handler) leave in a single write.
+     *
+     * receive() runs on the event loop thread. The send_* members may be
+     * called from any thread: all state is guarded by one mutex, which also
+     * keeps header blocks in the order the HPACK encoder produced them.
+     */
+    class http2_connection : public std::enable_shared_from_this<http2_connection>
+    {
+    public:
+        /// Client connection preface (RFC 9113, section 3.4)
+        static constexpr char PREFACE[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+        static constexpr std::size_t PREFACE_SIZE = sizeof(PREFACE) - 1;
+
+        /// A stream whose request is complete, or was rejected early (method is then a BAD_* token, as from http_message_handler)
+        struct stream_request
+        {
+            std::uint32_t stream_id = 0;
+            std::string method;
+            std::string path;
+            std::multimap<std::string, std::string> headers; ///< Upper-case names like http_message_handler; :authority becomes Host
+            std::string body;
+            std::shared_ptr<request_timings> timings;
+        };
+
+        /// Receives every complete stream, on the event loop thread
+        using request_callback = std::function<void(const std::shared_ptr<http2_connection> &, stream_request &)>;
+
+        /**
+         * @brief Whether the first bytes of a connection are (the start of) the HTTP/2 preface.
+         * @note At least "PRI " must be there; shorter reads are left to the HTTP/1.1 parser
+         */
+        static bool is_preface(const char *data, std::size_t size);
+
+        /**
+         * @brief Whether an HTTP/1.1 request asks to switch to h2c (RFC 7540, section 3.2).
+         * @param headers Request headers with upper-case names, as parsed by http_message_handler
+         * @note Requires Upgrade: h2c, Connection: Upgrade and exactly one HTTP2-Settings header
+         */
+        static bool is_upgrade_request(const std::string &version, const std::multimap<std::string, std::string> &headers);
+
+        http2_connection(const http2_connection &) = delete;
+        http2_connection &operator=(const http2_connection &) = delete;
+
+        /**
+         * @brief Send the response head of a stream.
+         * @param headers Header names in any case; connection-specific fields (Connection, Transfer-Encoding, ...) are dropped
+         * @param end_stream true if no body follows
+         */
+        void send_headers(std::uint32_t stream_id, int status, const std::multimap<std::string, std::string> &headers,
+                          bool end_stream);
+
+        /**
+         * @brief Send body bytes on a stream.
+         *
+         * Bytes beyond the peer's flow-control windows wait in the stream
+         * and leave as the client sends WINDOW_UPDATE.
+         */
+        void send_data(std::uint32_t stream_id, const char *data, std::size_t size, bool end_stream);
+        void send_data(std::uint32_t stream_id, const std::string &data, bool end_stream)
+        {
+            send_data(stream_id, data.data(), data.size(), end_stream);
+        }
+
+        /// Send trailers, ending the stream (after any body bytes still waiting for the window)
+        void send_trailers(std::uint32_t stream_id, const std::multimap<std::string, std::string> &trailers);
+
+        /**
+         * @brief The response object of a stream is done (http_response::end() or destruction).
+         * @note A stream whose response never ended is reset with INTERNAL_ERROR (nothing sent) or
+         *       CANCEL (incomplete), unless it carries an event stream
+         */
+        void finish_stream(std::uint32_t stream_id);
+
+        /// Create the event_stream of a stream (http_response::start_event_stream()); closing it ends the stream
+        std::shared_ptr<event_stream> open_event_stream(std::uint32_t stream_id);
+
+        /// Remote address of the client
+        const std::string &get_remote_address() const { return remote; }
+
+    private:
+        friend class http_server;
+
+        /**
+         * @brief Private constructor, used by http_server.
+         * @param remote Remote address of the client
+         * @param write Queues bytes for the client
+         * @param close_transport Closes the TCP connection once queued bytes were written
+         * @param outbound Outbound queue of the connection (null on epoll)
+         * @param on_request Receives complete streams
+         */
+        http2_connection(std::string remote, std::function<void(const std::string &)> write,
+                         std::function<void()> close_transport, std::shared_ptr<outbound_queue> outbound,
+                         request_callback on_request);
+
+        /// Per-stream state; a stream is dropped once both sides ended it
+        struct stream
+        {
+            bool remote_closed = false; ///< The client sent END_STREAM
+            bool local_closed = false;  ///< We sent END_STREAM or RST_STREAM
+            bool delivered = false;     ///< The request was handed to the server
+            bool rejected = false;      ///< Delivered early as an error; later DATA is dropped
+            bool headers_sent = false;
+            bool end_queued = false; ///< The response ended; pending may still hold its last bytes
+
+            std::string method, path;
+            std::multimap<std::string, std::string> headers;
+            std::string body;
+            std::shared_ptr<request_timings> timings;
+
+            std::int64_t send_window = 0;
+            std::int64_t receive_window = 0;
+            std::uint32_t unacknowledged = 0; ///< Received bytes not yet returned with WINDOW_UPDATE
+
+            std::string pending; ///< Body bytes waiting for flow-control credit
+            std::size_t pending_offset = 0;
+            bool trailers_pending = false;
+            std::multimap<std::string, std::string> trailers;
+
+            std::weak_ptr<event_stream> events;
+        };
+
+        std::string remote;
+        std::function<void(const std::string &)> write;
+        std::function<void()> close_transport;
+        std::shared_ptr<outbound_queue> outbound;
+        request_callback on_request;
+
+        std::mutex mutex;
+        std::map<std::uint32_t, stream> streams;
+
+        hpack::decoder decoder;
+        hpack::encoder encoder;
+
+        std::string inbound;  ///< Start of a frame cut off by the end of a read
+        std::string outgoing; ///< Frames produced under the lock, written in one piece
+        bool preface_received = false;
+        bool settings_received = false;
+        bool goaway_sent = false;
+        bool failed = false;             ///< A connection error was sent; the transport is being closed
+        bool close_requested = false;    ///< close_transport() is due once the lock is released
+        bool batching = false;           ///< receive() is dispatching requests; their frames are written afterwards
+        std::size_t released = 0;        ///< Pending body bytes that left since the last flush, for outbound->written()
+        std::atomic<bool> closed{false}; ///< The transport is gone (or the server was destroyed)
+
+        std::uint32_t last_stream_id = 0;
+        std::uint32_t continuation_stream = 0; ///< HEADERS without END_HEADERS: only CONTINUATION may follow
+        bool continuation_end_stream = false;
+        std::string header_block;
+
+        // Peer settings and our send windows
+        std::uint32_t peer_max_frame_size = 16384;
+        std::int64_t peer_initial_window = 65535;
+        std::int64_t connection_send_window = 65535;
+
+        // Our receive window
+        std::int64_t connection_receive_window = 65535;
+        std::uint32_t connection_unacknowledged = 0;
+
+        /**
+         * @brief Send our SETTINGS and receive window.
+         * @param upgrade_settings Value of the HTTP2-Settings header for an h2c upgrade, null for prior knowledge
+         * @note After an upgrade, stream 1 exists half-closed: its request was the HTTP/1.1 one
+         */
+        void start(const std::string *upgrade_settings);
+
+        /// Feed bytes read from the client (event loop thread)
+        void receive(const char *data, std::size_t size);
+
+        /// The TCP connection was closed
+        void transport_closed();
+
+        /// The server is going away: later sends are dropped
+        void detach();
+
+        /// Send GOAWAY, accept no new streams and close once the open ones are done
+        void go_away();
+
+        /// Parse whole frames from data; returns the bytes consumed
+        std::size_t process(const char *data, std::size_t size, std::vector<stream_request> &ready);
+        void handle_frame(http2_frame_type type, std::uint8_t flags, std::uint32_t stream_id,
+                          const char *payload, std::size_t length, std::vector<stream_request> &ready);
+        void handle_data(std::uint8_t flags, std::uint32_t stream_id, const char *payload, std::size_t length,
+                         std::vector<stream_request> &ready);
+        void handle_headers(std::uint8_t flags, std::uint32_t stream_id, const char *payload, std::size_t length,
+                            std::vector<stream_request> &ready);
+        void handle_header_block(std::uint32_t stream_id, bool end_stream, std::vector<stream_request> &ready);
+        void handle_settings(std::uint8_t flags, const char *payload, std::size_t length);
+        bool apply_setting(std::uint16_t id, std::uint32_t value);
+        void handle_window_update(std::uint32_t stream_id, const char *payload, std::size_t length);
+
+        /**
+         * @brief Turn decoded fields into the request of a new stream.
+         * @return false if the request is malformed (RFC 9113, section 8.1.1)
+         */
+        bool build_request(std::vector<hpack::header_field> &fields, stream &s);
+        stream_request take_request(std::uint32_t stream_id, stream &s, const std::string &error = "");
+
+        void write_frame(http2_frame_type type, std::uint8_t flags, std::uint32_t stream_id,
+                         const char *payload, std::size_t length);
+        void write_header_block(std::uint32_t stream_id, const std::string &block, bool end_stream);
+        void write_settings();
+        void write_window_update(std::uint32_t stream_id, std::uint32_t increment);
+        void write_rst_stream(std::uint32_t stream_id, std::uint32_t error);
+
+        /// Encode headers (lower-cased, connection-specific ones dropped) after the optional :status
+        std::string encode_headers(int status, const std::multimap<std::string, std::string> &headers);
+
+        /// Send as much of a stream's pending bytes as the windows allow, then its end
+        void flush_stream(std::uint32_t stream_id, stream &s);
+        void flush_all_streams();
+
+        /// Drop a stream both sides are done with
+        void settle(std::map<std::uint32_t, stream>::iterator it);
+
+        /// Reset a stream (RST_STREAM) and drop it
+        void stream_error(std::uint32_t stream_id, std::uint32_t error);
+
+        /// Send GOAWAY with error and close the connection
+        void connection_error(std::uint32_t error);
+
+        /// Write outgoing, release the lock and close the transport if requested
+        void flush_and_unlock(std::unique_lock<std::mutex> &lock);
+    };
+}
@@ -1,8 +1,11 @@
 #pragma once
 
 #include <string>
+#include <vector>
 #include <algorithm>
 #include <chrono>
+
+#include "url.hpp"
 namespace hh_http
 {
     namespace epoll_config
@@ -16,18 +19,58 @@ namespace hh_http
         /// @brief Maximum timeout for connections (in milliseconds)
         extern int TIMEOUT_MILLISECONDS;
 
+        /// @brief TCP_DEFER_ACCEPT on the listener: wake the server only once a client sent data (seconds, 0 = off)
+        extern int DEFER_ACCEPT_SECONDS;
+
+    }
+    namespace uring_config
+    {
+        /// @brief Submission queue entries of the io_uring backend
+        extern unsigned QUEUE_DEPTH;
+
+        /// @brief Receive buffers shared by all connections (rounded up to a power of two)
+        extern unsigned RECV_BUFFER_COUNT;
+
+        /// @brief Size of each receive buffer (in bytes)
+        extern unsigned RECV_BUFFER_SIZE;
+
+        /// @brief Set SO_REUSEPORT on the listener so a new process can bind the port while this one runs
+        extern bool REUSE_PORT;
     }
     namespace config
     {
         extern size_t MAX_HEADER_SIZE;
         extern size_t MAX_BODY_SIZE;
         extern std::chrono::seconds MAX_IDLE_TIME_SECONDS;
+        extern bool ENABLE_METRICS;
+        extern bool ENABLE_COMPRESSION;
+        extern size_t COMPRESSION_MIN_SIZE;
+        extern int COMPRESSION_LEVEL;
+        extern std::vector<std::string> COMPRESSIBLE_CONTENT_TYPES;
+        extern bool ENABLE_REQUEST_DECOMPRESSION;
+        extern size_t MAX_DECOMPRESSED_BODY_SIZE;
+        extern size_t MAX_DECOMPRESSION_RATIO;
+        extern size_t MAX_BUFFERED_BYTES;
+        extern size_t OUTBOUND_HIGH_WATERMARK;
+        extern size_t OUTBOUND_LOW_WATERMARK;
+        extern std::chrono::seconds WRITE_TIMEOUT_SECONDS;
+        extern size_t WEBSOCKET_MAX_MESSAGE_SIZE;
+        extern bool ENABLE_HTTP2;
+        extern size_t HTTP2_MAX_CONCURRENT_STREAMS;
+        extern size_t HTTP2_INITIAL_WINDOW_SIZE;
+        extern url::encoded_slash ENCODED_SLASH_POLICY;
+        extern size_t RATE_LIMIT_TABLE_SLOTS;
+        extern std::chrono::seconds MAX_HEADER_READ_TIME;
+        extern size_t MIN_BODY_RATE;
+        extern std::chrono::seconds BODY_RATE_WINDOW;
+        extern size_t MAX_PARTIAL_REQUESTS_PER_IP;
     }
     // HTTP Version Constants
     constexpr const char *HTTP_VERSION_1_0 = "HTTP/1.0";
     constexpr const char *HTTP_VERSION_1_1 = "HTTP/1.1";
 
     // HTTP Status Codes (commonly used)
+    constexpr int HTTP_CONTINUE = 100;
     constexpr int HTTP_OK = 200;
     constexpr int HTTP_CREATED = 201;
     constexpr int HTTP_NO_CONTENT = 204;
@@ -35,6 +78,9 @@ namespace hh_http
     constexpr int HTTP_UNAUTHORIZED = 401;
     constexpr int HTTP_FORBIDDEN = 403;
     constexpr int HTTP_NOT_FOUND = 404;
+    constexpr int HTTP_CONTENT_TOO_LARGE = 413;
+    constexpr int HTTP_EXPECTATION_FAILED = 417;
+    constexpr int HTTP_TOO_MANY_REQUESTS = 429;
     constexpr int HTTP_INTERNAL_SERVER_ERROR = 500;
 
     // HTTP Methods
@@ -59,6 +105,16 @@ namespace hh_http
     constexpr const char *HEADER_IF_MODIFIED_SINCE = "If-Modified-Since";
     constexpr const char *HEADER_IF_NONE_MATCH = "If-None-Match";
     constexpr const char *HEADER_EXPECT = "Expect";
+    constexpr const char *HEADER_ACCEPT_ENCODING = "Accept-Encoding";
+    constexpr const char *HEADER_CONTENT_ENCODING = "Content-Encoding";
+    constexpr const char *HEADER_TRANSFER_ENCODING = "Transfer-Encoding";
+    constexpr const char *HEADER_VARY = "Vary";
+    constexpr const char *HEADER_CACHE_CONTROL = "Cache-Control";
+    constexpr const char *HEADER_UPGRADE = "Upgrade";
+    constexpr const char *HEADER_SEC_WEBSOCKET_KEY = "Sec-WebSocket-Key";
+    constexpr const char *HEADER_SEC_WEBSOCKET_VERSION = "Sec-WebSocket-Version";
+    constexpr const char *HEADER_SEC_WEBSOCKET_ACCEPT = "Sec-WebSocket-Accept";
+    constexpr const char *HEADER_HTTP2_SETTINGS = "HTTP2-Settings";
 
     // HTTP Line Endings
     constexpr const char *CRLF = "\r\n";
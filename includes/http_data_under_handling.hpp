@@ -4,6 +4,10 @@
 #include <string>
 #include <map>
 #include <chrono>
+#include <memory>
+
+#include "compression.hpp"
+#include "body_sink.hpp"
 namespace hh_http
 {
     enum class handling_type
@@ -32,11 +36,37 @@ namespace hh_http
         std::string uri;                                 ///< Request URI
         std::string version;                             ///< HTTP version (e.g., "HTTP/1.1")
         std::multimap<std::string, std::string> headers; ///< Request headers
-        std::string body;                                ///< Request body
+        std::string body;                                ///< Request body (decompressed when body_decoder is set)
+
+        // body_decoder: inflates a Content-Encoding: gzip/deflate body as it arrives (null otherwise)
+        std::shared_ptr<compression::decompressor> body_decoder;
+        // sink: receives the body instead of body when the server asked for it (null otherwise)
+        std::shared_ptr<body_sink> sink;
+        // received_body_bytes: body bytes read from the socket so far, before decompression
+        std::size_t received_body_bytes = 0;
+        // partial_chunk: chunk-size or trailer line cut off by the end of the last read (at most MAX_HEADER_SIZE bytes)
+        std::string partial_chunk;
+        // chunk_data_left / chunk_crlf_left: data and CRLF bytes of the current chunk still to be received
+        std::size_t chunk_data_left = 0;
+        std::size_t chunk_crlf_left = 0;
+        // chunk_trailers: the last chunk is read, its trailer section is being received
+        bool chunk_trailers = false;
+        // budgeted_bytes: bytes of this request currently charged to memory_budget
+        std::size_t budgeted_bytes = 0;
 
         // last_activity: timestamp of the last activity on this connection
         std::chrono::steady_clock::time_point last_activity;
 
+        // wire_bytes: bytes read for this request after its first read, framing included (for the body rate)
+        std::size_t wire_bytes = 0;
+        // rate_checkpoint / rate_checkpoint_bytes: start of the current body rate window and wire_bytes then
+        std::chrono::steady_clock::time_point rate_checkpoint;
+        std::size_t rate_checkpoint_bytes = 0;
+
+        // first_byte / headers_complete: carried over to the completed request for phase timings
+        std::chrono::steady_clock::time_point first_byte;
+        std::chrono::steady_clock::time_point headers_complete;
+
         http_data_under_handling() = default;
         http_data_under_handling(const std::string &socket_key, handling_type type) : socket_key(socket_key), type(type) {}
 
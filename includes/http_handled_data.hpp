@@ -1,6 +1,10 @@
 #pragma once
 #include <string>
 #include <map>
+#include <chrono>
+#include <memory>
+
+#include "body_sink.hpp"
 namespace hh_http
 {
     /**
@@ -14,6 +18,12 @@ namespace hh_http
         std::string version;                             ///< HTTP version (e.g., "HTTP/1.1")
         std::multimap<std::string, std::string> headers; ///< Request headers
         std::string body;                                ///< Request body
+        std::shared_ptr<body_sink> sink;                 ///< Took the body instead of body (complete results), null otherwise
+        bool expects_continue = false;                   ///< Incomplete request whose client holds the body back until "100 Continue"
+
+        std::chrono::steady_clock::time_point first_byte;       ///< First read of this request arrived
+        std::chrono::steady_clock::time_point headers_complete; ///< Request line and headers were parsed
+        std::chrono::steady_clock::time_point body_complete;    ///< Whole request was received (completed results only)
 
         http_handled_data(bool completed, const std::string &method,
                           const std::string &uri, const std::string &version,
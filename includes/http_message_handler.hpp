@@ -5,51 +5,153 @@
 #include "http_handled_data.hpp"
 #include "http_data_under_handling.hpp"
 #include "http_consts.hpp"
+#include "compression.hpp"
+#include "buffer_view_stream.hpp"
+#include "memory_budget.hpp"
+#include "remote_address.hpp"
+#include <algorithm>
+#include <cstring>
 #include <memory>
 #include <map>
 #include <sstream>
 #include <mutex>
 #include <functional>
+#include <unordered_map>
+#include <vector>
 namespace hh_http
 {
 
     class http_message_handler
     {
         std::map<std::string, http_data_under_handling> under_handling_data;
+        /// Partial requests per client IP, for config::MAX_PARTIAL_REQUESTS_PER_IP
+        std::unordered_map<std::string, std::size_t> partial_per_ip;
         std::mutex mtx;
 
     public:
+        /// Chooses a body_sink for a request with a body from its request line and headers (null = buffer the body)
+        using body_sink_factory = std::function<std::shared_ptr<body_sink>(const std::string &method, const std::string &uri,
+                                                                           const std::string &version,
+                                                                           const std::multimap<std::string, std::string> &headers)>;
+
+        /**
+         * @brief Let the server stream request bodies into a sink instead of the request.
+         * @note Called under the parser lock once the headers of a request with a body are parsed
+         */
+        void set_body_sink_factory(body_sink_factory factory)
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            sink_factory = std::move(factory);
+        }
+
         http_handled_data handle(std::shared_ptr<hh_socket::connection> conn, const hh_socket::data_buffer &message)
+        {
+            std::string bytes = message.to_string();
+            return handle(conn->get_remote_address().to_string(), conn->get_fd(), bytes.data(), bytes.size());
+        }
+
+        /**
+         * @brief Socket-free entry point, keyed directly by client identity.
+         * @param socket_key Key identifying the client (normally the remote address string)
+         * @param FD File descriptor reported back through cleanup_idle_connections()
+         * @param message Raw bytes received from the client
+         * @note Used by the parser benchmarks, which have no real connections
+         */
+        http_handled_data handle(const std::string &socket_key, int FD, const hh_socket::data_buffer &message)
+        {
+            std::string bytes = message.to_string();
+            return handle(socket_key, FD, bytes.data(), bytes.size());
+        }
+
+        /**
+         * @brief Parse bytes in place, straight from the caller's receive buffer.
+         * @param data Received bytes; only read during the call, never retained
+         * @param size Number of bytes at data
+         * @note Nothing is copied except what ends up in the request (headers, body)
+         */
+        http_handled_data handle(const std::string &socket_key, int FD, const char *data, std::size_t size)
         {
             std::lock_guard<std::mutex> lock(mtx);
-            auto socket_key = conn->get_remote_address().to_string();
+            auto received_at = std::chrono::steady_clock::now();
 
-            if (under_handling_data.find(socket_key) != under_handling_data.end())
+            auto it = under_handling_data.find(socket_key);
+            if (it != under_handling_data.end())
             {
-                return continue_handling(under_handling_data[socket_key], message);
+                // The entry is erased once the request completes, keep its timestamps
+                auto first_byte = it->second.first_byte;
+                auto headers_complete = it->second.headers_complete;
+
+                it->second.wire_bytes += size;
+                auto result = continue_handling(it->second, data, size);
+                result.first_byte = first_byte;
+                result.headers_complete = headers_complete;
+                if (result.completed)
+                    result.body_complete = std::chrono::steady_clock::now();
+                settle(it, result.completed);
+                return result;
             }
 
-            return start_handling(socket_key, message, conn->get_fd());
+            auto result = start_handling(socket_key, data, size, FD);
+            result.first_byte = received_at;
+            result.headers_complete = std::chrono::steady_clock::now();
+            if (result.completed)
+            {
+                result.body_complete = result.headers_complete;
+            }
+            else
+            {
+                it = under_handling_data.try_emplace(socket_key).first;
+                it->second.first_byte = result.first_byte;
+                it->second.headers_complete = result.headers_complete;
+                it->second.rate_checkpoint = result.headers_complete;
+                if (!admit_partial(socket_key))
+                {
+                    // Too many of this IP's requests are still arriving: this one is not waited for
+                    settle(it, true);
+                    return http_handled_data(true, "BAD_TOO_MANY_PARTIAL_REQUESTS", result.uri, result.version, {}, "");
+                }
+                settle(it, false);
+            }
+            return result;
+        }
+
+        /// Whether part of a request from this client is buffered
+        bool in_progress(const std::string &socket_key)
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            return under_handling_data.count(socket_key) != 0;
         }
 
-        http_handled_data continue_handling(http_data_under_handling &data, const hh_socket::data_buffer &message)
+        /**
+         * @brief Drop the partial request of a client, releasing its buffered bytes.
+         * @note Used when a request has to be rejected before it is complete
+         */
+        void discard(const std::string &socket_key)
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            auto it = under_handling_data.find(socket_key);
+            if (it != under_handling_data.end())
+                settle(it, true);
+        }
+
+        http_handled_data continue_handling(http_data_under_handling &data, const char *bytes, std::size_t size)
         {
             data.last_activity = std::chrono::steady_clock::now();
 
             if (data.type == handling_type::CHUNKED)
             {
-                return continue_chunked_handling(data, message);
+                return continue_chunked_handling(data, bytes, size);
             }
             else // Content-Length handling
             {
-                return continue_content_length_handling(data, message);
+                return continue_content_length_handling(data, bytes, size);
             }
         }
 
-        http_handled_data start_handling(const std::string &socket_key, const hh_socket::data_buffer &message, int FD)
+        http_handled_data start_handling(const std::string &socket_key, const char *bytes, std::size_t size, int FD)
         {
-            // Convert raw message to string stream for line-by-line parsing
-            std::istringstream request_stream(message.to_string());
+            // Parse line by line directly from the received bytes
+            buffer_view_stream request_stream(bytes, size);
 
             // HTTP request components to be parsed
             std::string method, uri, version;
@@ -85,15 +187,24 @@ namespace hh_http
                 return http_handled_data(true, "BAD_REPEATED_LENGTH_OR_TRANSFER_ENCODING_OR_BOTH", uri, version, headers, "");
             }
 
+            // "Expect: 100-continue" with no body bytes yet: the client waits for the server's go-ahead.
+            // Only HTTP/1.1 clients may be sent 100 Continue (RFC 9110, section 10.1.1)
+            bool waits_for_continue = request_stream.remaining() == 0 && version == HTTP_VERSION_1_1 &&
+                                      expects_continue(headers);
+
             // Handle body based on headers
             if (has_content_length)
             {
                 content_length = std::stoull(content_length_it->second);
-                return handle_content_length(socket_key, request_stream, method, uri, version, headers, content_length, FD);
+                auto result = handle_content_length(socket_key, request_stream, method, uri, version, headers, content_length, FD);
+                result.expects_continue = waits_for_continue && !result.completed;
+                return result;
             }
             else if (has_transfer_encoding)
             {
-                return handle_chunked_encoding(socket_key, request_stream, method, uri, version, headers, FD);
+                auto result = handle_chunked_encoding(socket_key, request_stream, method, uri, version, headers, FD);
+                result.expects_continue = waits_for_continue && !result.completed;
+                return result;
             }
 
             // No body to process
@@ -102,27 +213,126 @@ namespace hh_http
 
         void cleanup_idle_connections(std::chrono::seconds max_idle_time, std::function<void(int)> close_connection)
         {
-            std::lock_guard<std::mutex> lock(mtx);
-            auto now = std::chrono::steady_clock::now();
-            for (auto it = under_handling_data.begin(); it != under_handling_data.end();)
+            // Closed after the lock is released: closing may re-enter discard() from the close callback
+            std::vector<int> idle_fds;
             {
-                auto duration = std::chrono::duration_cast<std::chrono::seconds>(now - it->second.last_activity);
-                if (duration > max_idle_time)
+                std::lock_guard<std::mutex> lock(mtx);
+                auto now = std::chrono::steady_clock::now();
+                for (auto it = under_handling_data.begin(); it != under_handling_data.end();)
                 {
-                    // std::cout << "❌ idle-timeout-exceeded@ " << it->first << " FD=" << it->second.FD << std::endl;
-                    close_connection(it->second.FD);
-                    it = under_handling_data.erase(it);
+                    auto duration = std::chrono::duration_cast<std::chrono::seconds>(now - it->second.last_activity);
+                    if (duration > max_idle_time)
+                    {
+                        idle_fds.push_back(it->second.FD);
+                        memory_budget::instance().release(it->second.budgeted_bytes);
+                        it = erase_partial(it);
+                    }
+                    else
+                    {
+                        ++it;
+                    }
                 }
-                else
+            }
+            for (int fd : idle_fds)
+                close_connection(fd);
+        }
+
+        /**
+         * @brief Close connections whose request body arrives slower than min_rate.
+         * @param min_rate Bytes per second a partial request must average over each window
+         * @param window Length of the window; a request is first judged one window after its headers
+         * @note Counts bytes as read from the socket, so chunk framing and a chunk still being
+         *       received count too. A client trickling a byte now and then no longer survives
+         *       just because every byte refreshes last_activity. While the memory budget is
+         *       exhausted the io_uring backend reads from nobody, so windows start over instead
+         *       of counting the pause against every partial request
+         */
+        void cleanup_slow_requests(std::size_t min_rate, std::chrono::seconds window, std::function<void(int)> close_connection)
+        {
+            std::vector<int> slow_fds;
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                auto now = std::chrono::steady_clock::now();
+                bool reading_paused = memory_budget::instance().exhausted();
+                for (auto it = under_handling_data.begin(); it != under_handling_data.end();)
                 {
+                    auto &data = it->second;
+                    if (reading_paused)
+                    {
+                        data.rate_checkpoint = now;
+                        data.rate_checkpoint_bytes = data.wire_bytes;
+                        ++it;
+                        continue;
+                    }
+                    auto elapsed = std::chrono::duration<double>(now - data.rate_checkpoint).count();
+                    if (elapsed < static_cast<double>(window.count()))
+                    {
+                        ++it;
+                        continue;
+                    }
+                    std::size_t received = data.wire_bytes - data.rate_checkpoint_bytes;
+                    if (static_cast<double>(received) < static_cast<double>(min_rate) * elapsed)
+                    {
+                        slow_fds.push_back(data.FD);
+                        memory_budget::instance().release(data.budgeted_bytes);
+                        it = erase_partial(it);
+                        continue;
+                    }
+                    data.rate_checkpoint = now;
+                    data.rate_checkpoint_bytes = data.wire_bytes;
                     ++it;
                 }
             }
+            for (int fd : slow_fds)
+                close_connection(fd);
         }
 
     private:
+        body_sink_factory sink_factory;
+
+        /**
+         * Charge the memory budget for what a partial request buffers now; a
+         * finished request (complete or rejected) gives its bytes back and
+         * its state is dropped.
+         */
+        void settle(std::map<std::string, http_data_under_handling>::iterator it, bool finished)
+        {
+            auto &budget = memory_budget::instance();
+            auto &data = it->second;
+            if (finished)
+            {
+                budget.release(data.budgeted_bytes);
+                erase_partial(it);
+                return;
+            }
+
+            std::size_t buffered = data.body.size() + data.partial_chunk.size();
+            if (buffered > data.budgeted_bytes)
+                budget.acquire(buffered - data.budgeted_bytes);
+            else
+                budget.release(data.budgeted_bytes - buffered);
+            data.budgeted_bytes = buffered;
+        }
+
+        // Count a new partial request against its IP; false if the IP already has its share
+        bool admit_partial(const std::string &socket_key)
+        {
+            std::size_t &count = partial_per_ip[std::string(remote_ip(socket_key))];
+            ++count;
+            return config::MAX_PARTIAL_REQUESTS_PER_IP == 0 || count <= config::MAX_PARTIAL_REQUESTS_PER_IP;
+        }
+
+        // Drop a partial request's state and its count; returns the next entry
+        std::map<std::string, http_data_under_handling>::iterator erase_partial(std::map<std::string, http_data_under_handling>::iterator it)
+        {
+            auto ip = partial_per_ip.find(std::string(remote_ip(it->first)));
+            if (ip != partial_per_ip.end() && --ip->second == 0)
+                partial_per_ip.erase(ip);
+            return under_handling_data.erase(it);
+        }
+
         // Helper method to parse request line
-        std::pair<bool, std::string> parse_request_line(std::istringstream &request_stream,
+        std::pair<bool, std::string> parse_request_line(std::istream &request_stream,
                                                         std::string &method,
                                                         std::string &uri,
                                                         std::string &version)
@@ -150,7 +360,7 @@ namespace hh_http
         }
 
         // Helper method to parse headers
-        std::pair<bool, std::multimap<std::string, std::string>> parse_headers(std::istringstream &request_stream,
+        std::pair<bool, std::multimap<std::string, std::string>> parse_headers(std::istream &request_stream,
                                                                                const std::string &uri,
                                                                                const std::string &version)
         {
@@ -224,9 +434,99 @@ namespace hh_http
             return false;
         }
 
+        // Helper method to check if the client sent "Expect: 100-continue" (values are case-insensitive)
+        static bool expects_continue(const std::multimap<std::string, std::string> &headers)
+        {
+            auto range = headers.equal_range(hh_socket::to_upper_case(HEADER_EXPECT));
+            for (auto it = range.first; it != range.second; ++it)
+            {
+                if (hh_socket::to_upper_case(it->second) == "100-CONTINUE")
+                    return true;
+            }
+            return false;
+        }
+
+        // Decoder for a Content-Encoding: gzip/deflate body, nullptr if the body is passed through as received
+        std::shared_ptr<compression::decompressor> make_body_decoder(const std::multimap<std::string, std::string> &headers)
+        {
+            if (!config::ENABLE_REQUEST_DECOMPRESSION || !compression::available())
+                return nullptr;
+
+            auto content_encoding = headers.find(hh_socket::to_upper_case("Content-Encoding"));
+            if (content_encoding == headers.end() || headers.count(content_encoding->first) > 1)
+                return nullptr;
+
+            auto coding = compression::parse_content_encoding(content_encoding->second);
+            if (coding == compression::coding::IDENTITY)
+                return nullptr;
+            return std::make_shared<compression::decompressor>(coding, config::MAX_DECOMPRESSED_BODY_SIZE,
+                                                               config::MAX_DECOMPRESSION_RATIO);
+        }
+
+        // Sink for the body of a request, nullptr if the body is buffered in the request
+        std::shared_ptr<body_sink> make_body_sink(const std::string &method, const std::string &uri, const std::string &version,
+                                                  const std::multimap<std::string, std::string> &headers)
+        {
+            return sink_factory ? sink_factory(method, uri, version, headers) : nullptr;
+        }
+
+        // Append received body bytes, inflating them first when there is a decoder; returns an error kind or ""
+        // With a sink the bytes go to the sink instead of body; only the piece decoded from one read is held
+        std::string append_body(std::string &body, const char *data, std::size_t size, compression::decompressor *decoder,
+                                body_sink *sink = nullptr)
+        {
+            if (sink)
+            {
+                if (!decoder)
+                    return sink->write(data, size) ? "" : "BAD_BODY_REJECTED";
+                std::string decoded;
+                std::string error = append_body(decoded, data, size, decoder);
+                if (!error.empty())
+                    return error;
+                return sink->write(decoded.data(), decoded.size()) ? "" : "BAD_BODY_REJECTED";
+            }
+
+            if (!decoder)
+            {
+                body.append(data, size);
+                return "";
+            }
+
+            switch (decoder->update(data, size, body))
+            {
+            case compression::decompress_status::OK:
+                return "";
+            case compression::decompress_status::TOO_LARGE:
+                return "BAD_DECOMPRESSED_TOO_LARGE";
+            case compression::decompress_status::CORRUPT:
+                break;
+            }
+            return "BAD_CONTENT_ENCODING";
+        }
+
+        // Check a decoded body is complete and make the headers describe it; returns an error kind or ""
+        std::string finish_body(std::multimap<std::string, std::string> &headers, const std::string &body,
+                                compression::decompressor *decoder, body_sink *sink = nullptr)
+        {
+            if (decoder)
+            {
+                // An empty body carries no compressed stream at all
+                if (!decoder->finished() && decoder->total_in() > 0)
+                    return "BAD_CONTENT_ENCODING";
+
+                // A streamed body's decoded size is the sink's business: Content-Length is dropped, not rewritten
+                headers.erase(hh_socket::to_upper_case("Content-Encoding"));
+                if (headers.erase(hh_socket::to_upper_case("content-length")) && !sink)
+                    headers.emplace(hh_socket::to_upper_case("content-length"), std::to_string(body.size()));
+            }
+            if (sink && !sink->finish())
+                return "BAD_BODY_REJECTED";
+            return "";
+        }
+
         // Handle content-length based body
         http_handled_data handle_content_length(const std::string &socket_key,
-                                                std::istringstream &request_stream,
+                                                buffer_view_stream &request_stream,
                                                 const std::string &method,
                                                 const std::string &uri,
                                                 const std::string &version,
@@ -234,19 +534,40 @@ namespace hh_http
                                                 size_t content_length,
                                                 int FD)
         {
-            // Read the body from the stream
-            std::ostringstream body_stream;
-            body_stream << request_stream.rdbuf();
-            std::string body = body_stream.str();
+            // The rest of the receive buffer is body
+            std::size_t received_size = request_stream.remaining();
+            const char *received = request_stream.read_in_place(received_size);
 
-            // Complete request in one go
-            if (body.size() == content_length)
+            if (received_size != content_length && (received_size > content_length || received_size > config::MAX_BODY_SIZE))
             {
-                return http_handled_data(true, method, uri, version, headers, body);
+                return http_handled_data(true, "BAD_CONTENT_TOO_LARGE", uri, version, headers, "");
             }
-            else if (body.size() > content_length || body.size() > config::MAX_BODY_SIZE)
+
+            // Inflate a compressed body as it arrives, so only the decoded bytes are kept
+            auto decoder = make_body_decoder(headers);
+            auto sink = content_length > 0 ? make_body_sink(method, uri, version, headers) : nullptr;
+            std::string body;
+            if (decoder || sink)
             {
-                return http_handled_data(true, "BAD_CONTENT_TOO_LARGE", uri, version, headers, "");
+                std::string error = append_body(body, received, received_size, decoder.get(), sink.get());
+                if (!error.empty())
+                    return http_handled_data(true, error, uri, version, headers, "");
+            }
+            else
+            {
+                body.assign(received, received_size);
+            }
+
+            // Complete request in one go
+            if (received_size == content_length)
+            {
+                auto request_headers = headers;
+                std::string error = finish_body(request_headers, body, decoder.get(), sink.get());
+                if (!error.empty())
+                    return http_handled_data(true, error, uri, version, headers, "");
+                http_handled_data result(true, method, uri, version, request_headers, body);
+                result.sink = std::move(sink);
+                return result;
             }
             else
             {
@@ -255,6 +576,9 @@ namespace hh_http
                 auto &data_ref = under_handling_data[socket_key];
                 data_ref.content_length = content_length;
                 data_ref.body = body;
+                data_ref.body_decoder = decoder;
+                data_ref.sink = sink;
+                data_ref.received_body_bytes = received_size;
                 data_ref.method = method;
                 data_ref.uri = uri;
                 data_ref.version = version;
@@ -267,200 +591,111 @@ namespace hh_http
 
         // Handle chunked encoding body
         http_handled_data handle_chunked_encoding(const std::string &socket_key,
-                                                  std::istringstream &request_stream,
+                                                  buffer_view_stream &request_stream,
                                                   const std::string &method,
                                                   const std::string &uri,
                                                   const std::string &version,
                                                   const std::multimap<std::string, std::string> &headers,
                                                   int FD)
         {
-            std::ostringstream chunked_body_stream;
-            std::string chunk_size_line;
-            bool complete = false;
+            http_data_under_handling state(socket_key, handling_type::CHUNKED);
+            state.body_decoder = make_body_decoder(headers);
+            state.sink = make_body_sink(method, uri, version, headers);
 
             // Process chunks from the initial request
-            while (std::getline(request_stream, chunk_size_line))
+            bool complete = false;
+            std::string error = parse_chunks(state, request_stream.position(), request_stream.remaining(), complete);
+            if (!error.empty())
             {
-                // Remove carriage return from chunk size line
-                if (!chunk_size_line.empty() && chunk_size_line.back() == '\r')
-                {
-                    chunk_size_line.pop_back();
-                }
-
-                // Validate chunk size line is not empty
-                if (chunk_size_line.empty())
-                {
-                    return http_handled_data(true, "BAD_CHUNK_ENCODING", uri, version, headers, "");
-                }
-
-                // Extract the actual size (ignore chunk extensions after semicolon)
-                std::string chunk_size_hex = chunk_size_line;
-                size_t semicolon_pos = chunk_size_hex.find(';');
-                if (semicolon_pos != std::string::npos)
-                {
-                    chunk_size_hex = chunk_size_hex.substr(0, semicolon_pos);
-                }
-
-                // Validate chunk size hex format
-                for (char c : chunk_size_hex)
-                {
-                    if (!isxdigit(c))
-                    {
-                        return http_handled_data(true, "BAD_CHUNK_ENCODING", uri, version, headers, "");
-                    }
-                }
-
-                // Convert hex string to integer
-                std::istringstream hex_stream(chunk_size_hex);
-                unsigned int chunk_size_int = 0;
-                if (!(hex_stream >> std::hex >> chunk_size_int))
-                {
-                    return http_handled_data(true, "BAD_CHUNK_ENCODING", uri, version, headers, "");
-                }
-
-                // Check for end of chunks
-                if (chunk_size_int == 0)
-                {
-                    complete = true;
-                    break;
-                }
-
-                // Prevent unreasonable chunk sizes that could cause memory issues
-                if (chunk_size_int > config::MAX_BODY_SIZE)
-                {
-                    return http_handled_data(true, "BAD_CONTENT_TOO_LARGE", uri, version, headers, "");
-                }
-
-                // Read the exact number of bytes specified by chunk size
-                char *chunk_buffer = new char[chunk_size_int + 2]; // +2 for CRLF
-
-                // Check if we have enough data
-                if (!request_stream.read(chunk_buffer, chunk_size_int + 2))
-                {
-                    delete[] chunk_buffer;
-                    break; // Not enough data, will need to continue later
-                }
-
-                // Validate CRLF after chunk data
-                if (chunk_buffer[chunk_size_int] != '\r' || chunk_buffer[chunk_size_int + 1] != '\n')
-                {
-                    delete[] chunk_buffer;
-                    return http_handled_data(true, "BAD_CHUNK_ENCODING", uri, version, headers, "");
-                }
-
-                // Only add the actual data (without the trailing CRLF)
-                chunked_body_stream.write(chunk_buffer, chunk_size_int);
-
-                delete[] chunk_buffer;
-
-                // Check if we've exceeded max body size
-                if (chunked_body_stream.str().size() > config::MAX_BODY_SIZE)
-                {
-                    return http_handled_data(true, "BAD_CONTENT_TOO_LARGE", uri, version, headers, "");
-                }
+                return http_handled_data(true, error, uri, version, headers, "");
             }
 
             // Request is complete
             if (complete)
             {
-                // After the final "0" chunk, there should be an empty line or trailer headers
-                std::string trailer_line;
-                std::multimap<std::string, std::string> trailer_headers;
-
-                // Process trailer headers if any
-                while (std::getline(request_stream, trailer_line))
-                {
-                    // Remove carriage return
-                    if (!trailer_line.empty() && trailer_line.back() == '\r')
-                    {
-                        trailer_line.pop_back();
-                    }
-
-                    // Empty line indicates end of trailer headers
-                    if (trailer_line.empty())
-                    {
-                        break;
-                    }
-
-                    // Parse trailer header
-                    size_t colon_pos = trailer_line.find(':');
-                    if (colon_pos != std::string::npos)
-                    {
-                        std::string header_name = trailer_line.substr(0, colon_pos);
-                        std::string header_value = trailer_line.substr(colon_pos + 1);
-
-                        // Trim leading whitespace
-                        size_t start = header_value.find_first_not_of(" \t");
-                        if (start != std::string::npos)
-                        {
-                            header_value = header_value.substr(start);
-                        }
-
-                        // Trim trailing whitespace
-                        size_t end = header_value.find_last_not_of(" \t");
-                        if (end != std::string::npos)
-                        {
-                            header_value = header_value.substr(0, end + 1);
-                        }
-
-                        // Add to headers
-                        trailer_headers.emplace(hh_socket::to_upper_case(header_name), header_value);
-                    }
-                    else
-                    {
-                        // Invalid trailer header format
-                        return http_handled_data(true, "BAD_TRAILER_HEADERS", uri, version, headers, "");
-                    }
-                }
-
-                // Merge trailer headers with original headers
-                // std::multimap<std::string, std::string> combined_headers = headers;
-                // for (const auto &trailer : trailer_headers)
-                // {
-                //     combined_headers.insert(trailer);
-                // }
-
-                return http_handled_data(true, method, uri, version, headers, chunked_body_stream.str());
+                auto request_headers = headers;
+                error = finish_body(request_headers, state.body, state.body_decoder.get(), state.sink.get());
+                if (!error.empty())
+                    return http_handled_data(true, error, uri, version, headers, "");
+                http_handled_data result(true, method, uri, version, request_headers, state.body);
+                result.sink = std::move(state.sink);
+                return result;
             }
             else
             {
                 // Need to continue handling in subsequent calls
-                under_handling_data.insert({socket_key, http_data_under_handling(socket_key, handling_type::CHUNKED)});
-                auto &data_ref = under_handling_data[socket_key];
-                data_ref.content_length = 0; // Not relevant for chunked
-                data_ref.body = chunked_body_stream.str();
-                data_ref.method = method;
-                data_ref.uri = uri;
-                data_ref.version = version;
-                data_ref.headers = headers;
-                data_ref.FD = FD;
-
-                data_ref.last_activity = std::chrono::steady_clock::now();
-                return http_handled_data(false, method, uri, version, headers, chunked_body_stream.str());
+                state.content_length = 0; // Not relevant for chunked
+                state.method = method;
+                state.uri = uri;
+                state.version = version;
+                state.headers = headers;
+                state.FD = FD;
+
+                state.last_activity = std::chrono::steady_clock::now();
+                auto &data_ref = under_handling_data.emplace(socket_key, std::move(state)).first->second;
+                return http_handled_data(false, method, uri, version, headers, data_ref.body);
             }
         }
 
         // Continue processing chunked encoding for partial requests
         http_handled_data continue_chunked_handling(http_data_under_handling &data,
-                                                    const hh_socket::data_buffer &message)
+                                                    const char *bytes, std::size_t size)
         {
-            std::istringstream chunked_stream(message.to_string());
-            std::string chunk_size_line;
             bool complete = false;
+            std::string error = parse_chunks(data, bytes, size, complete);
+            if (!error.empty())
+            {
+                return http_handled_data(true, error, data.uri, data.version, data.headers, "");
+            }
 
-            // Process additional chunks
-            while (std::getline(chunked_stream, chunk_size_line))
+            // Request is complete
+            if (complete)
             {
-                // Remove carriage return from chunk size line
-                if (!chunk_size_line.empty() && chunk_size_line.back() == '\r')
+                // just Ignore Trailer Headers for now
+                error = finish_body(data.headers, data.body, data.body_decoder.get(), data.sink.get());
+                if (!error.empty())
                 {
-                    chunk_size_line.pop_back();
+                    return http_handled_data(true, error, data.uri, data.version, data.headers, "");
+                }
+
+                http_handled_data result(true, data.method, data.uri, data.version, data.headers, data.body);
+                result.sink = data.sink;
+                return result;
+            }
+
+            // Still waiting for more data
+            return http_handled_data(false, data.method, data.uri, data.version, {}, "");
+        }
+
+        /**
+         * Parse the chunked body bytes of one read into data. Chunk data goes
+         * to the body (or sink) as soon as it arrives; a chunk cut off by the
+         * end of the read leaves chunk_data_left and chunk_crlf_left owed by
+         * the next one. Only a line cut off by the end of the read (a chunk
+         * size or a trailer) is copied, into partial_chunk, so every byte is
+         * copied at most once. Returns an error kind or "", and sets complete
+         * once the last chunk and the empty line ending its trailers are read.
+         */
+        std::string parse_chunks(http_data_under_handling &data, const char *bytes, std::size_t size, bool &complete)
+        {
+            buffer_view_stream chunked_stream(bytes, size);
+            std::string chunk_size_line;
+            std::string error;
+            complete = false;
+
+            while (!data.chunk_trailers)
+            {
+                // The rest of a chunk an earlier read (or the previous line) started
+                error = take_chunk_rest(data, chunked_stream);
+                if (!error.empty() || !next_chunk_line(data, chunked_stream, chunk_size_line, error))
+                {
+                    return error;
                 }
 
                 // Validate chunk size line is not empty
                 if (chunk_size_line.empty())
                 {
-                    return http_handled_data(true, "BAD_CHUNK_ENCODING", data.uri, data.version, data.headers, "");
+                    return "BAD_CHUNK_ENCODING";
                 }
 
                 // Extract the actual size (ignore chunk extensions after semicolon)
@@ -476,7 +711,7 @@ namespace hh_http
                 {
                     if (!isxdigit(c))
                     {
-                        return http_handled_data(true, "BAD_CHUNK_ENCODING", data.uri, data.version, data.headers, "");
+                        return "BAD_CHUNK_ENCODING";
                     }
                 }
 
@@ -485,136 +720,150 @@ namespace hh_http
                 unsigned int chunk_size_int = 0;
                 if (!(hex_stream >> std::hex >> chunk_size_int))
                 {
-                    return http_handled_data(true, "BAD_CHUNK_ENCODING", data.uri, data.version, data.headers, "");
+                    return "BAD_CHUNK_ENCODING";
                 }
 
                 // Check for end of chunks
                 if (chunk_size_int == 0)
                 {
-                    complete = true;
+                    data.chunk_trailers = true;
                     break;
                 }
 
-                // Prevent unreasonable chunk sizes that could cause memory issues
-                if (chunk_size_int > config::MAX_BODY_SIZE)
+                // Refuse a chunk that would take the body (as received, before decompression) past its limit
+                if (chunk_size_int > config::MAX_BODY_SIZE - data.received_body_bytes)
                 {
-                    return http_handled_data(true, "CONTENT_TOO_LARGE", data.uri, data.version, data.headers, "");
+                    return "BAD_CONTENT_TOO_LARGE";
                 }
 
-                // Read the exact number of bytes specified by chunk size
-                char *chunk_buffer = new char[chunk_size_int + 2]; // +2 for CRLF
+                // The chunk's data and CRLF are owed from here on
+                data.chunk_data_left = chunk_size_int;
+                data.chunk_crlf_left = 2;
+            }
 
-                // Check if we have enough data
-                if (!chunked_stream.read(chunk_buffer, chunk_size_int + 2))
+            // After the final "0" chunk, trailer headers (ignored for now) up to an empty line
+            std::string trailer_line;
+            while (next_chunk_line(data, chunked_stream, trailer_line, error))
+            {
+                if (trailer_line.empty())
                 {
-                    delete[] chunk_buffer;
-                    break; // Not enough data, will need to continue later
+                    complete = true;
+                    break;
                 }
-
-                // Validate CRLF after chunk data
-                if (chunk_buffer[chunk_size_int] != '\r' || chunk_buffer[chunk_size_int + 1] != '\n')
+                if (trailer_line.find(':') == std::string::npos)
                 {
-                    delete[] chunk_buffer;
-                    return http_handled_data(true, "BAD_CHUNK_ENCODING", data.uri, data.version, data.headers, "");
+                    // Invalid trailer header format
+                    return "BAD_TRAILER_HEADERS";
                 }
+            }
+            return error;
+        }
 
-                // Only add the actual data (without the trailing CRLF)
-                data.body.append(chunk_buffer, chunk_size_int);
+        /**
+         * Next line of the chunked framing without its CRLF, joined with the
+         * start of it the previous read ended in. Returns false if this read
+         * ends first (its start is kept in partial_chunk) or the line is longer
+         * than config::MAX_HEADER_SIZE (error is set).
+         */
+        bool next_chunk_line(http_data_under_handling &data, buffer_view_stream &chunked_stream, std::string &line,
+                             std::string &error)
+        {
+            if (chunked_stream.remaining() == 0)
+            {
+                return false;
+            }
+            const char *line_start = chunked_stream.position();
+            const void *newline = std::memchr(line_start, '\n', chunked_stream.remaining());
+            std::size_t line_size = newline ? static_cast<const char *>(newline) - line_start + 1 : chunked_stream.remaining();
+            chunked_stream.read_in_place(line_size);
+            if (data.partial_chunk.size() + line_size > config::MAX_HEADER_SIZE)
+            {
+                error = "BAD_CHUNK_ENCODING";
+                return false;
+            }
+            data.partial_chunk.append(line_start, line_size);
+            if (!newline)
+            {
+                return false;
+            }
 
-                delete[] chunk_buffer;
+            line.swap(data.partial_chunk);
+            data.partial_chunk.clear();
+            line.pop_back();
+            // Remove carriage return from the line
+            if (!line.empty() && line.back() == '\r')
+            {
+                line.pop_back();
+            }
+            return true;
+        }
 
-                if (data.body.size() > config::MAX_BODY_SIZE)
+        // Consume what this read holds of the chunk being received: its data first, then its CRLF
+        std::string take_chunk_rest(http_data_under_handling &data, buffer_view_stream &chunked_stream)
+        {
+            std::size_t take = std::min(chunked_stream.remaining(), data.chunk_data_left);
+            if (take > 0)
+            {
+                // Only add the actual data (without the trailing CRLF), read in place from the receive buffer
+                const char *chunk_buffer = chunked_stream.read_in_place(take);
+                data.chunk_data_left -= take;
+                data.received_body_bytes += take;
+                std::string error = append_body(data.body, chunk_buffer, take, data.body_decoder.get(), data.sink.get());
+                if (!error.empty())
                 {
-                    return http_handled_data(true, "CONTENT_TOO_LARGE", data.uri, data.version, data.headers, "");
+                    return error;
                 }
             }
 
-            // Request is complete
-            if (complete)
+            // Validate CRLF after chunk data, a byte at a time since a read may end between the two
+            while (data.chunk_data_left == 0 && data.chunk_crlf_left > 0 && chunked_stream.remaining() > 0)
             {
-                // After the final "0" chunk, there should be an empty line or trailer headers
-                std::string trailer_line;
-                std::multimap<std::string, std::string> trailer_headers;
-
-                // Process trailer headers if any
-                while (std::getline(chunked_stream, trailer_line))
+                const char *crlf = chunked_stream.read_in_place(1);
+                if (*crlf != "\r\n"[2 - data.chunk_crlf_left])
                 {
-                    // Remove carriage return
-                    if (!trailer_line.empty() && trailer_line.back() == '\r')
-                    {
-                        trailer_line.pop_back();
-                    }
-
-                    // Empty line indicates end of trailer headers
-                    if (trailer_line.empty())
-                    {
-                        break;
-                    }
-
-                    // Parse trailer header
-                    size_t colon_pos = trailer_line.find(':');
-                    if (colon_pos != std::string::npos)
-                    {
-                        std::string header_name = trailer_line.substr(0, colon_pos);
-                        std::string header_value = trailer_line.substr(colon_pos + 1);
-
-                        // Trim leading whitespace
-                        size_t start = header_value.find_first_not_of(" \t");
-                        if (start != std::string::npos)
-                        {
-                            header_value = header_value.substr(start);
-                        }
-
-                        // Trim trailing whitespace
-                        size_t end = header_value.find_last_not_of(" \t");
-                        if (end != std::string::npos)
-                        {
-                            header_value = header_value.substr(0, end + 1);
-                        }
-
-                        // Add to headers
-                        trailer_headers.emplace(hh_socket::to_upper_case(header_name), header_value);
-                    }
-                    else
-                    {
-                        // Invalid trailer header format
-                        return http_handled_data(true, "BAD_TRAILER_HEADERS", data.uri, data.version, data.headers, "");
-                    }
+                    return "BAD_CHUNK_ENCODING";
                 }
-                // just Ignore Trailer Headers for now
-                // Clean up completed data
-                auto return_value = http_handled_data(true, data.method, data.uri, data.version, data.headers, data.body);
-                under_handling_data.erase(data.socket_key);
-                return return_value;
+                --data.chunk_crlf_left;
             }
-
-            return http_handled_data(false, data.method, data.uri, data.version, data.headers, data.body);
+            return "";
         }
 
         // Continue processing content-length for partial requests
         http_handled_data continue_content_length_handling(http_data_under_handling &data,
-                                                           const hh_socket::data_buffer &message)
+                                                           const char *bytes, std::size_t size)
         {
-            // Add new data to existing body
-            std::string body = message.to_string();
-            data.body += body;
+            // Add new data to existing body (limits apply to the bytes as received, before decompression)
+            data.received_body_bytes += size;
 
-            if (data.body.size() > config::MAX_BODY_SIZE)
+            if (data.received_body_bytes > config::MAX_BODY_SIZE)
             {
                 return http_handled_data(true, "BAD_CONTENT_TOO_LARGE", data.uri, data.version, data.headers, "");
             }
-            // Check if we've received all expected data
-            if (data.body.size() == data.content_length)
+
+            // Check for errors: too much data
+            if (data.received_body_bytes > data.content_length)
             {
-                auto return_value = http_handled_data(true, data.method, data.uri, data.version, data.headers, data.body);
-                under_handling_data.erase(data.socket_key);
-                return return_value;
+                return http_handled_data(true, "BAD_CONTENT_TOO_LARGE", data.uri, data.version, data.headers, "");
             }
 
-            // Check for errors: too much data or exceeding size limits
-            if (data.body.size() > data.content_length || data.body.size() > config::MAX_BODY_SIZE)
+            std::string error = append_body(data.body, bytes, size, data.body_decoder.get(), data.sink.get());
+            if (!error.empty())
             {
-                return http_handled_data(true, "BAD_CONTENT_TOO_LARGE", data.uri, data.version, data.headers, "");
+                return http_handled_data(true, error, data.uri, data.version, data.headers, "");
+            }
+
+            // Check if we've received all expected data
+            if (data.received_body_bytes == data.content_length)
+            {
+                error = finish_body(data.headers, data.body, data.body_decoder.get(), data.sink.get());
+                if (!error.empty())
+                {
+                    return http_handled_data(true, error, data.uri, data.version, data.headers, "");
+                }
+
+                http_handled_data result(true, data.method, data.uri, data.version, data.headers, data.body);
+                result.sink = data.sink;
+                return result;
             }
 
             // Still waiting for more data
@@ -3,9 +3,15 @@
 #include "../libs/socket-lib/socket-lib.hpp"
 
 #include "http_consts.hpp"
+#include "http_request_timings.hpp"
+#include "body_sink.hpp"
+#include "url.hpp"
+#include "header_values.hpp"
 
 #include <map>
+#include <memory>
 #include <functional>
+#include <string_view>
 
 namespace hh_http
 {
@@ -38,9 +44,35 @@ namespace hh_http
         /// Request body content
         std::string body;
 
+        /// Where path and query lie in uri, found once by the constructor (offsets survive a move, views would not)
+        std::size_t path_begin = 0, path_size = 0, query_begin = 0, query_size = 0;
+
+        /// get_normalized_path() result, computed on first use
+        mutable std::string normalized_path;
+        mutable bool path_normalized = false;
+
+        /// cookies() result: views into the Cookie values of headers, parsed on first use
+        mutable std::vector<cookie> parsed_cookies;
+        mutable bool cookies_parsed = false;
+
+        /// bearer_token() / basic_auth() results, parsed from the Authorization header on first use
+        mutable std::string_view parsed_bearer;
+        mutable basic_credentials parsed_basic;
+        mutable bool basic_valid = false;
+        mutable bool authorization_parsed = false;
+
+        /// Parse the Authorization header once for bearer_token() and basic_auth()
+        void parse_authorization() const;
+
         /// Function to close the connection when needed (closes the current client only, it shall know what to close)
         std::function<void()> close_connection;
 
+        /// Phase timestamps, shared with the matching http_response
+        std::shared_ptr<request_timings> timings;
+
+        /// Sink the body was streamed into instead of body (null if the body was buffered)
+        std::shared_ptr<hh_http::body_sink> body_sink;
+
         /**
          * @brief Private constructor for internal use by http_server.
          * @param method HTTP method
@@ -49,13 +81,15 @@ namespace hh_http
          * @param headers Request headers
          * @param body Request body
          * @param close_connection Function to close the associated connection
+         * @param timings Phase timestamps shared with the response (created empty if null)
          *
          * This constructor is private and can only be called by the http_server
          * class to ensure proper request object creation and lifecycle management.
          */
         http_request(const std::string &method, const std::string &uri, const std::string &version,
                      const std::multimap<std::string, std::string> &headers,
-                     const std::string &body, std::function<void()> close_connection);
+                     const std::string &body, std::function<void()> close_connection,
+                     std::shared_ptr<request_timings> timings = nullptr);
 
     public:
         // Copy operations - DELETED for resource safety
@@ -117,6 +151,32 @@ namespace hh_http
          */
         std::string get_uri() const;
 
+        /**
+         * @brief Get the path of the request URI, without query and fragment (still percent-encoded).
+         * @note The view refers to this request; it is invalidated when the request is moved or destroyed
+         */
+        std::string_view get_path() const;
+
+        /**
+         * @brief Get the query string of the request URI, without the '?' (empty if none).
+         * @note The view refers to this request; it is invalidated when the request is moved or destroyed
+         */
+        std::string_view get_query() const;
+
+        /**
+         * @brief Get the query parameters, parsed lazily without allocating (see url::query_view).
+         * @note The view refers to this request; it is invalidated when the request is moved or destroyed
+         */
+        url::query_view get_query_params() const;
+
+        /**
+         * @brief Get the decoded path with dot segments removed, for routing and cache keys.
+         * @return The normalized path (see url::normalize_path(), with config::ENCODED_SLASH_POLICY),
+         *         or "" if the path is malformed or rejected
+         * @note Computed on first call and cached; not safe to call from two threads at once
+         */
+        const std::string &get_normalized_path() const;
+
         /**
          * @brief Get the HTTP version.
          */
@@ -132,11 +192,57 @@ namespace hh_http
          */
         std::vector<std::pair<std::string, std::string>> get_headers() const;
 
+        /**
+         * @brief Get the cookies of all Cookie headers, in order.
+         * @note Parsed on first call and cached; the views refer to this request's headers and
+         *       stay valid while the request (or the request it is moved into) lives
+         */
+        const std::vector<cookie> &cookies() const;
+
+        /**
+         * @brief Get the first cookie with this name.
+         * @return The cookie, or null if there is none
+         */
+        const cookie *find_cookie(std::string_view name) const;
+
+        /**
+         * @brief Get the token of an "Authorization: Bearer" header.
+         * @return A view into the header (see cookies() for its lifetime), or empty if there is none
+         */
+        std::string_view bearer_token() const;
+
+        /**
+         * @brief Get the user and password of an "Authorization: Basic" header.
+         * @return The decoded credentials, or null if there are none or they are malformed
+         * @note Parsed on first call and cached, like bearer_token(); not safe to call from two threads at once
+         */
+        const basic_credentials *basic_auth() const;
+
         /**
          * @brief Get the request body.
          */
         std::string get_body() const;
 
+        /**
+         * @brief Get the sink the body was streamed into (see http_server::set_body_sink_callback()).
+         * @return The sink, e.g. a multipart_parser (std::dynamic_pointer_cast it), or null if the body is in get_body()
+         */
+        std::shared_ptr<hh_http::body_sink> get_body_sink() const;
+
+        /**
+         * @brief Get the phase timestamps recorded so far for this request.
+         */
+        const request_timings &get_timings() const;
+
+        /**
+         * @brief Record that the handler started working on this request.
+         *
+         * The server sets handler_start to the dispatch time. Handlers that hand
+         * the request to another thread (e.g. a thread_pool) should call this
+         * when the worker picks it up, so queue time is reported separately.
+         */
+        void mark_handler_start();
+
         /// Default destructor
         ~http_request() = default;
     };
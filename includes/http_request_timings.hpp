@@ -0,0 +1,55 @@
+#pragma once
+
+#include <chrono>
+namespace hh_http
+{
+    /**
+     * @brief Monotonic timestamps of the phases a request goes through.
+     *
+     * Filled in by http_message_handler (reading), http_server (dispatch) and
+     * http_response (sending). A phase that did not happen (e.g. no response
+     * was sent) keeps a default-constructed time_point; use recorded() to
+     * check before computing a duration.
+     */
+    struct request_timings
+    {
+        using clock = std::chrono::steady_clock;
+
+        clock::time_point first_byte;       ///< First read of the request was received
+        clock::time_point headers_complete; ///< Request line and headers were parsed
+        clock::time_point body_complete;    ///< The whole body was received
+        clock::time_point dispatch;         ///< Server handed the request to on_request_received()
+        clock::time_point handler_start;    ///< Handler started working (defaults to dispatch, see http_request::mark_handler_start())
+        clock::time_point response_send;    ///< http_response::send() was called
+        clock::time_point write_complete;   ///< The socket layer accepted the serialized response
+
+        /// true if the time point has been set
+        static bool recorded(const clock::time_point &point)
+        {
+            return point != clock::time_point();
+        }
+
+        /// Duration between two recorded points, zero if either is missing
+        static std::chrono::nanoseconds between(const clock::time_point &from, const clock::time_point &to)
+        {
+            if (!recorded(from) || !recorded(to) || to < from)
+                return std::chrono::nanoseconds(0);
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(to - from);
+        }
+
+        /// Time spent waiting for the body after the headers were parsed
+        std::chrono::nanoseconds body_wait() const { return between(headers_complete, body_complete); }
+
+        /// Time between dispatch and the handler starting (e.g. waiting in a thread_pool)
+        std::chrono::nanoseconds queue_wait() const { return between(dispatch, handler_start); }
+
+        /// Time the handler took to produce the response
+        std::chrono::nanoseconds handler_time() const { return between(handler_start, response_send); }
+
+        /// Time spent handing the response to the socket layer
+        std::chrono::nanoseconds write_time() const { return between(response_send, write_complete); }
+
+        /// First byte received to response written
+        std::chrono::nanoseconds total() const { return between(first_byte, write_complete); }
+    };
+}
@@ -2,7 +2,14 @@
 
 #include "../libs/socket-lib/socket-lib.hpp"
 #include "http_consts.hpp"
+#include "http_request_timings.hpp"
+#include "compression.hpp"
+#include "outbound_queue.hpp"
+#include "event_stream.hpp"
+#include "http2.hpp"
+#include <atomic>
 #include <map>
+#include <memory>
 #include <functional>
 namespace hh_http
 {
@@ -49,6 +56,69 @@ namespace hh_http
 
         /// Function to send a message to the client
         std::function<void(const std::string &)> send_message;
+
+        /// Phase timestamps, shared with the matching http_request
+        std::shared_ptr<request_timings> timings;
+
+        /// Invoked once, after the first successful send(), to report the completed request
+        std::function<void(const http_response &)> on_completed;
+
+        /// Accept-Encoding of the request, used to negotiate response compression
+        std::string accept_encoding;
+
+        /// Compressor of a chunked response, created by the first send_chunk()
+        std::unique_ptr<compression::compressor> chunk_compressor;
+
+        /// true once send_chunk() has sent the status line and headers
+        bool chunked_headers_sent = false;
+
+        /// Body bytes sent so far (after compression)
+        std::size_t body_bytes_sent = 0;
+
+        /// Outbound queue of the connection; null when the backend reports none (epoll)
+        std::shared_ptr<outbound_queue> outbound;
+
+        /// Set by http_server while it shuts down; responses sent from then on carry "Connection: close"
+        std::shared_ptr<const std::atomic<bool>> closing;
+
+        /// Held for as long as the response exists, so http_server::shutdown() can wait for in-flight handlers
+        std::shared_ptr<void> in_flight;
+
+        /// Corks (true) or uncorks the client's socket around a streamed response (socket_profile::cork_streams); null = no corking
+        std::function<void(bool)> cork;
+
+        /// Creates the event_stream of this connection, set by http_server
+        std::function<std::shared_ptr<event_stream>()> open_event_stream;
+
+        /// HTTP/2 connection this response is framed onto, as stream http2_stream_id; null for HTTP/1.1
+        std::shared_ptr<http2_connection> http2;
+        std::uint32_t http2_stream_id = 0;
+
+        /// Resets the HTTP/2 stream if the response is dropped without being completed
+        std::shared_ptr<void> http2_stream_guard;
+
+        /// Send status and headers (plus Date) as the HEADERS of the HTTP/2 stream
+        void send_http2_head(bool end_stream);
+
+        /**
+         * @brief Coding to apply to this response's body.
+         * @return IDENTITY if compression is disabled, the client does not
+         *         accept it, the status has no body, the Content-Type is not
+         *         in the allowlist, or a Content-Encoding is already set
+         */
+        compression::coding choose_coding() const;
+
+        /// Replace all values of a header with a single value
+        void replace_header(const std::string &name, const std::string &value);
+
+        /// Add "Accept-Encoding" to Vary unless it is already listed
+        void add_vary_accept_encoding();
+
+        /// Status line and headers, including the terminating empty line
+        std::string head_to_string() const;
+
+        /// Call on_completed once
+        void report_completed();
         /**
          * @brief Validate the response before sending.
          * @return true if response is valid, false otherwise
@@ -63,13 +133,18 @@ namespace hh_http
          * @param version HTTP version
          * @param headers Initial headers
          * @param close_connection Function to close the associated connection
+         * @param send_message Function to send a message to the client
+         * @param timings Phase timestamps shared with the request (optional)
+         * @param on_completed Called once after the response was handed to the socket layer (optional)
          *
          * This constructor is private and can only be called by the http_server
          * class to ensure proper response object creation and lifecycle management.
          */
         http_response(const std::string &version, const std::multimap<std::string, std::string> &headers,
                       std::function<void()> close_connection,
-                      std::function<void(const std::string &)> send_message);
+                      std::function<void(const std::string &)> send_message,
+                      std::shared_ptr<request_timings> timings = nullptr,
+                      std::function<void(const http_response &)> on_completed = nullptr);
 
     public:
         /// Allow http_server to access private constructor
@@ -120,6 +195,18 @@ namespace hh_http
          */
         void set_body(const std::string &body);
 
+        /**
+         * @brief Use a static file as the body.
+         * @param path File to send
+         * @return false if the file cannot be read
+         *
+         * If the client accepts gzip and an up-to-date "path.gz" exists, that
+         * file is sent instead with "Content-Encoding: gzip", so common assets
+         * need no compression work per request. Sets Content-Length; the
+         * caller still sets Content-Type.
+         */
+        bool set_body_from_file(const std::string &path);
+
         /**
          * @brief Set the HTTP status code and message.
          */
@@ -189,9 +276,71 @@ namespace hh_http
          *
          * This function sends the constructed HTTP response back to the client
          * over the established socket connection.
+         *
+         * Bodies of at least config::COMPRESSION_MIN_SIZE bytes with a
+         * compressible Content-Type are compressed with gzip or deflate when
+         * the request's Accept-Encoding allows it; Content-Encoding, Vary and
+         * an existing Content-Length are updated to match.
          */
         void send();
 
+        /**
+         * @brief Stream part of the body using chunked transfer encoding.
+         * @param data Body bytes; empty data sends nothing
+         *
+         * The first call sends the status line and headers with
+         * "Transfer-Encoding: chunked" (any Content-Length is dropped). If the
+         * response is compressed, each call flushes the compressor so the
+         * client can decode every chunk as it arrives.
+         */
+        void send_chunk(const std::string &data);
+
+        /**
+         * @brief Finish a chunked response.
+         *
+         * Sends the remaining compressed bytes, the last (zero-size) chunk and
+         * the trailers added with add_trailer().
+         */
+        void send_last_chunk();
+
+        /**
+         * @brief Turn this response into a Server-Sent Events stream.
+         * @return The stream, to send events on after the handler returned (e.g. subscribe it to an event_channel)
+         * @throws std::runtime_error if the response is not attached to a server connection
+         *
+         * Sends the head with Content-Type: text/event-stream and Cache-Control:
+         * no-cache, without a length and without compression; the stream ends
+         * when the connection closes. Do not call end() afterwards, close the
+         * stream instead. Counts as the response being sent (completion hook,
+         * access log).
+         */
+        std::shared_ptr<event_stream> start_event_stream();
+
+        /**
+         * @brief Bytes sent on this connection that the client has not read yet.
+         * @return 0 when the backend does not track its queue (epoll)
+         */
+        std::size_t get_queued_bytes() const;
+
+        /**
+         * @brief Whether more data can be sent without piling up memory.
+         *
+         * false once config::OUTBOUND_HIGH_WATERMARK bytes are queued for
+         * the connection, until it has drained to OUTBOUND_LOW_WATERMARK.
+         * Always true on the epoll backend.
+         */
+        bool is_writable() const;
+
+        /**
+         * @brief Call callback once the connection is writable.
+         *
+         * Streaming handlers send a chunk, and if is_writable() turned false
+         * continue from here instead of sending more. Runs immediately when
+         * the connection is writable, otherwise on the event loop thread once
+         * the queue has drained; never runs if the connection closes first.
+         */
+        void on_writable(std::function<void()> callback);
+
         /**
          * @brief Clear all values for a specific header.
          * @param name Header name
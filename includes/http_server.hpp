@@ -6,11 +6,39 @@
 #include "http_request.hpp"
 #include "http_response.hpp"
 #include "http_consts.hpp"
-
+#include "metrics.hpp"
+#include "access_log.hpp"
+#include "uring_server.hpp"
+#include "memory_budget.hpp"
+#include "websocket.hpp"
+#include "middleware.hpp"
+#include "rate_limiter.hpp"
+#include "remote_address.hpp"
+#include "socket_profile.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <unordered_map>
 
 namespace hh_http
 {
+    /// Event loop that performs the socket I/O of an http_server
+    enum class io_backend
+    {
+        EPOLL,   ///< hh_socket::epoll_server (default)
+        IO_URING ///< uring_server; falls back to EPOLL when the kernel does not support it
+    };
+
+    /// Listening socket received from a previous process with listener_handoff::take()
+    struct inherited_listener
+    {
+        int fd;
+    };
+
     /**
      * @brief High-level HTTP/1.1 server built on top of TCP server infrastructure.
      *
@@ -26,7 +54,10 @@ namespace hh_http
      *
      * 2-   Extend the http_server and override virtual methods to customize behavior.
      *
-     * @note Currently implements HTTP/1.1 with "Connection: close" semantics
+     * @note Implements HTTP/1.1 with "Connection: close" semantics for plain requests
+     * @note Speaks HTTP/2 over cleartext TCP (prior knowledge or "Upgrade: h2c") when config::ENABLE_HTTP2 is set
+     * @note Connections can switch to WebSocket, see set_websocket_callback()
+     * @note Responses can stay open as Server-Sent Events streams, see http_response::start_event_stream()
      * @note Supports GET, POST, and other HTTP methods through generic parsing
      * @note Thread-safe through underlying tcp_server implementation
      * @note Move-only design prevents accidental copying of server resources
@@ -69,6 +100,237 @@ namespace hh_http
                            const std::string &, const std::string &, const std::string &, const std::string &)>
             headers_received_callback;
 
+        /// Callback triggered after a response was sent, with the request's phase timings
+        std::function<void(const request_timings &)> request_completed_callback;
+
+        /// Callback choosing a body_sink for request bodies (null = bodies are buffered)
+        std::function<std::shared_ptr<body_sink>(http_request &)> body_sink_callback;
+
+        /// Middlewares every request passes before on_request_received()
+        middleware_chain middlewares;
+
+        /// Callback deciding whether a client sending "Expect: 100-continue" may send its body
+        std::function<bool(http_request &, http_response &)> continue_callback;
+
+        /// Callback receiving connections upgraded to WebSocket (null = upgrades are not accepted)
+        std::function<void(http_request &, std::shared_ptr<websocket_connection>)> websocket_callback;
+
+        /// TCP options applied to every client connection
+        socket_profile profile;
+
+        /// Request, per-route and new-connection token buckets per client IP (null / empty = unlimited)
+        std::unique_ptr<rate_limiter> request_limiter;
+        std::unordered_map<std::string, std::unique_ptr<rate_limiter>> route_limiters;
+        std::unique_ptr<rate_limiter> connection_limiter;
+
+        /// Path served with the Prometheus metrics text (empty = not mounted)
+        std::string metrics_path;
+
+        /// Access log that completed requests are written to (null = disabled)
+        std::shared_ptr<access_log> access_logger;
+
+        /// io_uring event loop; null when the epoll backend is used
+        std::unique_ptr<uring_server> uring;
+
+        /// Remote address of each io_uring client (event loop thread only)
+        std::unordered_map<uring_server::client_handle, std::string> uring_remotes;
+
+        /// memory_budget listener that pauses the io_uring loop (registered only with that backend)
+        std::size_t budget_listener = 0;
+
+        /// How long the destructor waits for responses still held by the application when shutdown() was not called
+        static constexpr std::chrono::seconds RESPONSE_DETACH_TIMEOUT{1};
+
+        /// Shutdown progress, shared with the response objects (which may outlive the server)
+        struct drain_state
+        {
+            std::atomic<bool> draining{false};
+            std::atomic<std::size_t> in_flight{0}; ///< Response objects still alive
+            std::atomic<bool> detached{false};     ///< The server is gone: responses it left behind no longer call it
+            std::atomic<std::size_t> calls{0};     ///< Response callbacks into the server running now
+            std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max(); ///< Of shutdown(), under mutex
+            std::mutex mutex;
+            std::condition_variable idle;
+
+            /// Run fn unless the server is gone; false if it was not run
+            template <typename Fn>
+            bool call(Fn &&fn)
+            {
+                // Counted before detached is read, so ~http_server either sees this call or this call sees it
+                struct running
+                {
+                    drain_state &state;
+                    ~running()
+                    {
+                        if (state.calls.fetch_sub(1) == 1 && state.detached.load())
+                        {
+                            std::lock_guard<std::mutex> lock(state.mutex);
+                            state.idle.notify_all();
+                        }
+                    }
+                };
+                calls.fetch_add(1);
+                running guard{*this};
+                if (detached.load())
+                    return false;
+                fn();
+                return true;
+            }
+        };
+        std::shared_ptr<drain_state> drain = std::make_shared<drain_state>();
+
+        /// Upgraded connections by client key; their bytes bypass the HTTP parser
+        std::unordered_map<std::string, std::shared_ptr<websocket_connection>> websockets;
+        std::mutex websockets_mutex;
+        std::atomic<std::size_t> websocket_count{0}; ///< Lets the HTTP path skip the lookup when there are none
+
+        /// HTTP/2 connections by client key; their bytes go to the frame parser
+        std::unordered_map<std::string, std::shared_ptr<http2_connection>> http2_connections;
+        std::mutex http2_mutex;
+        std::atomic<std::size_t> http2_count{0}; ///< Lets the HTTP/1.1 path skip the lookup when there are none
+
+        /// A connection that has not sent anything yet; kept by handle, not fd, since its fd may be reused once it closes
+        struct awaiting_connection
+        {
+            std::shared_ptr<hh_socket::connection> conn; ///< epoll backend
+            uring_server::client_handle handle = 0;      ///< io_uring backend (fd and generation)
+            std::chrono::steady_clock::time_point accepted;
+        };
+
+        /// Connections waiting for their first request by client key, and their number per IP
+        std::unordered_map<std::string, awaiting_connection> awaiting_requests;
+        std::unordered_map<std::string, std::size_t> awaiting_per_ip;
+        std::mutex awaiting_mutex;
+        std::atomic<std::size_t> awaiting_count{0}; ///< Lets the read path skip the lookup when there are none
+
+        /// Open event streams by client key, so they learn when their client goes away
+        std::unordered_map<std::string, std::weak_ptr<event_stream>> event_streams;
+        std::mutex event_streams_mutex;
+
+        /// Idle connection sweeper, stopped and joined by the destructor
+        std::thread sweeper;
+        std::mutex sweeper_mutex;
+        std::condition_variable sweeper_wakeup;
+        bool sweeper_stopping = false;
+
+        /// I/O entry points of one client, independent of the backend
+        struct client_io
+        {
+            std::shared_ptr<hh_socket::connection> conn; ///< null on the io_uring backend
+            std::string key;                             ///< remote address, keys the parser state
+            int fd = -1;
+            std::function<void(const std::string &)> send;
+            std::function<void(std::shared_ptr<const std::string>)> send_shared; ///< Queues a buffer shared with other clients
+            std::function<void()> close;
+            std::function<void()> stop_reading;
+            std::function<void(bool)> cork; ///< Sets or clears TCP_CORK, after the bytes queued before it
+            std::shared_ptr<outbound_queue> outbound; ///< null on the epoll backend, which reports no queue size
+        };
+
+        client_io make_client_io(std::shared_ptr<hh_socket::connection> conn);
+        client_io make_client_io(uring_server::client_handle client, const std::string &remote);
+        uring_server::handlers make_uring_callbacks();
+
+        /// Run on the given io_uring loop and pause it while memory_budget is exhausted
+        void use_uring(std::unique_ptr<uring_server> loop);
+
+        /// Start the idle connection sweeper thread
+        void start_sweeper();
+
+        /// Close a client by fd on whichever backend is active
+        void close_client_fd(int fd);
+
+        /// Send the 101 response and route the client's further bytes to a websocket_connection
+        void upgrade_to_websocket(const client_io &client, http_request &request, const std::string &key);
+
+        /**
+         * @brief Switch a client to HTTP/2 and register it.
+         * @param upgrade_settings HTTP2-Settings of an h2c upgrade request, null for prior knowledge
+         */
+        std::shared_ptr<http2_connection> open_http2(const client_io &client, const std::string *upgrade_settings);
+
+        /// Send the 101 response to an h2c upgrade and answer the request on stream 1
+        void upgrade_to_http2(const client_io &client, http2_connection::stream_request &request);
+
+        /// HTTP/2 connection of a client, null if it speaks HTTP/1.1
+        std::shared_ptr<http2_connection> find_http2(const std::string &key);
+
+        /// Run a complete HTTP/2 stream through the request handler, with a response framed onto the stream
+        void dispatch_http2_stream(const client_io &client, const std::shared_ptr<http2_connection> &connection,
+                                   http2_connection::stream_request &stream);
+
+        /// WebSocket of a client, null if it was not upgraded
+        std::shared_ptr<websocket_connection> find_websocket(const std::string &key);
+
+        /// Forget the partial request, WebSocket, HTTP/2 connection or event stream of a client whose TCP connection closed
+        void client_closed(const std::string &key);
+
+        /// Create and register the event_stream of a client (http_response::start_event_stream())
+        std::shared_ptr<event_stream> open_event_stream(const client_io &client);
+
+        /// Send a close frame to every WebSocket, GOAWAY to every HTTP/2 client and close every event stream (shutdown)
+        void close_long_lived_connections(std::uint16_t code);
+
+        /// Drop WebSockets whose close frame went unanswered
+        void close_unanswered_websockets();
+
+        /**
+         * @brief Start the MAX_HEADER_READ_TIME clock of a new connection.
+         * @return false (and counted) if its IP already has MAX_PARTIAL_REQUESTS_PER_IP connections waiting
+         */
+        bool await_first_request(const std::string &key, std::shared_ptr<hh_socket::connection> conn,
+                                 uring_server::client_handle handle);
+
+        /// The client sent its first bytes, or closed: stop its clock
+        void first_request_arrived(const std::string &key);
+
+        /// Close connections past MAX_HEADER_READ_TIME and requests whose body arrives slower than MIN_BODY_RATE
+        void close_slow_clients();
+
+        /// Hand a new response the client's outbound queue and the shutdown state
+        void attach_response(const client_io &client, http_response &response);
+
+        /**
+         * @brief Parse bytes from a client and dispatch complete requests.
+         * @param data Received bytes, parsed in place and not retained
+         * @note Shared by both backends; on_message_received() forwards here
+         */
+        void handle_message(const client_io &client, const char *data, std::size_t size);
+
+        /// Let the parser ask on_request_body() for a sink whenever headers announce a body
+        void route_request_bodies();
+
+        /**
+         * @brief Answer a request that waits for "100 Continue": the go-ahead, or a final response and close.
+         * @note The request's parse state stays in the handler when accepted, and is discarded when rejected
+         */
+        void answer_expectation(const client_io &client, http_request &request,
+                                std::function<void(const std::string &)> send_message);
+
+        /**
+         * @brief Build the hook that reports a request once its response was sent.
+         * @note Calls on_request_completed() and, if an access log is attached, logs the request
+         */
+        std::function<void(const http_response &)> make_completion_hook(const std::string &remote,
+                                                                        const http_request &request,
+                                                                        std::shared_ptr<request_timings> timings);
+
+        /**
+         * @brief Hand a complete request to on_request_received(), or answer it directly
+         *        if it targets the mounted metrics endpoint.
+         * @note Records the request count and HANDLER phase latency
+         */
+        void dispatch_request(const std::string &remote, http_request &request, http_response &response);
+
+        /// Answer 429 if the client's request or route bucket is empty; true if the request was answered
+        bool reject_rate_limited(const std::string &remote, http_request &request, http_response &response);
+
+        /// false (and counted) if the client opens connections faster than the connection limit allows
+        bool admit_connection(const std::string &remote);
+
+        /// Run the middlewares, then on_request_received() unless one of them answered the request
+        void run_handler(http_request &request, http_response &response);
+
     protected:
         /**
          * @brief Parse HTTP request and invoke user callback.
@@ -130,6 +392,14 @@ namespace hh_http
          */
         virtual void on_request_received(http_request &request, http_response &response);
 
+        /**
+         * @brief Handle a connection that switched to the WebSocket protocol.
+         * @param request The upgrade request (path, headers, cookies)
+         * @param connection The WebSocket; register its callbacks here, before returning
+         * @note Runs on the event loop thread; calls the user-provided websocket callback
+         */
+        virtual void on_websocket_opened(http_request &request, std::shared_ptr<websocket_connection> connection);
+
         /**
          * @brief Handle HTTP headers received from the client.
          * @note this function is called when HTTP headers are received, it can be used to process headers before the body is received
@@ -153,15 +423,58 @@ namespace hh_http
             }
         };
 
+        /**
+         * @brief Choose where the body of a request goes, once its headers are parsed.
+         * @param request Request line and headers; the body is not read yet
+         * @return A sink that takes the body as it arrives, or null to buffer it in the request
+         * @note Called on the event loop thread for every request with a body, under the parser lock
+         * @note Calls the user-provided body sink callback if set
+         */
+        virtual std::shared_ptr<body_sink> on_request_body(http_request &request);
+
+        /**
+         * @brief Decide whether a client waiting with "Expect: 100-continue" may send its body.
+         * @param request Request line and headers; the body is not read yet
+         * @param response Rejection to send; its status is preset to 417 Expectation Failed
+         * @return true to answer "100 Continue" and read the body, false to send response and close the connection
+         * @note Called on the event loop thread before any body byte is read, on both backends
+         * @note Rejects a Content-Length over config::MAX_BODY_SIZE with 413, otherwise
+         *       calls the user-provided continue callback if set, and accepts without one
+         */
+        virtual bool on_continue_expected(http_request &request, http_response &response);
+
+        /**
+         * @brief Handle a request whose response has been sent.
+         * @param timings Monotonic timestamps of every phase of the request
+         * @note Called once per request, after the first http_response::send() returns,
+         *       on the thread that called send()
+         * @note Calls user-provided request completed callback if set
+         */
+        virtual void on_request_completed(const request_timings &timings);
+
     public:
         /**
          * @brief Construct HTTP server bound to specified socket address.
          * @param addr Socket address (IP and port) to bind server to
          * @param timeout_milliseconds Timeout duration in milliseconds for epoll calls
+         * @param backend Event loop to use; IO_URING falls back to EPOLL if unsupported
          * @throws socket_exception for socket creation, binding, or listening errors
          * @note Inherits all TCP server functionality and error handling
+         * @note On the io_uring backend, hooks that take an hh_socket::connection
+         *       (connected/disconnected/headers received) are not called
          */
-        explicit http_server(const hh_socket::socket_address &addr, int timeout_milliseconds = epoll_config::TIMEOUT_MILLISECONDS);
+        explicit http_server(const hh_socket::socket_address &addr, int timeout_milliseconds = epoll_config::TIMEOUT_MILLISECONDS,
+                             io_backend backend = io_backend::EPOLL);
+
+        /**
+         * @brief Construct HTTP server on a listening socket handed over by a previous process.
+         * @param listener Socket returned by listener_handoff::take(); the server takes ownership
+         * @param timeout_milliseconds Timeout duration in milliseconds for event loop waits
+         * @param backend Must be IO_URING: the socket library cannot adopt an existing fd
+         * @throws std::runtime_error if io_uring is unavailable or the fd is not a listening socket
+         */
+        http_server(inherited_listener listener, int timeout_milliseconds = epoll_config::TIMEOUT_MILLISECONDS,
+                    io_backend backend = io_backend::IO_URING);
 
         /**
          * @brief Construct HTTP server with IP address and port.
@@ -171,10 +484,21 @@ namespace hh_http
          * @note Convenience constructor that creates socket_address internally
          * @note Defaults to IPv4 address family
          */
-        explicit http_server(int port, const std::string &ip = "0.0.0.0", int timeout_milliseconds = epoll_config::TIMEOUT_MILLISECONDS)
-            : http_server(hh_socket::socket_address(hh_socket::port(port), hh_socket::ip_address(ip), hh_socket::family(hh_socket::IPV4)), timeout_milliseconds) {}
+        explicit http_server(int port, const std::string &ip = "0.0.0.0", int timeout_milliseconds = epoll_config::TIMEOUT_MILLISECONDS,
+                             io_backend backend = io_backend::EPOLL)
+            : http_server(hh_socket::socket_address(hh_socket::port(port), hh_socket::ip_address(ip), hh_socket::family(hh_socket::IPV4)),
+                          timeout_milliseconds, backend) {}
 
         // Copy and move operations - DELETED for resource safety
+
+        /**
+         * @brief Waits for the http_responses handed out, detaches those still alive, then stops the idle sweeper.
+         * @note Waits until the shutdown() deadline, or RESPONSE_DETACH_TIMEOUT without one. A response
+         *       kept after that (long poll, queued task) stays valid but sends and closes nothing.
+         *       Stop the event loop first (stop_server() or shutdown())
+         */
+        ~http_server() override;
+
         http_server(const http_server &) = delete;
         http_server &operator=(const http_server &) = delete;
         http_server(http_server &&) = delete;
@@ -239,6 +563,14 @@ namespace hh_http
          */
         void set_waiting_for_activity_callback(std::function<void()> callback);
 
+        /**
+         * @brief Set callback for completed requests.
+         * @param callback Function receiving the phase timings of each request after its response was sent
+         * @note Optional callback - can be nullptr
+         * @note Useful for latency breakdowns (body wait, queue, handler, write)
+         */
+        void set_request_completed_callback(std::function<void(const request_timings &)> callback);
+
         /**
          * @brief Set the headers received callback object
          *
@@ -253,13 +585,173 @@ namespace hh_http
             headers_received_callback = (callback);
         }
 
+        /**
+         * @brief Stream request bodies into a sink instead of buffering them.
+         * @param callback Receives the request (headers only) of every request with a body; returns
+         *        a sink (e.g. a multipart_parser) or nullptr to buffer the body as usual
+         * @note The handler finds the sink in http_request::get_body_sink(); get_body() is empty.
+         *       A sink that refuses the body makes the request arrive as BAD_BODY_REJECTED
+         * @note config::MAX_BODY_SIZE still limits the body; only the memory it takes goes away
+         */
+        void set_body_sink_callback(std::function<std::shared_ptr<body_sink>(http_request &)> callback)
+        {
+            body_sink_callback = callback;
+        }
+
+        /**
+         * @brief Add a middleware that runs before the request callback.
+         * @param middleware Callable bool(http_request &, http_response &): true passes the request on,
+         *        false stops the chain once the middleware answered the request itself
+         * @note Middlewares run in the order they were added, on every request (error-coded ones
+         *       included) except those for the metrics endpoint. Add them before listen()
+         * @note Pass a middleware_stack (compose()) to inline a fixed group of middlewares into one entry
+         */
+        template <typename Middleware>
+        void use(Middleware middleware)
+        {
+            middlewares.add(std::move(middleware));
+        }
+
+        /**
+         * @brief Set the callback deciding on "Expect: 100-continue" requests before their body is sent.
+         * @param callback Receives the request (headers only) and a response to fill for a rejection;
+         *        returns true to let the client send its body
+         * @note Return false after setting e.g. 401 or 413 on the response (preset: 417); the server
+         *       sends it with Connection: close and closes the connection without reading the body
+         * @note Requests over config::MAX_BODY_SIZE are rejected with 413 before the callback runs
+         */
+        void set_continue_callback(std::function<bool(http_request &, http_response &)> callback)
+        {
+            continue_callback = callback;
+        }
+
+        /**
+         * @brief Write an access log entry for every request whose response is sent.
+         * @param logger Shared access_log (e.g. std::make_shared<access_log>("access.log")); nullptr disables logging
+         * @note Logging only copies a fixed-size record into a per-thread ring buffer;
+         *       formatting and file I/O happen on the access_log's background thread
+         */
+        void set_access_log(std::shared_ptr<access_log> logger);
+
+        /**
+         * @brief Serve the built-in metrics in Prometheus text format.
+         * @param path Request path to answer (e.g. "/metrics"); empty string unmounts the endpoint
+         * @note GET requests for this path are answered by the server and never reach on_request_received()
+         * @note Metrics are recorded regardless of the endpoint, see config::ENABLE_METRICS
+         */
+        void set_metrics_endpoint(const std::string &path)
+        {
+            metrics_path = path;
+        }
+
+        /**
+         * @brief Accept WebSocket upgrades.
+         * @param callback Function receiving the upgrade request and the new connection
+         * @note Without a callback, upgrade requests reach the request callback like any other request
+         * @note The handshake answers with 101 before the callback runs; reject a client with
+         *       connection->close(websocket_close::POLICY_VIOLATION)
+         * @note No subprotocol or extension (e.g. permessage-deflate) is negotiated
+         */
+        void set_websocket_callback(std::function<void(http_request &, std::shared_ptr<websocket_connection>)> callback)
+        {
+            websocket_callback = callback;
+        }
+
+        /**
+         * @brief Limit the requests of each client IP.
+         * @param limit Sustained requests per second and burst; per_second = 0 removes the limit
+         * @note Requests over the limit are answered with 429 and Retry-After before middlewares and
+         *       handlers run. Call before listen()
+         */
+        void set_request_rate_limit(const rate_limit &limit)
+        {
+            request_limiter = limit.per_second > 0 ? std::make_unique<rate_limiter>(limit, config::RATE_LIMIT_TABLE_SLOTS) : nullptr;
+        }
+
+        /**
+         * @brief Limit the requests of each client IP to one path, on top of the request limit.
+         * @param path Normalized path (http_request::get_normalized_path()) the limit applies to
+         * @param limit per_second = 0 removes the limit for this path
+         * @note Call before listen()
+         */
+        void set_route_rate_limit(const std::string &path, const rate_limit &limit)
+        {
+            if (limit.per_second > 0)
+                route_limiters[path] = std::make_unique<rate_limiter>(limit, config::RATE_LIMIT_TABLE_SLOTS);
+            else
+                route_limiters.erase(path);
+        }
+
+        /**
+         * @brief Limit how fast each client IP may open connections.
+         * @param limit per_second = 0 removes the limit
+         * @note Connections over the limit are closed as soon as they are accepted. Call before listen()
+         */
+        void set_connection_rate_limit(const rate_limit &limit)
+        {
+            connection_limiter = limit.per_second > 0 ? std::make_unique<rate_limiter>(limit, config::RATE_LIMIT_TABLE_SLOTS) : nullptr;
+        }
+
+        /**
+         * @brief Set the TCP options applied to client connections.
+         * @param profile e.g. socket_profile::latency() or socket_profile::throughput()
+         * @note Call before listen(); connections accepted earlier keep their options
+         */
+        void set_socket_profile(const socket_profile &profile)
+        {
+            this->profile = profile;
+        }
+
+        /**
+         * @brief Backend actually in use (IO_URING only if it was requested and is supported).
+         */
+        io_backend get_io_backend() const
+        {
+            return uring ? io_backend::IO_URING : io_backend::EPOLL;
+        }
+
         /**
          * @brief Start listening for incoming HTTP requests.
-         * @note just calls the epoll_server::listen() method.
+         * @note Runs the io_uring event loop or epoll_server::listen(), depending on the backend.
+         */
+        virtual void listen();
+
+        /**
+         * @brief Stop the event loop started by listen().
+         * @note Stops the io_uring loop or forwards to epoll_server::stop_server(); safe from any thread
          */
-        virtual void listen()
+        void stop_server();
+
+        /**
+         * @brief Stop the server gracefully.
+         * @param deadline Point in time after which remaining connections are closed forcibly
+         * @return true if every handler finished and every queued response was written before the deadline
+         *
+         * Stops accepting connections, marks responses sent from now on with
+         * "Connection: close", waits until every request handed to a handler
+         * has finished (its http_response was destroyed) and, on the io_uring
+         * backend, until the queued responses were written. Then it stops the
+         * event loop, which closes every remaining connection.
+         *
+         * @note Blocks; call it from another thread than the event loop and the handlers
+         * @note The epoll backend reports no queue size, so there the loop stops as soon as the handlers are done
+         */
+        bool shutdown(std::chrono::steady_clock::time_point deadline);
+
+        /**
+         * @brief Give this server's listening socket to a successor process.
+         * @param control_path Unix socket path the successor passes to listener_handoff::take()
+         * @throws std::runtime_error if there is no listener (e.g. after shutdown()) or the exchange fails
+         *
+         * Blocks until the successor has received the socket. Both processes
+         * then accept on it; call shutdown() next to drain this one.
+         */
+        void hand_off_listener(const std::string &control_path);
+
+        /// shutdown() with a deadline timeout from now
+        bool shutdown(std::chrono::milliseconds timeout)
         {
-            epoll_server::listen(timeout_milliseconds);
+            return shutdown(std::chrono::steady_clock::now() + timeout);
         }
     };
 }
\ No newline at end of file
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <string>
+
+namespace hh_http
+{
+    /**
+     * @brief Pass a listening socket from a running server to its successor.
+     *
+     * For zero-downtime upgrades the old process offers its listener on a
+     * Unix domain socket; the newly exec'd process connects, receives the
+     * file descriptor (SCM_RIGHTS) and starts accepting on the very same
+     * socket. Connections waiting in the accept queue are never refused, and
+     * the old process can drain with http_server::shutdown() afterwards.
+     *
+     * Both sides block; the exchange is one message plus a one byte
+     * acknowledgement, so the old process knows the fd arrived before it
+     * stops accepting.
+     *
+     * @note Linux/POSIX only
+     */
+    class listener_handoff
+    {
+    public:
+        /**
+         * @brief Offer listener_fd on control_path and wait for one successor to take it.
+         * @param control_path Filesystem path of the Unix socket; a stale file is replaced and removed afterwards
+         * @param listener_fd Listening socket to share (it stays open in this process)
+         * @throws std::runtime_error if the control socket cannot be created or the exchange fails
+         */
+        static void offer(const std::string &control_path, int listener_fd);
+
+        /**
+         * @brief Take the listener offered on control_path.
+         * @return The listening socket, or -1 if no process offers one (fresh start)
+         * @throws std::runtime_error if a process answered but the exchange failed
+         */
+        static int take(const std::string &control_path);
+    };
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace hh_http
+{
+    /**
+     * @brief Process-wide budget for buffered request and response bytes.
+     *
+     * MAX_BODY_SIZE bounds a single request, but not how many of them are
+     * buffered at once. Every place that holds client data for longer than a
+     * read (partial requests in http_message_handler, queued writes of the
+     * io_uring backend) charges it here, so the total can be kept under
+     * config::MAX_BUFFERED_BYTES.
+     *
+     * The budget itself never refuses bytes that are already in memory; it
+     * reports pressure to its listeners so they stop reading from clients
+     * once the limit is reached, and again when usage has dropped back to
+     * RESUME_PERCENT of the limit.
+     */
+    class memory_budget
+    {
+    public:
+        /// Reading resumes once usage is back at or below this share of the limit
+        static constexpr std::size_t RESUME_PERCENT = 75;
+
+        /// Called with true when the limit is reached and false when usage is low enough again
+        using listener = std::function<void(bool exhausted)>;
+
+        static memory_budget &instance();
+
+        /// Account for n more buffered bytes (lock-free unless it crosses the limit)
+        void acquire(std::size_t n);
+
+        /// Account for n buffered bytes that were freed
+        void release(std::size_t n);
+
+        /// Bytes currently accounted
+        std::size_t used() const { return in_use.load(std::memory_order_relaxed); }
+
+        /// true while the limit is reached and usage has not dropped back to the resume mark
+        bool exhausted() const { return under_pressure.load(std::memory_order_acquire); }
+
+        /**
+         * @brief Register a pressure listener.
+         * @return Id for remove_listener()
+         * @note Listeners run on whichever thread crossed the limit, under the budget's lock; keep them short
+         */
+        std::size_t add_listener(listener callback);
+
+        void remove_listener(std::size_t id);
+
+    private:
+        memory_budget() = default;
+
+        std::atomic<std::size_t> in_use{0};
+        std::atomic<bool> under_pressure{false};
+
+        std::mutex listeners_mutex;
+        std::vector<std::pair<std::size_t, listener>> listeners;
+        std::size_t next_listener_id = 0;
+
+        void update_pressure();
+    };
+}
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include "http_consts.hpp"
+
+namespace hh_http
+{
+    namespace metrics
+    {
+        /// Number of shards per counter; threads are spread across shards round-robin
+        constexpr std::size_t SHARD_COUNT = 16;
+
+        /**
+         * @brief Monotonic counter sharded across threads.
+         *
+         * Each thread increments its own cache-line-sized shard with a relaxed
+         * atomic add, so hot-path increments from different threads never
+         * contend on the same cache line. Reading sums all shards and is only
+         * done when metrics are exported.
+         */
+        class counter
+        {
+        public:
+            /// Add n to the counter (lock-free, relaxed ordering)
+            void increment(std::uint64_t n = 1);
+
+            /// Sum of all shards
+            std::uint64_t value() const;
+
+        private:
+            struct alignas(64) shard
+            {
+                std::atomic<std::uint64_t> value{0};
+            };
+            std::array<shard, SHARD_COUNT> shards;
+        };
+
+        /**
+         * @brief Lock-free log-linear latency histogram (HdrHistogram style).
+         *
+         * Values are recorded in nanoseconds into power-of-two magnitudes that
+         * are split into linear sub-buckets, giving a fixed ~3% relative error
+         * over the full range with a relaxed atomic increment per sample.
+         *
+         * Like counter, the bucket array is sharded per thread, so threads
+         * recording the same hot latency bucket do not share its cache line;
+         * the shards are summed when the histogram is read.
+         */
+        class histogram
+        {
+        public:
+            static constexpr int SUB_BUCKET_BITS = 5;
+            static constexpr std::uint64_t SUB_BUCKET_COUNT = 1ull << SUB_BUCKET_BITS;
+            static constexpr std::uint64_t SUB_BUCKET_HALF = SUB_BUCKET_COUNT / 2;
+            static constexpr std::size_t BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 2) * SUB_BUCKET_HALF;
+
+            /// Record one value in nanoseconds
+            void record(std::uint64_t nanoseconds);
+
+            /// Record a steady_clock duration
+            void record(std::chrono::steady_clock::duration duration);
+
+            /// Number of recorded samples
+            std::uint64_t count() const;
+
+            /// Sum of all recorded samples in nanoseconds
+            std::uint64_t sum() const;
+
+            /// Number of samples whose value is less than or equal to the given bound
+            std::uint64_t count_at_or_below(std::uint64_t nanoseconds) const;
+
+            /// Value (nanoseconds) below which the given percentile [0, 100] of samples fall
+            std::uint64_t value_at_percentile(double percentile) const;
+
+        private:
+            struct alignas(64) bucket_shard
+            {
+                std::array<std::atomic<std::uint64_t>, BUCKET_COUNT> counts{};
+            };
+            std::array<bucket_shard, SHARD_COUNT> shards;
+            counter samples;
+            counter total;
+
+            static std::size_t index_of(std::uint64_t value);
+            static std::uint64_t highest_equivalent(std::size_t index);
+
+            /// Samples in one bucket, summed over all shards
+            std::uint64_t bucket_value(std::size_t index) const;
+        };
+
+        /// Request processing phases tracked by the latency histograms
+        enum class phase
+        {
+            PARSE,   ///< Time spent inside http_message_handler for one read
+            QUEUE,   ///< Time a task waited in thread_pool before a worker picked it up
+            HANDLER, ///< Time spent in on_request_received()
+            WRITE    ///< Time spent handing a response to the socket layer
+        };
+
+        /**
+         * @brief Process-wide registry of the server's built-in metrics.
+         *
+         * All members are safe to update from any thread. The registry is a
+         * singleton because the instrumented code paths (parser, thread pool,
+         * request/response objects) have no common owner.
+         */
+        class registry
+        {
+        public:
+            /// Error kinds reported by http_message_handler (the method field of a failed parse)
+            static constexpr std::array<const char *, 13> PARSE_ERROR_KINDS = {
+                "BAD_METHOD_OR_URI_OR_VERSION",
+                "BAD_HEADERS_TOO_LARGE",
+                "BAD_REPEATED_LENGTH_OR_TRANSFER_ENCODING_OR_BOTH",
+                "BAD_CONTENT_TOO_LARGE",
+                "CONTENT_TOO_LARGE",
+                "BAD_CHUNK_ENCODING",
+                "BAD_TRAILER_HEADERS",
+                "BAD_CONTENT_ENCODING",
+                "BAD_DECOMPRESSED_TOO_LARGE",
+                "BAD_MEMORY_BUDGET_EXHAUSTED",
+                "BAD_BODY_REJECTED",
+                "BAD_TOO_MANY_PARTIAL_REQUESTS",
+                "BAD_REQUEST",
+            };
+
+            static registry &instance();
+
+            counter requests_total;
+            counter bytes_received_total;
+            counter bytes_sent_total;
+            counter connections_opened_total;
+            counter connections_closed_total;
+            counter idle_timeouts_total;
+            counter access_log_dropped_total;
+            counter memory_budget_exhausted_total;
+            counter write_timeouts_total;
+            counter accept_batches_total;
+            counter accept_fd_exhausted_total;
+            counter websocket_upgrades_total;
+            counter websocket_messages_received_total;
+            counter websocket_messages_sent_total;
+            counter sse_events_published_total;
+            counter sse_subscribers_evicted_total;
+            counter http2_connections_total;
+            counter http2_streams_total;
+            counter http2_stream_resets_total;
+            counter continue_sent_total;
+            counter expectations_rejected_total;
+            counter rate_limited_requests_total;
+            counter rate_limited_connections_total;
+            counter header_timeouts_total;
+            counter slow_bodies_total;
+            counter partial_limit_rejections_total;
+
+            /**
+             * @brief Count a parse error.
+             * @param kind One of PARSE_ERROR_KINDS; unknown kinds are counted as "OTHER"
+             */
+            void record_parse_error(const std::string &kind);
+
+            /// Record the duration of one phase
+            void record_phase(phase p, std::chrono::steady_clock::duration duration);
+
+            /// Latency histogram of a phase
+            const histogram &phase_latency(phase p) const;
+
+            /// Render every metric in the Prometheus text exposition format (version 0.0.4)
+            std::string render_prometheus() const;
+
+        private:
+            registry() = default;
+
+            std::array<counter, PARSE_ERROR_KINDS.size() + 1> parse_errors; ///< last slot is "OTHER"
+            std::array<histogram, 4> phase_histograms;
+        };
+
+        /**
+         * @brief Returns true if a parser result's method field carries an error kind.
+         * @param method The method field of an http_handled_data
+         */
+        bool is_parse_error(const std::string &method);
+    }
+}
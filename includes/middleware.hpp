@@ -0,0 +1,116 @@
+#pragma once
+
+#include "http_request.hpp"
+#include "http_response.hpp"
+
+#include <memory>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace hh_http
+{
+    /**
+     * @brief A fixed stack of middlewares composed at compile time.
+     *
+     * A middleware is any callable bool(http_request &, http_response &):
+     * it returns true to pass the request on, or false once it answered it
+     * (short-circuit). The stack calls its middlewares in order with a
+     * fold expression, so the compiler sees every call and can inline the
+     * whole stack; it is itself a middleware and can be passed to
+     * http_server::use() as one entry.
+     */
+    template <typename... Middlewares>
+    class middleware_stack
+    {
+    public:
+        explicit middleware_stack(Middlewares... middlewares) : stack(std::move(middlewares)...) {}
+
+        bool operator()(http_request &request, http_response &response)
+        {
+            return std::apply([&](auto &...middleware)
+                              { return (middleware(request, response) && ...); },
+                              stack);
+        }
+
+    private:
+        std::tuple<Middlewares...> stack;
+    };
+
+    /// Compose middlewares into a middleware_stack
+    template <typename... Middlewares>
+    middleware_stack<std::decay_t<Middlewares>...> compose(Middlewares &&...middlewares)
+    {
+        return middleware_stack<std::decay_t<Middlewares>...>(std::forward<Middlewares>(middlewares)...);
+    }
+
+    /**
+     * @brief A middleware chain built at run time.
+     *
+     * Entries are stored flat, as a function pointer and the state it runs
+     * on, instead of std::function wrappers nested one per middleware: a
+     * request walks a vector and makes one indirect call per middleware,
+     * however many are stacked.
+     *
+     * Built at startup; add() is not safe while requests are dispatched.
+     */
+    class middleware_chain
+    {
+    public:
+        /// Append a middleware (a callable bool(http_request &, http_response &)); it runs after those added before
+        template <typename Middleware>
+        void add(Middleware middleware)
+        {
+            using stored = std::decay_t<Middleware>;
+            static_assert(std::is_invocable_r_v<bool, stored &, http_request &, http_response &>,
+                          "a middleware must be callable as bool(http_request &, http_response &)");
+            auto state = std::make_shared<stored>(std::move(middleware));
+            entries.push_back({&invoke<stored>, state.get(), std::move(state)});
+        }
+
+        /// Append a plain function; no state is allocated for it
+        void add(bool (*function)(http_request &, http_response &))
+        {
+            entries.push_back({&invoke_function, reinterpret_cast<void *>(function), nullptr});
+        }
+
+        /**
+         * @brief Run the chain on a request.
+         * @return true if every middleware passed the request on, false if one answered it
+         */
+        bool run(http_request &request, http_response &response) const
+        {
+            for (const auto &entry : entries)
+            {
+                if (!entry.call(entry.state, request, response))
+                    return false;
+            }
+            return true;
+        }
+
+        bool empty() const { return entries.empty(); }
+        std::size_t size() const { return entries.size(); }
+
+    private:
+        struct entry
+        {
+            bool (*call)(void *, http_request &, http_response &);
+            void *state;
+            std::shared_ptr<void> owner; ///< Keeps state alive; null for plain functions
+        };
+
+        std::vector<entry> entries;
+
+        template <typename Middleware>
+        static bool invoke(void *state, http_request &request, http_response &response)
+        {
+            return (*static_cast<Middleware *>(state))(request, response);
+        }
+
+        static bool invoke_function(void *state, http_request &request, http_response &response)
+        {
+            return reinterpret_cast<bool (*)(http_request &, http_response &)>(state)(request, response);
+        }
+    };
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include "body_sink.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace hh_http
+{
+    /// One part of a multipart/form-data body
+    struct multipart_part
+    {
+        std::multimap<std::string, std::string> headers; ///< Part headers, upper-case names
+        std::string name;                                ///< Form field name (Content-Disposition "name")
+        std::string filename;                            ///< Client-side file name, empty for plain fields; never used as a path
+        std::string content_type;                        ///< Part Content-Type, empty if absent
+        std::size_t size = 0;                            ///< Data bytes received so far
+        std::string value;                               ///< The data, for parts neither streamed to a callback nor saved to disk
+        std::string saved_path;                          ///< File the data was written to (save_files_to())
+    };
+
+    /**
+     * @brief Incremental multipart/form-data parser (RFC 7578).
+     *
+     * Bytes can be fed in pieces of any size; part headers and part data
+     * are reported as soon as they arrive, so an upload is never held in
+     * memory as a whole. The delimiter is found with Boyer-Moore-Horspool
+     * over each piece; a delimiter cut by the end of a piece is carried
+     * over (at most the delimiter's length) instead of copying the piece.
+     *
+     * Usable as a body_sink, so http_server feeds it while the body is
+     * still arriving, or on its own over a buffered body.
+     *
+     * The data of a part goes to the part-data callback if one is set,
+     * otherwise to a file for file parts when save_files_to() was called,
+     * otherwise into multipart_part::value.
+     */
+    class multipart_parser : public body_sink
+    {
+    public:
+        using part_callback = std::function<void(const multipart_part &)>;
+        using data_callback = std::function<void(const multipart_part &, const char *, std::size_t)>;
+
+        /**
+         * @param boundary Boundary parameter of the Content-Type (see boundary_of())
+         * @throws std::runtime_error if the boundary is empty or longer than 70 characters
+         */
+        explicit multipart_parser(const std::string &boundary);
+
+        /// Removes the files of a body that did not finish successfully
+        ~multipart_parser() override;
+
+        multipart_parser(const multipart_parser &) = delete;
+        multipart_parser &operator=(const multipart_parser &) = delete;
+
+        /**
+         * @brief Boundary of a multipart/form-data Content-Type.
+         * @return The boundary, or "" if the type is not multipart/form-data or has none
+         */
+        static std::string boundary_of(const std::string &content_type);
+
+        /// Called once the headers of a part were parsed
+        void on_part_begin(part_callback callback) { part_begin = std::move(callback); }
+
+        /// Receives the data of every part as it arrives; such parts keep no value
+        void on_part_data(data_callback callback) { part_data = std::move(callback); }
+
+        /// Called after the last data of a part (and after its file was closed)
+        void on_part_end(part_callback callback) { part_end = std::move(callback); }
+
+        /**
+         * @brief Write the data of file parts (those with a filename) to new files in directory.
+         * @note Files get unique generated names (see multipart_part::saved_path); they are removed
+         *       if the body fails or never completes, and belong to the caller after finish()
+         */
+        void save_files_to(const std::string &directory) { upload_directory = directory; }
+
+        /// Feed the next bytes of the body; false once the body is malformed
+        bool write(const char *data, std::size_t size) override;
+
+        /// The body ended; false unless the closing delimiter was seen
+        bool finish() override;
+
+        /// Parts whose headers were parsed, in body order
+        const std::vector<multipart_part> &parts() const { return all_parts; }
+
+        /// First part with this field name, null if none
+        const multipart_part *find(const std::string &name) const;
+
+        bool failed() const { return state == parse_state::FAILED; }
+
+        /// Why the body was rejected, empty if it was not
+        const std::string &error() const { return failure; }
+
+    private:
+        enum class parse_state
+        {
+            PREAMBLE,        ///< Before the first delimiter
+            AFTER_DELIMITER, ///< After a delimiter: "--" ends the body, CRLF starts a part
+            CLOSE_DASH,      ///< Saw the first '-' of "--"
+            DELIMITER_CR,    ///< Saw the CR of the CRLF ending a delimiter line
+            HEADERS,         ///< Part headers up to the empty line
+            DATA,            ///< Part data up to the next delimiter
+            EPILOGUE,        ///< After the closing delimiter; ignored
+            FAILED
+        };
+
+        std::string delimiter; ///< CRLF "--" boundary
+        std::array<std::size_t, 256> skip{};
+        parse_state state = parse_state::PREAMBLE;
+        std::string carry;  ///< End of the last piece that may start a delimiter
+        std::string header_block;
+        std::string failure;
+        bool finished_ok = false;
+
+        std::vector<multipart_part> all_parts;
+        std::FILE *file = nullptr;
+        std::string upload_directory;
+
+        part_callback part_begin;
+        data_callback part_data;
+        part_callback part_end;
+
+        /// Offset of the first delimiter in data, or size
+        std::size_t find_delimiter(const char *data, std::size_t size) const;
+
+        /// Data bytes of the current part (or preamble bytes, which are dropped)
+        void emit(const char *data, std::size_t size);
+
+        /// Scan part data (or preamble) for the delimiter; returns the bytes consumed
+        std::size_t scan(const char *data, std::size_t size);
+
+        /// Resolve a carried-over delimiter prefix with the next piece; returns the bytes of data consumed
+        std::size_t resolve_carry(const char *data, std::size_t size);
+
+        /// A delimiter was found at the end of the current part's data
+        void delimiter_found();
+
+        /// Parse header_block into a new part and open its file
+        bool begin_part();
+        void end_part();
+
+        bool fail(const std::string &reason);
+    };
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace hh_http
+{
+    /**
+     * @brief Outbound byte count of one connection, with high/low watermarks.
+     *
+     * Shared between the code that queues responses (any thread) and the
+     * event loop that writes them. Once more than
+     * config::OUTBOUND_HIGH_WATERMARK bytes are waiting the connection is
+     * reported as not writable, until the loop has drained it to
+     * config::OUTBOUND_LOW_WATERMARK; then the callbacks registered with
+     * on_writable() run. Producers that respect this never queue much more
+     * than the high watermark for a slow reader.
+     */
+    class outbound_queue
+    {
+    public:
+        /// Count n bytes handed to the event loop for writing
+        void queued(std::size_t n);
+
+        /// Count n bytes written (or dropped) by the event loop; runs drain callbacks when crossing the low watermark
+        void written(std::size_t n);
+
+        /// Bytes queued but not written yet
+        std::size_t size() const { return bytes.load(std::memory_order_relaxed); }
+
+        /// false from the high watermark until the queue drained to the low watermark
+        bool writable() const { return !congested.load(std::memory_order_acquire); }
+
+        /**
+         * @brief Run callback once the connection is writable.
+         * @note Runs right away on the calling thread if it already is, otherwise
+         *       on the event loop thread; dropped if the connection closes first
+         */
+        void on_writable(std::function<void()> callback);
+
+        /// The connection is gone: drop pending callbacks, later ones are never run
+        void close();
+
+    private:
+        std::atomic<std::size_t> bytes{0};
+        std::atomic<bool> congested{false};
+
+        std::mutex mutex;
+        bool closed = false;
+        std::vector<std::function<void()>> waiting;
+    };
+}
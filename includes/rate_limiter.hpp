@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+
+namespace hh_http
+{
+    /// A token bucket: `burst` tokens, refilled at `per_second` tokens per second
+    struct rate_limit
+    {
+        double per_second = 0; ///< Sustained rate; 0 disables the limit
+        double burst = 1;      ///< Requests allowed at once after a quiet period (at least 1)
+    };
+
+    /**
+     * @brief Token buckets for many keys (client IPs, IP + route) in fixed memory.
+     *
+     * Each bucket is stored as a single 64-bit "theoretical arrival time"
+     * (GCRA, equivalent to a token bucket): a request is allowed if the
+     * bucket's time minus the burst allowance is not in the future, and
+     * pushes the time one emission interval further. A check is one
+     * compare-and-swap on that word, so acquire() takes no lock.
+     *
+     * Buckets live in an open-addressing table split into shards, with a
+     * bounded probe inside a shard. A bucket whose time has passed is
+     * full again, so it is as good as absent: its slot expires lazily and
+     * is reused by the next key that needs one. When every probed slot is
+     * in use, the slot that refills soonest is taken over; memory never
+     * grows with the number of distinct keys.
+     */
+    class rate_limiter
+    {
+    public:
+        /**
+         * @param limit Rate and burst of every bucket
+         * @param slots Table size, rounded up to a power of two (16 bytes each)
+         * @throws std::runtime_error if the rate is not positive
+         */
+        rate_limiter(const rate_limit &limit, std::size_t slots);
+
+        rate_limiter(const rate_limiter &) = delete;
+        rate_limiter &operator=(const rate_limiter &) = delete;
+
+        /**
+         * @brief Take one token from the bucket of key.
+         * @param retry_after Set when refused: time until a token is available
+         * @return true if allowed
+         */
+        bool acquire(std::string_view key, std::chrono::milliseconds *retry_after = nullptr);
+
+        /// Same, for a key hashed by the caller (e.g. combine_keys())
+        bool acquire_hash(std::uint64_t key_hash, std::chrono::milliseconds *retry_after = nullptr);
+
+        /// 64-bit hash of a key
+        static std::uint64_t hash(std::string_view key);
+
+        /// Hash of a pair of keys, e.g. client IP and route
+        static std::uint64_t combine_keys(std::string_view first, std::string_view second);
+
+        /// Slots in the table
+        std::size_t capacity() const { return shard_count * shard_size; }
+
+    private:
+        struct slot
+        {
+            std::atomic<std::uint64_t> key{0}; ///< Key hash, 0 = never used
+            std::atomic<std::uint64_t> tat{0}; ///< Theoretical arrival time (microseconds since start)
+        };
+
+        static constexpr std::size_t MAX_PROBES = 8;
+
+        std::uint64_t interval;  ///< Microseconds per token
+        std::uint64_t allowance; ///< Microseconds of burst: interval * burst
+        std::size_t shard_count;
+        std::size_t shard_size;
+        std::unique_ptr<slot[]> slots;
+        std::chrono::steady_clock::time_point start;
+
+        std::uint64_t now() const;
+
+        /// Slot holding key_hash, claiming a free, expired or soonest-full one if needed
+        slot &find_slot(std::uint64_t key_hash, std::uint64_t now);
+    };
+}
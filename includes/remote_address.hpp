@@ -0,0 +1,9 @@
+#pragma once
+
+#include <string_view>
+
+namespace hh_http
+{
+    /// Client IP of a remote address "ip:port" ("[v6]:port" or "v6:port"); the whole string if it has no port
+    std::string_view remote_ip(std::string_view remote);
+}
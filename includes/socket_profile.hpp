@@ -0,0 +1,46 @@
+#pragma once
+
+namespace hh_http
+{
+    /**
+     * @brief Per-connection TCP options http_server applies to its clients.
+     *
+     * Static options (Nagle, buffer sizes) are set once when a connection is
+     * accepted. Corking happens around streamed responses: the socket is
+     * corked before the first chunk and uncorked by the last one, so the
+     * head and many small chunks leave in full segments. Responses sent with
+     * http_response::send() are a single write already and are never corked.
+     */
+    struct socket_profile
+    {
+        /// TCP_NODELAY: send small writes at once instead of waiting for the ACK of the previous segment
+        bool no_delay = true;
+
+        /// TCP_CORK while a chunked response is streamed; send_last_chunk() uncorks (the kernel flushes after 200 ms at the latest)
+        bool cork_streams = false;
+
+        /// TCP_QUICKACK after every read, so the client's next request is not held back by a delayed ACK
+        bool quick_ack = false;
+
+        /// SO_SNDBUF in bytes (0 keeps the kernel default and its autotuning)
+        int send_buffer = 0;
+
+        /// SO_RCVBUF in bytes (0 keeps the kernel default and its autotuning)
+        int receive_buffer = 0;
+
+        /// Request/response traffic with small messages: no Nagle, immediate ACKs
+        static socket_profile latency();
+
+        /// Large or streamed responses: corked streams so chunks fill whole segments
+        static socket_profile throughput();
+
+        /// Set the static options on a newly accepted socket
+        void apply(int fd) const;
+
+        /// Set or clear TCP_CORK; clearing flushes whatever is pending
+        static void set_cork(int fd, bool corked);
+
+        /// Re-enable TCP_QUICKACK, which the kernel clears on its own after a while
+        static void set_quick_ack(int fd);
+    };
+}
@@ -8,7 +8,9 @@
 #include <functional>
 #include <vector>
 #include <atomic>
-#include <iostream>
+#include <chrono>
+
+#include "metrics.hpp"
 namespace hh_http
 {
 
@@ -23,7 +25,8 @@ namespace hh_http
             {
                 workers.emplace_back([this]()
                                      {
-                                         while (!stop.load())
+                                         // Exit only once stopped and out of work, so queued tasks still run
+                                         while (true)
                                          {
                                              std::function<void()> task;
                                              {
@@ -38,9 +41,9 @@ namespace hh_http
                                          } });
             }
         }
+        /// Runs the tasks still queued, then joins the workers
         ~thread_pool()
         {
-            std::cout << "Stopping thread pool..." << std::endl;
             stop.store(true);
             condition.notify_all();
             for (std::thread &worker : workers)
@@ -55,7 +58,19 @@ namespace hh_http
         {
             {
                 std::unique_lock<std::mutex> lock(queue_mutex);
-                tasks.emplace(std::forward<F>(f));
+                if (config::ENABLE_METRICS)
+                {
+                    // Charge the time spent waiting for a worker to the QUEUE phase
+                    auto enqueued_at = std::chrono::steady_clock::now();
+                    tasks.emplace([enqueued_at, task = std::forward<F>(f)]() mutable
+                                  {
+                                      metrics::registry::instance().record_phase(metrics::phase::QUEUE, std::chrono::steady_clock::now() - enqueued_at);
+                                      task(); });
+                }
+                else
+                {
+                    tasks.emplace(std::forward<F>(f));
+                }
             }
             condition.notify_one();
         }
@@ -0,0 +1,266 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "outbound_queue.hpp"
+
+namespace hh_http
+{
+    /**
+     * @brief io_uring event loop used as an alternative to hh_socket::epoll_server.
+     *
+     * Talks to the kernel through the raw io_uring system calls (no liburing)
+     * and keeps the number of syscalls per request low:
+     * - one multishot accept produces every new connection,
+     * - one multishot recv per connection delivers data into a ring of
+     *   kernel-provided buffers, which are recycled right after the data is
+     *   handed to the callback,
+     * - writes queued during a loop iteration are submitted together with a
+     *   single io_uring_enter(), one sendmsg per connection covering all its
+     *   queued messages.
+     *
+     * Queued outgoing bytes are charged to memory_budget until they are written
+     * (except shared buffers, see send()).
+     * Each connection also has an outbound_queue for write-side backpressure,
+     * and connections whose queued writes make no progress for
+     * config::WRITE_TIMEOUT_SECONDS are closed.
+     *
+     * Connections are identified by a client_handle (file descriptor plus a
+     * generation number), so operations queued for a connection that has
+     * since been closed never reach a new connection that reuses its fd.
+     *
+     * send(), close() and stop_reading() may be called from any thread; all
+     * callbacks run on the thread that called run().
+     *
+     * @note Linux only. Needs multishot accept and provided buffer rings (5.19+);
+     *       multishot recv (6.0+) is used when available. Check supported() first.
+     */
+    class uring_server
+    {
+    public:
+        /// fd in the low 32 bits, generation in the high 32 bits
+        using client_handle = std::uint64_t;
+
+        /// File descriptor of a client handle
+        static int fd_of(client_handle client) { return static_cast<int>(client & 0xffffffffu); }
+
+        /// Event callbacks; all run on the event loop thread
+        struct handlers
+        {
+            std::function<void(client_handle, const std::string &remote)> connection_opened;
+            std::function<void(client_handle, const char *data, std::size_t size)> data_received;
+            std::function<void(client_handle)> connection_closed;
+            std::function<void()> listen_success;
+            std::function<void()> waiting_for_activity;
+            std::function<void()> shutdown_success;
+            std::function<void(const std::exception &)> exception_occurred;
+        };
+
+        /**
+         * @brief Returns true if the running kernel supports every feature the backend needs.
+         * @note Probes once and caches the answer
+         */
+        static bool supported();
+
+        /**
+         * @brief Create the listening socket and the ring.
+         * @param ip Address to bind (IPv4 or IPv6 literal)
+         * @param port Port to bind
+         * @param backlog listen(2) backlog
+         * @param callbacks Event handlers
+         * @throws std::runtime_error if the socket or the ring cannot be set up
+         */
+        uring_server(const std::string &ip, int port, int backlog, handlers callbacks);
+
+        /**
+         * @brief Serve an existing listening socket (e.g. one handed over by listener_handoff).
+         * @param listener_fd Listening socket; the server takes ownership (closed if construction fails)
+         * @param callbacks Event handlers
+         * @throws std::runtime_error if listener_fd is not a listening socket or the ring cannot be set up
+         */
+        uring_server(int listener_fd, handlers callbacks);
+        ~uring_server();
+
+        uring_server(const uring_server &) = delete;
+        uring_server &operator=(const uring_server &) = delete;
+
+        /**
+         * @brief Run the event loop until stop() is called.
+         * @param timeout_milliseconds Idle time after which waiting_for_activity is called
+         */
+        void run(int timeout_milliseconds);
+
+        /// Ask the event loop to exit; safe from any thread
+        void stop();
+
+        /// Stop accepting connections and close the listening socket; connected clients are served as usual
+        void stop_accepting();
+
+        /// Listening socket, -1 after stop_accepting(); pass it to listener_handoff::offer() before that
+        int listener_fd() const { return listen_fd; }
+
+        /// Bytes queued by send() on every connection that were not written yet
+        std::size_t queued_bytes() const { return unsent_bytes.load(std::memory_order_relaxed); }
+
+        /// Queue data for a client; messages are written in order
+        void send(client_handle client, std::string data);
+
+        /**
+         * @brief Queue a buffer shared with other clients (e.g. one broadcast event).
+         * @note The buffer is referenced, not copied, until written. It is not charged to
+         *       memory_budget per client, since it exists once however many clients queue it
+         */
+        void send(client_handle client, std::shared_ptr<const std::string> data);
+
+        /// Close a client once everything queued for it has been written
+        void close(client_handle client);
+
+        /// Close whichever client currently owns fd (used by the idle sweeper, which only knows fds)
+        void close_fd(int fd);
+
+        /// Stop delivering data from a client
+        void stop_reading(client_handle client);
+
+        /**
+         * @brief Set or clear TCP_CORK on a client, in order with its sends.
+         * @note Clearing waits until everything queued before it has been written,
+         *       so the uncork flushes the tail of the data instead of nothing
+         */
+        void set_corked(client_handle client, bool corked);
+
+        /**
+         * @brief Outbound queue of a client, null if it is not connected.
+         * @note Event loop thread only. The loop counts bytes as written; whoever
+         *       calls send() counts them as queued first
+         */
+        std::shared_ptr<outbound_queue> outbound(client_handle client);
+
+        /// Stop receiving from every client until resume_reading(); data already received is still delivered
+        void pause_reading();
+
+        /// Undo pause_reading() for every client that has not stopped reading
+        void resume_reading();
+
+    private:
+        /// Bytes queued for a client: owned, or shared with other clients
+        struct outgoing_buffer
+        {
+            std::string owned;
+            std::shared_ptr<const std::string> shared;
+
+            const char *data() const { return shared ? shared->data() : owned.data(); }
+            std::size_t size() const { return shared ? shared->size() : owned.size(); }
+            bool empty() const { return size() == 0; }
+        };
+
+        /// Operations requested from other threads, applied by the event loop
+        struct pending_operation
+        {
+            enum kind_t
+            {
+                SEND,
+                CLOSE,
+                CLOSE_FD,
+                STOP_READING,
+                CORK,
+                UNCORK,
+                PAUSE_READING,
+                RESUME_READING,
+                STOP_ACCEPTING
+            } kind;
+            client_handle client;
+            outgoing_buffer data;
+        };
+
+        struct connection_state
+        {
+            std::uint32_t generation = 0;
+            bool reading = true;
+            bool recv_armed = false;
+            bool close_requested = false;
+            bool send_in_flight = false;
+            bool uncork_pending = false; ///< Clear TCP_CORK once outgoing is written
+            std::deque<outgoing_buffer> outgoing;
+            std::size_t offset = 0; ///< Bytes of outgoing.front() already written
+            std::shared_ptr<outbound_queue> outbound;
+            std::chrono::steady_clock::time_point last_progress; ///< Last write progress while outgoing was non-empty
+
+            // Kept here so they stay valid until the sendmsg completes
+            std::vector<iovec> iov;
+            msghdr message{};
+        };
+
+        struct ring;
+
+        handlers callbacks;
+        std::atomic<int> listen_fd{-1}; ///< Read by listener_fd() from other threads
+        int wake_fd = -1;
+        std::uint64_t wake_value = 0;
+        ring *io = nullptr;
+
+        bool multishot_accept = true;
+        bool multishot_recv = true;
+        bool reading_paused = false;
+        std::size_t accepted_this_round = 0;
+        std::chrono::steady_clock::time_point last_write_sweep;
+
+        std::unordered_map<int, connection_state> connections; ///< Event loop thread only
+        std::uint32_t next_generation = 0;
+
+        std::mutex pending_mutex;
+        std::vector<pending_operation> pending;
+        std::vector<pending_operation> applying; ///< Swapped with pending, avoids allocating per iteration
+
+        std::atomic<bool> stopping{false};
+        std::atomic<bool> woken{false}; ///< A wake-up is pending; later queue() calls need not write the eventfd again
+        std::atomic<std::size_t> unsent_bytes{0};
+        std::atomic<std::thread::id> loop_thread{};
+
+        void queue(pending_operation operation);
+        void apply_pending();
+        void wake();
+
+        void charge(const outgoing_buffer &data);
+        void discharge(const outgoing_buffer &data);
+
+        void setup_ring();
+        void arm_accept();
+        void arm_accept_poll();
+        void arm_accept_retry();
+        void close_listener();
+        void arm_recv(int fd, connection_state &state);
+        void arm_wake();
+        void start_send(int fd, connection_state &state);
+        void close_now(int fd);
+        void abort(int fd, connection_state &state);
+        void cancel_recv(int fd, connection_state &state);
+        void set_reading_paused(bool paused);
+        void sweep_stalled_writes();
+
+        /// Completions are waiting in the completion queue
+        bool completions_ready() const;
+        /// Handle every completion that is ready; returns how many there were
+        std::size_t reap_completions();
+        void close_all();
+
+        void handle_completion(std::uint64_t user_data, int result, std::uint32_t flags);
+        void on_accept(int result, std::uint32_t flags);
+        void on_recv(int fd, std::uint32_t generation, int result, std::uint32_t flags);
+        void on_send(int fd, std::uint32_t generation, int result);
+
+        connection_state *find(int fd, std::uint32_t generation);
+    };
+}
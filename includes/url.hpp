@@ -0,0 +1,148 @@
+#pragma once
+
+#include <cstddef>
+#include <iterator>
+#include <string>
+#include <string_view>
+
+namespace hh_http
+{
+    namespace url
+    {
+        /// What a normalized path does with an encoded slash ("%2F")
+        enum class encoded_slash
+        {
+            KEEP,   ///< Leave "%2F" encoded, so it never splits a segment (default)
+            DECODE, ///< Decode it to '/' like any other escape
+            REJECT  ///< Treat the path as invalid
+        };
+
+        /// The pieces of a request target, as views into the target they were split from
+        struct target_parts
+        {
+            std::string_view path;     ///< Always starts with '/' except for "*" and empty targets
+            std::string_view query;    ///< After '?', without it; empty if none
+            std::string_view fragment; ///< After '#', without it; empty if none
+        };
+
+        /**
+         * @brief Split a request target into path, query and fragment without copying.
+         *
+         * Origin-form ("/a?b") and asterisk-form ("*") are split as is; for an
+         * absolute-form target ("http://host/a?b") the scheme and authority are
+         * skipped, and a target with no path after the authority gets an empty path.
+         */
+        target_parts split(std::string_view target);
+
+        /**
+         * @brief Percent-decode into a caller-provided buffer.
+         * @param plus_as_space Decode '+' as a space (query strings, form data)
+         * @return Bytes written, or std::string::npos if an escape is malformed or out is too small
+         * @note The result is never longer than in, so a buffer of in.size() bytes always suffices
+         */
+        std::size_t decode(std::string_view in, char *out, std::size_t capacity, bool plus_as_space = false);
+
+        /// Percent-decode into out (its capacity is reused); false if an escape is malformed
+        bool decode(std::string_view in, std::string &out, bool plus_as_space = false);
+
+        /// true if the percent-encoded in decodes to exactly text; compared in place, nothing is allocated
+        bool decoded_equals(std::string_view in, std::string_view text, bool plus_as_space = false);
+
+        /**
+         * @brief Decode a path and remove its dot segments (RFC 3986, section 5.2.4).
+         *
+         * "." and ".." segments are resolved (".." never climbs above the root)
+         * and escapes are decoded, so "/%61/./b" and "/a/b" give the same result.
+         * "%2F" is handled as slashes says; while it stays encoded, "%25" does
+         * too, so no other input normalizes to the same "%2F". Segments are
+         * decoded before dot segments are resolved: "%2E%2E" is "..".
+         * An empty path (absolute-form target without one) is "/".
+         *
+         * @return false if the path does not start with '/', has a malformed escape,
+         *         encodes a NUL byte, or has "%2F" with encoded_slash::REJECT
+         */
+        bool normalize_path(std::string_view path, std::string &out, encoded_slash slashes = encoded_slash::KEEP);
+
+        /// One name=value pair of a query string, still percent-encoded
+        struct query_param
+        {
+            std::string_view name;
+            std::string_view value; ///< Empty for "name" and "name="
+        };
+
+        /**
+         * @brief Allocation-free view over the parameters of a query string.
+         *
+         * Parameters are separated by '&' (empty ones are skipped) and stay
+         * percent-encoded until asked for: get() compares names in place and
+         * decodes only the value found, into the caller's buffer. The view
+         * refers to the query it was made from, which must outlive it.
+         */
+        class query_view
+        {
+        public:
+            class iterator
+            {
+            public:
+                using iterator_category = std::forward_iterator_tag;
+                using value_type = query_param;
+                using difference_type = std::ptrdiff_t;
+                using pointer = const query_param *;
+                using reference = const query_param &;
+
+                iterator() = default;
+
+                reference operator*() const { return current; }
+                pointer operator->() const { return &current; }
+                iterator &operator++();
+                iterator operator++(int)
+                {
+                    iterator before = *this;
+                    ++*this;
+                    return before;
+                }
+
+                bool operator==(const iterator &other) const { return rest.data() == other.rest.data() && done == other.done; }
+                bool operator!=(const iterator &other) const { return !(*this == other); }
+
+            private:
+                friend class query_view;
+                explicit iterator(std::string_view query);
+
+                std::string_view rest;
+                query_param current;
+                bool done = true;
+            };
+
+            query_view() = default;
+            explicit query_view(std::string_view query) : query(query) {}
+
+            iterator begin() const { return iterator(query); }
+            iterator end() const { return iterator(); }
+
+            bool empty() const { return begin() == end(); }
+
+            /// The raw query string
+            std::string_view raw() const { return query; }
+
+            /// true if a parameter has this (decoded) name
+            bool has(std::string_view name) const;
+
+            /// Raw (still encoded) value of the first parameter with this decoded name
+            bool find(std::string_view name, std::string_view &value) const;
+
+            /**
+             * @brief Decoded value of the first parameter with this decoded name.
+             * @param out Receives the value; its capacity is reused across calls
+             * @return false if there is no such parameter or its value is malformed
+             */
+            bool get(std::string_view name, std::string &out) const;
+
+            /// Same, into a fixed buffer; returns the value's length or std::string::npos
+            std::size_t get(std::string_view name, char *out, std::size_t capacity) const;
+
+        private:
+            std::string_view query;
+        };
+    }
+}
@@ -0,0 +1,256 @@
+#pragma once
+
+#include "http_consts.hpp"
+#include "outbound_queue.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+
+namespace hh_http
+{
+    /// Frame opcodes (RFC 6455, section 5.2)
+    enum class websocket_opcode : std::uint8_t
+    {
+        CONTINUATION = 0x0,
+        TEXT = 0x1,
+        BINARY = 0x2,
+        CLOSE = 0x8,
+        PING = 0x9,
+        PONG = 0xA
+    };
+
+    /// Status codes of a close frame (RFC 6455, section 7.4.1)
+    namespace websocket_close
+    {
+        constexpr std::uint16_t NORMAL = 1000;
+        constexpr std::uint16_t GOING_AWAY = 1001;
+        constexpr std::uint16_t PROTOCOL_ERROR = 1002;
+        constexpr std::uint16_t UNSUPPORTED_DATA = 1003;
+        constexpr std::uint16_t NO_STATUS = 1005;       ///< Reported only: the peer's close frame had no code
+        constexpr std::uint16_t ABNORMAL = 1006;        ///< Reported only: the connection dropped without a close frame
+        constexpr std::uint16_t INVALID_PAYLOAD = 1007; ///< Text that is not UTF-8
+        constexpr std::uint16_t POLICY_VIOLATION = 1008;
+        constexpr std::uint16_t MESSAGE_TOO_BIG = 1009;
+        constexpr std::uint16_t INTERNAL_ERROR = 1011;
+
+        /// Whether a peer may send this code in a close frame (RFC 6455, section 7.4); 1005 and 1006 are reported only
+        bool is_valid(std::uint16_t code);
+    }
+
+    /**
+     * @brief Incremental, zero-copy parser for client-to-server frames.
+     *
+     * Fed straight from the receive buffer: only a frame header cut off by
+     * the end of a read (at most 14 bytes) is staged. Payload bytes are
+     * unmasked in the same pass that moves them into the caller's buffer,
+     * 16 bytes at a time with SSE2 (8 bytes at a time elsewhere).
+     *
+     * Usage: call next() until it returns NEED_MORE. After HEADER, pick the
+     * buffer the payload goes to (header() tells what it is); after FRAME the
+     * whole payload has been appended to it.
+     */
+    class websocket_frame_parser
+    {
+    public:
+        /// Where next() stopped
+        enum class event
+        {
+            NEED_MORE, ///< Every byte was consumed; call again with the next read
+            HEADER,    ///< A frame header is complete, its payload follows
+            FRAME,     ///< The payload of the current frame is complete
+            ERROR      ///< Protocol violation, see error_code(); the connection must be closed
+        };
+
+        struct frame_header
+        {
+            bool fin = false;
+            websocket_opcode opcode = websocket_opcode::CONTINUATION;
+            std::uint64_t length = 0;
+            std::uint8_t mask[4] = {};
+        };
+
+        /**
+         * @brief Consume bytes up to the next event.
+         * @param data Advanced past the consumed bytes
+         * @param size Decreased by the consumed bytes
+         * @param payload Buffer the unmasked payload is appended to (ignored until HEADER was returned)
+         */
+        event next(const char *&data, std::size_t &size, std::string *payload);
+
+        /// Header of the current frame, valid from HEADER to the next call after FRAME
+        const frame_header &header() const { return current; }
+
+        /// Close code describing the last ERROR
+        std::uint16_t error_code() const { return error; }
+
+        /**
+         * @brief XOR n bytes of in with the masking key into out.
+         * @param offset Position in the key of the first byte, advanced by n (mod 4)
+         * @note out and in may be the same buffer
+         */
+        static void unmask(char *out, const char *in, std::size_t n, const std::uint8_t mask[4], std::size_t &offset);
+
+    private:
+        frame_header current;
+        bool in_payload = false;
+        std::uint64_t remaining = 0;
+        std::size_t mask_offset = 0;
+        std::uint16_t error = 0;
+
+        /// Header bytes received so far
+        std::uint8_t staged[14] = {};
+        std::size_t staged_size = 0;
+
+        /// Length of the header whose first two bytes are in staged, 0 if they are not yet there
+        std::size_t header_size() const;
+
+        event fail(std::uint16_t code);
+    };
+
+    /**
+     * @brief Server side of one WebSocket connection, created by http_server after the handshake.
+     *
+     * Messages are delivered to on_message() whole: fragmented messages are
+     * reassembled, pings are answered, and the close handshake is run as
+     * described in RFC 6455. Outgoing messages are sent as single frames
+     * through the connection's send queue; on the io_uring backend the same
+     * watermarks as for HTTP responses apply (is_writable(), on_writable()).
+     *
+     * Callbacks run on the event loop thread; register them in the
+     * http_server websocket callback, before the first frame can arrive.
+     * send_text(), send_binary(), ping() and close() may be called from any
+     * thread, as long as the http_server exists.
+     */
+    class websocket_connection
+    {
+    public:
+        /// Callback for complete messages; binary is false for text (which is valid UTF-8)
+        using message_callback = std::function<void(const std::string &message, bool binary)>;
+
+        /// Callback for the end of the connection, with the peer's close code (ABNORMAL if it just dropped)
+        using close_callback = std::function<void(std::uint16_t code, const std::string &reason)>;
+
+        /**
+         * @brief Whether a request asks to switch to the WebSocket protocol.
+         * @param method Request method, must be GET
+         * @param version Request version, must be HTTP/1.1
+         * @param headers Request headers with upper-case names, as parsed by http_message_handler
+         * @note Checks Upgrade, Connection, Sec-WebSocket-Version (13) and Sec-WebSocket-Key
+         */
+        static bool is_upgrade_request(const std::string &method, const std::string &version,
+                                       const std::multimap<std::string, std::string> &headers);
+
+        /**
+         * @brief Sec-WebSocket-Accept value for a Sec-WebSocket-Key.
+         * @return base64(SHA-1(key + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"))
+         */
+        static std::string accept_key(const std::string &client_key);
+
+        websocket_connection(const websocket_connection &) = delete;
+        websocket_connection &operator=(const websocket_connection &) = delete;
+
+        /// Send a text message (the caller guarantees UTF-8); false once the connection is closing
+        bool send_text(const std::string &message);
+
+        /// Send a binary message; false once the connection is closing
+        bool send_binary(const std::string &message);
+
+        /// Send a ping (payload of at most 125 bytes); the client's pong is not reported
+        bool ping(const std::string &payload = "");
+
+        /**
+         * @brief Start the close handshake.
+         * @param code Close code sent to the client
+         * @param reason Reason text, cut to fit a control frame (123 bytes)
+         * @note The TCP connection is closed once the client answered with its close frame
+         */
+        void close(std::uint16_t code = websocket_close::NORMAL, const std::string &reason = "");
+
+        void on_message(message_callback callback) { message_handler = std::move(callback); }
+        void on_close(close_callback callback) { close_handler = std::move(callback); }
+
+        /// false once either side sent a close frame or the connection dropped
+        bool is_open() const { return !close_sent.load() && !closed.load(); }
+
+        /// Remote address of the client
+        const std::string &get_remote_address() const { return remote; }
+
+        /// Bytes sent that the client has not read yet (0 on the epoll backend)
+        std::size_t get_queued_bytes() const { return outbound ? outbound->size() : 0; }
+
+        /// false while more than config::OUTBOUND_HIGH_WATERMARK bytes wait for the client (always true on epoll)
+        bool is_writable() const { return !outbound || outbound->writable(); }
+
+        /// Run callback once the connection is writable, see http_response::on_writable()
+        void on_writable(std::function<void()> callback);
+
+    private:
+        friend class http_server;
+
+        /**
+         * @brief Private constructor, used by http_server once the 101 response was sent.
+         * @param remote Remote address of the client
+         * @param write Queues bytes for the client
+         * @param close_transport Closes the TCP connection once queued bytes were written
+         * @param outbound Outbound queue of the connection (null on epoll)
+         */
+        websocket_connection(std::string remote, std::function<void(const std::string &)> write,
+                             std::function<void()> close_transport, std::shared_ptr<outbound_queue> outbound);
+
+        std::string remote;
+        std::function<void(const std::string &)> write;
+        std::function<void()> close_transport;
+        std::shared_ptr<outbound_queue> outbound;
+
+        message_callback message_handler;
+        close_callback close_handler;
+
+        std::atomic<bool> close_sent{false};
+        std::atomic<bool> closed{false}; ///< The transport is gone (or the server was destroyed)
+
+        // Receive side, event loop thread only
+        websocket_frame_parser parser;
+        std::string message;      ///< Data frames of the message being reassembled
+        std::string control;      ///< Payload of the current control frame
+        bool in_message = false;  ///< A fragmented message waits for its last frame
+        bool message_binary = false;
+        bool close_received = false;
+        bool close_reported = false;
+
+        /// When close() sent our close frame (steady_clock ticks, 0 = not sent); read by the idle sweeper
+        std::atomic<std::chrono::steady_clock::rep> close_started{0};
+
+        /// Feed bytes read from the client (event loop thread)
+        void receive(const char *data, std::size_t size);
+
+        /// The TCP connection was closed; reports ABNORMAL unless a close frame was received
+        void transport_closed();
+
+        /// The server is going away: later sends are dropped
+        void detach() { closed.store(true); }
+
+        /// Our close frame went unanswered for longer than timeout
+        bool close_timed_out(std::chrono::steady_clock::time_point now, std::chrono::seconds timeout) const;
+
+        /// Queue one unfragmented frame, unless a close frame was sent already
+        bool send_frame(websocket_opcode opcode, const char *payload, std::size_t size);
+
+        /// Queue one frame unconditionally
+        void write_frame(websocket_opcode opcode, const char *payload, std::size_t size);
+
+        /// Queue a close frame carrying code (none for NO_STATUS) and reason
+        void write_close(std::uint16_t code, const std::string &reason);
+        void handle_frame();
+        void handle_close_frame();
+
+        /// Send a close frame (unless one was sent) and close the transport
+        void fail(std::uint16_t code);
+        void report_close(std::uint16_t code, const std::string &reason);
+    };
+}
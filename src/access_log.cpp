@@ -0,0 +1,328 @@
+#include <algorithm>
+#include <ctime>
+#include <stdexcept>
+
+#include "../includes/access_log.hpp"
+
+namespace hh_http
+{
+    namespace
+    {
+        /// How long the writer sleeps when every ring is empty
+        constexpr std::chrono::milliseconds WRITER_IDLE_INTERVAL(20);
+
+        std::atomic<std::uint64_t> next_logger_id{1};
+
+        std::size_t round_up_to_power_of_two(std::size_t value)
+        {
+            std::size_t power = 1;
+            while (power < value)
+                power <<= 1;
+            return power;
+        }
+
+        void append_json_string(std::string &out, const char *value)
+        {
+            out += '"';
+            for (const char *p = value; *p; ++p)
+            {
+                unsigned char c = static_cast<unsigned char>(*p);
+                switch (c)
+                {
+                case '"':
+                    out += "\\\"";
+                    break;
+                case '\\':
+                    out += "\\\\";
+                    break;
+                case '\n':
+                    out += "\\n";
+                    break;
+                case '\r':
+                    out += "\\r";
+                    break;
+                case '\t':
+                    out += "\\t";
+                    break;
+                default:
+                    if (c < 0x20)
+                    {
+                        char escaped[8];
+                        std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                        out += escaped;
+                    }
+                    else
+                    {
+                        out += static_cast<char>(c);
+                    }
+                }
+            }
+            out += '"';
+        }
+
+        /// Quoted CLF field: '"' and control characters are escaped, empty values become "-"
+        void append_clf_string(std::string &out, const char *value)
+        {
+            out += '"';
+            if (!*value)
+                out += '-';
+            for (const char *p = value; *p; ++p)
+            {
+                unsigned char c = static_cast<unsigned char>(*p);
+                if (c == '"' || c == '\\')
+                {
+                    out += '\\';
+                    out += static_cast<char>(c);
+                }
+                else if (c < 0x20)
+                {
+                    char escaped[8];
+                    std::snprintf(escaped, sizeof(escaped), "\\x%02x", c);
+                    out += escaped;
+                }
+                else
+                {
+                    out += static_cast<char>(c);
+                }
+            }
+            out += '"';
+        }
+    }
+
+    /**
+     * Per-thread cache of the ring each logger gave this thread. When the
+     * thread exits its rings are marked orphaned, and the writer releases
+     * them once drained; a ring of a destroyed logger stays alive only
+     * until the thread next registers a ring or exits.
+     */
+    struct access_log_thread_rings
+    {
+        struct entry
+        {
+            std::uint64_t logger_id;
+            std::shared_ptr<access_log::ring> ring;
+        };
+        std::vector<entry> entries;
+
+        ~access_log_thread_rings()
+        {
+            for (const auto &cached : entries)
+                cached.ring->orphaned.store(true, std::memory_order_release);
+        }
+    };
+
+    namespace
+    {
+        thread_local access_log_thread_rings thread_rings;
+    }
+
+    access_log::access_log(const std::string &path, access_log_format format, std::size_t ring_capacity)
+        : format(format), ring_capacity(round_up_to_power_of_two(ring_capacity ? ring_capacity : 1)),
+          id(next_logger_id.fetch_add(1, std::memory_order_relaxed))
+    {
+        if (path == "-")
+        {
+            output = stdout;
+            owns_output = false;
+        }
+        else
+        {
+            output = std::fopen(path.c_str(), "a");
+            owns_output = true;
+            if (!output)
+                throw std::runtime_error("Failed to open access log: " + path);
+        }
+
+        writer = std::thread([this]()
+                             { run_writer(); });
+    }
+
+    access_log::~access_log()
+    {
+        stopping.store(true);
+        wake.notify_all();
+        if (writer.joinable())
+            writer.join();
+        // Threads still caching these rings release them on their next registration or exit
+        for (const auto &r : rings)
+            r->closed.store(true, std::memory_order_release);
+        if (owns_output)
+            std::fclose(output);
+        else
+            std::fflush(output);
+    }
+
+    access_log::ring *access_log::ring_for_this_thread()
+    {
+        auto &entries = thread_rings.entries;
+        for (const auto &cached : entries)
+        {
+            if (cached.logger_id == id)
+                return cached.ring.get();
+        }
+
+        // Rings of loggers destroyed since are of no use to this thread any more
+        entries.erase(std::remove_if(entries.begin(), entries.end(), [](const access_log_thread_rings::entry &cached)
+                                     { return cached.ring->closed.load(std::memory_order_acquire); }),
+                      entries.end());
+
+        // First record from this thread: register a ring (the only locked step on the producer side)
+        auto fresh = std::make_shared<ring>(ring_capacity);
+        {
+            std::lock_guard<std::mutex> lock(rings_mutex);
+            rings.push_back(fresh);
+        }
+        entries.push_back({id, fresh});
+        return fresh.get();
+    }
+
+    bool access_log::log(const access_log_record &record)
+    {
+        ring *r = ring_for_this_thread();
+        std::size_t head = r->head.load(std::memory_order_relaxed);
+        if (head - r->tail.load(std::memory_order_acquire) >= r->slots.size())
+        {
+            dropped_records.fetch_add(1, std::memory_order_relaxed);
+            if (config::ENABLE_METRICS)
+                metrics::registry::instance().access_log_dropped_total.increment();
+            return false;
+        }
+        r->slots[head & r->mask] = record;
+        r->head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    std::size_t access_log::drain(std::string &batch)
+    {
+        std::vector<ring *> snapshot;
+        {
+            std::lock_guard<std::mutex> lock(rings_mutex);
+            for (const auto &r : rings)
+                snapshot.push_back(r.get());
+        }
+
+        std::size_t drained = 0;
+        std::vector<ring *> finished;
+        for (ring *r : snapshot)
+        {
+            // Read before head: once its thread has exited, an orphan's head is final
+            bool orphaned = r->orphaned.load(std::memory_order_acquire);
+            std::size_t tail = r->tail.load(std::memory_order_relaxed);
+            std::size_t head = r->head.load(std::memory_order_acquire);
+            for (; tail != head; ++tail, ++drained)
+                format_record(r->slots[tail & r->mask], batch);
+            r->tail.store(tail, std::memory_order_release);
+            if (orphaned)
+                finished.push_back(r);
+        }
+
+        // Rings of exited threads are drained for good: release them
+        if (!finished.empty())
+        {
+            std::lock_guard<std::mutex> lock(rings_mutex);
+            rings.erase(std::remove_if(rings.begin(), rings.end(), [&finished](const std::shared_ptr<ring> &r)
+                                       { return std::find(finished.begin(), finished.end(), r.get()) != finished.end(); }),
+                        rings.end());
+        }
+        return drained;
+    }
+
+    void access_log::run_writer()
+    {
+        std::string batch;
+        batch.reserve(64 * 1024);
+
+        while (true)
+        {
+            bool stop_requested = stopping.load();
+
+            batch.clear();
+            std::size_t drained = drain(batch);
+            if (drained)
+            {
+                std::fwrite(batch.data(), 1, batch.size(), output);
+                std::fflush(output);
+                written_records.fetch_add(drained, std::memory_order_relaxed);
+            }
+
+            // Rings were drained after the stop flag was observed, nothing is left behind
+            if (stop_requested)
+                return;
+
+            if (!drained)
+            {
+                std::unique_lock<std::mutex> lock(wake_mutex);
+                wake.wait_for(lock, WRITER_IDLE_INTERVAL, [this]()
+                              { return stopping.load(); });
+            }
+        }
+    }
+
+    void access_log::format_record(const access_log_record &record, std::string &out) const
+    {
+        std::time_t seconds = static_cast<std::time_t>(record.unix_time_ns / 1000000000);
+        std::tm tm{};
+        gmtime_r(&seconds, &tm);
+        char number[32];
+
+        if (format == access_log_format::JSON)
+        {
+            char time_buffer[40];
+            std::strftime(time_buffer, sizeof(time_buffer), "%Y-%m-%dT%H:%M:%S", &tm);
+            std::snprintf(number, sizeof(number), ".%03dZ", static_cast<int>((record.unix_time_ns / 1000000) % 1000));
+
+            out += "{\"time\":\"";
+            out += time_buffer;
+            out += number;
+            out += "\",\"remote\":";
+            append_json_string(out, record.remote);
+            out += ",\"method\":";
+            append_json_string(out, record.method);
+            out += ",\"uri\":";
+            append_json_string(out, record.uri);
+            out += ",\"version\":";
+            append_json_string(out, record.version);
+            out += ",\"status\":";
+            out += std::to_string(record.status);
+            out += ",\"bytes\":";
+            out += std::to_string(record.bytes_sent);
+            out += ",\"duration_us\":";
+            out += std::to_string(record.duration_ns / 1000);
+            out += ",\"referer\":";
+            append_json_string(out, record.referer);
+            out += ",\"user_agent\":";
+            append_json_string(out, record.user_agent);
+            out += "}\n";
+            return;
+        }
+
+        // host ident authuser [date] "request" status bytes "referer" "user-agent"
+        char time_buffer[40];
+        std::strftime(time_buffer, sizeof(time_buffer), "[%d/%b/%Y:%H:%M:%S +0000]", &tm);
+
+        out += *record.remote ? record.remote : "-";
+        out += " - - ";
+        out += time_buffer;
+        out += " \"";
+        out += record.method;
+        out += ' ';
+        for (const char *p = record.uri; *p; ++p)
+        {
+            if (*p == '"' || static_cast<unsigned char>(*p) < 0x20)
+                out += '?';
+            else
+                out += *p;
+        }
+        out += ' ';
+        out += record.version;
+        out += "\" ";
+        out += std::to_string(record.status);
+        out += ' ';
+        out += record.bytes_sent ? std::to_string(record.bytes_sent) : "-";
+        out += ' ';
+        append_clf_string(out, record.referer);
+        out += ' ';
+        append_clf_string(out, record.user_agent);
+        out += '\n';
+    }
+}
@@ -0,0 +1,394 @@
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+#include <sys/stat.h>
+
+#ifdef HTTP_WITH_ZLIB
+#include <zlib.h>
+#endif
+
+#include "../includes/compression.hpp"
+#include "../includes/http_consts.hpp"
+
+namespace hh_http
+{
+    namespace compression
+    {
+        namespace
+        {
+            /// Output is produced in pieces of this size
+            constexpr std::size_t OUTPUT_CHUNK_SIZE = 16 * 1024;
+
+            std::string trim(const std::string &value)
+            {
+                std::size_t start = value.find_first_not_of(" \t");
+                if (start == std::string::npos)
+                    return "";
+                std::size_t end = value.find_last_not_of(" \t");
+                return value.substr(start, end - start + 1);
+            }
+
+            std::string to_lower_case(std::string value)
+            {
+                std::transform(value.begin(), value.end(), value.begin(), [](unsigned char c)
+                               { return std::tolower(c); });
+                return value;
+            }
+
+            /**
+             * q-value the client gave a coding: an exact match wins over "*",
+             * a coding that is not listed at all gets 0.
+             */
+            double accepted_quality(const std::string &accept_encoding, const std::string &name)
+            {
+                double exact = -1, wildcard = -1;
+                std::size_t start = 0;
+                while (start <= accept_encoding.size())
+                {
+                    std::size_t comma = accept_encoding.find(',', start);
+                    if (comma == std::string::npos)
+                        comma = accept_encoding.size();
+                    std::string item = accept_encoding.substr(start, comma - start);
+                    start = comma + 1;
+
+                    std::size_t semicolon = item.find(';');
+                    std::string token = to_lower_case(trim(item.substr(0, semicolon)));
+                    if (token.empty())
+                        continue;
+
+                    double quality = 1;
+                    if (semicolon != std::string::npos)
+                    {
+                        std::string parameter = trim(item.substr(semicolon + 1));
+                        if (parameter.size() > 2 && (parameter[0] == 'q' || parameter[0] == 'Q') && parameter[1] == '=')
+                            quality = std::strtod(parameter.c_str() + 2, nullptr);
+                    }
+
+                    if (token == name)
+                        exact = quality;
+                    else if (token == "*")
+                        wildcard = quality;
+                }
+                if (exact >= 0)
+                    return exact;
+                return wildcard >= 0 ? wildcard : 0;
+            }
+
+#ifdef HTTP_WITH_ZLIB
+            /// Idle streams kept per thread and (coding, level); extra streams are freed
+            constexpr std::size_t MAX_POOLED_STREAMS = 4;
+
+            struct pooled_stream
+            {
+                coding stream_coding;
+                int level;
+                z_stream *stream;
+            };
+
+            /// Per-thread pool of initialized deflate streams, freed when the thread exits
+            struct stream_pool
+            {
+                std::vector<pooled_stream> idle;
+
+                ~stream_pool()
+                {
+                    for (auto &entry : idle)
+                    {
+                        deflateEnd(entry.stream);
+                        delete entry.stream;
+                    }
+                }
+
+                z_stream *acquire(coding c, int level)
+                {
+                    for (std::size_t i = 0; i < idle.size(); ++i)
+                    {
+                        if (idle[i].stream_coding == c && idle[i].level == level)
+                        {
+                            z_stream *stream = idle[i].stream;
+                            idle[i] = idle.back();
+                            idle.pop_back();
+                            return stream;
+                        }
+                    }
+
+                    auto stream = std::make_unique<z_stream>();
+                    // 15 window bits; +16 asks zlib for a gzip header and trailer instead of the zlib wrapper
+                    int window_bits = c == coding::GZIP ? 15 + 16 : 15;
+                    if (deflateInit2(stream.get(), level, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+                        throw std::runtime_error("Failed to initialize zlib compressor");
+                    return stream.release();
+                }
+
+                void release(coding c, int level, z_stream *stream)
+                {
+                    std::size_t same_kind = 0;
+                    for (const auto &entry : idle)
+                        same_kind += entry.stream_coding == c && entry.level == level;
+
+                    if (same_kind >= MAX_POOLED_STREAMS || deflateReset(stream) != Z_OK)
+                    {
+                        deflateEnd(stream);
+                        delete stream;
+                        return;
+                    }
+                    idle.push_back({c, level, stream});
+                }
+            };
+
+            stream_pool &this_thread_pool()
+            {
+                thread_local stream_pool pool;
+                return pool;
+            }
+#endif
+        }
+
+        bool available()
+        {
+#ifdef HTTP_WITH_ZLIB
+            return true;
+#else
+            return false;
+#endif
+        }
+
+        const char *coding_name(coding c)
+        {
+            switch (c)
+            {
+            case coding::GZIP:
+                return "gzip";
+            case coding::DEFLATE:
+                return "deflate";
+            case coding::IDENTITY:
+                break;
+            }
+            return "identity";
+        }
+
+        coding negotiate(const std::string &accept_encoding)
+        {
+            if (!available() || accept_encoding.empty())
+                return coding::IDENTITY;
+
+            double gzip = accepted_quality(accept_encoding, "gzip");
+            double deflate = accepted_quality(accept_encoding, "deflate");
+            if (gzip <= 0 && deflate <= 0)
+                return coding::IDENTITY;
+            return gzip >= deflate ? coding::GZIP : coding::DEFLATE;
+        }
+
+        bool is_compressible_type(const std::string &content_type)
+        {
+            std::string media_type = to_lower_case(trim(content_type.substr(0, content_type.find(';'))));
+            if (media_type.empty())
+                return false;
+
+            for (const auto &allowed : config::COMPRESSIBLE_CONTENT_TYPES)
+            {
+                if (!allowed.empty() && allowed.back() == '/')
+                {
+                    if (media_type.compare(0, allowed.size(), allowed) == 0)
+                        return true;
+                }
+                else if (media_type == allowed)
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        compressor::compressor(coding c, int level)
+            : stream(nullptr), stream_coding(c), stream_level(level < 0 ? config::COMPRESSION_LEVEL : level)
+        {
+            if (c == coding::IDENTITY)
+                throw std::runtime_error("compressor needs gzip or deflate");
+#ifdef HTTP_WITH_ZLIB
+            stream = this_thread_pool().acquire(stream_coding, stream_level);
+#else
+            throw std::runtime_error("Compression is unavailable: built without zlib");
+#endif
+        }
+
+        compressor::~compressor()
+        {
+            release();
+        }
+
+        std::string compressor::update(const std::string &data)
+        {
+#ifdef HTTP_WITH_ZLIB
+            return run(data, Z_NO_FLUSH);
+#else
+            return run(data, 0);
+#endif
+        }
+
+        std::string compressor::flush(const std::string &data)
+        {
+#ifdef HTTP_WITH_ZLIB
+            return run(data, Z_SYNC_FLUSH);
+#else
+            return run(data, 0);
+#endif
+        }
+
+        std::string compressor::finish(const std::string &data)
+        {
+#ifdef HTTP_WITH_ZLIB
+            std::string output = run(data, Z_FINISH);
+            release();
+            return output;
+#else
+            return run(data, 0);
+#endif
+        }
+
+        std::string compressor::run(const std::string &data, int flush_mode)
+        {
+            if (!stream)
+                throw std::runtime_error("compressor used after finish()");
+#ifdef HTTP_WITH_ZLIB
+            z_stream *z = static_cast<z_stream *>(stream);
+            z->next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+            z->avail_in = static_cast<uInt>(data.size());
+
+            std::string output;
+            char buffer[OUTPUT_CHUNK_SIZE];
+            int result;
+            do
+            {
+                z->next_out = reinterpret_cast<Bytef *>(buffer);
+                z->avail_out = sizeof(buffer);
+                result = deflate(z, flush_mode);
+                if (result == Z_STREAM_ERROR)
+                    throw std::runtime_error("zlib compression failed");
+                output.append(buffer, sizeof(buffer) - z->avail_out);
+            } while (z->avail_out == 0 || (flush_mode == Z_FINISH && result != Z_STREAM_END));
+            return output;
+#else
+            (void)data;
+            (void)flush_mode;
+            return "";
+#endif
+        }
+
+        void compressor::release()
+        {
+#ifdef HTTP_WITH_ZLIB
+            if (stream)
+                this_thread_pool().release(stream_coding, stream_level, static_cast<z_stream *>(stream));
+#endif
+            stream = nullptr;
+        }
+
+        decompressor::decompressor(coding c, std::size_t max_output, std::size_t max_ratio)
+            : stream(nullptr), max_output(max_output), max_ratio(max_ratio)
+        {
+            if (c == coding::IDENTITY)
+                throw std::runtime_error("decompressor needs gzip or deflate");
+#ifdef HTTP_WITH_ZLIB
+            auto z = std::make_unique<z_stream>();
+            // +16 expects a gzip header and trailer, plain 15 the zlib wrapper used by "deflate"
+            int window_bits = c == coding::GZIP ? 15 + 16 : 15;
+            if (inflateInit2(z.get(), window_bits) != Z_OK)
+                throw std::runtime_error("Failed to initialize zlib decompressor");
+            stream = z.release();
+#else
+            throw std::runtime_error("Decompression is unavailable: built without zlib");
+#endif
+        }
+
+        decompressor::~decompressor()
+        {
+#ifdef HTTP_WITH_ZLIB
+            if (stream)
+            {
+                inflateEnd(static_cast<z_stream *>(stream));
+                delete static_cast<z_stream *>(stream);
+            }
+#endif
+        }
+
+        decompress_status decompressor::update(const char *data, std::size_t size, std::string &out)
+        {
+            if (!size)
+                return decompress_status::OK;
+            if (stream_finished)
+                return decompress_status::CORRUPT;
+#ifdef HTTP_WITH_ZLIB
+            z_stream *z = static_cast<z_stream *>(stream);
+            z->next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+            z->avail_in = static_cast<uInt>(size);
+
+            char buffer[OUTPUT_CHUNK_SIZE];
+            while (z->avail_in > 0 || z->avail_out == 0)
+            {
+                z->next_out = reinterpret_cast<Bytef *>(buffer);
+                z->avail_out = sizeof(buffer);
+                std::size_t in_before = z->avail_in;
+                int result = inflate(z, Z_NO_FLUSH);
+                if (result != Z_OK && result != Z_STREAM_END && result != Z_BUF_ERROR)
+                    return decompress_status::CORRUPT;
+
+                std::size_t written = sizeof(buffer) - z->avail_out;
+                consumed += in_before - z->avail_in;
+                produced += written;
+                if (produced > max_output ||
+                    (max_ratio && produced > RATIO_CHECK_MIN_OUTPUT && produced / (consumed ? consumed : 1) > max_ratio))
+                    return decompress_status::TOO_LARGE;
+                out.append(buffer, written);
+
+                if (result == Z_STREAM_END)
+                {
+                    stream_finished = true;
+                    // Anything after the end of the stream is not part of this body
+                    return z->avail_in ? decompress_status::CORRUPT : decompress_status::OK;
+                }
+                if (result == Z_BUF_ERROR && written == 0)
+                    break; // needs more input
+            }
+            return decompress_status::OK;
+#else
+            (void)data;
+            (void)out;
+            return decompress_status::CORRUPT;
+#endif
+        }
+
+        coding parse_content_encoding(const std::string &content_encoding)
+        {
+            std::string value = to_lower_case(trim(content_encoding));
+            if (value == "gzip" || value == "x-gzip")
+                return coding::GZIP;
+            if (value == "deflate")
+                return coding::DEFLATE;
+            return coding::IDENTITY;
+        }
+
+        std::string compress(const std::string &data, coding c, int level)
+        {
+            compressor z(c, level);
+            return z.finish(data);
+        }
+
+        std::string find_precompressed(const std::string &path, const std::string &accept_encoding)
+        {
+            if (accepted_quality(accept_encoding, "gzip") <= 0)
+                return "";
+
+            std::string candidate = path + ".gz";
+            struct stat original, compressed;
+            if (stat(candidate.c_str(), &compressed) != 0 || !S_ISREG(compressed.st_mode))
+                return "";
+            // A stale .gz (the original was edited after it was built) must not be served
+            if (stat(path.c_str(), &original) == 0 && original.st_mtime > compressed.st_mtime)
+                return "";
+            return candidate;
+        }
+    }
+}
@@ -0,0 +1,194 @@
+#include <algorithm>
+
+#include "../includes/event_stream.hpp"
+#include "../includes/http_consts.hpp"
+#include "../includes/metrics.hpp"
+
+namespace hh_http
+{
+    namespace
+    {
+        /// Append "name: value\n", without the line breaks value may contain
+        void append_field(std::string &out, const char *name, const std::string &value)
+        {
+            out += name;
+            out += ": ";
+            for (char c : value)
+            {
+                if (c != '\r' && c != '\n')
+                    out.push_back(c);
+            }
+            out.push_back('\n');
+        }
+    }
+
+    std::string event_stream::serialize(const std::string &data, const std::string &event, const std::string &id)
+    {
+        std::string out;
+        out.reserve(data.size() + event.size() + id.size() + 32);
+        if (!id.empty())
+            append_field(out, "id", id);
+        if (!event.empty())
+            append_field(out, "event", event);
+
+        // Each line of data is its own field; CRLF, CR and LF all end a line
+        std::size_t start = 0;
+        while (true)
+        {
+            std::size_t end = data.find_first_of("\r\n", start);
+            out += "data: ";
+            out.append(data, start, end == std::string::npos ? std::string::npos : end - start);
+            out.push_back('\n');
+            if (end == std::string::npos)
+                break;
+            start = end + (data.compare(end, 2, "\r\n") == 0 ? 2 : 1);
+        }
+        out.push_back('\n');
+        return out;
+    }
+
+    event_stream::event_stream(std::string remote, std::function<void(const std::string &)> write,
+                               std::function<void(std::shared_ptr<const std::string>)> write_shared,
+                               std::function<void()> close_transport, std::shared_ptr<outbound_queue> outbound)
+        : remote(std::move(remote)), write(std::move(write)), write_shared(std::move(write_shared)),
+          close_transport(std::move(close_transport)), outbound(std::move(outbound))
+    {
+    }
+
+    event_stream::~event_stream()
+    {
+        if (!detached.load() && !closed.exchange(true))
+            close_transport();
+    }
+
+    bool event_stream::send(const std::string &data, const std::string &event, const std::string &id)
+    {
+        if (closed.load())
+            return false;
+        write(serialize(data, event, id));
+        return true;
+    }
+
+    bool event_stream::send_serialized(std::shared_ptr<const std::string> event)
+    {
+        if (closed.load())
+            return false;
+        write_shared(std::move(event));
+        return true;
+    }
+
+    bool event_stream::send_comment(const std::string &text)
+    {
+        if (closed.load())
+            return false;
+        std::string comment;
+        append_field(comment, "", text);
+        write(comment);
+        return true;
+    }
+
+    void event_stream::close()
+    {
+        if (!detached.load() && !closed.exchange(true))
+            close_transport();
+    }
+
+    void event_stream::on_writable(std::function<void()> callback)
+    {
+        if (outbound)
+            outbound->on_writable(std::move(callback));
+        else
+            callback();
+    }
+
+    void event_stream::detach()
+    {
+        detached.store(true);
+        closed.store(true);
+    }
+
+    event_channel::event_channel(std::size_t max_queued_bytes)
+        : max_queued_bytes(max_queued_bytes)
+    {
+    }
+
+    event_channel::event_channel()
+        : event_channel(config::OUTBOUND_HIGH_WATERMARK)
+    {
+    }
+
+    void event_channel::subscribe(std::shared_ptr<event_stream> stream)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        subscribers.push_back(std::move(stream));
+    }
+
+    void event_channel::unsubscribe(const std::shared_ptr<event_stream> &stream)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        subscribers.erase(std::remove(subscribers.begin(), subscribers.end(), stream), subscribers.end());
+    }
+
+    std::size_t event_channel::publish(const std::string &data, const std::string &event, const std::string &id)
+    {
+        return publish_serialized(std::make_shared<const std::string>(event_stream::serialize(data, event, id)));
+    }
+
+    /**
+     * One pass over the subscribers: closed streams are dropped, streams
+     * over the queue limit are evicted, every other one gets a reference to
+     * the same buffer. Removal swaps with the last element, order does not
+     * matter to a broadcast.
+     */
+    std::size_t event_channel::publish_serialized(std::shared_ptr<const std::string> event)
+    {
+        std::size_t delivered = 0;
+        std::size_t evicted = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (std::size_t i = 0; i < subscribers.size();)
+            {
+                auto &stream = subscribers[i];
+                bool keep = stream->is_open();
+                if (keep && stream->get_queued_bytes() > max_queued_bytes)
+                {
+                    stream->close();
+                    keep = false;
+                    ++evicted;
+                }
+                if (keep && stream->send_serialized(event))
+                {
+                    ++delivered;
+                    ++i;
+                    continue;
+                }
+                std::swap(stream, subscribers.back());
+                subscribers.pop_back();
+            }
+        }
+        if (config::ENABLE_METRICS)
+        {
+            auto &stats = metrics::registry::instance();
+            stats.sse_events_published_total.increment();
+            stats.sse_subscribers_evicted_total.increment(evicted);
+        }
+        return delivered;
+    }
+
+    void event_channel::close_all()
+    {
+        std::vector<std::shared_ptr<event_stream>> closing;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closing.swap(subscribers);
+        }
+        for (auto &stream : closing)
+            stream->close();
+    }
+
+    std::size_t event_channel::size() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return subscribers.size();
+    }
+}
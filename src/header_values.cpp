@@ -0,0 +1,132 @@
+#include "../includes/header_values.hpp"
+
+namespace hh_http
+{
+    namespace header_values
+    {
+        namespace
+        {
+            std::string_view trim(std::string_view value)
+            {
+                std::size_t first = value.find_first_not_of(" \t");
+                if (first == std::string_view::npos)
+                    return std::string_view();
+                std::size_t last = value.find_last_not_of(" \t");
+                return value.substr(first, last - first + 1);
+            }
+
+            bool iequals(std::string_view a, std::string_view b)
+            {
+                if (a.size() != b.size())
+                    return false;
+                for (std::size_t i = 0; i < a.size(); ++i)
+                {
+                    char x = a[i] >= 'A' && a[i] <= 'Z' ? static_cast<char>(a[i] + 32) : a[i];
+                    char y = b[i] >= 'A' && b[i] <= 'Z' ? static_cast<char>(b[i] + 32) : b[i];
+                    if (x != y)
+                        return false;
+                }
+                return true;
+            }
+
+            // Credentials after "<scheme> " if the value uses this scheme, empty otherwise
+            std::string_view credentials_of(std::string_view value, std::string_view scheme)
+            {
+                value = trim(value);
+                std::size_t space = value.find(' ');
+                if (space == std::string_view::npos || !iequals(value.substr(0, space), scheme))
+                    return std::string_view();
+                return trim(value.substr(space + 1));
+            }
+
+            int base64_value(char c)
+            {
+                if (c >= 'A' && c <= 'Z')
+                    return c - 'A';
+                if (c >= 'a' && c <= 'z')
+                    return c - 'a' + 26;
+                if (c >= '0' && c <= '9')
+                    return c - '0' + 52;
+                if (c == '+')
+                    return 62;
+                if (c == '/')
+                    return 63;
+                return -1;
+            }
+
+            // Standard base64; padding is optional but nothing may follow it
+            bool base64_decode(std::string_view in, std::string &out)
+            {
+                out.clear();
+                out.reserve(in.size() / 4 * 3 + 2);
+                unsigned bits = 0;
+                int bit_count = 0;
+                std::size_t i = 0;
+                for (; i < in.size() && in[i] != '='; ++i)
+                {
+                    int value = base64_value(in[i]);
+                    if (value < 0)
+                        return false;
+                    bits = (bits << 6) | static_cast<unsigned>(value);
+                    bit_count += 6;
+                    if (bit_count >= 8)
+                    {
+                        bit_count -= 8;
+                        out.push_back(static_cast<char>((bits >> bit_count) & 0xff));
+                    }
+                }
+                // A single leftover character cannot encode a byte
+                if (bit_count >= 6)
+                    return false;
+                for (; i < in.size(); ++i)
+                {
+                    if (in[i] != '=')
+                        return false;
+                }
+                return true;
+            }
+        }
+
+        void parse_cookies(std::string_view value, std::vector<cookie> &out)
+        {
+            while (!value.empty())
+            {
+                std::size_t end = value.find(';');
+                std::string_view pair = value.substr(0, end);
+                value.remove_prefix(end == std::string_view::npos ? value.size() : end + 1);
+
+                std::size_t equals = pair.find('=');
+                if (equals == std::string_view::npos)
+                    continue;
+                std::string_view name = trim(pair.substr(0, equals));
+                std::string_view cookie_value = trim(pair.substr(equals + 1));
+                if (name.empty())
+                    continue;
+                if (cookie_value.size() >= 2 && cookie_value.front() == '"' && cookie_value.back() == '"')
+                    cookie_value = cookie_value.substr(1, cookie_value.size() - 2);
+                out.push_back({name, cookie_value});
+            }
+        }
+
+        std::string_view bearer_token(std::string_view value)
+        {
+            std::string_view token = credentials_of(value, "Bearer");
+            // token68 has no spaces: "Bearer a b" carries no valid token
+            return token.find_first_of(" \t") == std::string_view::npos ? token : std::string_view();
+        }
+
+        bool parse_basic(std::string_view value, basic_credentials &out)
+        {
+            std::string_view encoded = credentials_of(value, "Basic");
+            std::string decoded;
+            if (encoded.empty() || !base64_decode(encoded, decoded))
+                return false;
+            std::size_t colon = decoded.find(':');
+            if (colon == std::string::npos)
+                return false;
+            out.user = decoded.substr(0, colon);
+            out.password = decoded.substr(colon + 1);
+            return true;
+        }
+    }
+}
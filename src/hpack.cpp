@@ -0,0 +1,470 @@
+#include <algorithm>
+
+#include "../includes/hpack.hpp"
+
+namespace hh_http
+{
+    namespace hpack
+    {
+        namespace
+        {
+            /// Largest dynamic table the encoder keeps, whatever the peer allows
+            constexpr std::size_t ENCODER_TABLE_LIMIT = 4096;
+
+            /// Static table (RFC 7541, appendix A); index 1 is the first entry
+            const std::vector<header_field> &static_table()
+            {
+                static const std::vector<header_field> table = {
+                    {":authority", ""},
+                    {":method", "GET"},
+                    {":method", "POST"},
+                    {":path", "/"},
+                    {":path", "/index.html"},
+                    {":scheme", "http"},
+                    {":scheme", "https"},
+                    {":status", "200"},
+                    {":status", "204"},
+                    {":status", "206"},
+                    {":status", "304"},
+                    {":status", "400"},
+                    {":status", "404"},
+                    {":status", "500"},
+                    {"accept-charset", ""},
+                    {"accept-encoding", "gzip, deflate"},
+                    {"accept-language", ""},
+                    {"accept-ranges", ""},
+                    {"accept", ""},
+                    {"access-control-allow-origin", ""},
+                    {"age", ""},
+                    {"allow", ""},
+                    {"authorization", ""},
+                    {"cache-control", ""},
+                    {"content-disposition", ""},
+                    {"content-encoding", ""},
+                    {"content-language", ""},
+                    {"content-length", ""},
+                    {"content-location", ""},
+                    {"content-range", ""},
+                    {"content-type", ""},
+                    {"cookie", ""},
+                    {"date", ""},
+                    {"etag", ""},
+                    {"expect", ""},
+                    {"expires", ""},
+                    {"from", ""},
+                    {"host", ""},
+                    {"if-match", ""},
+                    {"if-modified-since", ""},
+                    {"if-none-match", ""},
+                    {"if-range", ""},
+                    {"if-unmodified-since", ""},
+                    {"last-modified", ""},
+                    {"link", ""},
+                    {"location", ""},
+                    {"max-forwards", ""},
+                    {"proxy-authenticate", ""},
+                    {"proxy-authorization", ""},
+                    {"range", ""},
+                    {"referer", ""},
+                    {"refresh", ""},
+                    {"retry-after", ""},
+                    {"server", ""},
+                    {"set-cookie", ""},
+                    {"strict-transport-security", ""},
+                    {"transfer-encoding", ""},
+                    {"user-agent", ""},
+                    {"vary", ""},
+                    {"via", ""},
+                    {"www-authenticate", ""},
+                };
+                return table;
+            }
+
+            /**
+             * Code length of every symbol (RFC 7541, appendix B), 256 = EOS.
+             * The code is canonical: within a length, codes are assigned in
+             * symbol order, so the lengths alone define it.
+             */
+            constexpr std::uint8_t HUFFMAN_CODE_LENGTHS[257] = {
+                13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+                28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+                6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+                5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+                13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+                7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+                15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+                6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+                20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+                24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+                22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+                21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+                26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+                19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+                20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+                26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+                30};
+
+            constexpr int HUFFMAN_MIN_LENGTH = 5;
+            constexpr int HUFFMAN_MAX_LENGTH = 30;
+            constexpr std::uint16_t HUFFMAN_EOS = 256;
+
+            /// First code, symbol count and position in symbols of every code length
+            struct huffman_table
+            {
+                std::uint32_t first_code[HUFFMAN_MAX_LENGTH + 1] = {};
+                std::uint32_t count[HUFFMAN_MAX_LENGTH + 1] = {};
+                std::uint32_t offset[HUFFMAN_MAX_LENGTH + 1] = {};
+                std::uint16_t symbols[257] = {};
+
+                huffman_table()
+                {
+                    for (std::uint8_t length : HUFFMAN_CODE_LENGTHS)
+                        ++count[length];
+
+                    std::uint32_t code = 0;
+                    std::uint32_t index = 0;
+                    for (int length = 1; length <= HUFFMAN_MAX_LENGTH; ++length)
+                    {
+                        first_code[length] = code;
+                        offset[length] = index;
+                        code = (code + count[length]) << 1;
+                        index += count[length];
+                    }
+
+                    std::uint32_t filled[HUFFMAN_MAX_LENGTH + 1] = {};
+                    for (std::uint16_t symbol = 0; symbol <= HUFFMAN_EOS; ++symbol)
+                    {
+                        std::uint8_t length = HUFFMAN_CODE_LENGTHS[symbol];
+                        symbols[offset[length] + filled[length]++] = symbol;
+                    }
+                }
+            };
+
+            const huffman_table &huffman()
+            {
+                static const huffman_table table;
+                return table;
+            }
+
+            bool decode_integer(const std::uint8_t *&p, const std::uint8_t *end, int prefix_bits, std::uint64_t &value)
+            {
+                if (p == end)
+                    return false;
+                const std::uint64_t max_prefix = (1u << prefix_bits) - 1;
+                value = *p++ & max_prefix;
+                if (value < max_prefix)
+                    return true;
+
+                // Anything beyond 2^35 is no sane length or index
+                for (int shift = 0; p < end && shift <= 28; shift += 7)
+                {
+                    std::uint8_t byte = *p++;
+                    value += static_cast<std::uint64_t>(byte & 0x7f) << shift;
+                    if (!(byte & 0x80))
+                        return true;
+                }
+                return false;
+            }
+
+            bool decode_string(const std::uint8_t *&p, const std::uint8_t *end, std::string &out)
+            {
+                if (p == end)
+                    return false;
+                bool huffman_coded = *p & 0x80;
+                std::uint64_t length;
+                if (!decode_integer(p, end, 7, length) || length > static_cast<std::uint64_t>(end - p))
+                    return false;
+                if (huffman_coded)
+                {
+                    if (!huffman_decode(p, length, out))
+                        return false;
+                }
+                else
+                {
+                    out.assign(reinterpret_cast<const char *>(p), length);
+                }
+                p += length;
+                return true;
+            }
+
+            /// Values that differ from one response to the next only churn the dynamic table
+            bool is_volatile(const std::string &name)
+            {
+                return name == "content-length" || name == "date" || name == "etag" || name == "last-modified" ||
+                       name == "expires" || name == "age" || name == "location" || name == "content-range";
+            }
+
+            /// Fields intermediaries must not index either (RFC 7541, section 7.1.3)
+            bool is_sensitive(const std::string &name)
+            {
+                return name == "set-cookie" || name == "authorization" || name == "proxy-authorization";
+            }
+        }
+
+        dynamic_table::dynamic_table(std::size_t max_size)
+            : limit(max_size)
+        {
+        }
+
+        void dynamic_table::insert(const std::string &name, const std::string &value)
+        {
+            std::size_t size = entry_size(name, value);
+            if (size > limit)
+            {
+                fields.clear();
+                used = 0;
+                return;
+            }
+            evict(size);
+            fields.push_front({name, value});
+            used += size;
+        }
+
+        void dynamic_table::resize(std::size_t max_size)
+        {
+            limit = max_size;
+            evict(0);
+        }
+
+        const header_field *dynamic_table::get(std::size_t index) const
+        {
+            if (index == 0 || index > fields.size())
+                return nullptr;
+            return &fields[index - 1];
+        }
+
+        void dynamic_table::evict(std::size_t needed)
+        {
+            while (!fields.empty() && used + needed > limit)
+            {
+                used -= entry_size(fields.back().name, fields.back().value);
+                fields.pop_back();
+            }
+        }
+
+        decoder::decoder(std::size_t max_table_size, std::size_t max_list_size)
+            : table(max_table_size), max_table_size(max_table_size), max_list_size(max_list_size)
+        {
+        }
+
+        const header_field *decoder::lookup(std::uint64_t index) const
+        {
+            const auto &fixed = static_table();
+            if (index == 0)
+                return nullptr;
+            if (index <= fixed.size())
+                return &fixed[index - 1];
+            return table.get(index - fixed.size());
+        }
+
+        decode_status decoder::decode(const char *data, std::size_t size, std::vector<header_field> &fields)
+        {
+            auto p = reinterpret_cast<const std::uint8_t *>(data);
+            auto end = p + size;
+            std::size_t list_size = 0;
+            bool field_seen = false;
+
+            while (p < end)
+            {
+                std::uint8_t first = *p;
+                std::uint64_t index;
+                std::string name;
+                std::string value;
+
+                if (first & 0x80)
+                {
+                    // Indexed field
+                    if (!decode_integer(p, end, 7, index))
+                        return decode_status::ERROR;
+                    const header_field *field = lookup(index);
+                    if (!field)
+                        return decode_status::ERROR;
+                    name = field->name;
+                    value = field->value;
+                }
+                else if ((first & 0xe0) == 0x20)
+                {
+                    // Table size update, only allowed before the first field of a block
+                    std::uint64_t new_size;
+                    if (field_seen || !decode_integer(p, end, 5, new_size) || new_size > max_table_size)
+                        return decode_status::ERROR;
+                    table.resize(new_size);
+                    continue;
+                }
+                else
+                {
+                    // Literal with incremental indexing (01), without indexing (0000) or never indexed (0001)
+                    bool add_to_table = first & 0x40;
+                    if (!decode_integer(p, end, add_to_table ? 6 : 4, index))
+                        return decode_status::ERROR;
+                    if (index != 0)
+                    {
+                        const header_field *field = lookup(index);
+                        if (!field)
+                            return decode_status::ERROR;
+                        name = field->name;
+                    }
+                    else if (!decode_string(p, end, name))
+                    {
+                        return decode_status::ERROR;
+                    }
+                    if (!decode_string(p, end, value))
+                        return decode_status::ERROR;
+                    if (add_to_table)
+                        table.insert(name, value);
+                }
+
+                field_seen = true;
+                list_size += entry_size(name, value);
+                if (list_size <= max_list_size)
+                    fields.push_back({std::move(name), std::move(value)});
+            }
+            return list_size > max_list_size ? decode_status::TOO_LARGE : decode_status::OK;
+        }
+
+        encoder::encoder(std::size_t max_table_size)
+            : table(std::min(max_table_size, ENCODER_TABLE_LIMIT))
+        {
+        }
+
+        void encoder::set_max_table_size(std::size_t max_size)
+        {
+            max_size = std::min(max_size, ENCODER_TABLE_LIMIT);
+            if (max_size == table.max_size() && !size_update_pending)
+                return;
+            smallest_pending = size_update_pending ? std::min(smallest_pending, max_size) : max_size;
+            pending_size = max_size;
+            size_update_pending = true;
+        }
+
+        void encoder::begin_block(std::string &out)
+        {
+            if (!size_update_pending)
+                return;
+            // A limit that went down and up again since the last block is announced at its lowest first
+            if (smallest_pending < pending_size)
+            {
+                encode_integer(smallest_pending, 5, 0x20, out);
+                table.resize(smallest_pending);
+            }
+            encode_integer(pending_size, 5, 0x20, out);
+            table.resize(pending_size);
+            size_update_pending = false;
+        }
+
+        void encoder::encode(const std::string &name, const std::string &value, std::string &out)
+        {
+            const auto &fixed = static_table();
+            std::size_t name_index = 0;
+            for (std::size_t i = 0; i < fixed.size(); ++i)
+            {
+                if (fixed[i].name != name)
+                    continue;
+                if (fixed[i].value == value)
+                {
+                    encode_integer(i + 1, 7, 0x80, out);
+                    return;
+                }
+                if (name_index == 0)
+                    name_index = i + 1;
+            }
+            for (std::size_t i = 1; i <= table.entries(); ++i)
+            {
+                const header_field *field = table.get(i);
+                if (field->name != name)
+                    continue;
+                if (field->value == value)
+                {
+                    encode_integer(fixed.size() + i, 7, 0x80, out);
+                    return;
+                }
+                if (name_index == 0)
+                    name_index = fixed.size() + i;
+            }
+
+            if (is_sensitive(name))
+            {
+                encode_integer(name_index, 4, 0x10, out);
+            }
+            else if (is_volatile(name) || entry_size(name, value) > table.max_size())
+            {
+                encode_integer(name_index, 4, 0x00, out);
+            }
+            else
+            {
+                encode_integer(name_index, 6, 0x40, out);
+                table.insert(name, value);
+            }
+            if (name_index == 0)
+                encode_string(name, out);
+            encode_string(value, out);
+        }
+
+        void encode_integer(std::uint64_t value, int prefix_bits, std::uint8_t flags, std::string &out)
+        {
+            const std::uint64_t max_prefix = (1u << prefix_bits) - 1;
+            if (value < max_prefix)
+            {
+                out.push_back(static_cast<char>(flags | value));
+                return;
+            }
+            out.push_back(static_cast<char>(flags | max_prefix));
+            value -= max_prefix;
+            while (value >= 0x80)
+            {
+                out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+                value >>= 7;
+            }
+            out.push_back(static_cast<char>(value));
+        }
+
+        void encode_string(const std::string &value, std::string &out)
+        {
+            encode_integer(value.size(), 7, 0x00, out);
+            out += value;
+        }
+
+        /**
+         * Bits are shifted into an accumulator a byte at a time; whenever the
+         * leading bits form a complete code it is consumed. Canonical codes of
+         * one length are consecutive, so a candidate of length n is a match
+         * if it falls in [first_code[n], first_code[n] + count[n]).
+         */
+        bool huffman_decode(const std::uint8_t *data, std::size_t size, std::string &out)
+        {
+            const huffman_table &table = huffman();
+            out.clear();
+            out.reserve(size * 8 / 5);
+
+            std::uint64_t bits = 0;
+            int bit_count = 0;
+            for (std::size_t i = 0; i < size; ++i)
+            {
+                bits = (bits << 8) | data[i];
+                bit_count += 8;
+
+                bool matched = true;
+                while (matched)
+                {
+                    matched = false;
+                    for (int length = HUFFMAN_MIN_LENGTH; length <= bit_count && length <= HUFFMAN_MAX_LENGTH; ++length)
+                    {
+                        auto code = static_cast<std::uint32_t>((bits >> (bit_count - length)) & ((1ull << length) - 1));
+                        if (code - table.first_code[length] >= table.count[length])
+                            continue;
+                        std::uint16_t symbol = table.symbols[table.offset[length] + code - table.first_code[length]];
+                        if (symbol == HUFFMAN_EOS)
+                            return false;
+                        out.push_back(static_cast<char>(symbol));
+                        bit_count -= length;
+                        bits &= (1ull << bit_count) - 1;
+                        matched = true;
+                        break;
+                    }
+                }
+            }
+            // The padding is the most significant bits of EOS: up to 7 one bits
+            return bit_count <= 7 && bits == (1ull << bit_count) - 1;
+        }
+    }
+}
@@ -0,0 +1,1079 @@
+#include <algorithm>
+#include <cstring>
+
+#include "../includes/http2.hpp"
+#include "../includes/metrics.hpp"
+
+namespace hh_http
+{
+    namespace
+    {
+        /// Frame header: 24-bit length, type, flags, 31-bit stream id
+        constexpr std::size_t FRAME_HEADER_SIZE = 9;
+
+        /// Largest frame we accept; we never raise SETTINGS_MAX_FRAME_SIZE above the default
+        constexpr std::uint32_t MAX_FRAME_SIZE = 16384;
+
+        /// Size of the windows before any SETTINGS or WINDOW_UPDATE
+        constexpr std::int64_t DEFAULT_WINDOW = 65535;
+        constexpr std::int64_t MAX_WINDOW = 0x7fffffff;
+
+        /// Table size we advertise (the protocol default, so it is not sent)
+        constexpr std::size_t DECODER_TABLE_SIZE = 4096;
+
+        std::uint32_t read_u32(const char *p)
+        {
+            auto u = reinterpret_cast<const std::uint8_t *>(p);
+            return (static_cast<std::uint32_t>(u[0]) << 24) | (u[1] << 16) | (u[2] << 8) | u[3];
+        }
+
+        void append_u32(std::string &out, std::uint32_t value)
+        {
+            out.push_back(static_cast<char>(value >> 24));
+            out.push_back(static_cast<char>(value >> 16));
+            out.push_back(static_cast<char>(value >> 8));
+            out.push_back(static_cast<char>(value));
+        }
+
+        /// Decode base64url without padding (the HTTP2-Settings header); false on any other character
+        bool base64url_decode(const std::string &in, std::string &out)
+        {
+            std::uint32_t bits = 0;
+            int bit_count = 0;
+            for (char c : in)
+            {
+                int value;
+                if (c >= 'A' && c <= 'Z')
+                    value = c - 'A';
+                else if (c >= 'a' && c <= 'z')
+                    value = c - 'a' + 26;
+                else if (c >= '0' && c <= '9')
+                    value = c - '0' + 52;
+                else if (c == '-' || c == '+')
+                    value = 62;
+                else if (c == '_' || c == '/')
+                    value = 63;
+                else if (c == '=')
+                    break;
+                else
+                    return false;
+                bits = (bits << 6) | static_cast<std::uint32_t>(value);
+                bit_count += 6;
+                if (bit_count >= 8)
+                {
+                    bit_count -= 8;
+                    out.push_back(static_cast<char>((bits >> bit_count) & 0xff));
+                }
+            }
+            return true;
+        }
+
+        /// Comma-separated token lists (Connection, Upgrade), compared case-insensitively
+        bool has_token(const std::string &value, const std::string &token)
+        {
+            std::size_t start = 0;
+            while (start <= value.size())
+            {
+                std::size_t end = value.find(',', start);
+                if (end == std::string::npos)
+                    end = value.size();
+                std::size_t first = value.find_first_not_of(" \t", start);
+                std::size_t last = value.find_last_not_of(" \t", end - 1);
+                if (first < end && last != std::string::npos && last >= first &&
+                    to_upper_case(value.substr(first, last - first + 1)) == token)
+                    return true;
+                start = end + 1;
+            }
+            return false;
+        }
+
+        /// Content-Length over MAX_BODY_SIZE; values that are not a number are left to the handler
+        bool exceeds_body_limit(const std::string &value)
+        {
+            if (value.empty() || value.find_first_not_of("0123456789") != std::string::npos)
+                return false;
+            return value.size() > 19 || std::stoull(value) > config::MAX_BODY_SIZE;
+        }
+
+        /// Fields that only make sense on an HTTP/1.1 connection (RFC 9113, section 8.2.2)
+        bool is_connection_specific(const std::string &lower_name)
+        {
+            return lower_name == "connection" || lower_name == "keep-alive" || lower_name == "proxy-connection" ||
+                   lower_name == "transfer-encoding" || lower_name == "upgrade";
+        }
+
+        void count_reset()
+        {
+            if (config::ENABLE_METRICS)
+                metrics::registry::instance().http2_stream_resets_total.increment();
+        }
+    }
+
+    bool http2_connection::is_preface(const char *data, std::size_t size)
+    {
+        return size >= 4 && std::memcmp(data, PREFACE, std::min(size, PREFACE_SIZE)) == 0;
+    }
+
+    bool http2_connection::is_upgrade_request(const std::string &version, const std::multimap<std::string, std::string> &headers)
+    {
+        if (version != HTTP_VERSION_1_1)
+            return false;
+        auto upgrade = headers.find(to_upper_case(HEADER_UPGRADE));
+        if (upgrade == headers.end() || !has_token(upgrade->second, "H2C"))
+            return false;
+        if (headers.count(to_upper_case(HEADER_HTTP2_SETTINGS)) != 1)
+            return false;
+
+        auto connection = headers.equal_range(to_upper_case(HEADER_CONNECTION));
+        for (auto it = connection.first; it != connection.second; ++it)
+        {
+            if (has_token(it->second, "UPGRADE"))
+                return true;
+        }
+        return false;
+    }
+
+    http2_connection::http2_connection(std::string remote, std::function<void(const std::string &)> write,
+                                       std::function<void()> close_transport, std::shared_ptr<outbound_queue> outbound,
+                                       request_callback on_request)
+        : remote(std::move(remote)), write(std::move(write)), close_transport(std::move(close_transport)),
+          outbound(std::move(outbound)), on_request(std::move(on_request)),
+          decoder(DECODER_TABLE_SIZE, config::MAX_HEADER_SIZE)
+    {
+    }
+
+    void http2_connection::start(const std::string *upgrade_settings)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        write_settings();
+        // Raise the connection window to the stream window, so one stream can use all of it
+        std::int64_t window = std::min<std::int64_t>(config::HTTP2_INITIAL_WINDOW_SIZE, MAX_WINDOW);
+        if (window > DEFAULT_WINDOW)
+        {
+            write_window_update(0, static_cast<std::uint32_t>(window - DEFAULT_WINDOW));
+            connection_receive_window = window;
+        }
+
+        if (upgrade_settings)
+        {
+            // The 101 response acknowledges these implicitly, no SETTINGS ACK is sent
+            std::string payload;
+            if (!base64url_decode(*upgrade_settings, payload) || payload.size() % 6 != 0)
+            {
+                connection_error(http2_error::PROTOCOL_ERROR);
+            }
+            else
+            {
+                for (std::size_t i = 0; i + 6 <= payload.size() && !failed; i += 6)
+                {
+                    auto id = static_cast<std::uint16_t>((static_cast<std::uint8_t>(payload[i]) << 8) |
+                                                         static_cast<std::uint8_t>(payload[i + 1]));
+                    apply_setting(id, read_u32(payload.data() + i + 2));
+                }
+            }
+
+            // The upgraded request is stream 1, already complete
+            stream &upgraded = streams[1];
+            upgraded.remote_closed = true;
+            upgraded.delivered = true;
+            upgraded.send_window = peer_initial_window;
+            last_stream_id = 1;
+            if (config::ENABLE_METRICS)
+                metrics::registry::instance().http2_streams_total.increment();
+        }
+        flush_and_unlock(lock);
+    }
+
+    void http2_connection::receive(const char *data, std::size_t size)
+    {
+        std::vector<stream_request> ready;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (closed.load() || failed)
+                return;
+
+            if (inbound.empty())
+            {
+                std::size_t consumed = process(data, size, ready);
+                inbound.assign(data + consumed, size - consumed);
+            }
+            else
+            {
+                inbound.append(data, size);
+                std::size_t consumed = process(inbound.data(), inbound.size(), ready);
+                inbound.erase(0, consumed);
+            }
+            if (failed)
+                ready.clear();
+            // Responses sent by the handlers below join the frames of this read
+            batching = !ready.empty();
+            if (!batching)
+            {
+                flush_and_unlock(lock);
+                return;
+            }
+        }
+
+        auto self = shared_from_this();
+        for (auto &request : ready)
+            on_request(self, request);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        batching = false;
+        flush_and_unlock(lock);
+    }
+
+    std::size_t http2_connection::process(const char *data, std::size_t size, std::vector<stream_request> &ready)
+    {
+        std::size_t pos = 0;
+        if (!preface_received)
+        {
+            if (std::memcmp(data, PREFACE, std::min(size, PREFACE_SIZE)) != 0)
+            {
+                connection_error(http2_error::PROTOCOL_ERROR);
+                return size;
+            }
+            if (size < PREFACE_SIZE)
+                return 0;
+            preface_received = true;
+            pos = PREFACE_SIZE;
+        }
+
+        while (!failed && size - pos >= FRAME_HEADER_SIZE)
+        {
+            auto header = reinterpret_cast<const std::uint8_t *>(data + pos);
+            std::uint32_t length = (static_cast<std::uint32_t>(header[0]) << 16) | (header[1] << 8) | header[2];
+            if (length > MAX_FRAME_SIZE)
+            {
+                connection_error(http2_error::FRAME_SIZE_ERROR);
+                break;
+            }
+            if (size - pos - FRAME_HEADER_SIZE < length)
+                break;
+
+            auto type = static_cast<http2_frame_type>(header[3]);
+            std::uint8_t flags = header[4];
+            std::uint32_t stream_id = read_u32(data + pos + 5) & 0x7fffffff;
+            handle_frame(type, flags, stream_id, data + pos + FRAME_HEADER_SIZE, length, ready);
+            pos += FRAME_HEADER_SIZE + length;
+        }
+        return failed ? size : pos;
+    }
+
+    void http2_connection::handle_frame(http2_frame_type type, std::uint8_t flags, std::uint32_t stream_id,
+                                        const char *payload, std::size_t length, std::vector<stream_request> &ready)
+    {
+        // The client's preface ends with its SETTINGS
+        if (!settings_received && (type != http2_frame_type::SETTINGS || (flags & http2_flag::ACK)))
+            return connection_error(http2_error::PROTOCOL_ERROR);
+        // A header block may not be interleaved with other frames
+        if (continuation_stream != 0 && (type != http2_frame_type::CONTINUATION || stream_id != continuation_stream))
+            return connection_error(http2_error::PROTOCOL_ERROR);
+
+        switch (type)
+        {
+        case http2_frame_type::DATA:
+            return handle_data(flags, stream_id, payload, length, ready);
+
+        case http2_frame_type::HEADERS:
+            return handle_headers(flags, stream_id, payload, length, ready);
+
+        case http2_frame_type::CONTINUATION:
+            if (continuation_stream == 0)
+                return connection_error(http2_error::PROTOCOL_ERROR);
+            header_block.append(payload, length);
+            if (header_block.size() > config::MAX_HEADER_SIZE)
+                return connection_error(http2_error::ENHANCE_YOUR_CALM);
+            if (flags & http2_flag::END_HEADERS)
+            {
+                std::uint32_t id = continuation_stream;
+                continuation_stream = 0;
+                handle_header_block(id, continuation_end_stream, ready);
+            }
+            return;
+
+        case http2_frame_type::PRIORITY:
+            // Accepted and ignored: every stream is served as soon as its handler responds
+            if (stream_id == 0)
+                return connection_error(http2_error::PROTOCOL_ERROR);
+            if (length != 5)
+                stream_error(stream_id, http2_error::FRAME_SIZE_ERROR);
+            return;
+
+        case http2_frame_type::RST_STREAM:
+        {
+            if (stream_id == 0)
+                return connection_error(http2_error::PROTOCOL_ERROR);
+            if (length != 4)
+                return connection_error(http2_error::FRAME_SIZE_ERROR);
+            if (stream_id > last_stream_id)
+                return connection_error(http2_error::PROTOCOL_ERROR);
+            auto it = streams.find(stream_id);
+            if (it == streams.end())
+                return;
+            if (auto events = it->second.events.lock())
+                events->transport_closed();
+            released += it->second.pending.size() - it->second.pending_offset;
+            streams.erase(it);
+            if (goaway_sent && streams.empty())
+                close_requested = true;
+            return;
+        }
+
+        case http2_frame_type::SETTINGS:
+            if (stream_id != 0)
+                return connection_error(http2_error::PROTOCOL_ERROR);
+            return handle_settings(flags, payload, length);
+
+        case http2_frame_type::PUSH_PROMISE:
+            // Only servers push
+            return connection_error(http2_error::PROTOCOL_ERROR);
+
+        case http2_frame_type::PING:
+            if (stream_id != 0)
+                return connection_error(http2_error::PROTOCOL_ERROR);
+            if (length != 8)
+                return connection_error(http2_error::FRAME_SIZE_ERROR);
+            if (!(flags & http2_flag::ACK))
+                write_frame(http2_frame_type::PING, http2_flag::ACK, 0, payload, length);
+            return;
+
+        case http2_frame_type::GOAWAY:
+            // The client opens no more streams; the ones in progress still get their responses
+            if (stream_id != 0)
+                return connection_error(http2_error::PROTOCOL_ERROR);
+            if (length < 8)
+                return connection_error(http2_error::FRAME_SIZE_ERROR);
+            return;
+
+        case http2_frame_type::WINDOW_UPDATE:
+            return handle_window_update(stream_id, payload, length);
+
+        default:
+            // Unknown frame types are ignored (RFC 9113, section 5.5)
+            return;
+        }
+    }
+
+    void http2_connection::handle_data(std::uint8_t flags, std::uint32_t stream_id, const char *payload, std::size_t length,
+                                       std::vector<stream_request> &ready)
+    {
+        if (stream_id == 0)
+            return connection_error(http2_error::PROTOCOL_ERROR);
+        std::size_t offset = 0;
+        std::size_t padding = 0;
+        if (flags & http2_flag::PADDED)
+        {
+            if (length < 1 || static_cast<std::uint8_t>(payload[0]) >= length)
+                return connection_error(http2_error::PROTOCOL_ERROR);
+            padding = static_cast<std::uint8_t>(payload[0]);
+            offset = 1;
+        }
+
+        // The whole frame counts against both windows, padding included
+        if (static_cast<std::int64_t>(length) > connection_receive_window)
+            return connection_error(http2_error::FLOW_CONTROL_ERROR);
+        connection_receive_window -= length;
+        connection_unacknowledged += length;
+        if (connection_unacknowledged >= config::HTTP2_INITIAL_WINDOW_SIZE / 2)
+        {
+            write_window_update(0, connection_unacknowledged);
+            connection_receive_window += connection_unacknowledged;
+            connection_unacknowledged = 0;
+        }
+
+        auto it = streams.find(stream_id);
+        if (it == streams.end() || it->second.remote_closed)
+        {
+            if (stream_id > last_stream_id)
+                return connection_error(http2_error::PROTOCOL_ERROR);
+            return stream_error(stream_id, http2_error::STREAM_CLOSED);
+        }
+        stream &s = it->second;
+        if (static_cast<std::int64_t>(length) > s.receive_window)
+            return stream_error(stream_id, http2_error::FLOW_CONTROL_ERROR);
+        s.receive_window -= length;
+
+        std::size_t data_size = length - offset - padding;
+        if (!s.rejected)
+        {
+            if (s.body.size() + data_size > config::MAX_BODY_SIZE)
+            {
+                // Answered right away, like an HTTP/1.1 request over the limit; the rest is dropped
+                s.rejected = true;
+                ready.push_back(take_request(stream_id, s, "BAD_CONTENT_TOO_LARGE"));
+                s.body.clear();
+            }
+            else
+            {
+                s.body.append(payload + offset, data_size);
+            }
+        }
+
+        if (flags & http2_flag::END_STREAM)
+        {
+            s.remote_closed = true;
+            if (!s.delivered)
+                ready.push_back(take_request(stream_id, s));
+            settle(it);
+            return;
+        }
+
+        s.unacknowledged += length;
+        if (s.unacknowledged >= config::HTTP2_INITIAL_WINDOW_SIZE / 2)
+        {
+            write_window_update(stream_id, s.unacknowledged);
+            s.receive_window += s.unacknowledged;
+            s.unacknowledged = 0;
+        }
+    }
+
+    void http2_connection::handle_headers(std::uint8_t flags, std::uint32_t stream_id, const char *payload, std::size_t length,
+                                          std::vector<stream_request> &ready)
+    {
+        // Client streams have odd ids
+        if (stream_id == 0 || stream_id % 2 == 0)
+            return connection_error(http2_error::PROTOCOL_ERROR);
+
+        std::size_t offset = 0;
+        std::size_t padding = 0;
+        if (flags & http2_flag::PADDED)
+        {
+            if (length < 1)
+                return connection_error(http2_error::PROTOCOL_ERROR);
+            padding = static_cast<std::uint8_t>(payload[0]);
+            offset = 1;
+        }
+        // Stream priorities are not used
+        if (flags & http2_flag::PRIORITY)
+            offset += 5;
+        if (offset + padding > length)
+            return connection_error(http2_error::PROTOCOL_ERROR);
+
+        header_block.assign(payload + offset, length - offset - padding);
+        if (flags & http2_flag::END_HEADERS)
+        {
+            handle_header_block(stream_id, flags & http2_flag::END_STREAM, ready);
+            return;
+        }
+        continuation_stream = stream_id;
+        continuation_end_stream = flags & http2_flag::END_STREAM;
+    }
+
+    void http2_connection::handle_header_block(std::uint32_t stream_id, bool end_stream, std::vector<stream_request> &ready)
+    {
+        // Every block is decoded, even for streams that are refused, to keep the table in sync
+        std::vector<hpack::header_field> fields;
+        auto status = decoder.decode(header_block.data(), header_block.size(), fields);
+        header_block.clear();
+        if (status == hpack::decode_status::ERROR)
+            return connection_error(http2_error::COMPRESSION_ERROR);
+
+        auto it = streams.find(stream_id);
+        if (it != streams.end())
+        {
+            // Trailers: a second header block that ends the stream
+            stream &s = it->second;
+            if (s.remote_closed)
+                return stream_error(stream_id, http2_error::STREAM_CLOSED);
+            if (!end_stream)
+                return stream_error(stream_id, http2_error::PROTOCOL_ERROR);
+            for (auto &field : fields)
+            {
+                if (!field.name.empty() && field.name[0] == ':')
+                    return stream_error(stream_id, http2_error::PROTOCOL_ERROR);
+                if (!s.rejected)
+                    s.headers.insert({to_upper_case(field.name), std::move(field.value)});
+            }
+            s.remote_closed = true;
+            if (!s.delivered)
+                ready.push_back(take_request(stream_id, s));
+            settle(it);
+            return;
+        }
+
+        if (stream_id <= last_stream_id)
+            return connection_error(http2_error::STREAM_CLOSED);
+        last_stream_id = stream_id;
+        // Streams opened after our GOAWAY are ignored (RFC 9113, section 6.8)
+        if (goaway_sent)
+            return;
+        if (streams.size() >= config::HTTP2_MAX_CONCURRENT_STREAMS)
+        {
+            write_rst_stream(stream_id, http2_error::REFUSED_STREAM);
+            return;
+        }
+
+        stream s;
+        s.send_window = peer_initial_window;
+        s.receive_window = std::min<std::int64_t>(config::HTTP2_INITIAL_WINDOW_SIZE, MAX_WINDOW);
+        s.timings = std::make_shared<request_timings>();
+        s.timings->first_byte = request_timings::clock::now();
+        s.timings->headers_complete = s.timings->first_byte;
+
+        bool too_large = status == hpack::decode_status::TOO_LARGE;
+        if (!too_large && !build_request(fields, s))
+        {
+            write_rst_stream(stream_id, http2_error::PROTOCOL_ERROR);
+            return;
+        }
+        if (config::ENABLE_METRICS)
+            metrics::registry::instance().http2_streams_total.increment();
+
+        it = streams.emplace(stream_id, std::move(s)).first;
+        if (too_large)
+        {
+            it->second.rejected = true;
+            ready.push_back(take_request(stream_id, it->second, "BAD_HEADERS_TOO_LARGE"));
+        }
+        else if (!end_stream)
+        {
+            // A body announced over the limit is refused before the client sends it;
+            // a client waiting with "Expect: 100-continue" is told to go on
+            auto &headers = it->second.headers;
+            auto length = headers.find(to_upper_case(HEADER_CONTENT_LENGTH));
+            auto expect = headers.find(to_upper_case(HEADER_EXPECT));
+            if (length != headers.end() && exceeds_body_limit(length->second))
+            {
+                it->second.rejected = true;
+                ready.push_back(take_request(stream_id, it->second, "BAD_CONTENT_TOO_LARGE"));
+            }
+            else if (expect != headers.end() && has_token(expect->second, "100-CONTINUE"))
+            {
+                write_header_block(stream_id, encode_headers(HTTP_CONTINUE, {}), false);
+                if (config::ENABLE_METRICS)
+                    metrics::registry::instance().continue_sent_total.increment();
+            }
+        }
+        if (end_stream)
+        {
+            it->second.remote_closed = true;
+            if (!it->second.delivered)
+                ready.push_back(take_request(stream_id, it->second));
+        }
+    }
+
+    bool http2_connection::build_request(std::vector<hpack::header_field> &fields, stream &s)
+    {
+        std::string scheme, authority, cookie;
+        bool regular_seen = false;
+        bool has_host = false;
+        for (auto &field : fields)
+        {
+            if (field.name.empty())
+                return false;
+            if (field.name[0] == ':')
+            {
+                // Pseudo-headers come first, each at most once
+                std::string *target = field.name == ":method"      ? &s.method
+                                      : field.name == ":path"      ? &s.path
+                                      : field.name == ":scheme"    ? &scheme
+                                      : field.name == ":authority" ? &authority
+                                                                   : nullptr;
+                if (regular_seen || !target || !target->empty())
+                    return false;
+                *target = std::move(field.value);
+                continue;
+            }
+
+            regular_seen = true;
+            if (std::any_of(field.name.begin(), field.name.end(), [](char c)
+                            { return c >= 'A' && c <= 'Z'; }))
+                return false;
+            if (is_connection_specific(field.name) || (field.name == "te" && field.value != "trailers"))
+                return false;
+            // Cookie may be split into one field per pair; rejoin them (RFC 9113, section 8.2.3)
+            if (field.name == "cookie")
+            {
+                if (!cookie.empty())
+                    cookie += "; ";
+                cookie += field.value;
+                continue;
+            }
+            if (field.name == "host")
+                has_host = true;
+            s.headers.insert({to_upper_case(field.name), std::move(field.value)});
+        }
+
+        if (!cookie.empty())
+            s.headers.insert({to_upper_case(HEADER_COOKIE), cookie});
+        if (!authority.empty() && !has_host)
+            s.headers.insert({to_upper_case(HEADER_HOST), authority});
+
+        if (s.method.empty())
+            return false;
+        if (s.method == "CONNECT")
+        {
+            // The target is the authority; there is no path
+            if (authority.empty() || !s.path.empty() || !scheme.empty())
+                return false;
+            s.path = authority;
+            return true;
+        }
+        return !scheme.empty() && !s.path.empty();
+    }
+
+    http2_connection::stream_request http2_connection::take_request(std::uint32_t stream_id, stream &s, const std::string &error)
+    {
+        s.delivered = true;
+        s.timings->body_complete = request_timings::clock::now();
+
+        stream_request request;
+        request.stream_id = stream_id;
+        request.method = error.empty() ? s.method : error;
+        request.path = s.path;
+        request.headers = std::move(s.headers);
+        if (error.empty())
+            request.body = std::move(s.body);
+        request.timings = s.timings;
+        return request;
+    }
+
+    void http2_connection::handle_settings(std::uint8_t flags, const char *payload, std::size_t length)
+    {
+        if (flags & http2_flag::ACK)
+        {
+            if (length != 0)
+                connection_error(http2_error::FRAME_SIZE_ERROR);
+            return;
+        }
+        if (length % 6 != 0)
+            return connection_error(http2_error::FRAME_SIZE_ERROR);
+
+        for (std::size_t i = 0; i < length; i += 6)
+        {
+            auto id = static_cast<std::uint16_t>((static_cast<std::uint8_t>(payload[i]) << 8) |
+                                                 static_cast<std::uint8_t>(payload[i + 1]));
+            if (!apply_setting(id, read_u32(payload + i + 2)))
+                return;
+        }
+        settings_received = true;
+        write_frame(http2_frame_type::SETTINGS, http2_flag::ACK, 0, nullptr, 0);
+        // A larger initial window or frame size may unblock streams
+        flush_all_streams();
+    }
+
+    bool http2_connection::apply_setting(std::uint16_t id, std::uint32_t value)
+    {
+        switch (id)
+        {
+        case http2_setting::HEADER_TABLE_SIZE:
+            encoder.set_max_table_size(value);
+            return true;
+
+        case http2_setting::ENABLE_PUSH:
+            if (value > 1)
+            {
+                connection_error(http2_error::PROTOCOL_ERROR);
+                return false;
+            }
+            return true;
+
+        case http2_setting::INITIAL_WINDOW_SIZE:
+        {
+            if (value > MAX_WINDOW)
+            {
+                connection_error(http2_error::FLOW_CONTROL_ERROR);
+                return false;
+            }
+            // Applies to every open stream, as a difference (RFC 9113, section 6.9.2)
+            std::int64_t delta = static_cast<std::int64_t>(value) - peer_initial_window;
+            peer_initial_window = value;
+            for (auto &entry : streams)
+            {
+                entry.second.send_window += delta;
+                if (entry.second.send_window > MAX_WINDOW)
+                {
+                    connection_error(http2_error::FLOW_CONTROL_ERROR);
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        case http2_setting::MAX_FRAME_SIZE:
+            if (value < 16384 || value > 16777215)
+            {
+                connection_error(http2_error::PROTOCOL_ERROR);
+                return false;
+            }
+            peer_max_frame_size = value;
+            return true;
+
+        default:
+            // MAX_CONCURRENT_STREAMS limits pushes, which are never sent; unknown settings are ignored
+            return true;
+        }
+    }
+
+    void http2_connection::handle_window_update(std::uint32_t stream_id, const char *payload, std::size_t length)
+    {
+        if (length != 4)
+            return connection_error(http2_error::FRAME_SIZE_ERROR);
+        std::uint32_t increment = read_u32(payload) & 0x7fffffff;
+
+        if (stream_id == 0)
+        {
+            if (increment == 0)
+                return connection_error(http2_error::PROTOCOL_ERROR);
+            connection_send_window += increment;
+            if (connection_send_window > MAX_WINDOW)
+                return connection_error(http2_error::FLOW_CONTROL_ERROR);
+            flush_all_streams();
+            return;
+        }
+
+        auto it = streams.find(stream_id);
+        if (it == streams.end())
+        {
+            if (stream_id > last_stream_id)
+                connection_error(http2_error::PROTOCOL_ERROR);
+            return;
+        }
+        if (increment == 0)
+            return stream_error(stream_id, http2_error::PROTOCOL_ERROR);
+        it->second.send_window += increment;
+        if (it->second.send_window > MAX_WINDOW)
+            return stream_error(stream_id, http2_error::FLOW_CONTROL_ERROR);
+        flush_stream(it->first, it->second);
+    }
+
+    void http2_connection::send_headers(std::uint32_t stream_id, int status, const std::multimap<std::string, std::string> &headers,
+                                        bool end_stream)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        auto it = streams.find(stream_id);
+        if (closed.load() || it == streams.end() || it->second.headers_sent || it->second.local_closed)
+            return;
+
+        // An interim (1xx) response goes out before the final head, and never ends the stream
+        bool interim = status < 200;
+        write_header_block(stream_id, encode_headers(status, headers), end_stream && !interim);
+        if (!interim)
+        {
+            it->second.headers_sent = true;
+            if (end_stream)
+            {
+                it->second.end_queued = true;
+                it->second.local_closed = true;
+                settle(it);
+            }
+        }
+        flush_and_unlock(lock);
+    }
+
+    void http2_connection::send_data(std::uint32_t stream_id, const char *data, std::size_t size, bool end_stream)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        auto it = streams.find(stream_id);
+        if (closed.load() || it == streams.end() || it->second.end_queued || it->second.local_closed)
+            return;
+
+        // Counted as queued for the connection until the windows let the bytes out
+        if (outbound && size > 0)
+            outbound->queued(size);
+        it->second.pending.append(data, size);
+        it->second.end_queued = end_stream;
+        flush_stream(stream_id, it->second);
+        flush_and_unlock(lock);
+    }
+
+    void http2_connection::send_trailers(std::uint32_t stream_id, const std::multimap<std::string, std::string> &trailers)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        auto it = streams.find(stream_id);
+        if (closed.load() || it == streams.end() || it->second.end_queued || it->second.local_closed)
+            return;
+
+        it->second.trailers = trailers;
+        it->second.trailers_pending = true;
+        it->second.end_queued = true;
+        flush_stream(stream_id, it->second);
+        flush_and_unlock(lock);
+    }
+
+    void http2_connection::finish_stream(std::uint32_t stream_id)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        auto it = streams.find(stream_id);
+        if (closed.load() || it == streams.end() || it->second.end_queued || !it->second.events.expired())
+            return;
+
+        write_rst_stream(stream_id, it->second.headers_sent ? http2_error::CANCEL : http2_error::INTERNAL_ERROR);
+        released += it->second.pending.size() - it->second.pending_offset;
+        streams.erase(it);
+        if (goaway_sent && streams.empty())
+            close_requested = true;
+        flush_and_unlock(lock);
+    }
+
+    std::shared_ptr<event_stream> http2_connection::open_event_stream(std::uint32_t stream_id)
+    {
+        auto self = shared_from_this();
+        auto write = [self, stream_id](const std::string &bytes)
+        {
+            self->send_data(stream_id, bytes, false);
+        };
+        // DATA frames carry a copy anyway, sharing the buffer would save nothing
+        auto write_shared = [self, stream_id](std::shared_ptr<const std::string> bytes)
+        {
+            self->send_data(stream_id, *bytes, false);
+        };
+        auto end_stream = [self, stream_id]()
+        {
+            self->send_data(stream_id, nullptr, 0, true);
+        };
+        std::shared_ptr<event_stream> events(new event_stream(remote, write, write_shared, end_stream, outbound));
+
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = streams.find(stream_id);
+        if (it == streams.end() || closed.load())
+            events->transport_closed();
+        else
+            it->second.events = events;
+        return events;
+    }
+
+    void http2_connection::transport_closed()
+    {
+        std::vector<std::shared_ptr<event_stream>> open;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed.store(true);
+            for (auto &entry : streams)
+            {
+                if (auto events = entry.second.events.lock())
+                    open.push_back(events);
+            }
+            streams.clear();
+            outgoing.clear();
+        }
+        for (auto &events : open)
+            events->transport_closed();
+    }
+
+    void http2_connection::detach()
+    {
+        std::vector<std::shared_ptr<event_stream>> open;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed.store(true);
+            for (auto &entry : streams)
+            {
+                if (auto events = entry.second.events.lock())
+                    open.push_back(events);
+            }
+        }
+        for (auto &events : open)
+            events->detach();
+    }
+
+    void http2_connection::go_away()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (closed.load() || failed || goaway_sent)
+            return;
+        std::string payload;
+        append_u32(payload, last_stream_id);
+        append_u32(payload, http2_error::NO_ERROR);
+        write_frame(http2_frame_type::GOAWAY, 0, 0, payload.data(), payload.size());
+        goaway_sent = true;
+        if (streams.empty())
+            close_requested = true;
+        flush_and_unlock(lock);
+    }
+
+    void http2_connection::write_frame(http2_frame_type type, std::uint8_t flags, std::uint32_t stream_id,
+                                       const char *payload, std::size_t length)
+    {
+        outgoing.push_back(static_cast<char>(length >> 16));
+        outgoing.push_back(static_cast<char>(length >> 8));
+        outgoing.push_back(static_cast<char>(length));
+        outgoing.push_back(static_cast<char>(type));
+        outgoing.push_back(static_cast<char>(flags));
+        append_u32(outgoing, stream_id & 0x7fffffff);
+        if (length > 0)
+            outgoing.append(payload, length);
+    }
+
+    void http2_connection::write_header_block(std::uint32_t stream_id, const std::string &block, bool end_stream)
+    {
+        // HEADERS, then CONTINUATION frames for whatever exceeds the peer's frame size
+        std::size_t offset = 0;
+        bool first = true;
+        do
+        {
+            std::size_t length = std::min<std::size_t>(block.size() - offset, peer_max_frame_size);
+            bool last = offset + length == block.size();
+            std::uint8_t flags = last ? http2_flag::END_HEADERS : 0;
+            if (first && end_stream)
+                flags |= http2_flag::END_STREAM;
+            write_frame(first ? http2_frame_type::HEADERS : http2_frame_type::CONTINUATION, flags, stream_id,
+                        block.data() + offset, length);
+            offset += length;
+            first = false;
+        } while (offset < block.size());
+    }
+
+    void http2_connection::write_settings()
+    {
+        std::string payload;
+        auto add = [&payload](std::uint16_t id, std::uint32_t value)
+        {
+            payload.push_back(static_cast<char>(id >> 8));
+            payload.push_back(static_cast<char>(id));
+            append_u32(payload, value);
+        };
+        add(http2_setting::ENABLE_PUSH, 0);
+        add(http2_setting::MAX_CONCURRENT_STREAMS, static_cast<std::uint32_t>(config::HTTP2_MAX_CONCURRENT_STREAMS));
+        add(http2_setting::INITIAL_WINDOW_SIZE,
+            static_cast<std::uint32_t>(std::min<std::int64_t>(config::HTTP2_INITIAL_WINDOW_SIZE, MAX_WINDOW)));
+        add(http2_setting::MAX_HEADER_LIST_SIZE, static_cast<std::uint32_t>(config::MAX_HEADER_SIZE));
+        write_frame(http2_frame_type::SETTINGS, 0, 0, payload.data(), payload.size());
+    }
+
+    void http2_connection::write_window_update(std::uint32_t stream_id, std::uint32_t increment)
+    {
+        std::string payload;
+        append_u32(payload, increment & 0x7fffffff);
+        write_frame(http2_frame_type::WINDOW_UPDATE, 0, stream_id, payload.data(), payload.size());
+    }
+
+    void http2_connection::write_rst_stream(std::uint32_t stream_id, std::uint32_t error)
+    {
+        std::string payload;
+        append_u32(payload, error);
+        write_frame(http2_frame_type::RST_STREAM, 0, stream_id, payload.data(), payload.size());
+        if (error != http2_error::NO_ERROR)
+            count_reset();
+    }
+
+    std::string http2_connection::encode_headers(int status, const std::multimap<std::string, std::string> &headers)
+    {
+        std::string block;
+        encoder.begin_block(block);
+        if (status > 0)
+            encoder.encode(":status", std::to_string(status), block);
+        for (const auto &header : headers)
+        {
+            std::string name = header.first;
+            std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c)
+                           { return static_cast<char>(std::tolower(c)); });
+            if (is_connection_specific(name))
+                continue;
+            encoder.encode(name, header.second, block);
+        }
+        return block;
+    }
+
+    void http2_connection::flush_stream(std::uint32_t stream_id, stream &s)
+    {
+        if (s.local_closed || !s.headers_sent)
+            return;
+
+        while (s.pending_offset < s.pending.size())
+        {
+            std::int64_t remaining = static_cast<std::int64_t>(s.pending.size() - s.pending_offset);
+            std::int64_t length = std::min({remaining, static_cast<std::int64_t>(peer_max_frame_size),
+                                            s.send_window, connection_send_window});
+            if (length <= 0)
+                break;
+            bool last = length == remaining && s.end_queued && !s.trailers_pending;
+            write_frame(http2_frame_type::DATA, last ? http2_flag::END_STREAM : 0, stream_id,
+                        s.pending.data() + s.pending_offset, static_cast<std::size_t>(length));
+            s.send_window -= length;
+            connection_send_window -= length;
+            s.pending_offset += static_cast<std::size_t>(length);
+            released += static_cast<std::size_t>(length);
+            if (last)
+                s.local_closed = true;
+        }
+        if (s.pending_offset == s.pending.size())
+        {
+            s.pending.clear();
+            s.pending_offset = 0;
+        }
+
+        if (s.pending.empty() && s.end_queued && !s.local_closed)
+        {
+            if (s.trailers_pending)
+                write_header_block(stream_id, encode_headers(0, s.trailers), true);
+            else
+                write_frame(http2_frame_type::DATA, http2_flag::END_STREAM, stream_id, nullptr, 0);
+            s.local_closed = true;
+        }
+        if (s.local_closed)
+            settle(streams.find(stream_id));
+    }
+
+    void http2_connection::flush_all_streams()
+    {
+        for (auto it = streams.begin(); it != streams.end();)
+        {
+            // flush_stream() may erase the stream it flushes, never another one
+            auto next = std::next(it);
+            if (!it->second.pending.empty() || it->second.end_queued)
+                flush_stream(it->first, it->second);
+            it = next;
+        }
+    }
+
+    void http2_connection::settle(std::map<std::uint32_t, stream>::iterator it)
+    {
+        if (!it->second.local_closed)
+            return;
+        // The response is complete but the request is not (rejected early): stop the upload
+        if (!it->second.remote_closed)
+            write_rst_stream(it->first, http2_error::NO_ERROR);
+        streams.erase(it);
+        if (goaway_sent && streams.empty())
+            close_requested = true;
+    }
+
+    void http2_connection::stream_error(std::uint32_t stream_id, std::uint32_t error)
+    {
+        write_rst_stream(stream_id, error);
+        auto it = streams.find(stream_id);
+        if (it == streams.end())
+            return;
+        if (auto events = it->second.events.lock())
+            events->transport_closed();
+        released += it->second.pending.size() - it->second.pending_offset;
+        streams.erase(it);
+        if (goaway_sent && streams.empty())
+            close_requested = true;
+    }
+
+    void http2_connection::connection_error(std::uint32_t error)
+    {
+        if (failed)
+            return;
+        std::string payload;
+        append_u32(payload, last_stream_id);
+        append_u32(payload, error);
+        write_frame(http2_frame_type::GOAWAY, 0, 0, payload.data(), payload.size());
+        failed = true;
+        close_requested = true;
+    }
+
+    void http2_connection::flush_and_unlock(std::unique_lock<std::mutex> &lock)
+    {
+        std::string bytes;
+        if (!batching || close_requested)
+            bytes.swap(outgoing);
+        bool close_now = close_requested;
+        close_requested = false;
+        std::size_t written = released;
+        released = 0;
+
+        // Written under the lock, so frames reach the socket in the order they were produced
+        if (!bytes.empty() && !closed.load())
+            write(bytes);
+        lock.unlock();
+
+        if (written > 0 && outbound)
+            outbound->written(written);
+        if (close_now && !closed.load())
+            close_transport();
+    }
+}
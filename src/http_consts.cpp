@@ -13,6 +13,23 @@ namespace hh_http
         /// @brief Maximum timeout for connections (in milliseconds)
         int TIMEOUT_MILLISECONDS = 1000;
 
+        /// @brief TCP_DEFER_ACCEPT on the listener: wake the server only once a client sent data (seconds, 0 = off)
+        int DEFER_ACCEPT_SECONDS = 0;
+
+    }
+    namespace uring_config
+    {
+        /// @brief Submission queue entries of the io_uring backend
+        unsigned QUEUE_DEPTH = 4096;
+
+        /// @brief Receive buffers shared by all connections (rounded up to a power of two)
+        unsigned RECV_BUFFER_COUNT = 1024;
+
+        /// @brief Size of each receive buffer (in bytes)
+        unsigned RECV_BUFFER_SIZE = 16 * 1024;
+
+        /// @brief Set SO_REUSEPORT on the listener so a new process can bind the port while this one runs
+        bool REUSE_PORT = false;
     }
     namespace config
     {
@@ -22,6 +39,59 @@ namespace hh_http
         size_t MAX_HEADER_SIZE = 1024 * 16;
         /// @brief Maximum size of HTTP body (in bytes)
         size_t MAX_BODY_SIZE = 1024 * 1024 * 5; // 5 MB
+        /// @brief Record built-in metrics (counters and latency histograms)
+        bool ENABLE_METRICS = true;
+        /// @brief Compress responses when the client sends a matching Accept-Encoding
+        bool ENABLE_COMPRESSION = true;
+        /// @brief Bodies smaller than this are sent uncompressed (in bytes)
+        size_t COMPRESSION_MIN_SIZE = 1024;
+        /// @brief zlib compression level (1 = fastest, 9 = smallest)
+        int COMPRESSION_LEVEL = 6;
+        /// @brief Media types that are compressed; entries ending in '/' match a whole top-level type
+        std::vector<std::string> COMPRESSIBLE_CONTENT_TYPES = {
+            "text/",
+            "application/json",
+            "application/javascript",
+            "application/xml",
+            "application/xhtml+xml",
+            "application/manifest+json",
+            "image/svg+xml",
+        };
+        /// @brief Decompress request bodies sent with Content-Encoding: gzip or deflate
+        bool ENABLE_REQUEST_DECOMPRESSION = false;
+        /// @brief Maximum size of a decompressed request body (in bytes); MAX_BODY_SIZE still limits the compressed size
+        size_t MAX_DECOMPRESSED_BODY_SIZE = 1024 * 1024 * 50; // 50 MB
+        /// @brief Maximum decompressed / compressed size ratio of a request body (0 disables the check)
+        size_t MAX_DECOMPRESSION_RATIO = 100;
+        /// @brief Server-wide limit on buffered request/response bytes; reading pauses when it is reached (0 disables it)
+        size_t MAX_BUFFERED_BYTES = 1024ull * 1024 * 512; // 512 MB
+        /// @brief Queued outgoing bytes at which a connection stops being writable (in bytes)
+        size_t OUTBOUND_HIGH_WATERMARK = 1024 * 1024; // 1 MB
+        /// @brief Queued outgoing bytes at which a congested connection is writable again (in bytes)
+        size_t OUTBOUND_LOW_WATERMARK = 1024 * 256; // 256 KB
+        /// @brief Close a connection whose queued writes made no progress for this long (0 disables it)
+        std::chrono::seconds WRITE_TIMEOUT_SECONDS = std::chrono::seconds(30);
+        /// @brief Largest WebSocket message (all fragments together) a client may send; larger ones close the connection with 1009
+        size_t WEBSOCKET_MAX_MESSAGE_SIZE = 1024 * 1024 * 16; // 16 MB
+        /// @brief Accept HTTP/2 over cleartext TCP, with prior knowledge or through "Upgrade: h2c" (opt-in)
+        bool ENABLE_HTTP2 = false;
+        /// @brief Streams an HTTP/2 client may have open at once (SETTINGS_MAX_CONCURRENT_STREAMS); more are refused
+        size_t HTTP2_MAX_CONCURRENT_STREAMS = 100;
+        /// @brief HTTP/2 receive window of each stream and of the connection (in bytes)
+        size_t HTTP2_INITIAL_WINDOW_SIZE = 1024 * 1024; // 1 MB
+        /// @brief What http_request::get_normalized_path() does with "%2F" in a path
+        url::encoded_slash ENCODED_SLASH_POLICY = url::encoded_slash::KEEP;
+        /// @brief Buckets of each rate_limiter table of http_server (16 bytes each); bounds its memory
+        size_t RATE_LIMIT_TABLE_SLOTS = 1 << 20;
+        /// @brief Time a new connection has to send its first request before it is closed (0 = no limit)
+        std::chrono::seconds MAX_HEADER_READ_TIME = std::chrono::seconds(10);
+        /// @brief Bytes per second a request body must average over each BODY_RATE_WINDOW (0 = no minimum)
+        size_t MIN_BODY_RATE = 512;
+        /// @brief Window the body rate is measured over
+        std::chrono::seconds BODY_RATE_WINDOW = std::chrono::seconds(10);
+        /// @brief Connections waiting for their first request, and partially received requests, allowed per IP (0 = no cap)
+        /// @note Off by default: behind a proxy, load balancer or NAT many clients share one IP
+        size_t MAX_PARTIAL_REQUESTS_PER_IP = 0;
 
     }
 
@@ -5,8 +5,10 @@ namespace hh_http
     http_request::http_request(const std::string &method, const std::string &uri, const std::string &version,
                                const std::multimap<std::string, std::string> &headers,
                                const std::string &body,
-                               std::function<void()> close_connection)
-        : method(method), uri(uri), version(version), headers(headers), body(body), close_connection(close_connection)
+                               std::function<void()> close_connection,
+                               std::shared_ptr<request_timings> timings)
+        : method(method), uri(uri), version(version), headers(headers), body(body), close_connection(close_connection),
+          timings(timings ? timings : std::make_shared<request_timings>())
     {
 
         std::multimap<std::string, std::string> lower_case_headers;
@@ -15,12 +17,24 @@ namespace hh_http
             lower_case_headers.insert({to_upper_case(header.first), header.second});
         }
         this->headers = std::move(lower_case_headers);
+
+        url::target_parts parts = url::split(this->uri);
+        path_begin = parts.path.empty() ? 0 : parts.path.data() - this->uri.data();
+        path_size = parts.path.size();
+        query_begin = parts.query.empty() ? 0 : parts.query.data() - this->uri.data();
+        query_size = parts.query.size();
     }
 
     http_request::http_request(http_request &&other)
         : method(std::move(other.method)), uri(std::move(other.uri)), version(std::move(other.version)),
           headers(std::move(other.headers)), body(std::move(other.body)),
-          close_connection(std::move(other.close_connection))
+          path_begin(other.path_begin), path_size(other.path_size), query_begin(other.query_begin),
+          query_size(other.query_size), normalized_path(std::move(other.normalized_path)),
+          path_normalized(other.path_normalized), parsed_cookies(std::move(other.parsed_cookies)),
+          cookies_parsed(other.cookies_parsed), parsed_bearer(other.parsed_bearer),
+          parsed_basic(std::move(other.parsed_basic)), basic_valid(other.basic_valid),
+          authorization_parsed(other.authorization_parsed), close_connection(std::move(other.close_connection)),
+          timings(std::move(other.timings)), body_sink(std::move(other.body_sink))
     {
     }
 
@@ -32,7 +46,11 @@ namespace hh_http
         }
         close_connection();
         uri.clear();
+        path_begin = path_size = query_begin = query_size = 0;
         headers.clear();
+        parsed_cookies.clear();
+        parsed_bearer = std::string_view();
+        cookies_parsed = authorization_parsed = basic_valid = false;
         body.clear();
         body.clear(); // Note: This appears to be a duplicate clear() call
     }
@@ -47,6 +65,31 @@ namespace hh_http
         return uri;
     }
 
+    std::string_view http_request::get_path() const
+    {
+        return std::string_view(uri).substr(path_begin, path_size);
+    }
+
+    std::string_view http_request::get_query() const
+    {
+        return std::string_view(uri).substr(query_begin, query_size);
+    }
+
+    url::query_view http_request::get_query_params() const
+    {
+        return url::query_view(get_query());
+    }
+
+    const std::string &http_request::get_normalized_path() const
+    {
+        if (!path_normalized)
+        {
+            url::normalize_path(get_path(), normalized_path, config::ENCODED_SLASH_POLICY);
+            path_normalized = true;
+        }
+        return normalized_path;
+    }
+
     std::string http_request::get_version() const
     {
         return version;
@@ -73,8 +116,71 @@ namespace hh_http
         return headers_vector;
     }
 
+    const std::vector<cookie> &http_request::cookies() const
+    {
+        if (!cookies_parsed)
+        {
+            // Moving the request moves the multimap's nodes, so views into the values stay valid
+            auto range = headers.equal_range(to_upper_case(HEADER_COOKIE));
+            for (auto it = range.first; it != range.second; ++it)
+                header_values::parse_cookies(it->second, parsed_cookies);
+            cookies_parsed = true;
+        }
+        return parsed_cookies;
+    }
+
+    const cookie *http_request::find_cookie(std::string_view name) const
+    {
+        for (const auto &item : cookies())
+        {
+            if (item.name == name)
+                return &item;
+        }
+        return nullptr;
+    }
+
+    void http_request::parse_authorization() const
+    {
+        if (authorization_parsed)
+            return;
+        authorization_parsed = true;
+        auto authorization = headers.find(to_upper_case(HEADER_AUTHORIZATION));
+        if (authorization == headers.end())
+            return;
+        parsed_bearer = header_values::bearer_token(authorization->second);
+        if (parsed_bearer.empty())
+            basic_valid = header_values::parse_basic(authorization->second, parsed_basic);
+    }
+
+    std::string_view http_request::bearer_token() const
+    {
+        parse_authorization();
+        return parsed_bearer;
+    }
+
+    const basic_credentials *http_request::basic_auth() const
+    {
+        parse_authorization();
+        return basic_valid ? &parsed_basic : nullptr;
+    }
+
     std::string http_request::get_body() const
     {
         return body;
     }
-}
\ No newline at end of file
+
+    std::shared_ptr<hh_http::body_sink> http_request::get_body_sink() const
+    {
+        return body_sink;
+    }
+
+    const request_timings &http_request::get_timings() const
+    {
+        return *timings;
+    }
+
+    void http_request::mark_handler_start()
+    {
+        timings->handler_start = request_timings::clock::now();
+    }
+}
@@ -4,6 +4,7 @@
 #include <memory>
 #include <map>
 #include <ctime>
+#include <fstream>
 
 #include "../includes/http_response.hpp"
 
@@ -11,8 +12,11 @@ namespace hh_http
 {
     http_response::http_response(const std::string &version, const std::multimap<std::string, std::string> &headers,
                                  std::function<void()> close_connection,
-                                 std::function<void(const std::string &)> send_message)
-        : version(version), headers(headers), close_connection(close_connection), send_message(send_message)
+                                 std::function<void(const std::string &)> send_message,
+                                 std::shared_ptr<request_timings> timings,
+                                 std::function<void(const http_response &)> on_completed)
+        : version(version), headers(headers), close_connection(close_connection), send_message(send_message),
+          timings(timings), on_completed(on_completed)
     {
 
         std::multimap<std::string, std::string> lower_case_headers;
@@ -28,7 +32,14 @@ namespace hh_http
         : version(std::move(other.version)), status_code(other.status_code),
           status_message(std::move(other.status_message)), headers(std::move(other.headers)),
           trailers(std::move(other.trailers)), body(std::move(other.body)),
-          close_connection(std::move(other.close_connection)), send_message(std::move(other.send_message))
+          close_connection(std::move(other.close_connection)), send_message(std::move(other.send_message)),
+          timings(std::move(other.timings)), on_completed(std::move(other.on_completed)),
+          accept_encoding(std::move(other.accept_encoding)), chunk_compressor(std::move(other.chunk_compressor)),
+          chunked_headers_sent(other.chunked_headers_sent), body_bytes_sent(other.body_bytes_sent),
+          outbound(std::move(other.outbound)), closing(std::move(other.closing)), in_flight(std::move(other.in_flight)),
+          cork(std::move(other.cork)), open_event_stream(std::move(other.open_event_stream)),
+          http2(std::move(other.http2)), http2_stream_id(other.http2_stream_id),
+          http2_stream_guard(std::move(other.http2_stream_guard))
     {
         other.status_code = 0;            // Invalidate the moved-from response
         other.send_message = nullptr;     // Reset the moved-from send_message
@@ -57,7 +68,7 @@ namespace hh_http
         return std::string(buffer);
     }
 
-    std::string http_response::to_string() const
+    std::string http_response::head_to_string() const
     {
         std::ostringstream response_stream;
         response_stream << version << " " << status_code << " " << status_message << "\r\n";
@@ -66,15 +77,81 @@ namespace hh_http
         {
             response_stream << to_upper_case(header.first) << ": " << header.second << "\r\n";
         }
-        if (body.size())
-            response_stream << "\r\n"
-                            << body;
-        else
-            response_stream << "\r\n";
+        response_stream << "\r\n";
 
         return response_stream.str();
     }
 
+    void http_response::send_http2_head(bool end_stream)
+    {
+        auto fields = headers;
+        fields.insert({"DATE", get_current_date()});
+        http2->send_headers(http2_stream_id, status_code, fields, end_stream);
+    }
+
+    std::string http_response::to_string() const
+    {
+        return head_to_string() + body;
+    }
+
+    compression::coding http_response::choose_coding() const
+    {
+        if (!config::ENABLE_COMPRESSION || accept_encoding.empty())
+            return compression::coding::IDENTITY;
+
+        // No body (1xx, 204, 304) or a byte range of the identity representation (206)
+        if (status_code < 200 || status_code == HTTP_NO_CONTENT || status_code == 206 || status_code == 304)
+            return compression::coding::IDENTITY;
+
+        if (headers.count(to_upper_case(HEADER_CONTENT_ENCODING)))
+            return compression::coding::IDENTITY;
+
+        auto content_type = headers.find(to_upper_case(HEADER_CONTENT_TYPE));
+        if (content_type == headers.end() || !compression::is_compressible_type(content_type->second))
+            return compression::coding::IDENTITY;
+
+        return compression::negotiate(accept_encoding);
+    }
+
+    void http_response::replace_header(const std::string &name, const std::string &value)
+    {
+        headers.erase(to_upper_case(name));
+        headers.insert({to_upper_case(name), value});
+    }
+
+    void http_response::add_vary_accept_encoding()
+    {
+        auto range = headers.equal_range(to_upper_case(HEADER_VARY));
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            if (to_upper_case(it->second).find(to_upper_case(HEADER_ACCEPT_ENCODING)) != std::string::npos)
+                return;
+        }
+        headers.insert({to_upper_case(HEADER_VARY), HEADER_ACCEPT_ENCODING});
+    }
+
+    bool http_response::set_body_from_file(const std::string &path)
+    {
+        std::string file_path = compression::find_precompressed(path, accept_encoding);
+        bool precompressed = !file_path.empty();
+        if (!precompressed)
+            file_path = path;
+
+        std::ifstream file(file_path, std::ios::binary);
+        if (!file)
+            return false;
+        std::ostringstream content;
+        content << file.rdbuf();
+        body = content.str();
+
+        if (precompressed)
+            replace_header(HEADER_CONTENT_ENCODING, "gzip");
+        // Either way the representation depends on Accept-Encoding once a .gz sibling may exist
+        add_vary_accept_encoding();
+        replace_header(HEADER_CONTENT_LENGTH, std::to_string(body.size()));
+        return true;
+    }
+
     void http_response::set_body(const std::string &body)
     {
         this->body = body;
@@ -144,6 +221,52 @@ namespace hh_http
         return values;
     }
 
+    std::size_t http_response::get_queued_bytes() const
+    {
+        return outbound ? outbound->size() : 0;
+    }
+
+    bool http_response::is_writable() const
+    {
+        return !outbound || outbound->writable();
+    }
+
+    void http_response::on_writable(std::function<void()> callback)
+    {
+        if (outbound)
+            outbound->on_writable(std::move(callback));
+        else
+            callback();
+    }
+
+    std::shared_ptr<event_stream> http_response::start_event_stream()
+    {
+        if (!open_event_stream)
+            throw std::runtime_error("Event streams need a response created by http_server");
+
+        if (timings)
+            timings->response_send = request_timings::clock::now();
+        replace_header(HEADER_CONTENT_TYPE, "text/event-stream");
+        replace_header(HEADER_CACHE_CONTROL, "no-cache");
+        headers.erase(to_upper_case(HEADER_CONTENT_LENGTH));
+        headers.erase(to_upper_case(HEADER_CONTENT_ENCODING));
+        if (http2)
+        {
+            // The stream ends with the HTTP/2 stream, the connection stays open
+            send_http2_head(false);
+        }
+        else
+        {
+            // The stream is delimited by the connection closing
+            replace_header(HEADER_CONNECTION, "close");
+            send_message(head_to_string());
+        }
+        if (timings)
+            timings->write_complete = request_timings::clock::now();
+        report_completed();
+        return open_event_stream();
+    }
+
     void http_response::end()
     {
         try
@@ -170,7 +293,38 @@ namespace hh_http
         {
             if (validate())
             {
-                send_message(to_string());
+                if (timings)
+                    timings->response_send = request_timings::clock::now();
+                if (closing && closing->load())
+                    replace_header(HEADER_CONNECTION, "close");
+
+                compression::coding coding = body.size() >= config::COMPRESSION_MIN_SIZE ? choose_coding()
+                                                                                         : compression::coding::IDENTITY;
+                if (coding != compression::coding::IDENTITY)
+                {
+                    body = compression::compress(body, coding);
+                    replace_header(HEADER_CONTENT_ENCODING, compression::coding_name(coding));
+                    add_vary_accept_encoding();
+                    if (headers.count(to_upper_case(HEADER_CONTENT_LENGTH)))
+                        replace_header(HEADER_CONTENT_LENGTH, std::to_string(body.size()));
+                }
+
+                if (http2)
+                {
+                    send_http2_head(body.empty());
+                    if (!body.empty())
+                        http2->send_data(http2_stream_id, body, true);
+                }
+                else
+                {
+                    send_message(to_string());
+                }
+                body_bytes_sent = body.size();
+
+                if (timings)
+                    timings->write_complete = request_timings::clock::now();
+
+                report_completed();
             }
             else
             {
@@ -183,11 +337,137 @@ namespace hh_http
         }
     }
 
+    void http_response::send_chunk(const std::string &data)
+    {
+        try
+        {
+            if (!validate())
+                throw std::runtime_error("Invalid HTTP response or client connection may be already closed");
+
+            std::string head;
+            if (!chunked_headers_sent)
+            {
+                if (timings)
+                    timings->response_send = request_timings::clock::now();
+                if (closing && closing->load())
+                    replace_header(HEADER_CONNECTION, "close");
+
+                if (cork)
+                    cork(true);
+
+                headers.erase(to_upper_case(HEADER_CONTENT_LENGTH));
+                // HTTP/2 frames the body itself
+                if (!http2)
+                    replace_header(HEADER_TRANSFER_ENCODING, "chunked");
+
+                // The total size is unknown up front, so there is no minimum size check here
+                compression::coding coding = choose_coding();
+                if (coding != compression::coding::IDENTITY)
+                {
+                    chunk_compressor = std::make_unique<compression::compressor>(coding);
+                    replace_header(HEADER_CONTENT_ENCODING, compression::coding_name(coding));
+                    add_vary_accept_encoding();
+                }
+                if (http2)
+                    send_http2_head(false);
+                else
+                    head = head_to_string();
+                chunked_headers_sent = true;
+            }
+
+            std::string payload = chunk_compressor && !data.empty() ? chunk_compressor->flush(data) : data;
+            if (http2)
+            {
+                if (!payload.empty())
+                    http2->send_data(http2_stream_id, payload, false);
+                body_bytes_sent += payload.size();
+                return;
+            }
+
+            // A zero-size chunk would end the body, so only the headers go out for empty data
+            std::ostringstream chunk_stream;
+            chunk_stream << head;
+            if (!payload.empty())
+                chunk_stream << std::hex << payload.size() << "\r\n"
+                             << payload << "\r\n";
+            if (chunk_stream.tellp() > 0)
+                send_message(chunk_stream.str());
+            body_bytes_sent += payload.size();
+        }
+        catch (const std::exception &e)
+        {
+            throw std::runtime_error("Error sending HTTP response chunk:\n" + std::string(e.what()));
+        }
+    }
+
+    void http_response::send_last_chunk()
+    {
+        if (!chunked_headers_sent)
+            send_chunk("");
+
+        try
+        {
+            std::string tail = chunk_compressor ? chunk_compressor->finish() : "";
+            chunk_compressor.reset();
+
+            if (http2)
+            {
+                http2->send_data(http2_stream_id, tail, trailers.empty());
+                if (!trailers.empty())
+                    http2->send_trailers(http2_stream_id, trailers);
+                body_bytes_sent += tail.size();
+                if (timings)
+                    timings->write_complete = request_timings::clock::now();
+                report_completed();
+                return;
+            }
+
+            std::ostringstream chunk_stream;
+            if (!tail.empty())
+                chunk_stream << std::hex << tail.size() << "\r\n"
+                             << tail << "\r\n";
+            chunk_stream << "0\r\n";
+            for (const auto &trailer : trailers)
+            {
+                chunk_stream << to_upper_case(trailer.first) << ": " << trailer.second << "\r\n";
+            }
+            chunk_stream << "\r\n";
+            send_message(chunk_stream.str());
+            body_bytes_sent += tail.size();
+            if (cork)
+                cork(false);
+
+            if (timings)
+                timings->write_complete = request_timings::clock::now();
+
+            report_completed();
+        }
+        catch (const std::exception &e)
+        {
+            throw std::runtime_error("Error sending HTTP response chunk:\n" + std::string(e.what()));
+        }
+    }
+
+    void http_response::report_completed()
+    {
+        // Report the request once, even if the handler sends more than once
+        if (on_completed)
+        {
+            auto completed = std::move(on_completed);
+            on_completed = nullptr;
+            completed(*this);
+        }
+    }
+
     void http_response::send_trailers()
     {
         try
         {
-            if (validate())
+            if (validate() && http2)
+            {
+                http2->send_trailers(http2_stream_id, trailers);
+            }
+            else if (validate())
             {
                 std::ostringstream trailer_stream;
                 for (const auto &trailer : trailers)
@@ -4,7 +4,13 @@
 #include <thread>
 #include <chrono>
 
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
 #include "../includes/http_server.hpp"
+#include "../includes/listener_handoff.hpp"
 namespace hh_http
 {
     /**
@@ -12,29 +18,195 @@ namespace hh_http
      * Delegates socket creation, binding, and listening to parent class.
      * HTTP-specific functionality is added through callback overrides.
      */
-    http_server::http_server(const hh_socket::socket_address &addr, int timeout_milliseconds) : hh_socket::epoll_server(epoll_config::MAX_FILE_DESCRIPTORS)
+    http_server::http_server(const hh_socket::socket_address &addr, int timeout_milliseconds, io_backend backend)
+        : hh_socket::epoll_server(epoll_config::MAX_FILE_DESCRIPTORS)
+    {
+        this->timeout_milliseconds = timeout_milliseconds;
+        if (backend == io_backend::IO_URING && uring_server::supported())
+        {
+            // The io_uring backend owns its listener socket; the epoll side stays idle
+            use_uring(std::make_unique<uring_server>(addr.get_ip_address().get(), addr.get_port().get(),
+                                                     epoll_config::BACKLOG_SIZE, make_uring_callbacks()));
+        }
+        else
+        {
+            this->server_socket = hh_socket::make_listener_socket(addr.get_port().get(),
+                                                                  addr.get_ip_address().get(),
+                                                                  epoll_config::BACKLOG_SIZE);
+            if (!this->server_socket)
+                throw std::runtime_error("Failed to create listener socket");
+            // The socket library accepts on its own; deferring at least spares it wake-ups for silent clients
+            if (epoll_config::DEFER_ACCEPT_SECONDS > 0)
+                setsockopt(this->server_socket->get_fd(), IPPROTO_TCP, TCP_DEFER_ACCEPT,
+                           &epoll_config::DEFER_ACCEPT_SECONDS, sizeof(int));
+            this->register_listener_socket(this->server_socket);
+        }
+        route_request_bodies();
+        start_sweeper();
+    }
+
+    /**
+     * Serve a listener handed over by a previous process. Only the io_uring
+     * backend can adopt a raw fd; the socket library creates its own.
+     */
+    http_server::http_server(inherited_listener listener, int timeout_milliseconds, io_backend backend)
+        : hh_socket::epoll_server(epoll_config::MAX_FILE_DESCRIPTORS)
     {
         this->timeout_milliseconds = timeout_milliseconds;
-        this->server_socket = hh_socket::make_listener_socket(addr.get_port().get(),
-                                                              addr.get_ip_address().get(),
-                                                              epoll_config::BACKLOG_SIZE);
-        if (!this->server_socket)
-            throw std::runtime_error("Failed to create listener socket");
-        this->register_listener_socket(this->server_socket);
+        if (backend != io_backend::IO_URING || !uring_server::supported())
+        {
+            ::close(listener.fd);
+            throw std::runtime_error("An inherited listener can only be served by the io_uring backend");
+        }
+        use_uring(std::make_unique<uring_server>(listener.fd, make_uring_callbacks()));
+        route_request_bodies();
+        start_sweeper();
+    }
+
+    void http_server::use_uring(std::unique_ptr<uring_server> loop)
+    {
+        this->uring = std::move(loop);
+
+        // Stop receiving while the buffered byte budget is exhausted
+        uring_server *paused = this->uring.get();
+        this->budget_listener = memory_budget::instance().add_listener([paused](bool exhausted)
+                                                                       {
+            if (exhausted)
+                paused->pause_reading();
+            else
+                paused->resume_reading(); });
+    }
+
+    void http_server::route_request_bodies()
+    {
+        handler.set_body_sink_factory([this](const std::string &method, const std::string &uri, const std::string &version,
+                                             const std::multimap<std::string, std::string> &headers)
+                                      {
+            http_request request(method, uri, version, headers, "", [] {});
+            return this->on_request_body(request); });
+    }
 
+    void http_server::start_sweeper()
+    {
         // spin a thread that cleans idle connections each MAX_IDLE_TIME_SECONDS
         std::function<void(int)> close_connection_for_handler = [this](int fd) -> void
         {
-            this->close_connection(fd);
+            if (config::ENABLE_METRICS)
+                metrics::registry::instance().idle_timeouts_total.increment();
+            this->close_client_fd(fd);
         };
-        std::thread([this, close_connection_for_handler]()
+        this->sweeper = std::thread([this, close_connection_for_handler]()
+                                    {
+            std::unique_lock<std::mutex> lock(sweeper_mutex);
+            // Deadlines of slow clients are checked every second, idle connections still every MAX_IDLE_TIME_SECONDS
+            auto tick = [] {
+                bool slow_checks = config::MAX_HEADER_READ_TIME.count() > 0 || config::MIN_BODY_RATE > 0;
+                return slow_checks ? std::min(config::MAX_IDLE_TIME_SECONDS, std::chrono::seconds(1)) : config::MAX_IDLE_TIME_SECONDS;
+            };
+            auto last_idle_sweep = std::chrono::steady_clock::now();
+            while (!sweeper_wakeup.wait_for(lock, tick(), [this] { return sweeper_stopping; }))
+            {
+                lock.unlock();
+                close_slow_clients();
+                auto now = std::chrono::steady_clock::now();
+                if (now - last_idle_sweep >= config::MAX_IDLE_TIME_SECONDS)
+                {
+                    last_idle_sweep = now;
+                    handler.cleanup_idle_connections(config::MAX_IDLE_TIME_SECONDS, close_connection_for_handler);
+                    close_unanswered_websockets();
+                }
+                lock.lock();
+            } });
+    }
+
+    bool http_server::await_first_request(const std::string &key, std::shared_ptr<hh_socket::connection> conn,
+                                          uring_server::client_handle handle)
+    {
+        if (config::MAX_HEADER_READ_TIME.count() <= 0 && config::MAX_PARTIAL_REQUESTS_PER_IP == 0)
+            return true;
+
+        std::string ip(remote_ip(key));
+        std::lock_guard<std::mutex> lock(awaiting_mutex);
+        auto waiting = awaiting_per_ip.find(ip);
+        if (config::MAX_PARTIAL_REQUESTS_PER_IP != 0 && waiting != awaiting_per_ip.end() &&
+            waiting->second >= config::MAX_PARTIAL_REQUESTS_PER_IP)
+        {
+            if (config::ENABLE_METRICS)
+                metrics::registry::instance().partial_limit_rejections_total.increment();
+            return false;
+        }
+        if (awaiting_requests.insert_or_assign(key, awaiting_connection{std::move(conn), handle, std::chrono::steady_clock::now()}).second)
+        {
+            ++awaiting_per_ip.try_emplace(std::move(ip), 0).first->second;
+            awaiting_count.fetch_add(1, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    void http_server::first_request_arrived(const std::string &key)
+    {
+        std::lock_guard<std::mutex> lock(awaiting_mutex);
+        auto it = awaiting_requests.find(key);
+        if (it == awaiting_requests.end())
+            return;
+        awaiting_requests.erase(it);
+        awaiting_count.fetch_sub(1, std::memory_order_relaxed);
+        auto ip = awaiting_per_ip.find(std::string(remote_ip(key)));
+        if (ip != awaiting_per_ip.end() && --ip->second == 0)
+            awaiting_per_ip.erase(ip);
+    }
+
+    /**
+     * Runs on the sweeper thread. Unlike the idle sweep, these deadlines do
+     * not move when a byte arrives: a connection gets MAX_HEADER_READ_TIME
+     * in total for its first request, and a body has to keep an average
+     * rate, so trickling a byte every few seconds no longer keeps a
+     * connection (and its fd) forever.
+     */
+    void http_server::close_slow_clients()
+    {
+        if (config::MAX_HEADER_READ_TIME.count() > 0 && awaiting_count.load(std::memory_order_relaxed) > 0)
+        {
+            // Closed after the lock is released: the close path calls first_request_arrived()
+            std::vector<awaiting_connection> expired;
+            {
+                std::lock_guard<std::mutex> lock(awaiting_mutex);
+                auto deadline = std::chrono::steady_clock::now() - config::MAX_HEADER_READ_TIME;
+                for (auto it = awaiting_requests.begin(); it != awaiting_requests.end();)
+                {
+                    if (it->second.accepted > deadline)
                     {
-            while (true)
+                        ++it;
+                        continue;
+                    }
+                    expired.push_back(std::move(it->second));
+                    auto ip = awaiting_per_ip.find(std::string(remote_ip(it->first)));
+                    if (ip != awaiting_per_ip.end() && --ip->second == 0)
+                        awaiting_per_ip.erase(ip);
+                    it = awaiting_requests.erase(it);
+                    awaiting_count.fetch_sub(1, std::memory_order_relaxed);
+                }
+            }
+            // By handle: a client that closed meanwhile is not confused with a new one on the same fd
+            for (const auto &connection : expired)
             {
-                std::this_thread::sleep_for(std::chrono::seconds(config::MAX_IDLE_TIME_SECONDS));
-                handler.cleanup_idle_connections(config::MAX_IDLE_TIME_SECONDS, close_connection_for_handler);
-            } })
-            .detach();
+                if (config::ENABLE_METRICS)
+                    metrics::registry::instance().header_timeouts_total.increment();
+                if (uring)
+                    uring->close(connection.handle);
+                else
+                    this->close_connection(connection.conn);
+            }
+        }
+
+        if (config::MIN_BODY_RATE > 0 && config::BODY_RATE_WINDOW.count() > 0)
+        {
+            handler.cleanup_slow_requests(config::MIN_BODY_RATE, config::BODY_RATE_WINDOW, [this](int fd)
+                                          {
+                if (config::ENABLE_METRICS)
+                    metrics::registry::instance().slow_bodies_total.increment();
+                this->close_client_fd(fd); });
+        }
     }
 
     /**
@@ -45,55 +217,895 @@ namespace hh_http
 
     void http_server::on_message_received(std::shared_ptr<hh_socket::connection> conn, const hh_socket::data_buffer &message)
     {
+        // The socket layer hands out its own buffer, one copy is unavoidable here
+        std::string bytes = message.to_string();
+        handle_message(make_client_io(conn), bytes.data(), bytes.size());
+    }
 
-        auto close_connection_for_objects = [this, conn]()
+    /**
+     * Wrap an epoll_server connection in backend-independent I/O functions.
+     */
+    http_server::client_io http_server::make_client_io(std::shared_ptr<hh_socket::connection> conn)
+    {
+        client_io client;
+        client.conn = conn;
+        client.key = conn->get_remote_address().to_string();
+        client.fd = conn->get_fd();
+        client.send = [this, conn](const std::string &message)
+        {
+            this->send_message(conn, hh_socket::data_buffer(message));
+        };
+        // The socket layer copies whatever it is given, a shared buffer saves nothing here
+        client.send_shared = [this, conn](std::shared_ptr<const std::string> message)
+        {
+            this->send_message(conn, hh_socket::data_buffer(*message));
+        };
+        client.close = [this, conn]()
         {
             this->close_connection(conn);
         };
-        auto send_message_for_request = [this, conn](const std::string &message)
+        client.stop_reading = [this, conn]()
         {
-            this->send_message(conn, hh_socket::data_buffer(message));
+            this->stop_reading_from_connection(conn);
+        };
+        // Messages are written by send_message() itself, so the option can be set right away
+        client.cork = [conn](bool corked)
+        {
+            socket_profile::set_cork(conn->get_fd(), corked);
+        };
+        return client;
+    }
+
+    /**
+     * Wrap an io_uring client in backend-independent I/O functions.
+     */
+    http_server::client_io http_server::make_client_io(uring_server::client_handle handle, const std::string &remote)
+    {
+        client_io client;
+        client.key = remote;
+        client.fd = uring_server::fd_of(handle);
+        client.outbound = uring->outbound(handle);
+        client.send = [this, handle, outbound = client.outbound](const std::string &message)
+        {
+            if (outbound)
+                outbound->queued(message.size());
+            this->uring->send(handle, message);
+        };
+        client.send_shared = [this, handle, outbound = client.outbound](std::shared_ptr<const std::string> message)
+        {
+            if (outbound)
+                outbound->queued(message->size());
+            this->uring->send(handle, std::move(message));
+        };
+        client.close = [this, handle]()
+        {
+            this->uring->close(handle);
+        };
+        client.cork = [this, handle](bool corked)
+        {
+            this->uring->set_corked(handle, corked);
+        };
+        client.stop_reading = [this, handle]()
+        {
+            this->uring->stop_reading(handle);
+        };
+        return client;
+    }
+
+    /**
+     * Create the io_uring event loop and route its events into the same
+     * request path and hooks the epoll backend uses.
+     */
+    uring_server::handlers http_server::make_uring_callbacks()
+    {
+        uring_server::handlers callbacks;
+        callbacks.connection_opened = [this](uring_server::client_handle client, const std::string &remote)
+        {
+            if (config::ENABLE_METRICS)
+                metrics::registry::instance().connections_opened_total.increment();
+            uring_remotes[client] = remote;
+            if (!admit_connection(remote) || !await_first_request(remote, nullptr, client))
+            {
+                uring->close(client);
+                return;
+            }
+            profile.apply(uring_server::fd_of(client));
+        };
+        callbacks.data_received = [this](uring_server::client_handle client, const char *data, std::size_t size)
+        {
+            // data points into a receive buffer lent by the ring; it is parsed in place and returned afterwards
+            handle_message(make_client_io(client, uring_remotes[client]), data, size);
+        };
+        callbacks.connection_closed = [this](uring_server::client_handle client)
+        {
+            if (config::ENABLE_METRICS)
+                metrics::registry::instance().connections_closed_total.increment();
+            auto remote = uring_remotes.find(client);
+            if (remote != uring_remotes.end())
+            {
+                client_closed(remote->second);
+                uring_remotes.erase(remote);
+            }
+        };
+        callbacks.listen_success = [this]()
+        {
+            this->on_listen_success();
+        };
+        callbacks.waiting_for_activity = [this]()
+        {
+            this->on_waiting_for_activity();
         };
+        callbacks.shutdown_success = [this]()
+        {
+            this->on_shutdown_success();
+        };
+        callbacks.exception_occurred = [this](const std::exception &e)
+        {
+            this->on_exception_occurred(e);
+        };
+        return callbacks;
+    }
+
+    http_server::~http_server()
+    {
+        // Responses still held by handlers call back into this server: give them until the shutdown()
+        // deadline, or a short while without one, then detach those the application keeps (long polls,
+        // queued tasks) so they no longer reach the destroyed server
+        {
+            std::unique_lock<std::mutex> lock(drain->mutex);
+            drain->draining.store(true);
+            auto deadline = drain->deadline == std::chrono::steady_clock::time_point::max()
+                                ? std::chrono::steady_clock::now() + RESPONSE_DETACH_TIMEOUT
+                                : drain->deadline;
+            drain->idle.wait_until(lock, deadline, [this]
+                                   { return drain->in_flight.load() == 0; });
+            drain->detached.store(true);
+            drain->idle.wait(lock, [this]
+                             { return drain->calls.load() == 0; });
+        }
+        {
+            // WebSockets kept by the application must not call into a destroyed server
+            std::lock_guard<std::mutex> lock(websockets_mutex);
+            for (auto &entry : websockets)
+                entry.second->detach();
+            websockets.clear();
+        }
+        {
+            std::lock_guard<std::mutex> lock(http2_mutex);
+            for (auto &entry : http2_connections)
+                entry.second->detach();
+            http2_connections.clear();
+        }
+        {
+            std::lock_guard<std::mutex> lock(event_streams_mutex);
+            for (auto &entry : event_streams)
+            {
+                if (auto stream = entry.second.lock())
+                    stream->detach();
+            }
+            event_streams.clear();
+        }
+        {
+            std::lock_guard<std::mutex> lock(sweeper_mutex);
+            sweeper_stopping = true;
+        }
+        sweeper_wakeup.notify_all();
+        if (sweeper.joinable())
+            sweeper.join();
+
+        if (uring)
+            memory_budget::instance().remove_listener(budget_listener);
+    }
+
+    void http_server::close_client_fd(int fd)
+    {
+        if (uring)
+            uring->close_fd(fd);
+        else
+            this->close_connection(fd);
+    }
+
+    void http_server::listen()
+    {
+        if (uring)
+            uring->run(timeout_milliseconds);
+        else
+            epoll_server::listen(timeout_milliseconds);
+    }
+
+    void http_server::stop_server()
+    {
+        if (uring)
+            uring->stop();
+        else
+            epoll_server::stop_server();
+    }
+
+    /**
+     * Drain in three steps: no new connections (WebSockets are asked to
+     * close, HTTP/2 clients get GOAWAY, event streams are closed), wait for the handlers (each live http_response holds an
+     * in_flight token), then for the io_uring write queues. Whatever is left at the deadline is closed by stopping
+     * the event loop.
+     */
+    bool http_server::shutdown(std::chrono::steady_clock::time_point deadline)
+    {
+        {
+            std::lock_guard<std::mutex> lock(drain->mutex);
+            drain->deadline = deadline;
+        }
+        drain->draining.store(true);
+        if (uring)
+            uring->stop_accepting();
+        close_long_lived_connections(websocket_close::GOING_AWAY);
+
+        bool drained;
+        {
+            std::unique_lock<std::mutex> lock(drain->mutex);
+            drained = drain->idle.wait_until(lock, deadline, [this]
+                                             { return drain->in_flight.load() == 0; });
+        }
+        while (drained && uring && uring->queued_bytes() > 0)
+        {
+            if (std::chrono::steady_clock::now() >= deadline)
+            {
+                drained = false;
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+
+        stop_server();
+        return drained;
+    }
 
-        bool completed = false;
+    void http_server::hand_off_listener(const std::string &control_path)
+    {
+        int fd = uring ? uring->listener_fd() : (server_socket ? server_socket->get_fd() : -1);
+        if (fd < 0)
+            throw std::runtime_error("No listening socket to hand off");
+        listener_handoff::offer(control_path, fd);
+    }
+
+    void http_server::attach_response(const client_io &client, http_response &response)
+    {
+        auto state = drain;
+        response.outbound = client.outbound;
+        // A streamed response corks the socket until its last chunk
+        if (profile.cork_streams && client.cork)
+        {
+            response.cork = [state, cork = client.cork](bool corked)
+            { state->call([&] { cork(corked); }); };
+        }
+        response.closing = std::shared_ptr<const std::atomic<bool>>(drain, &drain->draining);
+        response.open_event_stream = [this, client, state]()
+        {
+            std::shared_ptr<event_stream> stream;
+            if (!state->call([&] { stream = this->open_event_stream(client); }))
+                throw std::runtime_error("The server of this response was destroyed");
+            return stream;
+        };
+
+        // Once the server is destroyed, a response the application still holds does nothing
+        if (response.send_message)
+        {
+            response.send_message = [state, send = std::move(response.send_message)](const std::string &message)
+            { state->call([&] { send(message); }); };
+        }
+        if (response.close_connection)
+        {
+            response.close_connection = [state, close = std::move(response.close_connection)]()
+            { state->call([&] { close(); }); };
+        }
+        if (response.on_completed)
+        {
+            response.on_completed = [state, completed = std::move(response.on_completed)](const http_response &sent)
+            { state->call([&] { completed(sent); }); };
+        }
+
+        state->in_flight.fetch_add(1);
+        response.in_flight = std::shared_ptr<void>(nullptr, [state](void *)
+                                                   {
+            if (state->in_flight.fetch_sub(1) == 1 && state->draining.load())
+            {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->idle.notify_all();
+            } });
+    }
+
+    /**
+     * Parse bytes received from a client and, once a request is complete,
+     * build request/response objects around the client's I/O functions.
+     */
+    void http_server::handle_message(const client_io &client, const char *data, std::size_t size)
+    {
+        if (awaiting_count.load(std::memory_order_relaxed) > 0)
+            first_request_arrived(client.key);
+        if (http2_count.load(std::memory_order_relaxed) > 0)
+        {
+            if (auto connection = find_http2(client.key))
+            {
+                if (config::ENABLE_METRICS)
+                    metrics::registry::instance().bytes_received_total.increment(size);
+                connection->receive(data, size);
+                return;
+            }
+        }
+        if (websocket_count.load(std::memory_order_relaxed) > 0)
+        {
+            if (auto websocket = find_websocket(client.key))
+            {
+                if (config::ENABLE_METRICS)
+                    metrics::registry::instance().bytes_received_total.increment(size);
+                websocket->receive(data, size);
+                return;
+            }
+        }
+
+        // HTTP/2 with prior knowledge: the connection opens with the preface instead of a request line
+        if (config::ENABLE_HTTP2 && !drain->draining.load() && http2_connection::is_preface(data, size) &&
+            !handler.in_progress(client.key))
+        {
+            if (config::ENABLE_METRICS)
+                metrics::registry::instance().bytes_received_total.increment(size);
+            open_http2(client, nullptr)->receive(data, size);
+            return;
+        }
+
+        auto close_connection_for_objects = client.close;
+        auto send_message_for_request = [send = client.send](const std::string &message)
+        {
+            if (!config::ENABLE_METRICS)
+            {
+                send(message);
+                return;
+            }
+            auto write_start = std::chrono::steady_clock::now();
+            send(message);
+            auto &stats = metrics::registry::instance();
+            stats.record_phase(metrics::phase::WRITE, std::chrono::steady_clock::now() - write_start);
+            stats.bytes_sent_total.increment(message.size());
+        };
+
+        bool completed = false, expects_continue = false;
         std::string method = "", uri = "", version = "", body = "";
         std::multimap<std::string, std::string> headers;
+        std::shared_ptr<body_sink> sink;
+        auto timings = std::make_shared<request_timings>();
+        if (profile.quick_ack)
+            socket_profile::set_quick_ack(client.fd);
         try
         {
-            auto RES = handler.handle(conn, message);
+            auto parse_start = std::chrono::steady_clock::now();
+            auto RES = handler.handle(client.key, client.fd, data, size);
             completed = RES.completed, method = RES.method, uri = RES.uri, version = RES.version, body = RES.body;
+            expects_continue = RES.expects_continue;
+            sink = std::move(RES.sink);
             headers = RES.headers;
+            timings->first_byte = RES.first_byte;
+            timings->headers_complete = RES.headers_complete;
+            timings->body_complete = RES.body_complete;
 
-            if (static_cast<int>(headers.size()) >= 0)
-                on_headers_received(conn, headers, method, uri, version, body);
+            // Over the buffered byte budget: the io_uring loop pauses reading until memory frees up
+            // (see the budget listener), epoll cannot resume a connection later, so there the
+            // partial request is rejected instead of buffering more of it
+            if (!completed && !uring && memory_budget::instance().exhausted())
+            {
+                handler.discard(client.key);
+                completed = true;
+                expects_continue = false;
+                method = "BAD_MEMORY_BUDGET_EXHAUSTED";
+                body.clear();
+            }
 
-            if (!completed)
+            if (config::ENABLE_METRICS)
+            {
+                auto &stats = metrics::registry::instance();
+                stats.record_phase(metrics::phase::PARSE, std::chrono::steady_clock::now() - parse_start);
+                stats.bytes_received_total.increment(size);
+                if (completed && metrics::is_parse_error(method))
+                    stats.record_parse_error(method);
+            }
+
+            // The connection-object hook only exists on the epoll backend
+            if (client.conn)
+                on_headers_received(client.conn, headers, method, uri, version, body);
+
+            if (!completed && !expects_continue)
                 return;
         }
         catch (const std::exception &e)
         {
+            if (config::ENABLE_METRICS)
+                metrics::registry::instance().record_parse_error("BAD_REQUEST");
 
-            this->stop_reading_from_connection(conn);
+            client.stop_reading();
 
             // Create HTTP request object with parsed data
-            http_request request("BAD_REQUEST", uri, version, headers, body, close_connection_for_objects);
+            http_request request("BAD_REQUEST", uri, version, headers, body, close_connection_for_objects, timings);
 
             // Create HTTP response object with default HTTP/1.1 version
-            http_response response("HTTP/1.1", {}, close_connection_for_objects, send_message_for_request);
-            this->on_request_received(request, response);
+            http_response response("HTTP/1.1", {}, close_connection_for_objects, send_message_for_request,
+                                   timings, make_completion_hook(client.key, request, timings));
+            attach_response(client, response);
+            this->dispatch_request(client.key, request, response);
             return;
         }
-        this->stop_reading_from_connection(conn);
+
+        // The headers are in and the client holds its body back until it is told to go on
+        if (!completed)
+        {
+            http_request request(method, uri, version, headers, "", close_connection_for_objects, timings);
+            answer_expectation(client, request, send_message_for_request);
+            return;
+        }
+
+        // After "Upgrade: h2c" the connection keeps reading HTTP/2 frames; the request itself is stream 1
+        if (config::ENABLE_HTTP2 && !drain->draining.load() && http2_connection::is_upgrade_request(version, headers))
+        {
+            http2_connection::stream_request upgraded;
+            upgraded.stream_id = 1;
+            upgraded.method = method;
+            upgraded.path = uri;
+            upgraded.headers = std::move(headers);
+            upgraded.body = std::move(body);
+            upgraded.timings = timings;
+            upgrade_to_http2(client, upgraded);
+            return;
+        }
+
+        // An upgraded connection keeps reading; its next bytes are WebSocket frames
+        if (websocket_callback && !drain->draining.load() && websocket_connection::is_upgrade_request(method, version, headers))
+        {
+            http_request request(method, uri, version, headers, body, close_connection_for_objects, timings);
+            upgrade_to_websocket(client, request, headers.find(to_upper_case(HEADER_SEC_WEBSOCKET_KEY))->second);
+            return;
+        }
+        client.stop_reading();
 
         // Create HTTP request object with parsed data
-        http_request request(method, uri, version, headers, body, close_connection_for_objects);
+        http_request request(method, uri, version, headers, body, close_connection_for_objects, timings);
+        request.body_sink = std::move(sink);
 
         // Create HTTP response object with default HTTP/1.1 version
-        http_response response("HTTP/1.1", {}, close_connection_for_objects, send_message_for_request);
+        http_response response("HTTP/1.1", {}, close_connection_for_objects, send_message_for_request,
+                               timings, make_completion_hook(client.key, request, timings));
+        attach_response(client, response);
+
+        // Lets send() negotiate gzip/deflate for the body
+        auto accept_encoding = headers.find(to_upper_case(HEADER_ACCEPT_ENCODING));
+        if (accept_encoding != headers.end())
+            response.accept_encoding = accept_encoding->second;
 
         // Invoke user-defined request handler with parsed request and response objects
         // User callback populates response and optionally closes connection
-        this->on_request_received(request, response);
+        this->dispatch_request(client.key, request, response);
+    }
+
+    /**
+     * Runs before any body byte was read. A rejected client is told to
+     * close: the body it may still send is never read.
+     */
+    void http_server::answer_expectation(const client_io &client, http_request &request,
+                                         std::function<void(const std::string &)> send_message)
+    {
+        http_response response("HTTP/1.1", {}, client.close, send_message, request.timings,
+                               make_completion_hook(client.key, request, request.timings));
+        attach_response(client, response);
+        response.set_status(HTTP_EXPECTATION_FAILED, "Expectation Failed");
+
+        if (on_continue_expected(request, response))
+        {
+            std::string go_ahead = std::string(HTTP_VERSION_1_1) + " 100 Continue" + DOUBLE_CRLF;
+            client.send(go_ahead);
+            if (config::ENABLE_METRICS)
+            {
+                auto &stats = metrics::registry::instance();
+                stats.continue_sent_total.increment();
+                stats.bytes_sent_total.increment(go_ahead.size());
+            }
+            return;
+        }
+
+        handler.discard(client.key);
+        client.stop_reading();
+        if (config::ENABLE_METRICS)
+            metrics::registry::instance().expectations_rejected_total.increment();
+
+        response.replace_header(HEADER_CONNECTION, "close");
+        if (response.get_header(HEADER_CONTENT_LENGTH).empty())
+            response.add_header(HEADER_CONTENT_LENGTH, std::to_string(response.body.size()));
+        response.send();
+        response.end();
+    }
+
+    void http_server::upgrade_to_websocket(const client_io &client, http_request &request, const std::string &key)
+    {
+        std::string handshake = std::string(HTTP_VERSION_1_1) + " 101 Switching Protocols" + CRLF +
+                                HEADER_UPGRADE + ": websocket" + CRLF +
+                                HEADER_CONNECTION + ": Upgrade" + CRLF +
+                                HEADER_SEC_WEBSOCKET_ACCEPT + ": " + websocket_connection::accept_key(key) + DOUBLE_CRLF;
+        client.send(handshake);
+
+        auto write = [send = client.send](const std::string &bytes)
+        {
+            send(bytes);
+            if (config::ENABLE_METRICS)
+                metrics::registry::instance().bytes_sent_total.increment(bytes.size());
+        };
+        std::shared_ptr<websocket_connection> websocket(
+            new websocket_connection(client.key, write, client.close, client.outbound));
+        {
+            std::lock_guard<std::mutex> lock(websockets_mutex);
+            websockets[client.key] = websocket;
+            websocket_count.store(websockets.size(), std::memory_order_relaxed);
+        }
+        if (config::ENABLE_METRICS)
+        {
+            auto &stats = metrics::registry::instance();
+            stats.requests_total.increment();
+            stats.websocket_upgrades_total.increment();
+        }
+        on_websocket_opened(request, websocket);
+    }
+
+    std::shared_ptr<http2_connection> http_server::open_http2(const client_io &client, const std::string *upgrade_settings)
+    {
+        auto write = [send = client.send](const std::string &bytes)
+        {
+            send(bytes);
+            if (config::ENABLE_METRICS)
+                metrics::registry::instance().bytes_sent_total.increment(bytes.size());
+        };
+        auto on_request = [this, client](const std::shared_ptr<http2_connection> &connection,
+                                         http2_connection::stream_request &stream)
+        {
+            this->dispatch_http2_stream(client, connection, stream);
+        };
+        std::shared_ptr<http2_connection> connection(
+            new http2_connection(client.key, write, client.close, client.outbound, on_request));
+        {
+            std::lock_guard<std::mutex> lock(http2_mutex);
+            http2_connections[client.key] = connection;
+            http2_count.store(http2_connections.size(), std::memory_order_relaxed);
+        }
+        if (config::ENABLE_METRICS)
+            metrics::registry::instance().http2_connections_total.increment();
+        connection->start(upgrade_settings);
+        return connection;
+    }
+
+    void http_server::upgrade_to_http2(const client_io &client, http2_connection::stream_request &request)
+    {
+        std::string handshake = std::string(HTTP_VERSION_1_1) + " 101 Switching Protocols" + CRLF +
+                                HEADER_CONNECTION + ": Upgrade" + CRLF +
+                                HEADER_UPGRADE + ": h2c" + DOUBLE_CRLF;
+        client.send(handshake);
+
+        std::string settings = request.headers.find(to_upper_case(HEADER_HTTP2_SETTINGS))->second;
+        auto connection = open_http2(client, &settings);
+        dispatch_http2_stream(client, connection, request);
+    }
+
+    std::shared_ptr<http2_connection> http_server::find_http2(const std::string &key)
+    {
+        std::lock_guard<std::mutex> lock(http2_mutex);
+        auto it = http2_connections.find(key);
+        return it == http2_connections.end() ? nullptr : it->second;
+    }
+
+    /**
+     * Streams get the same request/response objects as HTTP/1.1 requests;
+     * only the response's output is routed to the stream, and end() (or
+     * dropping the response) finishes the stream instead of closing the
+     * connection.
+     */
+    void http_server::dispatch_http2_stream(const client_io &client, const std::shared_ptr<http2_connection> &connection,
+                                            http2_connection::stream_request &stream)
+    {
+        std::uint32_t stream_id = stream.stream_id;
+        std::weak_ptr<http2_connection> weak_connection = connection;
+        auto finish_stream = [weak_connection, stream_id]()
+        {
+            if (auto owner = weak_connection.lock())
+                owner->finish_stream(stream_id);
+        };
+
+        // The stream's body is already buffered; a sink still gets it, so handlers see one model
+        std::shared_ptr<body_sink> sink;
+        if (!stream.body.empty() && !metrics::is_parse_error(stream.method))
+        {
+            http_request head(stream.method, stream.path, "HTTP/2.0", stream.headers, "", [] {});
+            sink = on_request_body(head);
+            if (sink)
+            {
+                if (!sink->write(stream.body.data(), stream.body.size()) || !sink->finish())
+                {
+                    stream.method = "BAD_BODY_REJECTED";
+                    sink.reset();
+                }
+                stream.body.clear();
+            }
+        }
+
+        if (config::ENABLE_METRICS && metrics::is_parse_error(stream.method))
+            metrics::registry::instance().record_parse_error(stream.method);
+
+        http_request request(stream.method, stream.path, "HTTP/2.0", stream.headers, stream.body, finish_stream,
+                             stream.timings);
+        request.body_sink = std::move(sink);
+        http_response response("HTTP/2.0", {}, finish_stream, client.send, stream.timings,
+                               make_completion_hook(client.key, request, stream.timings));
+        attach_response(client, response);
+        // Corking would hold back every other stream of the connection
+        response.cork = nullptr;
+        response.http2 = connection;
+        response.http2_stream_id = stream_id;
+        response.http2_stream_guard = std::shared_ptr<void>(nullptr, [finish_stream](void *)
+                                                            { finish_stream(); });
+        response.open_event_stream = [connection, stream_id]()
+        {
+            return connection->open_event_stream(stream_id);
+        };
+
+        auto accept_encoding = stream.headers.find(to_upper_case(HEADER_ACCEPT_ENCODING));
+        if (accept_encoding != stream.headers.end())
+            response.accept_encoding = accept_encoding->second;
+
+        this->dispatch_request(client.key, request, response);
+    }
+
+    std::shared_ptr<websocket_connection> http_server::find_websocket(const std::string &key)
+    {
+        std::lock_guard<std::mutex> lock(websockets_mutex);
+        auto it = websockets.find(key);
+        return it == websockets.end() ? nullptr : it->second;
+    }
+
+    std::shared_ptr<event_stream> http_server::open_event_stream(const client_io &client)
+    {
+        auto write = [send = client.send](const std::string &bytes)
+        {
+            send(bytes);
+            if (config::ENABLE_METRICS)
+                metrics::registry::instance().bytes_sent_total.increment(bytes.size());
+        };
+        auto write_shared = [send = client.send_shared](std::shared_ptr<const std::string> bytes)
+        {
+            std::size_t size = bytes->size();
+            send(std::move(bytes));
+            if (config::ENABLE_METRICS)
+                metrics::registry::instance().bytes_sent_total.increment(size);
+        };
+        std::shared_ptr<event_stream> stream(
+            new event_stream(client.key, write, write_shared, client.close, client.outbound));
+        std::lock_guard<std::mutex> lock(event_streams_mutex);
+        event_streams[client.key] = stream;
+        return stream;
+    }
+
+    void http_server::client_closed(const std::string &key)
+    {
+        // A partial request can no longer complete: release its buffers (and body sink) now, not at the idle sweep
+        handler.discard(key);
+        if (awaiting_count.load(std::memory_order_relaxed) > 0)
+            first_request_arrived(key);
+        {
+            std::lock_guard<std::mutex> lock(event_streams_mutex);
+            auto it = event_streams.find(key);
+            if (it != event_streams.end())
+            {
+                if (auto stream = it->second.lock())
+                    stream->transport_closed();
+                event_streams.erase(it);
+                return;
+            }
+        }
+
+        std::shared_ptr<http2_connection> connection;
+        {
+            std::lock_guard<std::mutex> lock(http2_mutex);
+            auto it = http2_connections.find(key);
+            if (it != http2_connections.end())
+            {
+                connection = it->second;
+                http2_connections.erase(it);
+                http2_count.store(http2_connections.size(), std::memory_order_relaxed);
+            }
+        }
+        if (connection)
+        {
+            connection->transport_closed();
+            return;
+        }
+
+        std::shared_ptr<websocket_connection> websocket;
+        {
+            std::lock_guard<std::mutex> lock(websockets_mutex);
+            auto it = websockets.find(key);
+            if (it == websockets.end())
+                return;
+            websocket = it->second;
+            websockets.erase(it);
+            websocket_count.store(websockets.size(), std::memory_order_relaxed);
+        }
+        // Outside the lock: the close callback may send to other WebSockets
+        websocket->transport_closed();
+    }
+
+    void http_server::close_long_lived_connections(std::uint16_t code)
+    {
+        std::vector<std::shared_ptr<websocket_connection>> open;
+        {
+            std::lock_guard<std::mutex> lock(websockets_mutex);
+            for (auto &entry : websockets)
+                open.push_back(entry.second);
+        }
+        for (auto &websocket : open)
+            websocket->close(code);
+
+        std::vector<std::shared_ptr<http2_connection>> multiplexed;
+        {
+            std::lock_guard<std::mutex> lock(http2_mutex);
+            for (auto &entry : http2_connections)
+                multiplexed.push_back(entry.second);
+        }
+        // Streams in progress are still answered; each connection closes once its last one is done
+        for (auto &connection : multiplexed)
+            connection->go_away();
+
+        std::vector<std::shared_ptr<event_stream>> streams;
+        {
+            std::lock_guard<std::mutex> lock(event_streams_mutex);
+            for (auto &entry : event_streams)
+            {
+                if (auto stream = entry.second.lock())
+                    streams.push_back(stream);
+            }
+        }
+        // Closed outside the lock: the last reference may be dropped here, and closing re-enters client_closed()
+        for (auto &stream : streams)
+            stream->close();
+    }
+
+    /**
+     * A client that never answers our close frame would keep its
+     * connection forever: the idle sweeper only knows partial requests.
+     */
+    void http_server::close_unanswered_websockets()
+    {
+        auto now = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lock(websockets_mutex);
+        for (auto &entry : websockets)
+        {
+            if (entry.second->close_timed_out(now, config::MAX_IDLE_TIME_SECONDS))
+                entry.second->close_transport();
+        }
+    }
+
+    /**
+     * Build the hook http_response calls after its first send().
+     * When an access log is attached, the request side of the record is
+     * captured here, while the request object is still on this thread.
+     */
+    std::function<void(const http_response &)> http_server::make_completion_hook(const std::string &remote,
+                                                                                 const http_request &request,
+                                                                                 std::shared_ptr<request_timings> timings)
+    {
+        auto logger = access_logger;
+        if (!logger)
+        {
+            return [this, timings](const http_response &)
+            {
+                this->on_request_completed(*timings);
+            };
+        }
+
+        access_log_record record;
+        access_log_record::assign(record.method, request.method);
+        access_log_record::assign(record.uri, request.uri);
+        access_log_record::assign(record.version, request.version);
+        access_log_record::assign(record.remote, remote_ip(remote));
+        auto referer = request.headers.find(to_upper_case(HEADER_REFERER));
+        if (referer != request.headers.end())
+            access_log_record::assign(record.referer, referer->second);
+        auto user_agent = request.headers.find(to_upper_case(HEADER_USER_AGENT));
+        if (user_agent != request.headers.end())
+            access_log_record::assign(record.user_agent, user_agent->second);
+
+        return [this, timings, logger, record](const http_response &response) mutable
+        {
+            this->on_request_completed(*timings);
+
+            record.unix_time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                      std::chrono::system_clock::now().time_since_epoch())
+                                      .count();
+            record.duration_ns = static_cast<std::uint64_t>(timings->total().count());
+            record.status = response.get_status_code();
+            record.bytes_sent = response.body_bytes_sent;
+            logger->log(record);
+        };
+    }
+
+    /**
+     * Route a complete request to the metrics endpoint or the user handler.
+     * Keeps the request counter and HANDLER latency in one place for both
+     * the normal and the BAD_REQUEST paths of on_message_received().
+     */
+    void http_server::dispatch_request(const std::string &remote, http_request &request, http_response &response)
+    {
+        request.timings->dispatch = request_timings::clock::now();
+        request.timings->handler_start = request.timings->dispatch;
+
+        if ((request_limiter || !route_limiters.empty()) && reject_rate_limited(remote, request, response))
+            return;
+
+        if (!config::ENABLE_METRICS)
+        {
+            run_handler(request, response);
+            return;
+        }
+
+        auto &stats = metrics::registry::instance();
+        stats.requests_total.increment();
+
+        if (!metrics_path.empty() && request.get_method() == HTTP_GET && request.get_path() == metrics_path)
+        {
+            std::string exposition = stats.render_prometheus();
+            response.set_status(HTTP_OK, "OK");
+            response.add_header(HEADER_CONTENT_TYPE, "text/plain; version=0.0.4; charset=utf-8");
+            response.add_header(HEADER_CONTENT_LENGTH, std::to_string(exposition.size()));
+            response.add_header(HEADER_CONNECTION, "close");
+            response.set_body(exposition);
+            response.send();
+            response.end();
+            return;
+        }
+
+        auto handler_start = std::chrono::steady_clock::now();
+        run_handler(request, response);
+        stats.record_phase(metrics::phase::HANDLER, std::chrono::steady_clock::now() - handler_start);
+    }
+
+    bool http_server::reject_rate_limited(const std::string &remote, http_request &request, http_response &response)
+    {
+        std::string_view ip = remote_ip(remote);
+        std::chrono::milliseconds retry_after{0};
+        bool allowed = !request_limiter || request_limiter->acquire(ip, &retry_after);
+        if (allowed && !route_limiters.empty())
+        {
+            auto route = route_limiters.find(request.get_normalized_path());
+            if (route != route_limiters.end())
+                allowed = route->second->acquire_hash(rate_limiter::combine_keys(ip, route->first), &retry_after);
+        }
+        if (allowed)
+            return false;
+
+        if (config::ENABLE_METRICS)
+            metrics::registry::instance().rate_limited_requests_total.increment();
+        // Retry-After is in whole seconds; round up so a client that obeys it finds a token
+        auto seconds = std::max<long long>(1, (retry_after.count() + 999) / 1000);
+        response.set_status(HTTP_TOO_MANY_REQUESTS, "Too Many Requests");
+        response.add_header("Retry-After", std::to_string(seconds));
+        response.add_header(HEADER_CONTENT_LENGTH, "0");
+        response.add_header(HEADER_CONNECTION, "close");
+        response.send();
+        response.end();
+        return true;
+    }
+
+    bool http_server::admit_connection(const std::string &remote)
+    {
+        if (!connection_limiter || connection_limiter->acquire(remote_ip(remote)))
+            return true;
+        if (config::ENABLE_METRICS)
+            metrics::registry::instance().rate_limited_connections_total.increment();
+        return false;
+    }
+
+    void http_server::run_handler(http_request &request, http_response &response)
+    {
+        if (middlewares.empty() || middlewares.run(request, response))
+            this->on_request_received(request, response);
     }
 
     void http_server::on_request_received(http_request &request, http_response &response)
@@ -108,6 +1120,42 @@ namespace hh_http
         }
     }
 
+    std::shared_ptr<body_sink> http_server::on_request_body(http_request &request)
+    {
+        if (body_sink_callback)
+            return body_sink_callback(request);
+        return nullptr;
+    }
+
+    bool http_server::on_continue_expected(http_request &request, http_response &response)
+    {
+        auto content_length = request.headers.find(to_upper_case(HEADER_CONTENT_LENGTH));
+        if (content_length != request.headers.end() && std::stoull(content_length->second) > config::MAX_BODY_SIZE)
+        {
+            response.set_status(HTTP_CONTENT_TOO_LARGE, "Content Too Large");
+            return false;
+        }
+        if (continue_callback)
+            return continue_callback(request, response);
+        return true;
+    }
+
+    void http_server::on_websocket_opened(http_request &request, std::shared_ptr<websocket_connection> connection)
+    {
+        if (websocket_callback)
+            websocket_callback(request, connection);
+    }
+
+    /**
+     * Report the phase timings of a request whose response was sent.
+     * Runs on the thread that called http_response::send().
+     */
+    void http_server::on_request_completed(const request_timings &timings)
+    {
+        if (request_completed_callback)
+            request_completed_callback(timings);
+    }
+
     /**
      * Handle server startup completion event.
      * Calls user-provided callback to notify application that server is listening.
@@ -146,6 +1194,9 @@ namespace hh_http
      */
     void http_server::on_connection_closed(std::shared_ptr<hh_socket::connection> conn)
     {
+        if (config::ENABLE_METRICS)
+            metrics::registry::instance().connections_closed_total.increment();
+        client_closed(conn->get_remote_address().to_string());
         if (client_disconnected_callback)
             client_disconnected_callback(conn);
     }
@@ -155,6 +1206,16 @@ namespace hh_http
      */
     void http_server::on_connection_opened(std::shared_ptr<hh_socket::connection> conn)
     {
+        if (config::ENABLE_METRICS)
+            metrics::registry::instance().connections_opened_total.increment();
+        // The socket layer keeps accepting while draining; turn such clients away
+        std::string remote = conn->get_remote_address().to_string();
+        if (drain->draining.load() || !admit_connection(remote) || !await_first_request(remote, conn, 0))
+        {
+            this->close_connection(conn);
+            return;
+        }
+        profile.apply(conn->get_fd());
         if (client_connected_callback)
             client_connected_callback(conn);
     }
@@ -221,6 +1282,22 @@ namespace hh_http
         client_disconnected_callback = callback;
     }
 
+    /**
+     * Set callback function for completed requests (phase timings).
+     */
+    void http_server::set_request_completed_callback(std::function<void(const request_timings &)> callback)
+    {
+        request_completed_callback = callback;
+    }
+
+    /**
+     * Attach (or detach with nullptr) the asynchronous access log.
+     */
+    void http_server::set_access_log(std::shared_ptr<access_log> logger)
+    {
+        access_logger = logger;
+    }
+
     /**
      * Set callback function for server idle periods.
      */
@@ -0,0 +1,153 @@
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "../includes/listener_handoff.hpp"
+
+namespace hh_http
+{
+    namespace
+    {
+        /// Tag sent with the fd, so a stray client of the control socket is not mistaken for a successor
+        constexpr char HANDOFF_MAGIC[] = "hh_http listener";
+
+        sockaddr_un control_address(const std::string &path)
+        {
+            sockaddr_un address{};
+            if (path.empty() || path.size() >= sizeof(address.sun_path))
+                throw std::runtime_error("Invalid handoff control path: " + path);
+            address.sun_family = AF_UNIX;
+            std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+            return address;
+        }
+
+        std::runtime_error errno_error(const std::string &what)
+        {
+            return std::runtime_error(what + ": " + std::strerror(errno));
+        }
+
+        /// Closes a descriptor when leaving scope
+        struct fd_guard
+        {
+            int fd;
+            ~fd_guard()
+            {
+                if (fd >= 0)
+                    ::close(fd);
+            }
+        };
+    }
+
+    void listener_handoff::offer(const std::string &control_path, int listener_fd)
+    {
+        sockaddr_un address = control_address(control_path);
+        fd_guard server{::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+        if (server.fd < 0)
+            throw errno_error("Failed to create handoff socket");
+
+        ::unlink(control_path.c_str());
+        if (::bind(server.fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 ||
+            ::listen(server.fd, 1) < 0)
+            throw errno_error("Failed to bind handoff socket " + control_path);
+
+        struct path_guard
+        {
+            const std::string &path;
+            ~path_guard() { ::unlink(path.c_str()); }
+        } remove_path{control_path};
+
+        fd_guard successor{-1};
+        do
+            successor.fd = ::accept4(server.fd, nullptr, nullptr, SOCK_CLOEXEC);
+        while (successor.fd < 0 && errno == EINTR);
+        if (successor.fd < 0)
+            throw errno_error("Failed to accept handoff connection");
+
+        iovec payload{const_cast<char *>(HANDOFF_MAGIC), sizeof(HANDOFF_MAGIC)};
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+        msghdr message{};
+        message.msg_iov = &payload;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        cmsghdr *header = CMSG_FIRSTHDR(&message);
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_RIGHTS;
+        header->cmsg_len = CMSG_LEN(sizeof(int));
+        std::memcpy(CMSG_DATA(header), &listener_fd, sizeof(int));
+
+        if (::sendmsg(successor.fd, &message, MSG_NOSIGNAL) != static_cast<ssize_t>(sizeof(HANDOFF_MAGIC)))
+            throw errno_error("Failed to send listener");
+
+        char ack = 0;
+        ssize_t received;
+        do
+            received = ::recv(successor.fd, &ack, 1, 0);
+        while (received < 0 && errno == EINTR);
+        if (received != 1)
+            throw std::runtime_error("Successor did not acknowledge the listener handoff");
+    }
+
+    int listener_handoff::take(const std::string &control_path)
+    {
+        sockaddr_un address = control_address(control_path);
+        fd_guard client{::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+        if (client.fd < 0)
+            throw errno_error("Failed to create handoff socket");
+        if (::connect(client.fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0)
+        {
+            // Nobody is offering a listener: this is a fresh start
+            if (errno == ENOENT || errno == ECONNREFUSED)
+                return -1;
+            throw errno_error("Failed to connect to handoff socket " + control_path);
+        }
+
+        char tag[sizeof(HANDOFF_MAGIC)] = {};
+        iovec payload{tag, sizeof(tag)};
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+        msghdr message{};
+        message.msg_iov = &payload;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+
+        ssize_t received;
+        do
+            received = ::recvmsg(client.fd, &message, MSG_CMSG_CLOEXEC);
+        while (received < 0 && errno == EINTR);
+
+        int listener_fd = -1;
+        cmsghdr *header = CMSG_FIRSTHDR(&message);
+        if (header && header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS &&
+            header->cmsg_len == CMSG_LEN(sizeof(int)))
+            std::memcpy(&listener_fd, CMSG_DATA(header), sizeof(int));
+
+        if (received != static_cast<ssize_t>(sizeof(HANDOFF_MAGIC)) || std::memcmp(tag, HANDOFF_MAGIC, sizeof(tag)) != 0 ||
+            listener_fd < 0 || (message.msg_flags & MSG_CTRUNC))
+        {
+            if (listener_fd >= 0)
+                ::close(listener_fd);
+            throw std::runtime_error("Invalid listener handoff message");
+        }
+
+        int accepting = 0;
+        socklen_t size = sizeof(accepting);
+        if (::getsockopt(listener_fd, SOL_SOCKET, SO_ACCEPTCONN, &accepting, &size) < 0 || !accepting)
+        {
+            ::close(listener_fd);
+            throw std::runtime_error("Handed off descriptor is not a listening socket");
+        }
+
+        char ack = 1;
+        if (::send(client.fd, &ack, 1, MSG_NOSIGNAL) != 1)
+        {
+            ::close(listener_fd);
+            throw errno_error("Failed to acknowledge listener handoff");
+        }
+        return listener_fd;
+    }
+}
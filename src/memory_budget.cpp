@@ -0,0 +1,67 @@
+#include <algorithm>
+
+#include "../includes/memory_budget.hpp"
+#include "../includes/http_consts.hpp"
+#include "../includes/metrics.hpp"
+
+namespace hh_http
+{
+    memory_budget &memory_budget::instance()
+    {
+        static memory_budget budget;
+        return budget;
+    }
+
+    void memory_budget::acquire(std::size_t n)
+    {
+        std::size_t now = in_use.fetch_add(n, std::memory_order_relaxed) + n;
+        if (config::MAX_BUFFERED_BYTES && now >= config::MAX_BUFFERED_BYTES && !exhausted())
+            update_pressure();
+    }
+
+    void memory_budget::release(std::size_t n)
+    {
+        std::size_t now = in_use.fetch_sub(n, std::memory_order_relaxed) - n;
+        if (exhausted() && now <= config::MAX_BUFFERED_BYTES / 100 * RESUME_PERCENT)
+            update_pressure();
+    }
+
+    std::size_t memory_budget::add_listener(listener callback)
+    {
+        std::lock_guard<std::mutex> lock(listeners_mutex);
+        listeners.emplace_back(next_listener_id, std::move(callback));
+        return next_listener_id++;
+    }
+
+    void memory_budget::remove_listener(std::size_t id)
+    {
+        std::lock_guard<std::mutex> lock(listeners_mutex);
+        listeners.erase(std::remove_if(listeners.begin(), listeners.end(), [id](const auto &entry)
+                                       { return entry.first == id; }),
+                        listeners.end());
+    }
+
+    /**
+     * Re-evaluate the state under the lock, so concurrent acquire/release
+     * calls that both saw a crossing still notify listeners in order and
+     * only once per transition.
+     */
+    void memory_budget::update_pressure()
+    {
+        std::lock_guard<std::mutex> lock(listeners_mutex);
+        std::size_t now = used();
+        bool pressure = exhausted();
+        if (!pressure && config::MAX_BUFFERED_BYTES && now >= config::MAX_BUFFERED_BYTES)
+            pressure = true;
+        else if (pressure && now <= config::MAX_BUFFERED_BYTES / 100 * RESUME_PERCENT)
+            pressure = false;
+        if (pressure == exhausted())
+            return;
+
+        under_pressure.store(pressure, std::memory_order_release);
+        if (pressure && config::ENABLE_METRICS)
+            metrics::registry::instance().memory_budget_exhausted_total.increment();
+        for (auto &entry : listeners)
+            entry.second(pressure);
+    }
+}
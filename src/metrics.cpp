@@ -0,0 +1,243 @@
+#include <sstream>
+
+#include "../includes/metrics.hpp"
+#include "../includes/memory_budget.hpp"
+
+namespace hh_http
+{
+    namespace metrics
+    {
+        namespace
+        {
+            /// Shard index of the calling thread, assigned round-robin on first use
+            std::size_t this_thread_shard()
+            {
+                static std::atomic<std::size_t> next_shard{0};
+                thread_local std::size_t shard = next_shard.fetch_add(1, std::memory_order_relaxed) % SHARD_COUNT;
+                return shard;
+            }
+
+            /// Upper bounds (seconds) of the exported Prometheus buckets
+            constexpr double EXPORT_BUCKETS_SECONDS[] = {
+                0.00005, 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005,
+                0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10};
+
+            const char *phase_name(phase p)
+            {
+                switch (p)
+                {
+                case phase::PARSE:
+                    return "parse";
+                case phase::QUEUE:
+                    return "queue";
+                case phase::HANDLER:
+                    return "handler";
+                case phase::WRITE:
+                    return "write";
+                }
+                return "unknown";
+            }
+
+            void write_counter(std::ostringstream &out, const char *name, const char *help, const counter &c)
+            {
+                out << "# HELP " << name << " " << help << "\n";
+                out << "# TYPE " << name << " counter\n";
+                out << name << " " << c.value() << "\n";
+            }
+        }
+
+        void counter::increment(std::uint64_t n)
+        {
+            shards[this_thread_shard()].value.fetch_add(n, std::memory_order_relaxed);
+        }
+
+        std::uint64_t counter::value() const
+        {
+            std::uint64_t sum = 0;
+            for (const auto &s : shards)
+                sum += s.value.load(std::memory_order_relaxed);
+            return sum;
+        }
+
+        std::size_t histogram::index_of(std::uint64_t value)
+        {
+            if (value < SUB_BUCKET_COUNT)
+                return static_cast<std::size_t>(value);
+            int shift = (63 - __builtin_clzll(value)) - (SUB_BUCKET_BITS - 1);
+            return static_cast<std::size_t>(shift * SUB_BUCKET_HALF + (value >> shift));
+        }
+
+        std::uint64_t histogram::highest_equivalent(std::size_t index)
+        {
+            if (index < SUB_BUCKET_COUNT)
+                return index;
+            std::uint64_t shift = index / SUB_BUCKET_HALF - 1;
+            std::uint64_t sub = index - shift * SUB_BUCKET_HALF;
+            return ((sub + 1) << shift) - 1;
+        }
+
+        void histogram::record(std::uint64_t nanoseconds)
+        {
+            shards[this_thread_shard()].counts[index_of(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+            samples.increment();
+            total.increment(nanoseconds);
+        }
+
+        void histogram::record(std::chrono::steady_clock::duration duration)
+        {
+            auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+            record(static_cast<std::uint64_t>(ns > 0 ? ns : 0));
+        }
+
+        std::uint64_t histogram::bucket_value(std::size_t index) const
+        {
+            std::uint64_t sum = 0;
+            for (const auto &s : shards)
+                sum += s.counts[index].load(std::memory_order_relaxed);
+            return sum;
+        }
+
+        std::uint64_t histogram::count() const
+        {
+            return samples.value();
+        }
+
+        std::uint64_t histogram::sum() const
+        {
+            return total.value();
+        }
+
+        std::uint64_t histogram::count_at_or_below(std::uint64_t nanoseconds) const
+        {
+            std::uint64_t seen = 0;
+            for (std::size_t i = 0; i < BUCKET_COUNT && highest_equivalent(i) <= nanoseconds; ++i)
+                seen += bucket_value(i);
+            return seen;
+        }
+
+        std::uint64_t histogram::value_at_percentile(double percentile) const
+        {
+            // Summed once up front: the shards keep changing while they are read
+            std::array<std::uint64_t, BUCKET_COUNT> counts;
+            std::uint64_t samples_now = 0;
+            for (std::size_t i = 0; i < BUCKET_COUNT; ++i)
+            {
+                counts[i] = bucket_value(i);
+                samples_now += counts[i];
+            }
+            if (!samples_now)
+                return 0;
+
+            auto wanted = static_cast<std::uint64_t>(percentile / 100.0 * static_cast<double>(samples_now) + 0.5);
+            if (wanted == 0)
+                wanted = 1;
+
+            std::uint64_t seen = 0;
+            for (std::size_t i = 0; i < BUCKET_COUNT; ++i)
+            {
+                seen += counts[i];
+                if (seen >= wanted)
+                    return highest_equivalent(i);
+            }
+            return highest_equivalent(BUCKET_COUNT - 1);
+        }
+
+        registry &registry::instance()
+        {
+            static registry global_registry;
+            return global_registry;
+        }
+
+        void registry::record_parse_error(const std::string &kind)
+        {
+            for (std::size_t i = 0; i < PARSE_ERROR_KINDS.size(); ++i)
+            {
+                if (kind == PARSE_ERROR_KINDS[i])
+                {
+                    parse_errors[i].increment();
+                    return;
+                }
+            }
+            parse_errors.back().increment();
+        }
+
+        void registry::record_phase(phase p, std::chrono::steady_clock::duration duration)
+        {
+            phase_histograms[static_cast<std::size_t>(p)].record(duration);
+        }
+
+        const histogram &registry::phase_latency(phase p) const
+        {
+            return phase_histograms[static_cast<std::size_t>(p)];
+        }
+
+        std::string registry::render_prometheus() const
+        {
+            std::ostringstream out;
+
+            write_counter(out, "hh_http_requests_total", "Complete HTTP requests dispatched to handlers.", requests_total);
+            write_counter(out, "hh_http_received_bytes_total", "Bytes read from clients.", bytes_received_total);
+            write_counter(out, "hh_http_sent_bytes_total", "Bytes handed to the socket layer for clients.", bytes_sent_total);
+            write_counter(out, "hh_http_connections_opened_total", "Client connections accepted.", connections_opened_total);
+            write_counter(out, "hh_http_connections_closed_total", "Client connections closed.", connections_closed_total);
+            write_counter(out, "hh_http_idle_timeouts_total", "Connections closed by the idle sweeper.", idle_timeouts_total);
+            write_counter(out, "hh_http_access_log_dropped_total", "Access log records dropped because a ring buffer was full.", access_log_dropped_total);
+            write_counter(out, "hh_http_memory_budget_exhausted_total", "Times the buffered byte budget was reached and reading paused.", memory_budget_exhausted_total);
+            write_counter(out, "hh_http_write_timeouts_total", "Connections closed because queued writes made no progress.", write_timeouts_total);
+            write_counter(out, "hh_http_accept_batches_total", "Event loop iterations that accepted at least one connection.", accept_batches_total);
+            write_counter(out, "hh_http_accept_fd_exhausted_total", "Accepts that failed with EMFILE/ENFILE.", accept_fd_exhausted_total);
+            write_counter(out, "hh_http_websocket_upgrades_total", "Connections switched to the WebSocket protocol.", websocket_upgrades_total);
+            write_counter(out, "hh_http_websocket_messages_received_total", "Complete WebSocket messages received from clients.", websocket_messages_received_total);
+            write_counter(out, "hh_http_websocket_messages_sent_total", "WebSocket messages sent to clients.", websocket_messages_sent_total);
+            write_counter(out, "hh_http_sse_events_published_total", "Events published to event_channel subscribers.", sse_events_published_total);
+            write_counter(out, "hh_http_sse_subscribers_evicted_total", "Event stream subscribers closed for reading too slowly.", sse_subscribers_evicted_total);
+            write_counter(out, "hh_http_http2_connections_total", "Connections speaking HTTP/2 (prior knowledge or h2c upgrade).", http2_connections_total);
+            write_counter(out, "hh_http_http2_streams_total", "HTTP/2 streams opened by clients.", http2_streams_total);
+            write_counter(out, "hh_http_http2_stream_resets_total", "HTTP/2 streams reset by the server with an error code.", http2_stream_resets_total);
+            write_counter(out, "hh_http_continue_sent_total", "100 Continue responses sent to clients waiting to send a body.", continue_sent_total);
+            write_counter(out, "hh_http_expectations_rejected_total", "Expect: 100-continue requests rejected before their body was read.", expectations_rejected_total);
+            write_counter(out, "hh_http_rate_limited_requests_total", "Requests answered with 429 by a rate limit.", rate_limited_requests_total);
+            write_counter(out, "hh_http_rate_limited_connections_total", "Connections closed on accept by the connection rate limit.", rate_limited_connections_total);
+            write_counter(out, "hh_http_header_timeouts_total", "Connections closed for not sending a request within MAX_HEADER_READ_TIME.", header_timeouts_total);
+            write_counter(out, "hh_http_slow_bodies_total", "Connections closed for sending a request body slower than MIN_BODY_RATE.", slow_bodies_total);
+            write_counter(out, "hh_http_partial_limit_rejections_total", "Connections closed on accept because their IP had MAX_PARTIAL_REQUESTS_PER_IP requests in progress.", partial_limit_rejections_total);
+
+            out << "# HELP hh_http_buffered_bytes Request/response bytes currently held in server buffers.\n";
+            out << "# TYPE hh_http_buffered_bytes gauge\n";
+            out << "hh_http_buffered_bytes " << memory_budget::instance().used() << "\n";
+
+            out << "# HELP hh_http_parse_errors_total Requests rejected by the parser, by error kind.\n";
+            out << "# TYPE hh_http_parse_errors_total counter\n";
+            for (std::size_t i = 0; i < parse_errors.size(); ++i)
+            {
+                const char *kind = i < PARSE_ERROR_KINDS.size() ? PARSE_ERROR_KINDS[i] : "OTHER";
+                out << "hh_http_parse_errors_total{kind=\"" << kind << "\"} " << parse_errors[i].value() << "\n";
+            }
+
+            out << "# HELP hh_http_phase_duration_seconds Time spent in each request processing phase.\n";
+            out << "# TYPE hh_http_phase_duration_seconds histogram\n";
+            for (phase p : {phase::PARSE, phase::QUEUE, phase::HANDLER, phase::WRITE})
+            {
+                const histogram &h = phase_latency(p);
+                const char *name = phase_name(p);
+                for (double bound : EXPORT_BUCKETS_SECONDS)
+                {
+                    out << "hh_http_phase_duration_seconds_bucket{phase=\"" << name << "\",le=\"" << bound << "\"} "
+                        << h.count_at_or_below(static_cast<std::uint64_t>(bound * 1e9)) << "\n";
+                }
+                // Derive the total from the buckets so +Inf is never below a finite bucket
+                std::uint64_t count = h.count_at_or_below(UINT64_MAX);
+                out << "hh_http_phase_duration_seconds_bucket{phase=\"" << name << "\",le=\"+Inf\"} " << count << "\n";
+                out << "hh_http_phase_duration_seconds_sum{phase=\"" << name << "\"} " << static_cast<double>(h.sum()) / 1e9 << "\n";
+                out << "hh_http_phase_duration_seconds_count{phase=\"" << name << "\"} " << count << "\n";
+            }
+
+            return out.str();
+        }
+
+        bool is_parse_error(const std::string &method)
+        {
+            return method.rfind("BAD_", 0) == 0 || method == "CONTENT_TOO_LARGE";
+        }
+    }
+}
@@ -0,0 +1,399 @@
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <stdexcept>
+
+#include <unistd.h>
+
+#include "../includes/multipart.hpp"
+#include "../includes/http_consts.hpp"
+
+namespace hh_http
+{
+    namespace
+    {
+        constexpr std::size_t MAX_BOUNDARY_SIZE = 70;
+
+        std::string trim(const std::string &value)
+        {
+            std::size_t first = value.find_first_not_of(" \t");
+            if (first == std::string::npos)
+                return "";
+            std::size_t last = value.find_last_not_of(" \t");
+            return value.substr(first, last - first + 1);
+        }
+
+        std::string to_lower(std::string value)
+        {
+            std::transform(value.begin(), value.end(), value.begin(), [](unsigned char c)
+                           { return static_cast<char>(std::tolower(c)); });
+            return value;
+        }
+
+        /**
+         * Parameters after the first ';' of a header value, such as
+         * form-data; name="field"; filename="a.txt". Names are lower-cased;
+         * quoted values may contain ';' and backslash escapes. The first
+         * occurrence of a name wins.
+         */
+        std::map<std::string, std::string> parse_parameters(const std::string &value)
+        {
+            std::map<std::string, std::string> parameters;
+            std::size_t pos = value.find(';');
+            while (pos < value.size())
+            {
+                ++pos;
+                std::size_t equals = value.find_first_of("=;", pos);
+                std::string name = to_lower(trim(value.substr(pos, equals == std::string::npos ? std::string::npos : equals - pos)));
+                if (equals == std::string::npos || value[equals] == ';')
+                {
+                    pos = equals;
+                    continue;
+                }
+
+                pos = value.find_first_not_of(" \t", equals + 1);
+                std::string parameter;
+                if (pos != std::string::npos && value[pos] == '"')
+                {
+                    for (++pos; pos < value.size() && value[pos] != '"'; ++pos)
+                    {
+                        if (value[pos] == '\\' && pos + 1 < value.size())
+                            ++pos;
+                        parameter.push_back(value[pos]);
+                    }
+                    pos = value.find(';', pos);
+                }
+                else
+                {
+                    std::size_t end = pos == std::string::npos ? std::string::npos : value.find(';', pos);
+                    if (pos != std::string::npos)
+                        parameter = trim(value.substr(pos, end == std::string::npos ? std::string::npos : end - pos));
+                    pos = end;
+                }
+                if (!name.empty())
+                    parameters.emplace(name, parameter);
+            }
+            return parameters;
+        }
+    }
+
+    multipart_parser::multipart_parser(const std::string &boundary)
+        : delimiter("\r\n--" + boundary)
+    {
+        if (boundary.empty() || boundary.size() > MAX_BOUNDARY_SIZE)
+            throw std::runtime_error("Invalid multipart boundary");
+
+        // Horspool shift: distance from a byte's last position (before the final one) to the end
+        std::size_t n = delimiter.size();
+        skip.fill(n);
+        for (std::size_t i = 0; i + 1 < n; ++i)
+            skip[static_cast<unsigned char>(delimiter[i])] = n - 1 - i;
+
+        // The body may open with the delimiter itself: start as if a CRLF preceded it
+        carry = "\r\n";
+    }
+
+    multipart_parser::~multipart_parser()
+    {
+        if (file)
+            std::fclose(file);
+        if (finished_ok)
+            return;
+        for (const auto &part : all_parts)
+        {
+            if (!part.saved_path.empty())
+                std::remove(part.saved_path.c_str());
+        }
+    }
+
+    std::string multipart_parser::boundary_of(const std::string &content_type)
+    {
+        std::string media_type = to_lower(trim(content_type.substr(0, content_type.find(';'))));
+        if (media_type != "multipart/form-data")
+            return "";
+        auto parameters = parse_parameters(content_type);
+        auto boundary = parameters.find("boundary");
+        if (boundary == parameters.end() || boundary->second.size() > MAX_BOUNDARY_SIZE)
+            return "";
+        return boundary->second;
+    }
+
+    const multipart_part *multipart_parser::find(const std::string &name) const
+    {
+        for (const auto &part : all_parts)
+        {
+            if (part.name == name)
+                return &part;
+        }
+        return nullptr;
+    }
+
+    bool multipart_parser::write(const char *data, std::size_t size)
+    {
+        std::size_t offset = 0;
+        while (offset < size && state != parse_state::FAILED && state != parse_state::EPILOGUE)
+        {
+            const char *piece = data + offset;
+            std::size_t left = size - offset;
+            switch (state)
+            {
+            case parse_state::PREAMBLE:
+            case parse_state::DATA:
+                offset += scan(piece, left);
+                break;
+
+            case parse_state::AFTER_DELIMITER:
+                // Transport padding may follow the boundary before its CRLF (RFC 2046, section 5.1.1)
+                if (*piece == '-')
+                    state = parse_state::CLOSE_DASH;
+                else if (*piece == '\r')
+                    state = parse_state::DELIMITER_CR;
+                else if (*piece != ' ' && *piece != '\t')
+                    fail("malformed multipart delimiter");
+                ++offset;
+                break;
+
+            case parse_state::CLOSE_DASH:
+                if (*piece == '-')
+                    state = parse_state::EPILOGUE;
+                else
+                    fail("malformed multipart delimiter");
+                ++offset;
+                break;
+
+            case parse_state::DELIMITER_CR:
+                if (*piece == '\n')
+                {
+                    // Starting from the CRLF just read, an empty header section is found like any other
+                    state = parse_state::HEADERS;
+                    header_block = "\r\n";
+                }
+                else
+                {
+                    fail("malformed multipart delimiter");
+                }
+                ++offset;
+                break;
+
+            case parse_state::HEADERS:
+            {
+                std::size_t before = header_block.size();
+                std::size_t take = std::min(left, config::MAX_HEADER_SIZE + 4);
+                header_block.append(piece, take);
+                std::size_t end = header_block.find("\r\n\r\n", before >= 3 ? before - 3 : 0);
+                if (end == std::string::npos)
+                {
+                    if (header_block.size() > config::MAX_HEADER_SIZE)
+                        fail("multipart part headers too large");
+                    offset += take;
+                    break;
+                }
+                offset += end + 4 - before;
+                header_block.resize(end + 2);
+                if (begin_part())
+                    state = parse_state::DATA;
+                break;
+            }
+
+            default:
+                break;
+            }
+        }
+        return state != parse_state::FAILED;
+    }
+
+    bool multipart_parser::finish()
+    {
+        if (state == parse_state::EPILOGUE)
+        {
+            finished_ok = true;
+            return true;
+        }
+        return fail("multipart body ended before its closing delimiter");
+    }
+
+    std::size_t multipart_parser::find_delimiter(const char *data, std::size_t size) const
+    {
+        std::size_t n = delimiter.size();
+        char last = delimiter[n - 1];
+        for (std::size_t i = 0; i + n <= size;)
+        {
+            char c = data[i + n - 1];
+            if (c == last && std::memcmp(data + i, delimiter.data(), n - 1) == 0)
+                return i;
+            i += skip[static_cast<unsigned char>(c)];
+        }
+        return size;
+    }
+
+    void multipart_parser::emit(const char *data, std::size_t size)
+    {
+        // Bytes before the first delimiter are a preamble, ignored by definition
+        if (size == 0 || state != parse_state::DATA)
+            return;
+        auto &part = all_parts.back();
+        part.size += size;
+        if (part_data)
+            part_data(part, data, size);
+        else if (file)
+        {
+            if (std::fwrite(data, 1, size, file) != size)
+                fail("cannot write upload file");
+        }
+        else
+            part.value.append(data, size);
+    }
+
+    std::size_t multipart_parser::scan(const char *data, std::size_t size)
+    {
+        if (!carry.empty())
+            return resolve_carry(data, size);
+
+        std::size_t found = find_delimiter(data, size);
+        if (found < size)
+        {
+            emit(data, found);
+            delimiter_found();
+            return found + delimiter.size();
+        }
+
+        // The earliest tail that is a prefix of the delimiter waits for the next piece
+        std::size_t n = delimiter.size();
+        for (std::size_t j = size > n - 1 ? size - (n - 1) : 0; j < size; ++j)
+        {
+            if (data[j] == '\r' && std::memcmp(data + j, delimiter.data(), size - j) == 0)
+            {
+                emit(data, j);
+                carry.assign(data + j, size - j);
+                return size;
+            }
+        }
+        emit(data, size);
+        return size;
+    }
+
+    /**
+     * carry is a prefix of the delimiter left by the previous piece. A
+     * delimiter may start at any of its bytes, so each start is checked
+     * against carry plus the first bytes of this piece; carry bytes that
+     * start none are part data.
+     */
+    std::size_t multipart_parser::resolve_carry(const char *data, std::size_t size)
+    {
+        std::size_t n = delimiter.size();
+        std::size_t kept = carry.size();
+        std::size_t take = std::min(size, n - 1);
+        std::string window = carry;
+        window.append(data, take);
+        carry.clear();
+
+        for (std::size_t start = 0; start < kept; ++start)
+        {
+            std::size_t length = std::min(window.size() - start, n);
+            if (std::memcmp(window.data() + start, delimiter.data(), length) != 0)
+                continue;
+            emit(window.data(), start);
+            if (length == n)
+            {
+                delimiter_found();
+                return n - (kept - start);
+            }
+            // Still a prefix, and this piece is used up
+            carry = window.substr(start);
+            return take;
+        }
+        emit(window.data(), kept);
+        return 0;
+    }
+
+    void multipart_parser::delimiter_found()
+    {
+        if (state == parse_state::FAILED)
+            return;
+        if (state == parse_state::DATA)
+            end_part();
+        if (state != parse_state::FAILED)
+            state = parse_state::AFTER_DELIMITER;
+    }
+
+    bool multipart_parser::begin_part()
+    {
+        multipart_part part;
+        // header_block holds "\r\n" + lines, each ending in "\r\n"
+        std::size_t pos = 2;
+        while (pos < header_block.size())
+        {
+            std::size_t end = header_block.find("\r\n", pos);
+            std::string line = header_block.substr(pos, end - pos);
+            pos = end + 2;
+            std::size_t colon = line.find(':');
+            if (colon == std::string::npos || colon == 0)
+                return fail("malformed multipart part header");
+            part.headers.emplace(to_upper_case(trim(line.substr(0, colon))), trim(line.substr(colon + 1)));
+        }
+        header_block.clear();
+
+        auto disposition = part.headers.find(to_upper_case("Content-Disposition"));
+        if (disposition != part.headers.end())
+        {
+            auto parameters = parse_parameters(disposition->second);
+            part.name = parameters["name"];
+            part.filename = parameters["filename"];
+        }
+        auto content_type = part.headers.find(to_upper_case(HEADER_CONTENT_TYPE));
+        if (content_type != part.headers.end())
+            part.content_type = content_type->second;
+
+        if (!part_data && !upload_directory.empty() && !part.filename.empty())
+        {
+            // Generated name: the client's filename is never trusted as a path
+            std::string path = upload_directory + "/upload-XXXXXX";
+            int fd = ::mkstemp(&path[0]);
+            if (fd < 0)
+                return fail("cannot create upload file");
+            file = ::fdopen(fd, "wb");
+            if (!file)
+            {
+                ::close(fd);
+                std::remove(path.c_str());
+                return fail("cannot create upload file");
+            }
+            part.saved_path = path;
+        }
+
+        all_parts.push_back(std::move(part));
+        if (part_begin)
+            part_begin(all_parts.back());
+        return true;
+    }
+
+    void multipart_parser::end_part()
+    {
+        if (file)
+        {
+            bool closed = std::fclose(file) == 0;
+            file = nullptr;
+            if (!closed)
+            {
+                fail("cannot write upload file");
+                return;
+            }
+        }
+        if (part_end)
+            part_end(all_parts.back());
+    }
+
+    bool multipart_parser::fail(const std::string &reason)
+    {
+        if (state == parse_state::FAILED)
+            return false;
+        failure = reason;
+        state = parse_state::FAILED;
+        if (file)
+        {
+            std::fclose(file);
+            file = nullptr;
+        }
+        return false;
+    }
+}
@@ -0,0 +1,57 @@
+#include "../includes/outbound_queue.hpp"
+#include "../includes/http_consts.hpp"
+
+namespace hh_http
+{
+    void outbound_queue::queued(std::size_t n)
+    {
+        std::size_t now = bytes.fetch_add(n, std::memory_order_relaxed) + n;
+        if (now >= config::OUTBOUND_HIGH_WATERMARK && writable())
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (size() >= config::OUTBOUND_HIGH_WATERMARK)
+                congested.store(true, std::memory_order_release);
+        }
+    }
+
+    void outbound_queue::written(std::size_t n)
+    {
+        std::size_t now = bytes.fetch_sub(n, std::memory_order_relaxed) - n;
+        if (writable() || now > config::OUTBOUND_LOW_WATERMARK)
+            return;
+
+        std::vector<std::function<void()>> ready;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (size() > config::OUTBOUND_LOW_WATERMARK)
+                return;
+            congested.store(false, std::memory_order_release);
+            ready.swap(waiting);
+        }
+        // Outside the lock: callbacks usually queue more data
+        for (auto &callback : ready)
+            callback();
+    }
+
+    void outbound_queue::on_writable(std::function<void()> callback)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (closed)
+                return;
+            if (!writable())
+            {
+                waiting.push_back(std::move(callback));
+                return;
+            }
+        }
+        callback();
+    }
+
+    void outbound_queue::close()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        waiting.clear();
+    }
+}
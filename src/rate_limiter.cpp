@@ -0,0 +1,143 @@
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+
+#include "../includes/rate_limiter.hpp"
+
+namespace hh_http
+{
+    namespace
+    {
+        constexpr std::size_t SHARD_COUNT = 64;
+
+        std::size_t round_up_to_power_of_two(std::size_t value)
+        {
+            std::size_t result = 1;
+            while (result < value)
+                result <<= 1;
+            return result;
+        }
+
+        // splitmix64 finalizer: std::hash of a string may leave the high bits that pick the shard poorly mixed
+        std::uint64_t mix(std::uint64_t value)
+        {
+            value ^= value >> 30;
+            value *= 0xbf58476d1ce4e5b9ULL;
+            value ^= value >> 27;
+            value *= 0x94d049bb133111ebULL;
+            value ^= value >> 31;
+            return value;
+        }
+    }
+
+    rate_limiter::rate_limiter(const rate_limit &limit, std::size_t slot_count)
+        : start(std::chrono::steady_clock::now())
+    {
+        if (!(limit.per_second > 0))
+            throw std::runtime_error("Rate limit must be positive");
+
+        double burst = std::max(limit.burst, 1.0);
+        interval = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(std::llround(1e6 / limit.per_second)));
+        allowance = static_cast<std::uint64_t>(std::llround(static_cast<double>(interval) * burst));
+
+        std::size_t total = round_up_to_power_of_two(std::max(slot_count, SHARD_COUNT * MAX_PROBES));
+        shard_count = SHARD_COUNT;
+        shard_size = total / SHARD_COUNT;
+        slots.reset(new slot[total]);
+    }
+
+    std::uint64_t rate_limiter::hash(std::string_view key)
+    {
+        std::uint64_t value = mix(std::hash<std::string_view>()(key));
+        // 0 marks a slot that was never used
+        return value ? value : 1;
+    }
+
+    std::uint64_t rate_limiter::combine_keys(std::string_view first, std::string_view second)
+    {
+        std::uint64_t value = mix(hash(first) ^ (hash(second) * 0x9e3779b97f4a7c15ULL));
+        return value ? value : 1;
+    }
+
+    std::uint64_t rate_limiter::now() const
+    {
+        return static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    bool rate_limiter::acquire(std::string_view key, std::chrono::milliseconds *retry_after)
+    {
+        return acquire_hash(hash(key), retry_after);
+    }
+
+    bool rate_limiter::acquire_hash(std::uint64_t key_hash, std::chrono::milliseconds *retry_after)
+    {
+        std::uint64_t time = now();
+        slot &bucket = find_slot(key_hash, time);
+
+        std::uint64_t tat = bucket.tat.load(std::memory_order_relaxed);
+        while (true)
+        {
+            std::uint64_t next = std::max(tat, time) + interval;
+            if (next > time + allowance)
+            {
+                if (retry_after)
+                    *retry_after = std::chrono::milliseconds((next - allowance - time + 999) / 1000);
+                return false;
+            }
+            if (bucket.tat.compare_exchange_weak(tat, next, std::memory_order_relaxed))
+                return true;
+        }
+    }
+
+    /**
+     * Probe a few slots from the key's home position in its shard. Keys
+     * are never removed, only replaced, so a key is always found before
+     * the first unused slot of its probe window. Two threads inserting the
+     * same new key at once can each claim a slot; the key then has two
+     * buckets until one expires, which only makes it slightly more lenient.
+     */
+    rate_limiter::slot &rate_limiter::find_slot(std::uint64_t key_hash, std::uint64_t time)
+    {
+        slot *shard = &slots[(key_hash >> 48) % shard_count * shard_size];
+        std::size_t home = static_cast<std::size_t>(key_hash) & (shard_size - 1);
+
+        while (true)
+        {
+            slot *victim = nullptr;
+            std::uint64_t victim_key = 0;
+            std::uint64_t victim_tat = std::numeric_limits<std::uint64_t>::max();
+            for (std::size_t probe = 0; probe < MAX_PROBES; ++probe)
+            {
+                slot &candidate = shard[(home + probe) & (shard_size - 1)];
+                std::uint64_t key = candidate.key.load(std::memory_order_acquire);
+                if (key == key_hash)
+                    return candidate;
+                if (key == 0)
+                {
+                    victim = &candidate;
+                    victim_key = 0;
+                    break;
+                }
+                // Expired buckets (time passed) are full; otherwise take the one that refills soonest
+                std::uint64_t tat = candidate.tat.load(std::memory_order_relaxed);
+                if (tat < victim_tat)
+                {
+                    victim = &candidate;
+                    victim_key = key;
+                    victim_tat = tat;
+                }
+            }
+
+            if (!victim->key.compare_exchange_strong(victim_key, key_hash, std::memory_order_acq_rel))
+                continue; // Someone else claimed it; look again, it may have been this key
+
+            // An evicted bucket that was still draining starts over full for its new key
+            if (victim_key != 0 && victim_tat > time)
+                victim->tat.store(time, std::memory_order_relaxed);
+            return *victim;
+        }
+    }
+}
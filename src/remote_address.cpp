@@ -0,0 +1,15 @@
+#include "../includes/remote_address.hpp"
+
+namespace hh_http
+{
+    std::string_view remote_ip(std::string_view remote)
+    {
+        if (!remote.empty() && remote[0] == '[')
+        {
+            std::size_t close = remote.find(']');
+            return close == std::string_view::npos ? remote : remote.substr(1, close - 1);
+        }
+        std::size_t colon = remote.rfind(':');
+        return colon == std::string_view::npos ? remote : remote.substr(0, colon);
+    }
+}
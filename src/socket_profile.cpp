@@ -0,0 +1,53 @@
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "../includes/socket_profile.hpp"
+
+namespace hh_http
+{
+    socket_profile socket_profile::latency()
+    {
+        socket_profile profile;
+        profile.no_delay = true;
+        profile.quick_ack = true;
+        return profile;
+    }
+
+    socket_profile socket_profile::throughput()
+    {
+        socket_profile profile;
+        profile.no_delay = true; // a corked socket ignores it; the uncork then flushes the tail at once
+        profile.cork_streams = true;
+        return profile;
+    }
+
+    /**
+     * Failures are ignored on purpose: the options are tuning only, and a
+     * client that already went away is noticed by the event loop anyway.
+     */
+    void socket_profile::apply(int fd) const
+    {
+        int enable = 1;
+        if (no_delay)
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+        if (quick_ack)
+            setsockopt(fd, IPPROTO_TCP, TCP_QUICKACK, &enable, sizeof(enable));
+        if (send_buffer > 0)
+            setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &send_buffer, sizeof(send_buffer));
+        if (receive_buffer > 0)
+            setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &receive_buffer, sizeof(receive_buffer));
+    }
+
+    void socket_profile::set_cork(int fd, bool corked)
+    {
+        int value = corked ? 1 : 0;
+        setsockopt(fd, IPPROTO_TCP, TCP_CORK, &value, sizeof(value));
+    }
+
+    void socket_profile::set_quick_ack(int fd)
+    {
+        int enable = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_QUICKACK, &enable, sizeof(enable));
+    }
+}
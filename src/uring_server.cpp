@@ -0,0 +1,1145 @@
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+
+#include "../includes/uring_server.hpp"
+#include "../includes/http_consts.hpp"
+#include "../includes/memory_budget.hpp"
+#include "../includes/metrics.hpp"
+#include "../includes/socket_profile.hpp"
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define HTTP_HAVE_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <poll.h>
+#include <sys/syscall.h>
+#endif
+
+namespace hh_http
+{
+#ifdef HTTP_HAVE_IO_URING
+    namespace
+    {
+        /// Kind of operation, stored in the top byte of an SQE's user_data
+        enum operation_kind : std::uint64_t
+        {
+            OP_ACCEPT = 1,
+            OP_RECV,
+            OP_SEND,
+            OP_WAKE,
+            OP_ACCEPT_POLL,  ///< waits for a connection on a non-blocking listener
+            OP_ACCEPT_RETRY, ///< timeout before accepting again after running out of fds
+            OP_IGNORE ///< cancel requests and other completions nobody waits for
+        };
+
+        /// Pause before accepting again after EMFILE/ENFILE; read by the kernel when the timeout is submitted
+        const __kernel_timespec ACCEPT_BACKOFF{0, 100 * 1000 * 1000};
+
+        /// Provided buffer group used for every recv
+        constexpr std::uint16_t RECV_BUFFER_GROUP = 0;
+
+        /// At most this many queued messages are written by one sendmsg
+        constexpr std::size_t MAX_IOV_PER_SEND = 64;
+
+        std::uint64_t encode(operation_kind kind, std::uint32_t generation, int fd)
+        {
+            return (static_cast<std::uint64_t>(kind) << 56) |
+                   (static_cast<std::uint64_t>(generation & 0xffffffu) << 32) |
+                   static_cast<std::uint32_t>(fd);
+        }
+
+        int sys_io_uring_setup(unsigned entries, io_uring_params *params)
+        {
+            return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+        }
+
+        int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, const void *arg, std::size_t arg_size)
+        {
+            return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, arg_size));
+        }
+
+        int sys_io_uring_register(int fd, unsigned opcode, const void *arg, unsigned nr_args)
+        {
+            return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+        }
+
+        std::string address_to_string(const sockaddr_storage &address)
+        {
+            char host[INET6_ADDRSTRLEN] = {};
+            int port = 0;
+            if (address.ss_family == AF_INET)
+            {
+                const auto *v4 = reinterpret_cast<const sockaddr_in *>(&address);
+                inet_ntop(AF_INET, &v4->sin_addr, host, sizeof(host));
+                port = ntohs(v4->sin_port);
+            }
+            else if (address.ss_family == AF_INET6)
+            {
+                const auto *v6 = reinterpret_cast<const sockaddr_in6 *>(&address);
+                inet_ntop(AF_INET6, &v6->sin6_addr, host, sizeof(host));
+                port = ntohs(v6->sin6_port);
+            }
+            return std::string(host) + ":" + std::to_string(port);
+        }
+    }
+
+    /**
+     * Memory-mapped submission/completion queues plus the provided buffer
+     * ring. Only touched by the event loop thread.
+     */
+    struct uring_server::ring
+    {
+        int fd = -1;
+        io_uring_params params{};
+
+        void *sq_map = MAP_FAILED;
+        std::size_t sq_map_size = 0;
+        void *cq_map = MAP_FAILED;
+        std::size_t cq_map_size = 0;
+        io_uring_sqe *sqes = static_cast<io_uring_sqe *>(MAP_FAILED);
+        std::size_t sqes_size = 0;
+
+        unsigned *sq_head = nullptr, *sq_tail = nullptr, *sq_mask = nullptr, *sq_array = nullptr;
+        unsigned *cq_head = nullptr, *cq_tail = nullptr, *cq_mask = nullptr;
+        io_uring_cqe *cqes = nullptr;
+
+        unsigned local_tail = 0;    ///< SQEs prepared so far
+        unsigned submitted_tail = 0; ///< SQEs handed to the kernel so far
+
+        io_uring_buf_ring *buffer_ring = nullptr;
+        std::size_t buffer_ring_size = 0;
+        unsigned buffer_count = 0;
+        unsigned buffer_size = 0;
+        std::uint16_t buffer_tail = 0;
+        char *buffers = static_cast<char *>(MAP_FAILED);
+        std::size_t buffers_size = 0;
+
+        ring(unsigned entries, unsigned recv_buffer_count, unsigned recv_buffer_size)
+        {
+            params.flags = IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN;
+            fd = sys_io_uring_setup(entries, &params);
+            if (fd < 0 && errno == EINVAL)
+            {
+                // Older kernels reject the optional flags
+                params = io_uring_params{};
+                fd = sys_io_uring_setup(entries, &params);
+            }
+            if (fd < 0)
+                throw std::runtime_error("io_uring_setup failed: " + std::string(std::strerror(errno)));
+
+            const unsigned required = IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+            if ((params.features & required) != required)
+            {
+                release();
+                throw std::runtime_error("io_uring is missing NODROP or EXT_ARG support");
+            }
+
+            sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            if (params.features & IORING_FEAT_SINGLE_MMAP)
+                sq_map_size = cq_map_size = std::max(sq_map_size, cq_map_size);
+
+            sq_map = mmap(nullptr, sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+            if (sq_map == MAP_FAILED)
+                fail("mmap of the submission queue failed");
+            if (params.features & IORING_FEAT_SINGLE_MMAP)
+            {
+                cq_map = sq_map;
+            }
+            else
+            {
+                cq_map = mmap(nullptr, cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+                if (cq_map == MAP_FAILED)
+                    fail("mmap of the completion queue failed");
+            }
+
+            sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+            sqes = static_cast<io_uring_sqe *>(mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+            if (sqes == MAP_FAILED)
+                fail("mmap of the submission entries failed");
+
+            char *sq = static_cast<char *>(sq_map);
+            sq_head = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+            sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+            sq_mask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+            sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+            char *cq = static_cast<char *>(cq_map);
+            cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+            cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+            cq_mask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+            cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+            local_tail = submitted_tail = *sq_tail;
+
+            setup_buffers(recv_buffer_count, recv_buffer_size);
+        }
+
+        ~ring()
+        {
+            release();
+        }
+
+        void setup_buffers(unsigned count, unsigned size)
+        {
+            // The kernel requires a power-of-two ring of at most 32768 entries
+            buffer_count = 1;
+            while (buffer_count < count && buffer_count < 32768)
+                buffer_count <<= 1;
+            // Whole pages per buffer keep every buffer page aligned
+            long page = sysconf(_SC_PAGESIZE);
+            buffer_size = static_cast<unsigned>((size + page - 1) / page * page);
+
+            // One anonymous mapping for the pool: pages are committed only once the
+            // kernel first receives into them, so unused buffers cost no memory
+            buffers_size = static_cast<std::size_t>(buffer_count) * buffer_size;
+            buffers = static_cast<char *>(mmap(nullptr, buffers_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+            if (buffers == MAP_FAILED)
+                fail("mmap of the receive buffers failed");
+
+            buffer_ring_size = buffer_count * sizeof(io_uring_buf);
+            // The ring must be page aligned; the kernel pins these pages while it is registered
+            void *memory = nullptr;
+            int error = posix_memalign(&memory, static_cast<std::size_t>(sysconf(_SC_PAGESIZE)), buffer_ring_size);
+            if (error)
+            {
+                errno = error;
+                fail("allocating the provided buffer ring failed");
+            }
+            std::memset(memory, 0, buffer_ring_size);
+            buffer_ring = static_cast<io_uring_buf_ring *>(memory);
+
+            io_uring_buf_reg registration{};
+            registration.ring_addr = reinterpret_cast<std::uint64_t>(buffer_ring);
+            registration.ring_entries = buffer_count;
+            registration.bgid = RECV_BUFFER_GROUP;
+            if (sys_io_uring_register(fd, IORING_REGISTER_PBUF_RING, &registration, 1) < 0)
+                fail("registering the provided buffer ring failed");
+
+            for (unsigned id = 0; id < buffer_count; ++id)
+                add_buffer(static_cast<std::uint16_t>(id));
+            publish_buffers();
+        }
+
+        [[noreturn]] void fail(const std::string &what)
+        {
+            std::string reason = what + ": " + std::strerror(errno);
+            release();
+            throw std::runtime_error(reason);
+        }
+
+        void release()
+        {
+            // Closing the ring fd unregisters the buffer ring, so it is freed last
+            if (sqes != MAP_FAILED)
+                munmap(sqes, sqes_size);
+            if (cq_map != MAP_FAILED && cq_map != sq_map)
+                munmap(cq_map, cq_map_size);
+            if (sq_map != MAP_FAILED)
+                munmap(sq_map, sq_map_size);
+            if (fd >= 0)
+                ::close(fd);
+            std::free(buffer_ring);
+            buffer_ring = nullptr;
+            if (buffers != MAP_FAILED)
+                munmap(buffers, buffers_size);
+            buffers = static_cast<char *>(MAP_FAILED);
+            sqes = static_cast<io_uring_sqe *>(MAP_FAILED);
+            sq_map = cq_map = MAP_FAILED;
+            fd = -1;
+        }
+
+        /// Next free SQE, zeroed; submits what is queued if the ring is full
+        io_uring_sqe *next_sqe()
+        {
+            while (local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= params.sq_entries)
+                submit(0, nullptr);
+
+            unsigned index = local_tail & *sq_mask;
+            io_uring_sqe *sqe = &sqes[index];
+            std::memset(sqe, 0, sizeof(*sqe));
+            sq_array[index] = index;
+            ++local_tail;
+            return sqe;
+        }
+
+        /**
+         * Submit every prepared SQE and optionally wait for completions.
+         * @return false if the wait timed out
+         */
+        bool submit(unsigned wait_for, const __kernel_timespec *timeout)
+        {
+            __atomic_store_n(sq_tail, local_tail, __ATOMIC_RELEASE);
+
+            io_uring_getevents_arg arg{};
+            arg.ts = reinterpret_cast<std::uint64_t>(timeout);
+            unsigned flags = IORING_ENTER_EXT_ARG | (wait_for ? IORING_ENTER_GETEVENTS : 0);
+
+            while (true)
+            {
+                int result = sys_io_uring_enter(fd, local_tail - submitted_tail, wait_for, flags, &arg, sizeof(arg));
+                if (result >= 0)
+                {
+                    submitted_tail += static_cast<unsigned>(result);
+                    if (submitted_tail == local_tail || wait_for)
+                        return true;
+                    continue;
+                }
+                if (errno == EINTR)
+                    continue;
+                if (errno == ETIME)
+                {
+                    // Submissions still went through, only the wait expired
+                    submitted_tail = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+                    return false;
+                }
+                if (errno == EBUSY || errno == EAGAIN)
+                    return true; // completion queue is backed up, the caller drains it first
+                throw std::runtime_error("io_uring_enter failed: " + std::string(std::strerror(errno)));
+            }
+        }
+
+        char *buffer_data(std::uint16_t id)
+        {
+            return buffers + static_cast<std::size_t>(id) * buffer_size;
+        }
+
+        void add_buffer(std::uint16_t id)
+        {
+            // Not buffer_ring->bufs: in C++ the kernel's flexible array wrapper adds an empty
+            // struct that moves bufs one entry past where the kernel reads it
+            io_uring_buf *entry = reinterpret_cast<io_uring_buf *>(buffer_ring) + (buffer_tail & (buffer_count - 1));
+            entry->addr = reinterpret_cast<std::uint64_t>(buffer_data(id));
+            entry->len = buffer_size;
+            entry->bid = id;
+            ++buffer_tail;
+        }
+
+        void publish_buffers()
+        {
+            __atomic_store_n(&buffer_ring->tail, buffer_tail, __ATOMIC_RELEASE);
+        }
+    };
+
+    bool uring_server::supported()
+    {
+        static const bool is_supported = []()
+        {
+            try
+            {
+                ring probe_ring(8, 8, 64);
+
+                // Every opcode the backend submits must be known to the kernel
+                std::vector<char> storage(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op));
+                auto *probe = reinterpret_cast<io_uring_probe *>(storage.data());
+                if (sys_io_uring_register(probe_ring.fd, IORING_REGISTER_PROBE, probe, 256) < 0)
+                    return false;
+                for (int opcode : {IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SENDMSG, IORING_OP_READ, IORING_OP_ASYNC_CANCEL})
+                {
+                    if (opcode > probe->last_op || !(probe->ops[opcode].flags & IO_URING_OP_SUPPORTED))
+                        return false;
+                }
+                return true;
+            }
+            catch (const std::exception &)
+            {
+                return false;
+            }
+        }();
+        return is_supported;
+    }
+
+    uring_server::uring_server(const std::string &ip, int port, int backlog, handlers callbacks)
+        : callbacks(std::move(callbacks))
+    {
+        sockaddr_storage address{};
+        socklen_t address_size;
+        auto *v4 = reinterpret_cast<sockaddr_in *>(&address);
+        auto *v6 = reinterpret_cast<sockaddr_in6 *>(&address);
+        if (inet_pton(AF_INET, ip.c_str(), &v4->sin_addr) == 1)
+        {
+            v4->sin_family = AF_INET;
+            v4->sin_port = htons(static_cast<std::uint16_t>(port));
+            address_size = sizeof(sockaddr_in);
+        }
+        else if (inet_pton(AF_INET6, ip.c_str(), &v6->sin6_addr) == 1)
+        {
+            v6->sin6_family = AF_INET6;
+            v6->sin6_port = htons(static_cast<std::uint16_t>(port));
+            address_size = sizeof(sockaddr_in6);
+        }
+        else
+        {
+            throw std::runtime_error("Invalid listen address: " + ip);
+        }
+
+        listen_fd = ::socket(address.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listen_fd < 0)
+            throw std::runtime_error("Failed to create listener socket");
+        int enable = 1;
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+        // Lets a new process bind the port while this one still runs (e.g. during a deploy)
+        if (uring_config::REUSE_PORT)
+            setsockopt(listen_fd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable));
+        if (epoll_config::DEFER_ACCEPT_SECONDS > 0)
+            setsockopt(listen_fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &epoll_config::DEFER_ACCEPT_SECONDS, sizeof(int));
+        if (::bind(listen_fd, reinterpret_cast<sockaddr *>(&address), address_size) < 0 ||
+            ::listen(listen_fd, backlog) < 0)
+        {
+            ::close(listen_fd);
+            throw std::runtime_error("Failed to bind listener socket: " + std::string(std::strerror(errno)));
+        }
+        setup_ring();
+    }
+
+    uring_server::uring_server(int listener_fd, handlers callbacks)
+        : callbacks(std::move(callbacks))
+    {
+        int accepting = 0;
+        socklen_t size = sizeof(accepting);
+        if (::getsockopt(listener_fd, SOL_SOCKET, SO_ACCEPTCONN, &accepting, &size) < 0 || !accepting)
+        {
+            ::close(listener_fd);
+            throw std::runtime_error("Not a listening socket: fd " + std::to_string(listener_fd));
+        }
+        // O_NONBLOCK is left alone, it is shared with the process that handed the socket over
+        listen_fd = listener_fd;
+        setup_ring();
+    }
+
+    /// Create the wake eventfd and the ring; closes the listener if that fails
+    void uring_server::setup_ring()
+    {
+        wake_fd = eventfd(0, EFD_CLOEXEC);
+        if (wake_fd < 0)
+        {
+            ::close(listen_fd);
+            throw std::runtime_error("Failed to create eventfd");
+        }
+
+        try
+        {
+            io = new ring(uring_config::QUEUE_DEPTH, uring_config::RECV_BUFFER_COUNT, uring_config::RECV_BUFFER_SIZE);
+        }
+        catch (...)
+        {
+            ::close(wake_fd);
+            ::close(listen_fd);
+            throw;
+        }
+    }
+
+    uring_server::~uring_server()
+    {
+        for (auto &entry : connections)
+        {
+            for (const auto &data : entry.second.outgoing)
+                discharge(data);
+            ::close(entry.first);
+        }
+        for (const auto &operation : pending)
+            discharge(operation.data);
+        delete io;
+        ::close(wake_fd);
+        if (listen_fd >= 0)
+            ::close(listen_fd);
+    }
+
+    void uring_server::run(int timeout_milliseconds)
+    {
+        loop_thread.store(std::this_thread::get_id());
+        arm_accept();
+        arm_wake();
+        if (callbacks.listen_success)
+            callbacks.listen_success();
+
+        __kernel_timespec timeout{};
+        timeout.tv_sec = timeout_milliseconds / 1000;
+        timeout.tv_nsec = static_cast<long long>(timeout_milliseconds % 1000) * 1000000;
+
+        while (!stopping.load())
+        {
+            try
+            {
+                apply_pending();
+
+                // One syscall submits everything queued in this iteration and waits for work
+                bool woke = io->submit(1, &timeout);
+
+                accepted_this_round = 0;
+                if (!woke && !completions_ready() && callbacks.waiting_for_activity)
+                    callbacks.waiting_for_activity();
+                reap_completions();
+                if (accepted_this_round && config::ENABLE_METRICS)
+                    metrics::registry::instance().accept_batches_total.increment();
+                sweep_stalled_writes();
+            }
+            catch (const std::exception &e)
+            {
+                if (callbacks.exception_occurred)
+                    callbacks.exception_occurred(e);
+            }
+        }
+
+        close_all();
+        if (callbacks.shutdown_success)
+            callbacks.shutdown_success();
+    }
+
+    bool uring_server::completions_ready() const
+    {
+        return *io->cq_head != __atomic_load_n(io->cq_tail, __ATOMIC_ACQUIRE);
+    }
+
+    std::size_t uring_server::reap_completions()
+    {
+        unsigned head = *io->cq_head;
+        unsigned tail = __atomic_load_n(io->cq_tail, __ATOMIC_ACQUIRE);
+        std::size_t reaped = tail - head;
+        for (; head != tail; ++head)
+        {
+            const io_uring_cqe &cqe = io->cqes[head & *io->cq_mask];
+            std::uint64_t user_data = cqe.user_data;
+            int result = cqe.res;
+            std::uint32_t flags = cqe.flags;
+            // Release the slot before running callbacks, which may queue more work
+            __atomic_store_n(io->cq_head, head + 1, __ATOMIC_RELEASE);
+            handle_completion(user_data, result, flags);
+        }
+        io->publish_buffers();
+        return reaped;
+    }
+
+    /**
+     * Close every connection once the loop has stopped. A sendmsg in flight
+     * still points into its connection's strings and iovecs, so connections
+     * are closed through abort() and completions are reaped until on_send()
+     * has closed the last of them. The receive cancels queued by close_now()
+     * are then submitted and their completions drained as well, so nothing
+     * in the kernel refers to a socket or buffer when the ring is torn down.
+     */
+    void uring_server::close_all()
+    {
+        std::vector<int> open;
+        open.reserve(connections.size());
+        for (const auto &entry : connections)
+            open.push_back(entry.first);
+        for (int fd : open)
+        {
+            auto it = connections.find(fd);
+            if (it != connections.end())
+                abort(fd, it->second);
+        }
+
+        __kernel_timespec wait{};
+        wait.tv_nsec = 10 * 1000000;
+        while (!connections.empty())
+        {
+            io->submit(1, &wait);
+            reap_completions();
+        }
+        // Cancelled receives complete right away; stop once a wait brings nothing
+        while (io->submit(1, &wait) && reap_completions() > 0)
+        {
+        }
+    }
+
+    void uring_server::stop()
+    {
+        stopping.store(true);
+        woken.store(true);
+        wake();
+    }
+
+    void uring_server::send(client_handle client, std::string data)
+    {
+        // Charged until written (or dropped with its connection)
+        outgoing_buffer buffer{std::move(data), nullptr};
+        charge(buffer);
+        queue({pending_operation::SEND, client, std::move(buffer)});
+    }
+
+    void uring_server::send(client_handle client, std::shared_ptr<const std::string> data)
+    {
+        outgoing_buffer buffer{{}, std::move(data)};
+        charge(buffer);
+        queue({pending_operation::SEND, client, std::move(buffer)});
+    }
+
+    void uring_server::stop_accepting()
+    {
+        queue({pending_operation::STOP_ACCEPTING, 0, {}});
+    }
+
+    void uring_server::close(client_handle client)
+    {
+        queue({pending_operation::CLOSE, client, {}});
+    }
+
+    void uring_server::close_fd(int fd)
+    {
+        queue({pending_operation::CLOSE_FD, static_cast<std::uint32_t>(fd), {}});
+    }
+
+    void uring_server::stop_reading(client_handle client)
+    {
+        queue({pending_operation::STOP_READING, client, {}});
+    }
+
+    void uring_server::set_corked(client_handle client, bool corked)
+    {
+        queue({corked ? pending_operation::CORK : pending_operation::UNCORK, client, {}});
+    }
+
+    std::shared_ptr<outbound_queue> uring_server::outbound(client_handle client)
+    {
+        connection_state *state = find(fd_of(client), static_cast<std::uint32_t>(client >> 32));
+        return state ? state->outbound : nullptr;
+    }
+
+    void uring_server::pause_reading()
+    {
+        queue({pending_operation::PAUSE_READING, 0, {}});
+    }
+
+    void uring_server::resume_reading()
+    {
+        queue({pending_operation::RESUME_READING, 0, {}});
+    }
+
+    void uring_server::charge(const outgoing_buffer &data)
+    {
+        unsent_bytes.fetch_add(data.size(), std::memory_order_relaxed);
+        if (!data.shared)
+            memory_budget::instance().acquire(data.size());
+    }
+
+    void uring_server::discharge(const outgoing_buffer &data)
+    {
+        unsent_bytes.fetch_sub(data.size(), std::memory_order_relaxed);
+        if (!data.shared)
+            memory_budget::instance().release(data.size());
+    }
+
+    void uring_server::queue(pending_operation operation)
+    {
+        {
+            std::lock_guard<std::mutex> lock(pending_mutex);
+            pending.push_back(std::move(operation));
+        }
+        // The loop applies pending work before it waits again, no need to wake it from its own thread
+        if (loop_thread.load() != std::this_thread::get_id() && !woken.exchange(true))
+            wake();
+    }
+
+    void uring_server::wake()
+    {
+        std::uint64_t one = 1;
+        ssize_t written = ::write(wake_fd, &one, sizeof(one));
+        (void)written;
+    }
+
+    void uring_server::apply_pending()
+    {
+        // Operations queued after this point wake the loop again; a broadcast to
+        // thousands of clients between two iterations costs a single eventfd write
+        woken.store(false);
+        {
+            std::lock_guard<std::mutex> lock(pending_mutex);
+            applying.swap(pending);
+        }
+
+        for (auto &operation : applying)
+        {
+            if (operation.kind == pending_operation::PAUSE_READING || operation.kind == pending_operation::RESUME_READING)
+            {
+                set_reading_paused(operation.kind == pending_operation::PAUSE_READING);
+                continue;
+            }
+            if (operation.kind == pending_operation::STOP_ACCEPTING)
+            {
+                close_listener();
+                continue;
+            }
+
+            int fd = fd_of(operation.client);
+            auto generation = static_cast<std::uint32_t>(operation.client >> 32);
+            connection_state *state = operation.kind == pending_operation::CLOSE_FD ? nullptr : find(fd, generation);
+            if (operation.kind == pending_operation::CLOSE_FD)
+            {
+                auto it = connections.find(fd);
+                if (it != connections.end())
+                    state = &it->second;
+            }
+            if (!state)
+            {
+                // the connection is already gone
+                discharge(operation.data);
+                continue;
+            }
+
+            switch (operation.kind)
+            {
+            case pending_operation::SEND:
+                if (state->close_requested || operation.data.empty())
+                {
+                    discharge(operation.data);
+                    state->outbound->written(operation.data.size());
+                    break;
+                }
+                if (state->outgoing.empty())
+                    state->last_progress = std::chrono::steady_clock::now();
+                state->outgoing.push_back(std::move(operation.data));
+                if (!state->send_in_flight)
+                    start_send(fd, *state);
+                break;
+            case pending_operation::STOP_READING:
+                state->reading = false;
+                cancel_recv(fd, *state);
+                break;
+            case pending_operation::CORK:
+                state->uncork_pending = false;
+                socket_profile::set_cork(fd, true);
+                break;
+            case pending_operation::UNCORK:
+                if (state->outgoing.empty())
+                    socket_profile::set_cork(fd, false);
+                else
+                    state->uncork_pending = true;
+                break;
+            case pending_operation::CLOSE:
+            case pending_operation::CLOSE_FD:
+                state->close_requested = true;
+                if (!state->send_in_flight)
+                    close_now(fd);
+                break;
+            case pending_operation::PAUSE_READING:
+            case pending_operation::RESUME_READING:
+            case pending_operation::STOP_ACCEPTING:
+                break;
+            }
+        }
+        applying.clear();
+    }
+
+    uring_server::connection_state *uring_server::find(int fd, std::uint32_t generation)
+    {
+        auto it = connections.find(fd);
+        if (it == connections.end() || (it->second.generation & 0xffffffu) != (generation & 0xffffffu))
+            return nullptr;
+        return &it->second;
+    }
+
+    void uring_server::arm_accept()
+    {
+        io_uring_sqe *sqe = io->next_sqe();
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = listen_fd;
+        sqe->accept_flags = SOCK_CLOEXEC;
+        if (multishot_accept)
+            sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        sqe->user_data = encode(OP_ACCEPT, 0, listen_fd);
+    }
+
+    /**
+     * Cancel the accept and drop the listening socket. The kernel keeps the
+     * socket open until the cancelled accept completes; if another process
+     * shares it, that process keeps accepting.
+     */
+    void uring_server::close_listener()
+    {
+        if (listen_fd < 0)
+            return;
+        io_uring_sqe *sqe = io->next_sqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = encode(OP_ACCEPT, 0, listen_fd);
+        sqe->user_data = encode(OP_IGNORE, 0, listen_fd);
+        for (operation_kind kind : {OP_ACCEPT_POLL, OP_ACCEPT_RETRY})
+        {
+            sqe = io->next_sqe();
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->addr = encode(kind, 0, listen_fd);
+            sqe->user_data = encode(OP_IGNORE, 0, listen_fd);
+        }
+        ::close(listen_fd);
+        listen_fd = -1;
+    }
+
+    void uring_server::arm_accept_poll()
+    {
+        io_uring_sqe *sqe = io->next_sqe();
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = listen_fd;
+        sqe->poll32_events = POLLIN;
+        sqe->user_data = encode(OP_ACCEPT_POLL, 0, listen_fd);
+    }
+
+    void uring_server::arm_accept_retry()
+    {
+        io_uring_sqe *sqe = io->next_sqe();
+        sqe->opcode = IORING_OP_TIMEOUT;
+        sqe->addr = reinterpret_cast<std::uint64_t>(&ACCEPT_BACKOFF);
+        sqe->len = 1;
+        sqe->user_data = encode(OP_ACCEPT_RETRY, 0, listen_fd);
+    }
+
+    void uring_server::arm_recv(int fd, connection_state &state)
+    {
+        io_uring_sqe *sqe = io->next_sqe();
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = fd;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = RECV_BUFFER_GROUP;
+        if (multishot_recv)
+            sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->user_data = encode(OP_RECV, state.generation, fd);
+        state.recv_armed = true;
+    }
+
+    void uring_server::arm_wake()
+    {
+        io_uring_sqe *sqe = io->next_sqe();
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = wake_fd;
+        sqe->addr = reinterpret_cast<std::uint64_t>(&wake_value);
+        sqe->len = sizeof(wake_value);
+        sqe->user_data = encode(OP_WAKE, 0, wake_fd);
+    }
+
+    void uring_server::start_send(int fd, connection_state &state)
+    {
+        // Gather the queued messages into one sendmsg
+        state.iov.clear();
+        std::size_t index = 0;
+        for (auto &data : state.outgoing)
+        {
+            if (index == MAX_IOV_PER_SEND)
+                break;
+            std::size_t skip = index == 0 ? state.offset : 0;
+            state.iov.push_back({const_cast<char *>(data.data()) + skip, data.size() - skip});
+            ++index;
+        }
+        state.message = msghdr{};
+        state.message.msg_iov = state.iov.data();
+        state.message.msg_iovlen = state.iov.size();
+
+        io_uring_sqe *sqe = io->next_sqe();
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<std::uint64_t>(&state.message);
+        sqe->msg_flags = MSG_NOSIGNAL;
+        sqe->user_data = encode(OP_SEND, state.generation, fd);
+        state.send_in_flight = true;
+    }
+
+    void uring_server::close_now(int fd)
+    {
+        auto it = connections.find(fd);
+        if (it == connections.end())
+            return;
+        client_handle client = (static_cast<client_handle>(it->second.generation) << 32) | static_cast<std::uint32_t>(fd);
+
+        // A multishot recv keeps a reference to the socket until it is cancelled
+        cancel_recv(fd, it->second);
+
+        // Whatever was not written is dropped with the connection
+        for (const auto &data : it->second.outgoing)
+            discharge(data);
+        it->second.outbound->close();
+
+        ::shutdown(fd, SHUT_RDWR);
+        ::close(fd);
+        connections.erase(it);
+
+        if (callbacks.connection_closed)
+            callbacks.connection_closed(client);
+    }
+
+    /**
+     * Close a connection that failed. A sendmsg in flight still points into
+     * the outgoing strings, so in that case it is cancelled and the socket
+     * shut down; on_send() closes the connection once the send has ended.
+     */
+    void uring_server::abort(int fd, connection_state &state)
+    {
+        if (!state.send_in_flight)
+        {
+            close_now(fd);
+            return;
+        }
+        state.close_requested = true;
+        io_uring_sqe *sqe = io->next_sqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = encode(OP_SEND, state.generation, fd);
+        sqe->user_data = encode(OP_IGNORE, 0, fd);
+        ::shutdown(fd, SHUT_RDWR);
+    }
+
+    /**
+     * Close connections whose queued writes have not moved for
+     * WRITE_TIMEOUT_SECONDS, so a client that stops reading cannot pin its
+     * responses in memory. Runs at most once per second.
+     */
+    void uring_server::sweep_stalled_writes()
+    {
+        if (config::WRITE_TIMEOUT_SECONDS.count() <= 0)
+            return;
+        auto now = std::chrono::steady_clock::now();
+        if (now - last_write_sweep < std::chrono::seconds(1))
+            return;
+        last_write_sweep = now;
+
+        std::vector<int> stalled;
+        for (const auto &entry : connections)
+        {
+            if (!entry.second.outgoing.empty() && !entry.second.close_requested &&
+                now - entry.second.last_progress >= config::WRITE_TIMEOUT_SECONDS)
+                stalled.push_back(entry.first);
+        }
+        for (int fd : stalled)
+        {
+            if (config::ENABLE_METRICS)
+                metrics::registry::instance().write_timeouts_total.increment();
+            // Reset instead of a FIN, the kernel would otherwise keep trying to deliver the unsent data
+            linger reset{1, 0};
+            setsockopt(fd, SOL_SOCKET, SO_LINGER, &reset, sizeof(reset));
+            abort(fd, connections[fd]);
+        }
+    }
+
+    void uring_server::cancel_recv(int fd, connection_state &state)
+    {
+        if (!state.recv_armed)
+            return;
+        io_uring_sqe *sqe = io->next_sqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = encode(OP_RECV, state.generation, fd);
+        sqe->user_data = encode(OP_IGNORE, 0, fd);
+    }
+
+    void uring_server::set_reading_paused(bool paused)
+    {
+        if (paused == reading_paused)
+            return;
+        reading_paused = paused;
+        for (auto &entry : connections)
+        {
+            if (paused)
+                cancel_recv(entry.first, entry.second);
+            else if (entry.second.reading && !entry.second.recv_armed)
+                arm_recv(entry.first, entry.second);
+        }
+    }
+
+    void uring_server::handle_completion(std::uint64_t user_data, int result, std::uint32_t flags)
+    {
+        auto kind = static_cast<operation_kind>(user_data >> 56);
+        auto generation = static_cast<std::uint32_t>((user_data >> 32) & 0xffffffu);
+        int fd = static_cast<int>(user_data & 0xffffffffu);
+
+        switch (kind)
+        {
+        case OP_ACCEPT:
+            on_accept(result, flags);
+            break;
+        case OP_RECV:
+            on_recv(fd, generation, result, flags);
+            break;
+        case OP_SEND:
+            on_send(fd, generation, result);
+            break;
+        case OP_WAKE:
+            if (!stopping.load())
+                arm_wake();
+            break;
+        case OP_ACCEPT_POLL:
+        case OP_ACCEPT_RETRY:
+            if (listen_fd >= 0)
+                arm_accept();
+            break;
+        case OP_IGNORE:
+            break;
+        }
+    }
+
+    void uring_server::on_accept(int result, std::uint32_t flags)
+    {
+        if (listen_fd < 0 || stopping.load())
+        {
+            // stop_accepting() or stop() raced with a connection that was already accepted
+            if (result >= 0)
+                ::close(result);
+            return;
+        }
+        if (result == -EAGAIN)
+        {
+            // Non-blocking listener (e.g. handed over by an epoll process): wait until a connection is ready
+            if (!(flags & IORING_CQE_F_MORE))
+                arm_accept_poll();
+            return;
+        }
+        if (result == -EMFILE || result == -ENFILE)
+        {
+            // The listener stays readable, accepting again right away would spin; retry after a pause
+            if (config::ENABLE_METRICS)
+                metrics::registry::instance().accept_fd_exhausted_total.increment();
+            if (!(flags & IORING_CQE_F_MORE))
+                arm_accept_retry();
+            return;
+        }
+        if (result == -EINVAL && multishot_accept)
+        {
+            multishot_accept = false; // kernel without multishot accept, re-arm one accept at a time
+            arm_accept();
+            return;
+        }
+        if (!(flags & IORING_CQE_F_MORE))
+            arm_accept();
+        if (result < 0)
+        {
+            if (callbacks.exception_occurred)
+                callbacks.exception_occurred(std::runtime_error("accept failed: " + std::string(std::strerror(-result))));
+            return;
+        }
+
+        int fd = result;
+        ++accepted_this_round;
+        sockaddr_storage peer{};
+        socklen_t peer_size = sizeof(peer);
+        getpeername(fd, reinterpret_cast<sockaddr *>(&peer), &peer_size);
+
+        connection_state &state = connections[fd];
+        state = connection_state{};
+        state.generation = ++next_generation & 0xffffffu;
+        state.outbound = std::make_shared<outbound_queue>();
+        if (!reading_paused)
+            arm_recv(fd, state);
+
+        if (callbacks.connection_opened)
+            callbacks.connection_opened((static_cast<client_handle>(state.generation) << 32) | static_cast<std::uint32_t>(fd),
+                                        address_to_string(peer));
+    }
+
+    void uring_server::on_recv(int fd, std::uint32_t generation, int result, std::uint32_t flags)
+    {
+        connection_state *state = find(fd, generation);
+        bool more = flags & IORING_CQE_F_MORE;
+        if (state && !more)
+            state->recv_armed = false;
+
+        if (flags & IORING_CQE_F_BUFFER)
+        {
+            auto id = static_cast<std::uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+            if (state && state->reading && result > 0 && callbacks.data_received)
+                callbacks.data_received((static_cast<client_handle>(state->generation) << 32) | static_cast<std::uint32_t>(fd),
+                                        io->buffer_data(id), static_cast<std::size_t>(result));
+            // The data has been consumed (copied by the callback), give the buffer back to the kernel
+            io->add_buffer(id);
+            state = find(fd, generation);
+        }
+
+        if (!state)
+            return;
+        if (result == -EINVAL && multishot_recv)
+        {
+            multishot_recv = false; // kernel without multishot recv, re-arm one recv at a time
+            if (!reading_paused)
+                arm_recv(fd, *state);
+            return;
+        }
+        if (result == 0 || (result < 0 && result != -ENOBUFS && result != -ECANCELED))
+        {
+            abort(fd, *state);
+            return;
+        }
+        // Re-arm when the kernel ended the multishot (e.g. it ran out of buffers). A recv cancelled
+        // by a pause that was lifted before the cancel landed is re-armed too: resume saw it still
+        // armed, so without this the connection would never read again
+        if (!state->recv_armed && state->reading && !reading_paused)
+            arm_recv(fd, *state);
+    }
+
+    void uring_server::on_send(int fd, std::uint32_t generation, int result)
+    {
+        connection_state *state = find(fd, generation);
+        if (!state)
+            return;
+        state->send_in_flight = false;
+        if (result < 0)
+        {
+            close_now(fd);
+            return;
+        }
+
+        // Drop fully written messages, remember how far into the next one we got
+        std::size_t written = static_cast<std::size_t>(result) + state->offset;
+        state->offset = 0;
+        std::size_t finished = 0;
+        while (!state->outgoing.empty() && written >= state->outgoing.front().size())
+        {
+            written -= state->outgoing.front().size();
+            finished += state->outgoing.front().size();
+            discharge(state->outgoing.front());
+            state->outgoing.pop_front();
+        }
+        state->offset = written;
+        if (result > 0)
+            state->last_progress = std::chrono::steady_clock::now();
+        // May run drain callbacks; whatever they send or close is queued, so state stays valid
+        state->outbound->written(finished);
+
+        if (!state->outgoing.empty())
+        {
+            start_send(fd, *state);
+            return;
+        }
+        if (state->uncork_pending)
+        {
+            state->uncork_pending = false;
+            socket_profile::set_cork(fd, false);
+        }
+        if (state->close_requested)
+            close_now(fd);
+    }
+#else
+    struct uring_server::ring
+    {
+    };
+
+    bool uring_server::supported()
+    {
+        return false;
+    }
+
+    uring_server::uring_server(const std::string &, int, int, handlers)
+    {
+        throw std::runtime_error("io_uring is not available on this platform");
+    }
+
+    uring_server::uring_server(int, handlers)
+    {
+        throw std::runtime_error("io_uring is not available on this platform");
+    }
+
+    uring_server::~uring_server() = default;
+    void uring_server::run(int) {}
+    void uring_server::stop() {}
+    void uring_server::send(client_handle, std::string) {}
+    void uring_server::send(client_handle, std::shared_ptr<const std::string>) {}
+    void uring_server::close(client_handle) {}
+    void uring_server::close_fd(int) {}
+    void uring_server::stop_accepting() {}
+    void uring_server::stop_reading(client_handle) {}
+    void uring_server::set_corked(client_handle, bool) {}
+    std::shared_ptr<outbound_queue> uring_server::outbound(client_handle) { return nullptr; }
+    void uring_server::pause_reading() {}
+    void uring_server::resume_reading() {}
+#endif
+}
@@ -0,0 +1,281 @@
+#include "../includes/url.hpp"
+
+namespace hh_http
+{
+    namespace url
+    {
+        namespace
+        {
+            int hex_value(char c)
+            {
+                if (c >= '0' && c <= '9')
+                    return c - '0';
+                if (c >= 'a' && c <= 'f')
+                    return c - 'a' + 10;
+                if (c >= 'A' && c <= 'F')
+                    return c - 'A' + 10;
+                return -1;
+            }
+
+            // Byte encoded by the escape at in[pos] ('%'), or -1 if it is malformed
+            int escaped_byte(std::string_view in, std::size_t pos)
+            {
+                if (pos + 2 >= in.size())
+                    return -1;
+                int high = hex_value(in[pos + 1]);
+                int low = hex_value(in[pos + 2]);
+                return high < 0 || low < 0 ? -1 : high * 16 + low;
+            }
+
+            // normalize_path() without clearing out on failure
+            bool normalize_segments(std::string_view path, std::string &out, encoded_slash slashes)
+            {
+                out.clear();
+                // An absolute-form target without a path asks for the root
+                if (path.empty())
+                {
+                    out = "/";
+                    return true;
+                }
+                if (path[0] != '/')
+                    return false;
+
+                // Each segment is decoded straight into out, then dropped again if it is a dot segment
+                std::size_t i = 1;
+                bool last = false;
+                while (!last)
+                {
+                    std::size_t mark = out.size();
+                    out.push_back('/');
+                    last = true;
+                    while (i < path.size())
+                    {
+                        char c = path[i];
+                        if (c == '/')
+                        {
+                            ++i;
+                            last = false;
+                            break;
+                        }
+                        if (c != '%')
+                        {
+                            out.push_back(c);
+                            ++i;
+                            continue;
+                        }
+
+                        int byte = escaped_byte(path, i);
+                        if (byte <= 0)
+                            return false;
+                        i += 3;
+                        if (byte == '/')
+                        {
+                            if (slashes == encoded_slash::REJECT)
+                                return false;
+                            if (slashes == encoded_slash::DECODE)
+                            {
+                                last = false;
+                                break;
+                            }
+                            out += "%2F";
+                        }
+                        else if (byte == '%' && slashes == encoded_slash::KEEP)
+                        {
+                            // Kept encoded too, or "%252F" would become the same path as "%2F"
+                            out += "%25";
+                        }
+                        else
+                        {
+                            out.push_back(static_cast<char>(byte));
+                        }
+                    }
+
+                    std::string_view segment(out.data() + mark + 1, out.size() - mark - 1);
+                    if (segment == ".")
+                    {
+                        out.resize(mark + (last ? 1 : 0));
+                    }
+                    else if (segment == "..")
+                    {
+                        out.resize(mark);
+                        std::size_t parent = out.rfind('/');
+                        out.resize(parent == std::string::npos ? 0 : parent);
+                        if (last)
+                            out.push_back('/');
+                    }
+                }
+                if (out.empty())
+                    out = "/";
+                return true;
+            }
+        }
+
+        target_parts split(std::string_view target)
+        {
+            target_parts parts;
+
+            std::size_t hash = target.find('#');
+            if (hash != std::string_view::npos)
+            {
+                parts.fragment = target.substr(hash + 1);
+                target = target.substr(0, hash);
+            }
+            std::size_t question = target.find('?');
+            if (question != std::string_view::npos)
+            {
+                parts.query = target.substr(question + 1);
+                target = target.substr(0, question);
+            }
+
+            // Absolute-form: the path starts at the first '/' after "scheme://authority"
+            if (!target.empty() && target[0] != '/' && target != "*")
+            {
+                std::size_t scheme_end = target.find("://");
+                if (scheme_end != std::string_view::npos)
+                {
+                    std::size_t path_start = target.find('/', scheme_end + 3);
+                    target = path_start == std::string_view::npos ? std::string_view() : target.substr(path_start);
+                }
+            }
+            parts.path = target;
+            return parts;
+        }
+
+        std::size_t decode(std::string_view in, char *out, std::size_t capacity, bool plus_as_space)
+        {
+            std::size_t written = 0;
+            for (std::size_t i = 0; i < in.size(); ++i)
+            {
+                if (written == capacity)
+                    return std::string::npos;
+                char c = in[i];
+                if (c == '%')
+                {
+                    int byte = escaped_byte(in, i);
+                    if (byte < 0)
+                        return std::string::npos;
+                    c = static_cast<char>(byte);
+                    i += 2;
+                }
+                else if (c == '+' && plus_as_space)
+                {
+                    c = ' ';
+                }
+                out[written++] = c;
+            }
+            return written;
+        }
+
+        bool decode(std::string_view in, std::string &out, bool plus_as_space)
+        {
+            out.resize(in.size());
+            std::size_t size = decode(in, &out[0], out.size(), plus_as_space);
+            if (size == std::string::npos)
+            {
+                out.clear();
+                return false;
+            }
+            out.resize(size);
+            return true;
+        }
+
+        bool decoded_equals(std::string_view in, std::string_view text, bool plus_as_space)
+        {
+            std::size_t j = 0;
+            for (std::size_t i = 0; i < in.size(); ++i, ++j)
+            {
+                if (j == text.size())
+                    return false;
+                char c = in[i];
+                if (c == '%')
+                {
+                    int byte = escaped_byte(in, i);
+                    if (byte < 0)
+                        return false;
+                    c = static_cast<char>(byte);
+                    i += 2;
+                }
+                else if (c == '+' && plus_as_space)
+                {
+                    c = ' ';
+                }
+                if (c != text[j])
+                    return false;
+            }
+            return j == text.size();
+        }
+
+        bool normalize_path(std::string_view path, std::string &out, encoded_slash slashes)
+        {
+            if (normalize_segments(path, out, slashes))
+                return true;
+            out.clear();
+            return false;
+        }
+
+        query_view::iterator::iterator(std::string_view query) : rest(query), done(false)
+        {
+            ++*this;
+        }
+
+        query_view::iterator &query_view::iterator::operator++()
+        {
+            while (!rest.empty() && rest[0] == '&')
+                rest.remove_prefix(1);
+            if (rest.empty())
+            {
+                done = true;
+                rest = std::string_view();
+                current = query_param();
+                return *this;
+            }
+
+            std::size_t end = rest.find('&');
+            std::string_view pair = rest.substr(0, end);
+            rest.remove_prefix(end == std::string_view::npos ? rest.size() : end);
+
+            std::size_t equals = pair.find('=');
+            current.name = pair.substr(0, equals);
+            current.value = equals == std::string_view::npos ? std::string_view() : pair.substr(equals + 1);
+            return *this;
+        }
+
+        bool query_view::has(std::string_view name) const
+        {
+            std::string_view value;
+            return find(name, value);
+        }
+
+        bool query_view::find(std::string_view name, std::string_view &value) const
+        {
+            for (const auto &param : *this)
+            {
+                if (decoded_equals(param.name, name, true))
+                {
+                    value = param.value;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        bool query_view::get(std::string_view name, std::string &out) const
+        {
+            std::string_view value;
+            if (!find(name, value))
+            {
+                out.clear();
+                return false;
+            }
+            return decode(value, out, true);
+        }
+
+        std::size_t query_view::get(std::string_view name, char *out, std::size_t capacity) const
+        {
+            std::string_view value;
+            if (!find(name, value))
+                return std::string::npos;
+            return decode(value, out, capacity, true);
+        }
+    }
+}
@@ -0,0 +1,605 @@
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "../includes/websocket.hpp"
+#include "../includes/metrics.hpp"
+
+namespace hh_http
+{
+    namespace
+    {
+        constexpr char WEBSOCKET_GUID[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+        /// Longest reason that fits a control frame next to the 2-byte code
+        constexpr std::size_t MAX_CLOSE_REASON = 123;
+
+        /// Reassembly buffers above this capacity are released after each message
+        constexpr std::size_t KEEP_BUFFER_CAPACITY = 64 * 1024;
+
+        std::uint32_t rotate_left(std::uint32_t value, int bits)
+        {
+            return (value << bits) | (value >> (32 - bits));
+        }
+
+        /// SHA-1 (FIPS 180-4); only used for the handshake, where it is mandated by RFC 6455
+        std::array<std::uint8_t, 20> sha1(const std::string &input)
+        {
+            std::uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+
+            std::string padded = input;
+            padded.push_back(static_cast<char>(0x80));
+            while (padded.size() % 64 != 56)
+                padded.push_back('\0');
+            std::uint64_t bit_length = static_cast<std::uint64_t>(input.size()) * 8;
+            for (int shift = 56; shift >= 0; shift -= 8)
+                padded.push_back(static_cast<char>((bit_length >> shift) & 0xff));
+
+            for (std::size_t block = 0; block < padded.size(); block += 64)
+            {
+                std::uint32_t w[80];
+                for (int i = 0; i < 16; ++i)
+                {
+                    const auto *p = reinterpret_cast<const std::uint8_t *>(padded.data() + block + i * 4);
+                    w[i] = (std::uint32_t(p[0]) << 24) | (std::uint32_t(p[1]) << 16) | (std::uint32_t(p[2]) << 8) | p[3];
+                }
+                for (int i = 16; i < 80; ++i)
+                    w[i] = rotate_left(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+                std::uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+                for (int i = 0; i < 80; ++i)
+                {
+                    std::uint32_t f, k;
+                    if (i < 20)
+                        f = (b & c) | (~b & d), k = 0x5A827999;
+                    else if (i < 40)
+                        f = b ^ c ^ d, k = 0x6ED9EBA1;
+                    else if (i < 60)
+                        f = (b & c) | (b & d) | (c & d), k = 0x8F1BBCDC;
+                    else
+                        f = b ^ c ^ d, k = 0xCA62C1D6;
+                    std::uint32_t temp = rotate_left(a, 5) + f + e + k + w[i];
+                    e = d, d = c, c = rotate_left(b, 30), b = a, a = temp;
+                }
+                h[0] += a, h[1] += b, h[2] += c, h[3] += d, h[4] += e;
+            }
+
+            std::array<std::uint8_t, 20> digest;
+            for (int i = 0; i < 20; ++i)
+                digest[i] = static_cast<std::uint8_t>(h[i / 4] >> (24 - 8 * (i % 4)));
+            return digest;
+        }
+
+        std::string base64(const std::uint8_t *data, std::size_t size)
+        {
+            static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+            std::string out;
+            out.reserve((size + 2) / 3 * 4);
+            for (std::size_t i = 0; i < size; i += 3)
+            {
+                std::uint32_t group = std::uint32_t(data[i]) << 16;
+                if (i + 1 < size)
+                    group |= std::uint32_t(data[i + 1]) << 8;
+                if (i + 2 < size)
+                    group |= data[i + 2];
+                out.push_back(alphabet[(group >> 18) & 0x3f]);
+                out.push_back(alphabet[(group >> 12) & 0x3f]);
+                out.push_back(i + 1 < size ? alphabet[(group >> 6) & 0x3f] : '=');
+                out.push_back(i + 2 < size ? alphabet[group & 0x3f] : '=');
+            }
+            return out;
+        }
+
+        bool valid_utf8(const std::string &text)
+        {
+            const auto *p = reinterpret_cast<const std::uint8_t *>(text.data());
+            const auto *end = p + text.size();
+            while (p < end)
+            {
+                // Skip ASCII 8 bytes at a time, the common case for dashboards and JSON
+                if (end - p >= 8)
+                {
+                    std::uint64_t word;
+                    std::memcpy(&word, p, 8);
+                    if ((word & 0x8080808080808080ull) == 0)
+                    {
+                        p += 8;
+                        continue;
+                    }
+                }
+                std::uint8_t c = *p;
+                if (c < 0x80)
+                {
+                    ++p;
+                    continue;
+                }
+
+                std::size_t length;
+                std::uint32_t code_point;
+                if ((c & 0xE0) == 0xC0)
+                    length = 2, code_point = c & 0x1F;
+                else if ((c & 0xF0) == 0xE0)
+                    length = 3, code_point = c & 0x0F;
+                else if ((c & 0xF8) == 0xF0)
+                    length = 4, code_point = c & 0x07;
+                else
+                    return false;
+                if (static_cast<std::size_t>(end - p) < length)
+                    return false;
+                for (std::size_t i = 1; i < length; ++i)
+                {
+                    if ((p[i] & 0xC0) != 0x80)
+                        return false;
+                    code_point = (code_point << 6) | (p[i] & 0x3F);
+                }
+                // Overlong forms, surrogates and values past U+10FFFF are invalid
+                if ((length == 2 && code_point < 0x80) || (length == 3 && code_point < 0x800) ||
+                    (length == 4 && code_point < 0x10000) || code_point > 0x10FFFF ||
+                    (code_point >= 0xD800 && code_point <= 0xDFFF))
+                    return false;
+                p += length;
+            }
+            return true;
+        }
+
+        bool is_control(websocket_opcode opcode)
+        {
+            return static_cast<std::uint8_t>(opcode) & 0x8;
+        }
+
+        /// true if a comma-separated header value lists token (case-insensitive)
+        bool has_token(const std::string &value, const std::string &token)
+        {
+            std::size_t start = 0;
+            while (start <= value.size())
+            {
+                std::size_t end = value.find(',', start);
+                if (end == std::string::npos)
+                    end = value.size();
+                std::size_t first = value.find_first_not_of(" \t", start);
+                std::size_t last = value.find_last_not_of(" \t", end - 1);
+                if (first < end && last != std::string::npos && last >= first &&
+                    to_upper_case(value.substr(first, last - first + 1)) == token)
+                    return true;
+                start = end + 1;
+            }
+            return false;
+        }
+    }
+
+    bool websocket_close::is_valid(std::uint16_t code)
+    {
+        if (code >= 3000 && code <= 4999)
+            return true;
+        return code >= 1000 && code <= 1014 && code != 1004 && code != NO_STATUS && code != ABNORMAL;
+    }
+
+    std::size_t websocket_frame_parser::header_size() const
+    {
+        if (staged_size < 2)
+            return 0;
+        std::size_t size = 2;
+        std::uint8_t length = staged[1] & 0x7F;
+        if (length == 126)
+            size += 2;
+        else if (length == 127)
+            size += 8;
+        if (staged[1] & 0x80)
+            size += 4;
+        return size;
+    }
+
+    websocket_frame_parser::event websocket_frame_parser::fail(std::uint16_t code)
+    {
+        error = code;
+        return event::ERROR;
+    }
+
+    websocket_frame_parser::event websocket_frame_parser::next(const char *&data, std::size_t &size, std::string *payload)
+    {
+        if (error)
+            return event::ERROR;
+
+        if (!in_payload)
+        {
+            // Stage the header; it is at most 14 bytes and usually arrives whole
+            for (;;)
+            {
+                std::size_t needed = staged_size < 2 ? 2 : header_size();
+                if (staged_size == needed)
+                    break;
+                if (size == 0)
+                    return event::NEED_MORE;
+                std::size_t take = std::min(needed - staged_size, size);
+                std::memcpy(staged + staged_size, data, take);
+                staged_size += take;
+                data += take;
+                size -= take;
+            }
+
+            // No extension is negotiated, so the RSV bits must be clear
+            if (staged[0] & 0x70)
+                return fail(websocket_close::PROTOCOL_ERROR);
+            current.fin = staged[0] & 0x80;
+            current.opcode = static_cast<websocket_opcode>(staged[0] & 0x0F);
+            switch (current.opcode)
+            {
+            case websocket_opcode::CONTINUATION:
+            case websocket_opcode::TEXT:
+            case websocket_opcode::BINARY:
+            case websocket_opcode::CLOSE:
+            case websocket_opcode::PING:
+            case websocket_opcode::PONG:
+                break;
+            default:
+                return fail(websocket_close::PROTOCOL_ERROR);
+            }
+            // Frames from a client must be masked
+            if (!(staged[1] & 0x80))
+                return fail(websocket_close::PROTOCOL_ERROR);
+
+            std::size_t position = 2;
+            current.length = staged[1] & 0x7F;
+            if (current.length == 126)
+            {
+                current.length = (std::uint64_t(staged[2]) << 8) | staged[3];
+                position = 4;
+            }
+            else if (current.length == 127)
+            {
+                current.length = 0;
+                for (int i = 0; i < 8; ++i)
+                    current.length = (current.length << 8) | staged[2 + i];
+                position = 10;
+                if (current.length >> 63)
+                    return fail(websocket_close::PROTOCOL_ERROR);
+            }
+            std::memcpy(current.mask, staged + position, 4);
+
+            if (is_control(current.opcode) && (!current.fin || current.length > 125))
+                return fail(websocket_close::PROTOCOL_ERROR);
+
+            staged_size = 0;
+            in_payload = true;
+            remaining = current.length;
+            mask_offset = 0;
+            return event::HEADER;
+        }
+
+        std::size_t take = static_cast<std::size_t>(std::min<std::uint64_t>(remaining, size));
+        if (take > 0)
+        {
+            // Unmask straight from the receive buffer into the payload, the only copy made
+            std::size_t old_size = payload->size();
+            payload->resize(old_size + take);
+            unmask(&(*payload)[old_size], data, take, current.mask, mask_offset);
+            data += take;
+            size -= take;
+            remaining -= take;
+        }
+        if (remaining > 0)
+            return event::NEED_MORE;
+        in_payload = false;
+        return event::FRAME;
+    }
+
+    void websocket_frame_parser::unmask(char *out, const char *in, std::size_t n, const std::uint8_t mask[4], std::size_t &offset)
+    {
+        // The key rotated to start at offset, repeated; every block below is a multiple of 4 bytes long
+        alignas(16) std::uint8_t key[16];
+        for (std::size_t i = 0; i < sizeof(key); ++i)
+            key[i] = mask[(offset + i) & 3];
+
+        std::size_t i = 0;
+#if defined(__SSE2__)
+        __m128i key128 = _mm_load_si128(reinterpret_cast<const __m128i *>(key));
+        for (; i + 16 <= n; i += 16)
+        {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_xor_si128(block, key128));
+        }
+#endif
+        std::uint64_t key64;
+        std::memcpy(&key64, key, sizeof(key64));
+        for (; i + 8 <= n; i += 8)
+        {
+            std::uint64_t block;
+            std::memcpy(&block, in + i, sizeof(block));
+            block ^= key64;
+            std::memcpy(out + i, &block, sizeof(block));
+        }
+        for (; i < n; ++i)
+            out[i] = static_cast<char>(in[i] ^ key[i & 3]);
+
+        offset = (offset + n) & 3;
+    }
+
+    bool websocket_connection::is_upgrade_request(const std::string &method, const std::string &version,
+                                                  const std::multimap<std::string, std::string> &headers)
+    {
+        if (method != HTTP_GET || version != HTTP_VERSION_1_1)
+            return false;
+
+        auto upgrade = headers.find(to_upper_case(HEADER_UPGRADE));
+        auto key = headers.find(to_upper_case(HEADER_SEC_WEBSOCKET_KEY));
+        auto websocket_version = headers.find(to_upper_case(HEADER_SEC_WEBSOCKET_VERSION));
+        if (upgrade == headers.end() || key == headers.end() || websocket_version == headers.end())
+            return false;
+        if (!has_token(upgrade->second, "WEBSOCKET") || websocket_version->second != "13")
+            return false;
+        // The key is 16 random bytes in base64
+        if (key->second.size() != 24)
+            return false;
+
+        auto connection = headers.equal_range(to_upper_case(HEADER_CONNECTION));
+        for (auto it = connection.first; it != connection.second; ++it)
+        {
+            if (has_token(it->second, "UPGRADE"))
+                return true;
+        }
+        return false;
+    }
+
+    std::string websocket_connection::accept_key(const std::string &client_key)
+    {
+        auto digest = sha1(client_key + WEBSOCKET_GUID);
+        return base64(digest.data(), digest.size());
+    }
+
+    websocket_connection::websocket_connection(std::string remote, std::function<void(const std::string &)> write,
+                                               std::function<void()> close_transport, std::shared_ptr<outbound_queue> outbound)
+        : remote(std::move(remote)), write(std::move(write)), close_transport(std::move(close_transport)),
+          outbound(std::move(outbound))
+    {
+    }
+
+    bool websocket_connection::send_text(const std::string &message)
+    {
+        return send_frame(websocket_opcode::TEXT, message.data(), message.size());
+    }
+
+    bool websocket_connection::send_binary(const std::string &message)
+    {
+        return send_frame(websocket_opcode::BINARY, message.data(), message.size());
+    }
+
+    bool websocket_connection::ping(const std::string &payload)
+    {
+        return send_frame(websocket_opcode::PING, payload.data(), std::min<std::size_t>(payload.size(), 125));
+    }
+
+    void websocket_connection::close(std::uint16_t code, const std::string &reason)
+    {
+        if (closed.load() || close_sent.exchange(true))
+            return;
+        close_started.store(std::chrono::steady_clock::now().time_since_epoch().count());
+        write_close(code, reason);
+    }
+
+    void websocket_connection::on_writable(std::function<void()> callback)
+    {
+        if (outbound)
+            outbound->on_writable(std::move(callback));
+        else
+            callback();
+    }
+
+    bool websocket_connection::close_timed_out(std::chrono::steady_clock::time_point now, std::chrono::seconds timeout) const
+    {
+        auto started = close_started.load();
+        if (started == 0 || closed.load())
+            return false;
+        return now - std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(started)) > timeout;
+    }
+
+    bool websocket_connection::send_frame(websocket_opcode opcode, const char *payload, std::size_t size)
+    {
+        if (closed.load() || close_sent.load())
+            return false;
+        write_frame(opcode, payload, size);
+        if (config::ENABLE_METRICS && !is_control(opcode))
+            metrics::registry::instance().websocket_messages_sent_total.increment();
+        return true;
+    }
+
+    /**
+     * Frames from the server are not masked. Header and payload go into one
+     * string, so frames sent from several threads never interleave.
+     */
+    void websocket_connection::write_frame(websocket_opcode opcode, const char *payload, std::size_t size)
+    {
+        std::string frame;
+        frame.reserve(size + 10);
+        frame.push_back(static_cast<char>(0x80 | static_cast<std::uint8_t>(opcode)));
+        if (size < 126)
+        {
+            frame.push_back(static_cast<char>(size));
+        }
+        else if (size <= 0xFFFF)
+        {
+            frame.push_back(static_cast<char>(126));
+            frame.push_back(static_cast<char>(size >> 8));
+            frame.push_back(static_cast<char>(size & 0xff));
+        }
+        else
+        {
+            frame.push_back(static_cast<char>(127));
+            for (int shift = 56; shift >= 0; shift -= 8)
+                frame.push_back(static_cast<char>((static_cast<std::uint64_t>(size) >> shift) & 0xff));
+        }
+        frame.append(payload, size);
+        write(frame);
+    }
+
+    void websocket_connection::write_close(std::uint16_t code, const std::string &reason)
+    {
+        std::string payload;
+        if (code != websocket_close::NO_STATUS)
+        {
+            payload.push_back(static_cast<char>(code >> 8));
+            payload.push_back(static_cast<char>(code & 0xff));
+            payload.append(reason, 0, MAX_CLOSE_REASON);
+        }
+        write_frame(websocket_opcode::CLOSE, payload.data(), payload.size());
+    }
+
+    /**
+     * Runs the parser over one read. Data frames are appended to the
+     * message being reassembled, control frames (which may arrive between
+     * the fragments of a message) to their own small buffer.
+     */
+    void websocket_connection::receive(const char *data, std::size_t size)
+    {
+        while (!close_received && !closed.load())
+        {
+            std::string *target = is_control(parser.header().opcode) ? &control : &message;
+            switch (parser.next(data, size, target))
+            {
+            case websocket_frame_parser::event::NEED_MORE:
+                return;
+            case websocket_frame_parser::event::ERROR:
+                fail(parser.error_code());
+                return;
+            case websocket_frame_parser::event::HEADER:
+            {
+                const auto &header = parser.header();
+                if (is_control(header.opcode))
+                {
+                    control.clear();
+                    break;
+                }
+                if (header.opcode == websocket_opcode::CONTINUATION)
+                {
+                    if (!in_message)
+                    {
+                        fail(websocket_close::PROTOCOL_ERROR);
+                        return;
+                    }
+                }
+                else
+                {
+                    if (in_message)
+                    {
+                        fail(websocket_close::PROTOCOL_ERROR);
+                        return;
+                    }
+                    in_message = true;
+                    message_binary = header.opcode == websocket_opcode::BINARY;
+                    message.clear();
+                }
+                if (header.length > config::WEBSOCKET_MAX_MESSAGE_SIZE - message.size())
+                {
+                    fail(websocket_close::MESSAGE_TOO_BIG);
+                    return;
+                }
+                message.reserve(message.size() + static_cast<std::size_t>(header.length));
+                break;
+            }
+            case websocket_frame_parser::event::FRAME:
+                handle_frame();
+                break;
+            }
+        }
+    }
+
+    void websocket_connection::handle_frame()
+    {
+        const auto &header = parser.header();
+        switch (header.opcode)
+        {
+        case websocket_opcode::PING:
+            if (!close_sent.load())
+                write_frame(websocket_opcode::PONG, control.data(), control.size());
+            return;
+        case websocket_opcode::PONG:
+            return;
+        case websocket_opcode::CLOSE:
+            handle_close_frame();
+            return;
+        default:
+            break;
+        }
+
+        if (!header.fin)
+            return;
+        in_message = false;
+        if (!message_binary && !valid_utf8(message))
+        {
+            fail(websocket_close::INVALID_PAYLOAD);
+            return;
+        }
+        if (config::ENABLE_METRICS)
+            metrics::registry::instance().websocket_messages_received_total.increment();
+        if (message_handler)
+            message_handler(message, message_binary);
+        if (message.capacity() > KEEP_BUFFER_CAPACITY)
+            std::string().swap(message);
+    }
+
+    /**
+     * Answer the client's close frame with ours (or, if we started the
+     * handshake, take it as the answer), then close the TCP connection.
+     */
+    void websocket_connection::handle_close_frame()
+    {
+        close_received = true;
+        std::uint16_t code = websocket_close::NO_STATUS;
+        std::string reason;
+        if (control.size() == 1)
+        {
+            fail(websocket_close::PROTOCOL_ERROR);
+            return;
+        }
+        if (control.size() >= 2)
+        {
+            code = static_cast<std::uint16_t>((std::uint8_t(control[0]) << 8) | std::uint8_t(control[1]));
+            reason = control.substr(2);
+            if (!websocket_close::is_valid(code))
+            {
+                fail(websocket_close::PROTOCOL_ERROR);
+                return;
+            }
+            if (!valid_utf8(reason))
+            {
+                fail(websocket_close::INVALID_PAYLOAD);
+                return;
+            }
+        }
+
+        if (!close_sent.exchange(true))
+            write_close(code == websocket_close::NO_STATUS ? websocket_close::NORMAL : code, "");
+        report_close(code, reason);
+        close_transport();
+    }
+
+    void websocket_connection::fail(std::uint16_t code)
+    {
+        close_received = true;
+        if (!close_sent.exchange(true))
+            write_close(code, "");
+        report_close(code, "");
+        close_transport();
+    }
+
+    void websocket_connection::transport_closed()
+    {
+        closed.store(true);
+        report_close(websocket_close::ABNORMAL, "");
+        // Handlers usually capture the connection itself; dropping them breaks that cycle
+        message_handler = nullptr;
+        close_handler = nullptr;
+    }
+
+    void websocket_connection::report_close(std::uint16_t code, const std::string &reason)
+    {
+        if (close_reported)
+            return;
+        close_reported = true;
+        if (close_handler)
+            close_handler(code, reason);
+    }
+}
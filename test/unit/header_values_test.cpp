@@ -0,0 +1,90 @@
+#include "unit_test.hpp"
+
+#include "../../includes/header_values.hpp"
+
+#include <string>
+#include <vector>
+
+using namespace hh_http;
+
+namespace
+{
+    /// Credentials as "user|password", or "<invalid>"
+    std::string basic(std::string_view value)
+    {
+        basic_credentials credentials;
+        return header_values::parse_basic(value, credentials) ? credentials.user + "|" + credentials.password
+                                                              : "<invalid>";
+    }
+}
+
+TEST_CASE(header_values_parses_cookies)
+{
+    std::vector<cookie> cookies;
+    header_values::parse_cookies(" sid = abc123 ; theme=\"dark\";flag; =orphan;empty=; last=x=y ", cookies);
+    CHECK_EQ(cookies.size(), std::size_t(4));
+    if (cookies.size() == 4)
+    {
+        CHECK_EQ(cookies[0].name, std::string_view("sid"));
+        CHECK_EQ(cookies[0].value, std::string_view("abc123"));
+        CHECK_EQ(cookies[1].name, std::string_view("theme"));
+        CHECK_EQ(cookies[1].value, std::string_view("dark"));
+        CHECK_EQ(cookies[2].name, std::string_view("empty"));
+        CHECK_EQ(cookies[2].value, std::string_view());
+        CHECK_EQ(cookies[3].name, std::string_view("last"));
+        CHECK_EQ(cookies[3].value, std::string_view("x=y"));
+    }
+
+    // A second header appends rather than replaces
+    header_values::parse_cookies("more=1", cookies);
+    CHECK_EQ(cookies.size(), std::size_t(5));
+    header_values::parse_cookies("", cookies);
+    CHECK_EQ(cookies.size(), std::size_t(5));
+}
+
+TEST_CASE(header_values_extracts_bearer_tokens)
+{
+    CHECK_EQ(header_values::bearer_token("Bearer mF_9.B5f-4.1JqM"), std::string_view("mF_9.B5f-4.1JqM"));
+    CHECK_EQ(header_values::bearer_token("  bearer   tok=  "), std::string_view("tok="));
+    CHECK_EQ(header_values::bearer_token("Bearer"), std::string_view());
+    CHECK_EQ(header_values::bearer_token("Bearer "), std::string_view());
+    CHECK_EQ(header_values::bearer_token("Bearer a b"), std::string_view());
+    CHECK_EQ(header_values::bearer_token("Basic dXNlcjpwdw=="), std::string_view());
+    CHECK_EQ(header_values::bearer_token("Bearerish tok"), std::string_view());
+}
+
+TEST_CASE(header_values_decodes_basic_credentials)
+{
+    CHECK_EQ(basic("Basic QWxhZGRpbjpvcGVuIHNlc2FtZQ=="), std::string("Aladdin|open sesame"));
+    CHECK_EQ(basic("basic  QWxhZGRpbjpvcGVuIHNlc2FtZQ== "), std::string("Aladdin|open sesame"));
+    // Only the first ':' separates: passwords may contain more
+    CHECK_EQ(basic("Basic dTpwOnE="), std::string("u|p:q"));
+    CHECK_EQ(basic("Basic OnB3"), std::string("|pw"));
+    CHECK_EQ(basic("Basic dXNlcjo="), std::string("user|"));
+}
+
+TEST_CASE(header_values_accepts_basic_without_padding)
+{
+    // "user:pw" is 7 bytes, padded with two characters that may be left out
+    CHECK_EQ(basic("Basic dXNlcjpwdw=="), std::string("user|pw"));
+    CHECK_EQ(basic("Basic dXNlcjpwdw"), std::string("user|pw"));
+    CHECK_EQ(basic("Basic dXNlcjpwdw="), std::string("user|pw"));
+    CHECK_EQ(basic("Basic dXNlcjpwdzE"), std::string("user|pw1"));
+}
+
+TEST_CASE(header_values_rejects_bad_basic_credentials)
+{
+    CHECK_EQ(basic("Basic"), std::string("<invalid>"));
+    CHECK_EQ(basic("Basic "), std::string("<invalid>"));
+    CHECK_EQ(basic("Bearer dXNlcjpwdw"), std::string("<invalid>"));
+    // No ':' in "userpw"
+    CHECK_EQ(basic("Basic dXNlcnB3"), std::string("<invalid>"));
+    // Characters outside the base64 alphabet, and URL-safe base64
+    CHECK_EQ(basic("Basic dXNl*jpwdw=="), std::string("<invalid>"));
+    CHECK_EQ(basic("Basic dXNlcjp-_w=="), std::string("<invalid>"));
+    // Data after the padding
+    CHECK_EQ(basic("Basic dXNlcjpwdw==dw"), std::string("<invalid>"));
+    // A single leftover character cannot encode a byte
+    CHECK_EQ(basic("Basic dXNlcjpwd"), std::string("<invalid>"));
+    CHECK_EQ(basic("Basic dXNlcjpwdzE1Z"), std::string("<invalid>"));
+}
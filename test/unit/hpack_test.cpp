@@ -0,0 +1,243 @@
+#include "unit_test.hpp"
+
+#include "../../includes/hpack.hpp"
+
+#include <string>
+#include <vector>
+
+using namespace hh_http;
+
+namespace
+{
+    /// Bytes of a hex string; spaces are skipped
+    std::string from_hex(const std::string &hex)
+    {
+        std::string bytes;
+        int high = -1;
+        for (char c : hex)
+        {
+            if (c == ' ')
+                continue;
+            int digit = c <= '9' ? c - '0' : c - 'a' + 10;
+            if (high < 0)
+            {
+                high = digit;
+                continue;
+            }
+            bytes += static_cast<char>(high << 4 | digit);
+            high = -1;
+        }
+        return bytes;
+    }
+
+    hpack::decode_status decode(hpack::decoder &decoder, const std::string &block, std::vector<hpack::header_field> &fields)
+    {
+        fields.clear();
+        return decoder.decode(block.data(), block.size(), fields);
+    }
+
+    bool huffman(const std::string &encoded, std::string &out)
+    {
+        out.clear();
+        return hpack::huffman_decode(reinterpret_cast<const std::uint8_t *>(encoded.data()), encoded.size(), out);
+    }
+
+    std::string join(const std::vector<hpack::header_field> &fields)
+    {
+        std::string text;
+        for (const auto &field : fields)
+            text += field.name + ": " + field.value + "\n";
+        return text;
+    }
+}
+
+TEST_CASE(hpack_encodes_integers_like_rfc_examples)
+{
+    // RFC 7541, appendix C.1
+    std::string out;
+    hpack::encode_integer(10, 5, 0, out);
+    CHECK_EQ(out, from_hex("0a"));
+    out.clear();
+    hpack::encode_integer(1337, 5, 0, out);
+    CHECK_EQ(out, from_hex("1f9a0a"));
+    out.clear();
+    hpack::encode_integer(42, 8, 0, out);
+    CHECK_EQ(out, from_hex("2a"));
+    out.clear();
+    hpack::encode_integer(31, 5, 0xe0, out);
+    CHECK_EQ(out, from_hex("ff00"));
+}
+
+TEST_CASE(hpack_decodes_multi_byte_integers)
+{
+    // Literal without indexing, new name; the 200-byte value has a two-byte length (127 + 73)
+    std::string value(200, 'v');
+    std::string block = from_hex("00") + "\x01x" + from_hex("7f49") + value;
+    hpack::decoder decoder(4096, 65536);
+    std::vector<hpack::header_field> fields;
+    CHECK(decode(decoder, block, fields) == hpack::decode_status::OK);
+    CHECK_EQ(fields.size(), std::size_t(1));
+    if (fields.size() == 1)
+        CHECK_EQ(fields[0].value, value);
+}
+
+TEST_CASE(hpack_rejects_bad_integers)
+{
+    hpack::decoder decoder(4096, 65536);
+    std::vector<hpack::header_field> fields;
+    // Continuation bytes that never end
+    CHECK(decode(decoder, from_hex("ff8080"), fields) == hpack::decode_status::ERROR);
+    // More than 2^35: no sane index
+    CHECK(decode(decoder, from_hex("ffffffffffff7f"), fields) == hpack::decode_status::ERROR);
+    // Index 0 and indexes past the static and (empty) dynamic table
+    CHECK(decode(decoder, from_hex("80"), fields) == hpack::decode_status::ERROR);
+    CHECK(decode(decoder, from_hex("be"), fields) == hpack::decode_status::ERROR);
+    // String length past the end of the block
+    CHECK(decode(decoder, from_hex("0005") + "ab", fields) == hpack::decode_status::ERROR);
+}
+
+TEST_CASE(hpack_huffman_decodes_rfc_strings)
+{
+    std::string out;
+    CHECK(huffman(from_hex("f1e3 c2e5 f23a 6ba0 ab90 f4ff"), out));
+    CHECK_EQ(out, std::string("www.example.com"));
+    CHECK(huffman(from_hex("a8eb 1064 9cbf"), out));
+    CHECK_EQ(out, std::string("no-cache"));
+    CHECK(huffman(from_hex("25a8 49e9 5ba9 7d7f"), out));
+    CHECK_EQ(out, std::string("custom-key"));
+    CHECK(huffman(from_hex("25a8 49e9 5bb8 e8b4 bf"), out));
+    CHECK_EQ(out, std::string("custom-value"));
+    CHECK(huffman("", out));
+    CHECK_EQ(out, std::string());
+}
+
+TEST_CASE(hpack_huffman_rejects_bad_padding_and_eos)
+{
+    std::string out;
+    // '0' is 00000; the remaining three bits must be ones
+    CHECK(!huffman(from_hex("00"), out));
+    CHECK(huffman(from_hex("07"), out));
+    CHECK_EQ(out, std::string("0"));
+    // A whole byte of padding is more than 7 bits
+    CHECK(!huffman(from_hex("f1e3 c2e5 f23a 6ba0 ab90 f4ff ff"), out));
+    // EOS (30 ones) must not appear in a string
+    CHECK(!huffman(from_hex("ffff fffc"), out));
+    CHECK(!huffman(from_hex("ffff ffff"), out));
+}
+
+TEST_CASE(hpack_decodes_rfc_request_sequence_with_huffman)
+{
+    // RFC 7541, appendix C.4: three requests on one connection share the dynamic table
+    hpack::decoder decoder(4096, 65536);
+    std::vector<hpack::header_field> fields;
+
+    CHECK(decode(decoder, from_hex("8286 8441 8cf1 e3c2 e5f2 3a6b a0ab 90f4 ff"), fields) == hpack::decode_status::OK);
+    CHECK_EQ(join(fields), std::string(":method: GET\n:scheme: http\n:path: /\n:authority: www.example.com\n"));
+
+    CHECK(decode(decoder, from_hex("8286 84be 5886 a8eb 1064 9cbf"), fields) == hpack::decode_status::OK);
+    CHECK_EQ(join(fields), std::string(":method: GET\n:scheme: http\n:path: /\n:authority: www.example.com\ncache-control: no-cache\n"));
+
+    CHECK(decode(decoder, from_hex("8287 85bf 4088 25a8 49e9 5ba9 7d7f 8925 a849 e95b b8e8 b4bf"), fields) ==
+          hpack::decode_status::OK);
+    CHECK_EQ(join(fields), std::string(":method: GET\n:scheme: https\n:path: /index.html\n:authority: www.example.com\n"
+                                       "custom-key: custom-value\n"));
+}
+
+TEST_CASE(hpack_decodes_rfc_response_sequence_with_eviction)
+{
+    // RFC 7541, appendix C.6: a 256-byte table, so later responses evict earlier entries
+    hpack::decoder decoder(256, 65536);
+    std::vector<hpack::header_field> fields;
+
+    CHECK(decode(decoder, from_hex("4882 6402 5885 aec3 771a 4b61 96d0 7abe 9410 54d4 44a8 2005 9504 0b81 66e0 82a6 "
+                                   "2d1b ff6e 919d 29ad 1718 63c7 8f0b 97c8 e9ae 82ae 43d3"),
+                 fields) == hpack::decode_status::OK);
+    CHECK_EQ(join(fields), std::string(":status: 302\ncache-control: private\ndate: Mon, 21 Oct 2013 20:13:21 GMT\n"
+                                       "location: https://www.example.com\n"));
+
+    CHECK(decode(decoder, from_hex("4883 640e ffc1 c0bf"), fields) == hpack::decode_status::OK);
+    CHECK_EQ(join(fields), std::string(":status: 307\ncache-control: private\ndate: Mon, 21 Oct 2013 20:13:21 GMT\n"
+                                       "location: https://www.example.com\n"));
+
+    CHECK(decode(decoder, from_hex("88c1 6196 d07a be94 1054 d444 a820 0595 040b 8166 e084 a62d 1bff c05a 839b d9ab "
+                                   "77ad 94e7 821d d7f2 e6c7 b335 dfdf cd5b 3960 d5af 2708 7f36 72c1 ab27 0fb5 291f "
+                                   "9587 3160 65c0 03ed 4ee5 b106 3d50 07"),
+                 fields) == hpack::decode_status::OK);
+    CHECK_EQ(join(fields), std::string(":status: 200\ncache-control: private\ndate: Mon, 21 Oct 2013 20:13:22 GMT\n"
+                                       "location: https://www.example.com\ncontent-encoding: gzip\n"
+                                       "set-cookie: foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; version=1\n"));
+}
+
+TEST_CASE(hpack_dynamic_table_evicts_oldest_entries)
+{
+    hpack::dynamic_table table(100);
+    table.insert("a", "1"); // 34 bytes
+    table.insert("b", "2");
+    table.insert("c", "3");
+    CHECK_EQ(table.entries(), std::size_t(2));
+    CHECK_EQ(table.size(), std::size_t(68));
+    CHECK(table.get(1) && table.get(1)->name == "c");
+    CHECK(table.get(2) && table.get(2)->name == "b");
+    CHECK(table.get(3) == nullptr);
+
+    table.resize(40);
+    CHECK_EQ(table.entries(), std::size_t(1));
+    table.insert(std::string(100, 'x'), "");
+    CHECK_EQ(table.entries(), std::size_t(0));
+    CHECK_EQ(table.size(), std::size_t(0));
+}
+
+TEST_CASE(hpack_table_size_updates)
+{
+    hpack::decoder decoder(4096, 65536);
+    std::vector<hpack::header_field> fields;
+    // Allowed at the start of a block, up to the size we advertised
+    CHECK(decode(decoder, from_hex("3fe1 1f82"), fields) == hpack::decode_status::OK);
+    CHECK(decode(decoder, from_hex("3fe2 1f"), fields) == hpack::decode_status::ERROR);
+    // Not after a field
+    CHECK(decode(decoder, from_hex("8220"), fields) == hpack::decode_status::ERROR);
+}
+
+TEST_CASE(hpack_encoder_round_trips_through_decoder)
+{
+    hpack::encoder encoder;
+    hpack::decoder decoder(4096, 65536);
+    std::vector<hpack::header_field> fields;
+    const std::vector<hpack::header_field> response = {
+        {":status", "200"}, {"content-type", "text/html"}, {"x-trace", "abc"}, {"content-length", "42"}};
+
+    std::string first;
+    encoder.begin_block(first);
+    for (const auto &field : response)
+        encoder.encode(field.name, field.value, first);
+    CHECK(decode(decoder, first, fields) == hpack::decode_status::OK);
+    CHECK_EQ(join(fields), join(response));
+
+    // The same fields again come mostly from the dynamic table
+    std::string second;
+    encoder.begin_block(second);
+    for (const auto &field : response)
+        encoder.encode(field.name, field.value, second);
+    CHECK(second.size() < first.size());
+    CHECK(decode(decoder, second, fields) == hpack::decode_status::OK);
+    CHECK_EQ(join(fields), join(response));
+
+    // A smaller peer table is announced at the start of the next block
+    encoder.set_max_table_size(0);
+    std::string third;
+    encoder.begin_block(third);
+    for (const auto &field : response)
+        encoder.encode(field.name, field.value, third);
+    CHECK(!third.empty() && (static_cast<unsigned char>(third[0]) & 0xe0) == 0x20);
+    CHECK(decode(decoder, third, fields) == hpack::decode_status::OK);
+    CHECK_EQ(join(fields), join(response));
+}
+
+TEST_CASE(hpack_reports_header_lists_over_the_limit)
+{
+    hpack::decoder decoder(4096, 100);
+    std::vector<hpack::header_field> fields;
+    std::string block = from_hex("00") + "\x01x" + from_hex("7f49") + std::string(200, 'v');
+    CHECK(decode(decoder, block, fields) == hpack::decode_status::TOO_LARGE);
+    CHECK(fields.empty());
+}
@@ -0,0 +1,162 @@
+#include "unit_test.hpp"
+
+#include "../../includes/http_message_handler.hpp"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace hh_http;
+
+namespace
+{
+    const std::string CHUNKED_HEAD = "POST /upload HTTP/1.1\r\n"
+                                     "Host: localhost\r\n"
+                                     "Transfer-Encoding: chunked\r\n"
+                                     "\r\n";
+
+    const std::string CHUNKED_BODY = "4\r\nWiki\r\n"
+                                     "5;name=value\r\npedia\r\n"
+                                     "E\r\n in\r\n\r\nchunks.\r\n"
+                                     "0\r\n"
+                                     "X-Trailer: yes\r\n"
+                                     "\r\n";
+
+    const std::string DECODED_BODY = "Wikipedia in\r\n\r\nchunks.";
+
+    /// Feed the head, then the body in pieces; returns the result of the last piece
+    http_handled_data feed(http_message_handler &handler, const std::string &key, const std::string &body,
+                           std::size_t piece)
+    {
+        auto result = handler.handle(key, 7, CHUNKED_HEAD.data(), CHUNKED_HEAD.size());
+        for (std::size_t offset = 0; offset < body.size() && !result.completed; offset += piece)
+            result = handler.handle(key, 7, body.data() + offset, std::min(piece, body.size() - offset));
+        return result;
+    }
+}
+
+TEST_CASE(http_message_handler_parses_chunks_in_one_read)
+{
+    http_message_handler handler;
+    std::string request = CHUNKED_HEAD + CHUNKED_BODY;
+    auto result = handler.handle("10.0.0.1:5000", 7, request.data(), request.size());
+    CHECK(result.completed);
+    CHECK_EQ(result.method, std::string("POST"));
+    CHECK_EQ(result.body, DECODED_BODY);
+    CHECK(!handler.in_progress("10.0.0.1:5000"));
+}
+
+TEST_CASE(http_message_handler_parses_chunks_split_anywhere)
+{
+    // Head and body in one read up to the split, the rest in a second: size lines, data and CRLFs cut anywhere
+    std::string request = CHUNKED_HEAD + CHUNKED_BODY;
+    for (std::size_t split = CHUNKED_HEAD.size(); split < request.size(); ++split)
+    {
+        http_message_handler handler;
+        auto first = handler.handle("10.0.0.1:5000", 7, request.data(), split);
+        CHECK(!first.completed);
+        auto result = handler.handle("10.0.0.1:5000", 7, request.data() + split, request.size() - split);
+        if (!result.completed || result.body != DECODED_BODY)
+        {
+            unit_test::report(__FILE__, __LINE__, "split at " + std::to_string(split) + ": " + result.method);
+            break;
+        }
+    }
+}
+
+TEST_CASE(http_message_handler_parses_chunks_byte_by_byte)
+{
+    for (std::size_t piece : {1, 2, 3, 5})
+    {
+        http_message_handler handler;
+        auto result = feed(handler, "10.0.0.1:5000", CHUNKED_BODY, piece);
+        CHECK(result.completed);
+        CHECK_EQ(result.body, DECODED_BODY);
+        CHECK(!handler.in_progress("10.0.0.1:5000"));
+    }
+}
+
+TEST_CASE(http_message_handler_streams_large_chunk)
+{
+    // One 1 MB chunk in MSS-sized reads: the body grows read by read, nothing waits for the whole chunk
+    std::string data(1 << 20, 'x');
+    for (std::size_t i = 0; i < data.size(); i += 997)
+        data[i] = static_cast<char>('a' + i % 26);
+    char size_line[32];
+    std::snprintf(size_line, sizeof(size_line), "%zx\r\n", data.size());
+    std::string body = size_line + data + "\r\n0\r\n\r\n";
+
+    http_message_handler handler;
+    auto result = feed(handler, "10.0.0.1:5000", body, 1448);
+    CHECK(result.completed);
+    CHECK(result.body == data);
+}
+
+TEST_CASE(http_message_handler_rejects_bad_chunks)
+{
+    {
+        // Chunk data longer than its size: no CRLF where one is expected, even if it arrives later
+        http_message_handler handler;
+        auto result = feed(handler, "10.0.0.1:5000", "3\r\nabcd\r\n0\r\n\r\n", 1);
+        CHECK(result.completed);
+        CHECK_EQ(result.method, std::string("BAD_CHUNK_ENCODING"));
+    }
+    {
+        http_message_handler handler;
+        auto result = feed(handler, "10.0.0.1:5000", "zz\r\nab\r\n0\r\n\r\n", 2);
+        CHECK_EQ(result.method, std::string("BAD_CHUNK_ENCODING"));
+    }
+    {
+        // A size line that never ends is not buffered past MAX_HEADER_SIZE
+        http_message_handler handler;
+        std::string endless(config::MAX_HEADER_SIZE + 10, '1');
+        auto result = feed(handler, "10.0.0.1:5000", endless, 100);
+        CHECK(result.completed);
+        CHECK_EQ(result.method, std::string("BAD_CHUNK_ENCODING"));
+        CHECK(!handler.in_progress("10.0.0.1:5000"));
+    }
+    {
+        // Refused as soon as the size is read, before any of the data
+        http_message_handler handler;
+        char size_line[32];
+        std::snprintf(size_line, sizeof(size_line), "%zx\r\n", config::MAX_BODY_SIZE + 1);
+        auto result = feed(handler, "10.0.0.1:5000", size_line, 100);
+        CHECK(result.completed);
+        CHECK_EQ(result.method, std::string("BAD_CONTENT_TOO_LARGE"));
+    }
+}
+
+TEST_CASE(http_message_handler_does_not_count_budget_pause_as_slow_body)
+{
+    std::string request = "POST /upload HTTP/1.1\r\nHost: localhost\r\nContent-Length: 1000\r\n\r\nstart";
+    std::vector<int> closed;
+    auto record = [&](int fd) { closed.push_back(fd); };
+    auto saved_limit = config::MAX_BUFFERED_BYTES;
+    config::MAX_BUFFERED_BYTES = 1 << 20;
+
+    http_message_handler handler;
+    handler.handle("10.0.0.1:5000", 7, request.data(), request.size());
+    CHECK(handler.in_progress("10.0.0.1:5000"));
+
+    // The budget pauses reading for longer than a window: the request receives nothing, but is not slow
+    auto &budget = memory_budget::instance();
+    budget.acquire(config::MAX_BUFFERED_BYTES);
+    CHECK(budget.exhausted());
+    std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+    handler.cleanup_slow_requests(100, std::chrono::seconds(1), record);
+    CHECK(closed.empty());
+
+    // Once reading resumes, the request gets a whole window before it is judged
+    budget.release(config::MAX_BUFFERED_BYTES);
+    CHECK(!budget.exhausted());
+    handler.cleanup_slow_requests(100, std::chrono::seconds(1), record);
+    CHECK(closed.empty());
+    CHECK(handler.in_progress("10.0.0.1:5000"));
+
+    // Still nothing a window later: now it is slow
+    std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+    handler.cleanup_slow_requests(100, std::chrono::seconds(1), record);
+    CHECK_EQ(closed.size(), std::size_t(1));
+    CHECK(!handler.in_progress("10.0.0.1:5000"));
+    config::MAX_BUFFERED_BYTES = saved_limit;
+}
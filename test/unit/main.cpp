@@ -0,0 +1,43 @@
+/**
+ * @file main.cpp
+ * @brief Runs the unit tests.
+ *
+ * Usage:
+ *   ./unit_tests              # run every test
+ *   ./unit_tests websocket_   # run the tests whose name starts with a prefix
+ */
+
+#include "unit_test.hpp"
+
+#include <cstring>
+#include <exception>
+#include <string>
+
+int main(int argc, char **argv)
+{
+    const char *prefix = argc > 1 ? argv[1] : "";
+    int failed = 0;
+    int ran = 0;
+    for (const auto &test : unit_test::registry())
+    {
+        if (std::strncmp(test.name, prefix, std::strlen(prefix)) != 0)
+            continue;
+        ++ran;
+        unit_test::failures() = 0;
+        try
+        {
+            test.run();
+        }
+        catch (const std::exception &e)
+        {
+            unit_test::report(__FILE__, __LINE__, std::string(test.name) + " threw: " + e.what());
+        }
+        if (unit_test::failures())
+        {
+            ++failed;
+            std::fprintf(stderr, "FAILED %s\n", test.name);
+        }
+    }
+    std::printf("%d of %d tests passed\n", ran - failed, ran);
+    return failed || ran == 0 ? 1 : 0;
+}
@@ -0,0 +1,208 @@
+#include "unit_test.hpp"
+
+#include "../../includes/multipart.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace hh_http;
+
+namespace
+{
+    const std::string BOUNDARY = "----hhBoundary7MA4YWxk";
+
+    /// A body with a plain field, a file whose data contains near-delimiters, and an empty field
+    std::string sample_body()
+    {
+        return "preamble to ignore\r\n"
+               "--" + BOUNDARY + "\r\n"
+               "Content-Disposition: form-data; name=\"title\"\r\n"
+               "\r\n"
+               "hello world\r\n"
+               "--" + BOUNDARY + "\r\n"
+               "Content-Disposition: form-data; name=\"upload\"; filename=\"a.txt\"\r\n"
+               "Content-Type: text/plain\r\n"
+               "\r\n"
+               "line one\r\n--" + BOUNDARY.substr(0, 10) + " not a delimiter\r\n-\r\n--\r\nx" +
+               "--" + BOUNDARY + " (no CRLF before it)\r\n"
+               "--" + BOUNDARY + "\r\n"
+               "Content-Disposition: form-data; name=\"empty\"\r\n"
+               "\r\n"
+               "\r\n"
+               "--" + BOUNDARY + "--\r\n"
+               "epilogue to ignore";
+    }
+
+    const std::string UPLOAD_DATA = "line one\r\n--" + BOUNDARY.substr(0, 10) + " not a delimiter\r\n-\r\n--\r\nx" +
+                                    "--" + BOUNDARY + " (no CRLF before it)";
+
+    void check_sample_parts(const multipart_parser &parser)
+    {
+        CHECK(!parser.failed());
+        CHECK_EQ(parser.parts().size(), std::size_t(3));
+        if (parser.parts().size() != 3)
+            return;
+        CHECK_EQ(parser.parts()[0].name, std::string("title"));
+        CHECK_EQ(parser.parts()[0].value, std::string("hello world"));
+        CHECK_EQ(parser.parts()[1].name, std::string("upload"));
+        CHECK_EQ(parser.parts()[1].filename, std::string("a.txt"));
+        CHECK_EQ(parser.parts()[1].content_type, std::string("text/plain"));
+        CHECK_EQ(parser.parts()[1].size, UPLOAD_DATA.size());
+        CHECK_EQ(parser.parts()[2].name, std::string("empty"));
+        CHECK_EQ(parser.parts()[2].value, std::string());
+    }
+
+    bool feed(multipart_parser &parser, const std::string &body, std::size_t piece)
+    {
+        for (std::size_t offset = 0; offset < body.size(); offset += piece)
+        {
+            if (!parser.write(body.data() + offset, std::min(piece, body.size() - offset)))
+                return false;
+        }
+        return parser.finish();
+    }
+
+    bool exists(const std::string &path)
+    {
+        struct stat info;
+        return ::stat(path.c_str(), &info) == 0;
+    }
+}
+
+TEST_CASE(multipart_finds_boundary_of_content_type)
+{
+    CHECK_EQ(multipart_parser::boundary_of("multipart/form-data; boundary=abc"), std::string("abc"));
+    CHECK_EQ(multipart_parser::boundary_of("Multipart/Form-Data; charset=utf-8; boundary=\"a b;c\""), std::string("a b;c"));
+    CHECK_EQ(multipart_parser::boundary_of("multipart/mixed; boundary=abc"), std::string());
+    CHECK_EQ(multipart_parser::boundary_of("multipart/form-data"), std::string());
+    CHECK_EQ(multipart_parser::boundary_of("multipart/form-data; boundary=" + std::string(71, 'x')), std::string());
+}
+
+TEST_CASE(multipart_parses_whole_body)
+{
+    multipart_parser parser(BOUNDARY);
+    std::string data;
+    parser.on_part_data([&](const multipart_part &part, const char *bytes, std::size_t size)
+                        {
+        if (part.name == "upload")
+            data.append(bytes, size); });
+    CHECK(feed(parser, sample_body(), sample_body().size()));
+    CHECK_EQ(data, UPLOAD_DATA);
+    CHECK_EQ(parser.parts().size(), std::size_t(3));
+}
+
+TEST_CASE(multipart_carries_delimiters_across_every_split)
+{
+    // Two pieces, split at every offset: delimiters and header lines cut anywhere must be carried over
+    const std::string body = sample_body();
+    for (std::size_t split = 0; split <= body.size(); ++split)
+    {
+        multipart_parser parser(BOUNDARY);
+        bool ok = parser.write(body.data(), split) && parser.write(body.data() + split, body.size() - split) &&
+                  parser.finish();
+        if (!ok)
+        {
+            unit_test::report(__FILE__, __LINE__, "split at " + std::to_string(split) + ": " + parser.error());
+            break;
+        }
+        check_sample_parts(parser);
+        if (parser.parts().size() == 3)
+            CHECK_EQ(parser.parts()[1].value, UPLOAD_DATA);
+    }
+}
+
+TEST_CASE(multipart_parses_body_fed_in_small_pieces)
+{
+    for (std::size_t piece : {1, 2, 3, 7, 16})
+    {
+        multipart_parser parser(BOUNDARY);
+        if (!feed(parser, sample_body(), piece))
+            unit_test::report(__FILE__, __LINE__, "piece " + std::to_string(piece) + ": " + parser.error());
+        check_sample_parts(parser);
+        if (parser.parts().size() == 3)
+            CHECK_EQ(parser.parts()[1].value, UPLOAD_DATA);
+    }
+}
+
+TEST_CASE(multipart_rejects_malformed_bodies)
+{
+    {
+        multipart_parser parser(BOUNDARY);
+        std::string body = "--" + BOUNDARY + "\r\nContent-Disposition: form-data; name=\"a\"\r\n\r\nunfinished";
+        CHECK(parser.write(body.data(), body.size()));
+        CHECK(!parser.finish());
+        CHECK(!parser.error().empty());
+    }
+    {
+        multipart_parser parser(BOUNDARY);
+        std::string body = "--" + BOUNDARY + "\r\nno colon here\r\n\r\nx\r\n--" + BOUNDARY + "--\r\n";
+        CHECK(!parser.write(body.data(), body.size()));
+        CHECK(parser.failed());
+    }
+    {
+        multipart_parser parser(BOUNDARY);
+        std::string body = "--" + BOUNDARY + "garbage\r\n";
+        CHECK(!parser.write(body.data(), body.size()) || !parser.finish());
+    }
+    bool threw = false;
+    try
+    {
+        multipart_parser parser("");
+    }
+    catch (const std::runtime_error &)
+    {
+        threw = true;
+    }
+    CHECK(threw);
+}
+
+TEST_CASE(multipart_saves_files_and_removes_them_on_failure)
+{
+    char directory[] = "/tmp/hh_multipart_test_XXXXXX";
+    if (!::mkdtemp(directory))
+    {
+        unit_test::report(__FILE__, __LINE__, "mkdtemp failed");
+        return;
+    }
+
+    std::string saved;
+    {
+        multipart_parser parser(BOUNDARY);
+        parser.save_files_to(directory);
+        CHECK(feed(parser, sample_body(), 5));
+        check_sample_parts(parser);
+        if (parser.parts().size() == 3)
+        {
+            saved = parser.parts()[1].saved_path;
+            CHECK_EQ(parser.parts()[1].value, std::string());
+            CHECK(parser.parts()[0].saved_path.empty());
+        }
+    }
+    // A finished body's files belong to the caller
+    CHECK(!saved.empty() && exists(saved));
+    std::ifstream file(saved, std::ios::binary);
+    std::stringstream content;
+    content << file.rdbuf();
+    CHECK_EQ(content.str(), UPLOAD_DATA);
+    std::remove(saved.c_str());
+
+    std::string abandoned;
+    {
+        multipart_parser parser(BOUNDARY);
+        parser.save_files_to(directory);
+        std::string body = sample_body();
+        std::size_t cut = body.find("line one") + 4;
+        CHECK(parser.write(body.data(), cut));
+        if (parser.parts().size() == 2)
+            abandoned = parser.parts()[1].saved_path;
+        CHECK(!abandoned.empty() && exists(abandoned));
+    }
+    // The body never completed: its file is gone with the parser
+    CHECK(!abandoned.empty() && !exists(abandoned));
+    ::rmdir(directory);
+}
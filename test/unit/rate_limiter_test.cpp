@@ -0,0 +1,110 @@
+#include "unit_test.hpp"
+
+#include "../../includes/rate_limiter.hpp"
+
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+using namespace hh_http;
+
+namespace
+{
+    bool throws(const rate_limit &limit)
+    {
+        try
+        {
+            rate_limiter limiter(limit, 16);
+        }
+        catch (const std::runtime_error &)
+        {
+            return true;
+        }
+        return false;
+    }
+}
+
+TEST_CASE(rate_limiter_allows_burst_then_refuses)
+{
+    rate_limiter limiter({1, 3}, 64);
+    CHECK(limiter.acquire("10.0.0.1"));
+    CHECK(limiter.acquire("10.0.0.1"));
+    CHECK(limiter.acquire("10.0.0.1"));
+
+    std::chrono::milliseconds retry_after{0};
+    CHECK(!limiter.acquire("10.0.0.1", &retry_after));
+    // One token per second: the next one is at most a second away
+    CHECK(retry_after.count() > 0);
+    CHECK(retry_after.count() <= 1000);
+
+    // Other keys have their own buckets
+    CHECK(limiter.acquire("10.0.0.2"));
+}
+
+TEST_CASE(rate_limiter_treats_burst_below_one_as_one)
+{
+    rate_limiter limiter({10, 0}, 64);
+    CHECK(limiter.acquire("key"));
+    CHECK(!limiter.acquire("key"));
+}
+
+TEST_CASE(rate_limiter_refills_over_time)
+{
+    // 20 per second: a token every 50 ms, two at once
+    rate_limiter limiter({20, 2}, 64);
+    CHECK(limiter.acquire("key"));
+    CHECK(limiter.acquire("key"));
+
+    std::chrono::milliseconds retry_after{0};
+    CHECK(!limiter.acquire("key", &retry_after));
+    CHECK(retry_after.count() > 0);
+    CHECK(retry_after.count() <= 50);
+
+    std::this_thread::sleep_for(retry_after + std::chrono::milliseconds(5));
+    CHECK(limiter.acquire("key"));
+    CHECK(!limiter.acquire("key"));
+}
+
+TEST_CASE(rate_limiter_combines_keys_in_order)
+{
+    CHECK_EQ(rate_limiter::combine_keys("10.0.0.1", "/login"), rate_limiter::combine_keys("10.0.0.1", "/login"));
+    CHECK(rate_limiter::combine_keys("10.0.0.1", "/login") != rate_limiter::combine_keys("/login", "10.0.0.1"));
+    CHECK(rate_limiter::combine_keys("10.0.0.1", "/login") != rate_limiter::combine_keys("10.0.0.1", "/logout"));
+    CHECK(rate_limiter::combine_keys("a", "a") != 0);
+    CHECK(rate_limiter::hash("") != 0);
+
+    // A route limit keyed by IP and route does not consume the same IP's tokens on other routes
+    rate_limiter limiter({1, 1}, 64);
+    CHECK(limiter.acquire_hash(rate_limiter::combine_keys("10.0.0.1", "/login")));
+    CHECK(!limiter.acquire_hash(rate_limiter::combine_keys("10.0.0.1", "/login")));
+    CHECK(limiter.acquire_hash(rate_limiter::combine_keys("10.0.0.1", "/search")));
+}
+
+TEST_CASE(rate_limiter_rejects_non_positive_rates)
+{
+    CHECK(throws({0, 1}));
+    CHECK(throws({-1, 1}));
+    CHECK(throws({std::nan(""), 1}));
+    CHECK(!throws({0.5, 1}));
+}
+
+TEST_CASE(rate_limiter_rounds_capacity_to_power_of_two)
+{
+    // At least 64 shards of 8 probes
+    CHECK_EQ(rate_limiter({1, 1}, 0).capacity(), std::size_t(512));
+    CHECK_EQ(rate_limiter({1, 1}, 512).capacity(), std::size_t(512));
+    CHECK_EQ(rate_limiter({1, 1}, 1000).capacity(), std::size_t(1024));
+    CHECK_EQ(rate_limiter({1, 1}, 4097).capacity(), std::size_t(8192));
+}
+
+TEST_CASE(rate_limiter_admits_new_keys_when_full)
+{
+    // Far more keys than slots: evicted buckets start over full, so every new key is allowed once
+    rate_limiter limiter({1, 1}, 512);
+    std::size_t allowed = 0;
+    for (int i = 0; i < 10000; ++i)
+        allowed += limiter.acquire("client-" + std::to_string(i)) ? 1 : 0;
+    CHECK_EQ(allowed, std::size_t(10000));
+    CHECK_EQ(limiter.capacity(), std::size_t(512));
+}
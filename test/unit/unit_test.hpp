@@ -0,0 +1,83 @@
+#pragma once
+
+/**
+ * @file unit_test.hpp
+ * @brief Minimal test harness for the unit tests: no framework to fetch or install.
+ *
+ * TEST_CASE(name) registers a test; CHECK and CHECK_EQ report a failure and
+ * let the test go on, so one run shows every broken expectation.
+ */
+
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace unit_test
+{
+    struct test_case
+    {
+        const char *name;
+        void (*run)();
+    };
+
+    /// Every registered test, in registration order
+    inline std::vector<test_case> &registry()
+    {
+        static std::vector<test_case> tests;
+        return tests;
+    }
+
+    /// Failed checks of the test that is running
+    inline int &failures()
+    {
+        static int count = 0;
+        return count;
+    }
+
+    struct registrar
+    {
+        registrar(const char *name, void (*run)()) { registry().push_back({name, run}); }
+    };
+
+    template <typename T>
+    std::string printable(const T &value)
+    {
+        std::ostringstream out;
+        out << value;
+        return out.str();
+    }
+
+    inline std::string printable(const std::string &value) { return "\"" + value + "\""; }
+    inline std::string printable(const char *value) { return printable(std::string(value)); }
+    inline std::string printable(bool value) { return value ? "true" : "false"; }
+
+    inline void report(const char *file, int line, const std::string &what)
+    {
+        ++failures();
+        std::fprintf(stderr, "%s:%d: %s\n", file, line, what.c_str());
+    }
+}
+
+#define TEST_CASE(name)                                                         \
+    static void name();                                                         \
+    static const unit_test::registrar name##_registrar(#name, &name);           \
+    static void name()
+
+#define CHECK(condition)                                                        \
+    do                                                                          \
+    {                                                                           \
+        if (!(condition))                                                       \
+            unit_test::report(__FILE__, __LINE__, "CHECK(" #condition ") failed"); \
+    } while (0)
+
+#define CHECK_EQ(actual, expected)                                              \
+    do                                                                          \
+    {                                                                           \
+        const auto &actual_value = (actual);                                    \
+        const auto &expected_value = (expected);                                \
+        if (!(actual_value == expected_value))                                  \
+            unit_test::report(__FILE__, __LINE__, "CHECK_EQ(" #actual ", " #expected "): " + \
+                                                      unit_test::printable(actual_value) + " != " + \
+                                                      unit_test::printable(expected_value)); \
+    } while (0)
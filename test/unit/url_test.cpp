@@ -0,0 +1,172 @@
+#include "unit_test.hpp"
+
+#include "../../includes/url.hpp"
+
+#include <string>
+#include <vector>
+
+using namespace hh_http;
+
+namespace
+{
+    std::string normalized(std::string_view path, url::encoded_slash slashes = url::encoded_slash::KEEP)
+    {
+        std::string out;
+        return url::normalize_path(path, out, slashes) ? out : "<invalid>";
+    }
+}
+
+TEST_CASE(url_splits_targets)
+{
+    auto parts = url::split("/a/b?x=1&y=2#top");
+    CHECK_EQ(parts.path, std::string_view("/a/b"));
+    CHECK_EQ(parts.query, std::string_view("x=1&y=2"));
+    CHECK_EQ(parts.fragment, std::string_view("top"));
+
+    // A '?' inside the fragment belongs to the fragment
+    parts = url::split("/a#frag?not-query");
+    CHECK_EQ(parts.path, std::string_view("/a"));
+    CHECK_EQ(parts.query, std::string_view());
+    CHECK_EQ(parts.fragment, std::string_view("frag?not-query"));
+
+    parts = url::split("http://example.com:8080/p/q?r");
+    CHECK_EQ(parts.path, std::string_view("/p/q"));
+    CHECK_EQ(parts.query, std::string_view("r"));
+
+    parts = url::split("http://example.com?r");
+    CHECK_EQ(parts.path, std::string_view());
+    CHECK_EQ(parts.query, std::string_view("r"));
+
+    CHECK_EQ(url::split("*").path, std::string_view("*"));
+}
+
+TEST_CASE(url_decodes_escapes)
+{
+    std::string out = "reused";
+    CHECK(url::decode("a%20b%2Fc+d", out));
+    CHECK_EQ(out, std::string("a b/c+d"));
+    CHECK(url::decode("a%20b+c", out, true));
+    CHECK_EQ(out, std::string("a b c"));
+    CHECK(url::decode("%e2%82%AC", out));
+    CHECK_EQ(out, std::string("\xE2\x82\xAC"));
+
+    for (std::string_view bad : {"%", "%4", "%G1", "a%2", "%%41"})
+    {
+        out = "stale";
+        CHECK(!url::decode(bad, out));
+        CHECK_EQ(out, std::string());
+    }
+
+    char buffer[4];
+    CHECK_EQ(url::decode("%41%42", buffer, sizeof(buffer)), std::size_t(2));
+    CHECK_EQ(std::string(buffer, 2), std::string("AB"));
+    CHECK_EQ(url::decode("abcde", buffer, sizeof(buffer)), std::string::npos);
+}
+
+TEST_CASE(url_compares_decoded_in_place)
+{
+    CHECK(url::decoded_equals("a%62c", "abc"));
+    CHECK(url::decoded_equals("a+b", "a b", true));
+    CHECK(!url::decoded_equals("a+b", "a b"));
+    CHECK(!url::decoded_equals("abc", "ab"));
+    CHECK(!url::decoded_equals("ab", "abc"));
+    CHECK(!url::decoded_equals("a%6", "a%6"));
+    CHECK(url::decoded_equals("", ""));
+}
+
+TEST_CASE(url_removes_dot_segments)
+{
+    CHECK_EQ(normalized("/a/b/c"), std::string("/a/b/c"));
+    CHECK_EQ(normalized("/a/./b/../c"), std::string("/a/c"));
+    CHECK_EQ(normalized("/a/b/.."), std::string("/a/"));
+    CHECK_EQ(normalized("/a/b/."), std::string("/a/b/"));
+    CHECK_EQ(normalized("/../../etc/passwd"), std::string("/etc/passwd"));
+    CHECK_EQ(normalized("/.."), std::string("/"));
+    CHECK_EQ(normalized(""), std::string("/"));
+    CHECK_EQ(normalized("/a/..b/c."), std::string("/a/..b/c."));
+}
+
+TEST_CASE(url_decodes_before_resolving_dot_segments)
+{
+    CHECK_EQ(normalized("/%61/./b"), normalized("/a/b"));
+    CHECK_EQ(normalized("/a/%2E%2E/b"), std::string("/b"));
+    CHECK_EQ(normalized("/a/%2e/b"), std::string("/a/b"));
+    CHECK_EQ(normalized("/%7Euser"), std::string("/~user"));
+}
+
+TEST_CASE(url_handles_encoded_slashes_as_configured)
+{
+    CHECK_EQ(normalized("/a%2Fb"), std::string("/a%2Fb"));
+    CHECK_EQ(normalized("/a%2fb"), std::string("/a%2Fb"));
+    // While %2F stays encoded, so does %25: "%252F" cannot pass for an encoded slash
+    CHECK_EQ(normalized("/a%252Fb"), std::string("/a%252Fb"));
+    CHECK(normalized("/a%2Fb") != normalized("/a%252Fb"));
+    CHECK_EQ(normalized("/a/..%2Fb"), std::string("/a/..%2Fb"));
+
+    CHECK_EQ(normalized("/a%2Fb", url::encoded_slash::DECODE), std::string("/a/b"));
+    // A decoded slash splits segments, so the dot segments it forms are resolved too
+    CHECK_EQ(normalized("/a/b/..%2F..%2Fc", url::encoded_slash::DECODE), std::string("/c"));
+
+    CHECK_EQ(normalized("/a%2Fb", url::encoded_slash::REJECT), std::string("<invalid>"));
+    CHECK_EQ(normalized("/a/b", url::encoded_slash::REJECT), std::string("/a/b"));
+}
+
+TEST_CASE(url_rejects_invalid_paths_and_clears_out)
+{
+    for (std::string_view bad : {"a/b", "/a%2", "/a%zz", "/a%00b", "*"})
+    {
+        std::string out = "stale";
+        CHECK(!url::normalize_path(bad, out));
+        CHECK_EQ(out, std::string());
+    }
+}
+
+TEST_CASE(url_iterates_query_parameters)
+{
+    url::query_view query("&a=1&&b&c=&d=x=y&");
+    std::vector<std::string> seen;
+    for (const auto &param : query)
+        seen.push_back(std::string(param.name) + "|" + std::string(param.value));
+    CHECK_EQ(seen.size(), std::size_t(4));
+    if (seen.size() == 4)
+    {
+        CHECK_EQ(seen[0], std::string("a|1"));
+        CHECK_EQ(seen[1], std::string("b|"));
+        CHECK_EQ(seen[2], std::string("c|"));
+        CHECK_EQ(seen[3], std::string("d|x=y"));
+    }
+    CHECK(url::query_view("").empty());
+    CHECK(url::query_view("&&").empty());
+    CHECK(!query.empty());
+}
+
+TEST_CASE(url_finds_query_parameters_by_decoded_name)
+{
+    url::query_view query("first+name=J%C3%BCrgen&q=a+b%26c&q=second&flag&bad=%zz");
+    std::string_view raw;
+    std::string value = "stale";
+
+    CHECK(query.has("first name"));
+    CHECK(query.has("flag"));
+    CHECK(!query.has("missing"));
+
+    CHECK(query.find("q", raw));
+    CHECK_EQ(raw, std::string_view("a+b%26c"));
+    CHECK(query.get("q", value));
+    CHECK_EQ(value, std::string("a b&c"));
+    CHECK(query.get("first name", value));
+    CHECK_EQ(value, std::string("J\xC3\xBCrgen"));
+    CHECK(query.get("flag", value));
+    CHECK_EQ(value, std::string());
+
+    value = "stale";
+    CHECK(!query.get("missing", value));
+    CHECK_EQ(value, std::string());
+    CHECK(!query.get("bad", value));
+
+    char buffer[8];
+    CHECK_EQ(query.get("q", buffer, sizeof(buffer)), std::size_t(5));
+    CHECK_EQ(std::string(buffer, 5), std::string("a b&c"));
+    CHECK_EQ(query.get("first name", buffer, 3), std::string::npos);
+    CHECK_EQ(query.get("missing", buffer, sizeof(buffer)), std::string::npos);
+}
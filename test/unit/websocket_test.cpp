@@ -0,0 +1,194 @@
+#include "unit_test.hpp"
+
+#include "../../includes/websocket.hpp"
+
+#include <cstdint>
+#include <string>
+
+using namespace hh_http;
+
+namespace
+{
+    /// A masked client frame
+    std::string client_frame(std::uint8_t first_byte, const std::string &payload, const std::uint8_t mask[4])
+    {
+        std::string frame(1, static_cast<char>(first_byte));
+        if (payload.size() < 126)
+        {
+            frame += static_cast<char>(0x80 | payload.size());
+        }
+        else if (payload.size() <= 0xFFFF)
+        {
+            frame += static_cast<char>(0x80 | 126);
+            frame += static_cast<char>(payload.size() >> 8);
+            frame += static_cast<char>(payload.size() & 0xFF);
+        }
+        else
+        {
+            frame += static_cast<char>(0x80 | 127);
+            for (int shift = 56; shift >= 0; shift -= 8)
+                frame += static_cast<char>((static_cast<std::uint64_t>(payload.size()) >> shift) & 0xFF);
+        }
+        frame.append(reinterpret_cast<const char *>(mask), 4);
+        for (std::size_t i = 0; i < payload.size(); ++i)
+            frame += static_cast<char>(payload[i] ^ mask[i & 3]);
+        return frame;
+    }
+
+    const std::uint8_t MASK[4] = {0x37, 0xfa, 0x21, 0x3d};
+
+    /// Parse one whole frame; returns the last event
+    websocket_frame_parser::event parse(websocket_frame_parser &parser, const std::string &bytes, std::string &payload)
+    {
+        const char *data = bytes.data();
+        std::size_t size = bytes.size();
+        auto event = parser.next(data, size, &payload);
+        if (event == websocket_frame_parser::event::HEADER)
+            event = parser.next(data, size, &payload);
+        return event;
+    }
+}
+
+TEST_CASE(websocket_accept_key_matches_rfc_example)
+{
+    // RFC 6455, section 1.3
+    CHECK_EQ(websocket_connection::accept_key("dGhlIHNhbXBsZSBub25jZQ=="), std::string("s3pPLMBiTxaQ9kYGzzhZRbK+xOo="));
+}
+
+TEST_CASE(websocket_unmasks_rfc_example)
+{
+    // RFC 6455, section 5.7: masked "Hello"
+    const std::string frame("\x81\x85\x37\xfa\x21\x3d\x7f\x9f\x4d\x51\x58", 11);
+    websocket_frame_parser parser;
+    std::string payload;
+    CHECK(parse(parser, frame, payload) == websocket_frame_parser::event::FRAME);
+    CHECK_EQ(payload, std::string("Hello"));
+    CHECK(parser.header().fin);
+    CHECK(parser.header().opcode == websocket_opcode::TEXT);
+}
+
+TEST_CASE(websocket_unmask_keeps_key_offset_across_calls)
+{
+    // Every split point and length covers the SIMD, 8-byte and byte-wise paths
+    std::string plain;
+    for (int i = 0; i < 100; ++i)
+        plain += static_cast<char>(i * 7 + 3);
+    std::string masked = plain;
+    for (std::size_t i = 0; i < masked.size(); ++i)
+        masked[i] = static_cast<char>(masked[i] ^ MASK[i & 3]);
+
+    for (std::size_t split = 0; split <= masked.size(); ++split)
+    {
+        std::string out(masked.size(), '\0');
+        std::size_t offset = 0;
+        websocket_frame_parser::unmask(&out[0], masked.data(), split, MASK, offset);
+        CHECK_EQ(offset, split & 3);
+        websocket_frame_parser::unmask(&out[split], masked.data() + split, masked.size() - split, MASK, offset);
+        CHECK_EQ(out, plain);
+    }
+}
+
+TEST_CASE(websocket_parses_frame_fed_byte_by_byte)
+{
+    std::string message(300, 'x');
+    for (std::size_t i = 0; i < message.size(); ++i)
+        message[i] = static_cast<char>('a' + i % 26);
+    std::string frame = client_frame(0x82, message, MASK);
+
+    websocket_frame_parser parser;
+    std::string payload;
+    int headers = 0, frames = 0;
+    for (char byte : frame)
+    {
+        const char *data = &byte;
+        std::size_t size = 1;
+        while (true)
+        {
+            auto event = parser.next(data, size, &payload);
+            if (event == websocket_frame_parser::event::HEADER)
+                ++headers;
+            else if (event == websocket_frame_parser::event::FRAME)
+                ++frames;
+            if (event == websocket_frame_parser::event::NEED_MORE || size == 0)
+                break;
+        }
+    }
+    CHECK_EQ(headers, 1);
+    CHECK_EQ(frames, 1);
+    CHECK_EQ(parser.header().length, std::uint64_t(300));
+    CHECK(parser.header().opcode == websocket_opcode::BINARY);
+    CHECK_EQ(payload, message);
+}
+
+TEST_CASE(websocket_parses_64_bit_length)
+{
+    std::string message(70000, 'q');
+    websocket_frame_parser parser;
+    std::string payload;
+    CHECK(parse(parser, client_frame(0x82, message, MASK), payload) == websocket_frame_parser::event::FRAME);
+    CHECK_EQ(payload.size(), message.size());
+    CHECK(payload == message);
+}
+
+TEST_CASE(websocket_rejects_protocol_violations)
+{
+    struct violation
+    {
+        const char *what;
+        std::string frame;
+    };
+    std::string unmasked("\x81\x02hi", 4);
+    std::string long_ping = client_frame(0x89, std::string(126, 'p'), MASK);
+    std::string fragmented_close = client_frame(0x08, "", MASK);
+    std::string reserved_bit = client_frame(0xC1, "x", MASK);
+    std::string reserved_opcode = client_frame(0x83, "x", MASK);
+    std::string huge_length("\x82\xff\x80\x00\x00\x00\x00\x00\x00\x00\x37\xfa\x21\x3d", 14);
+
+    for (const auto &bad : {violation{"unmasked", unmasked}, violation{"long ping", long_ping},
+                            violation{"fragmented close", fragmented_close}, violation{"RSV1", reserved_bit},
+                            violation{"opcode 3", reserved_opcode}, violation{"length bit 63", huge_length}})
+    {
+        websocket_frame_parser parser;
+        std::string payload;
+        if (parse(parser, bad.frame, payload) != websocket_frame_parser::event::ERROR)
+            unit_test::report(__FILE__, __LINE__, std::string("accepted ") + bad.what);
+        CHECK_EQ(parser.error_code(), websocket_close::PROTOCOL_ERROR);
+    }
+}
+
+TEST_CASE(websocket_close_codes)
+{
+    CHECK(websocket_close::is_valid(websocket_close::NORMAL));
+    CHECK(websocket_close::is_valid(websocket_close::MESSAGE_TOO_BIG));
+    CHECK(websocket_close::is_valid(1014));
+    CHECK(websocket_close::is_valid(3000));
+    CHECK(websocket_close::is_valid(4999));
+    CHECK(!websocket_close::is_valid(999));
+    CHECK(!websocket_close::is_valid(1004));
+    CHECK(!websocket_close::is_valid(websocket_close::NO_STATUS));
+    CHECK(!websocket_close::is_valid(websocket_close::ABNORMAL));
+    CHECK(!websocket_close::is_valid(1015));
+    CHECK(!websocket_close::is_valid(2999));
+    CHECK(!websocket_close::is_valid(5000));
+}
+
+TEST_CASE(websocket_recognizes_upgrade_requests)
+{
+    std::multimap<std::string, std::string> headers = {
+        {"UPGRADE", "websocket"},
+        {"CONNECTION", "keep-alive, Upgrade"},
+        {"SEC-WEBSOCKET-VERSION", "13"},
+        {"SEC-WEBSOCKET-KEY", "dGhlIHNhbXBsZSBub25jZQ=="},
+    };
+    CHECK(websocket_connection::is_upgrade_request("GET", "HTTP/1.1", headers));
+    CHECK(!websocket_connection::is_upgrade_request("POST", "HTTP/1.1", headers));
+    CHECK(!websocket_connection::is_upgrade_request("GET", "HTTP/1.0", headers));
+
+    auto old_version = headers;
+    old_version.find("SEC-WEBSOCKET-VERSION")->second = "8";
+    CHECK(!websocket_connection::is_upgrade_request("GET", "HTTP/1.1", old_version));
+
+    auto no_upgrade_token = headers;
+    no_upgrade_token.find("CONNECTION")->second = "keep-alive";
+    CHECK(!websocket_connection::is_upgrade_request("GET", "HTTP/1.1", no_upgrade_token));
+}